@@ -112,6 +112,7 @@ LOCAL_C_INCLUDES := \
 		deps/sqlite/
 
 LOCAL_SRC_FILES := \
+		jni/src/activeobjectgrid.cpp              \
 		jni/src/ban.cpp                           \
 		jni/src/camera.cpp                        \
 		jni/src/cavegen.cpp                       \
@@ -133,6 +134,8 @@ LOCAL_SRC_FILES := \
 		jni/src/convert_json.cpp                  \
 		jni/src/craftdef.cpp                      \
 		jni/src/database-dummy.cpp                \
+		jni/src/database-files.cpp                \
+		jni/src/database-region.cpp               \
 		jni/src/database-sqlite3.cpp              \
 		jni/src/database.cpp                      \
 		jni/src/debug.cpp                         \
@@ -170,6 +173,7 @@ LOCAL_SRC_FILES := \
 		jni/src/main.cpp                          \
 		jni/src/map.cpp                           \
 		jni/src/mapblock.cpp                      \
+		jni/src/mapblock_hashmap.cpp              \
 		jni/src/mapblock_mesh.cpp                 \
 		jni/src/mapgen.cpp                        \
 		jni/src/mapgen_flat.cpp                   \
@@ -232,16 +236,21 @@ LOCAL_SRC_FILES := \
 		jni/src/util/srp.cpp                      \
 		jni/src/util/timetaker.cpp                \
 		jni/src/unittest/test.cpp                 \
+		jni/src/unittest/test_activeblocklist.cpp \
 		jni/src/unittest/test_collision.cpp       \
 		jni/src/unittest/test_compression.cpp     \
 		jni/src/unittest/test_connection.cpp      \
+		jni/src/unittest/test_database_region.cpp \
 		jni/src/unittest/test_filepath.cpp        \
 		jni/src/unittest/test_inventory.cpp       \
+		jni/src/unittest/test_mapblock_hashmap.cpp \
 		jni/src/unittest/test_mapnode.cpp         \
 		jni/src/unittest/test_nodedef.cpp         \
 		jni/src/unittest/test_noderesolver.cpp    \
+		jni/src/unittest/test_nodetimer.cpp       \
 		jni/src/unittest/test_noise.cpp           \
 		jni/src/unittest/test_objdef.cpp          \
+		jni/src/unittest/test_player_database.cpp \
 		jni/src/unittest/test_profiler.cpp        \
 		jni/src/unittest/test_random.cpp          \
 		jni/src/unittest/test_schematic.cpp       \
@@ -1,12 +1,55 @@
 
 core.log("info", "Initializing Asynchronous environment")
 
+-- Jobs of game mods only get safe functions. Their functions run with an
+-- environment of their own, which has no access to files, to the loaders
+-- or to the globals of this file.
+local make_job_env
+if INIT == "async_game" then
+	local safe_globals = {"assert", "error", "ipairs", "next", "pairs",
+		"pcall", "print", "rawequal", "rawget", "rawset", "select",
+		"getmetatable", "setmetatable", "tonumber", "tostring", "type",
+		"unpack", "xpcall", "_VERSION", "dump"}
+	local safe_libs = {"coroutine", "string", "table", "math"}
+	local safe_os = {"clock", "date", "difftime", "time"}
+
+	local function copy(t)
+		local c = {}
+		for k, v in pairs(t) do
+			c[k] = v
+		end
+		return c
+	end
+
+	make_job_env = function()
+		local env = {}
+		for _, name in ipairs(safe_globals) do
+			env[name] = _G[name]
+		end
+		for _, name in ipairs(safe_libs) do
+			env[name] = copy(_G[name])
+		end
+		env.os = {}
+		for _, name in ipairs(safe_os) do
+			env.os[name] = os[name]
+		end
+		env.core = copy(core)
+		env.core.job_processor = nil
+		env.minetest = env.core
+		env._G = env
+		return env
+	end
+end
+
 function core.job_processor(serialized_func, serialized_param)
 	local func = loadstring(serialized_func)
 	local param = core.deserialize(serialized_param)
 	local retval = nil
 
 	if type(func) == "function" then
+		if make_job_env then
+			setfenv(func, make_job_env())
+		end
 		retval = core.serialize(func(param))
 	else
 		core.log("error", "ASYNC WORKER: Unable to deserialize function")
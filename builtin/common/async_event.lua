@@ -8,9 +8,17 @@ local function handle_job(jobid, serialized_retval)
 	core.async_jobs[jobid] = nil
 end
 
+local do_async_callback = core.do_async_callback
+
 if core.register_globalstep then
+	-- Mods may only queue functions through core.handle_async, the async
+	-- threads would run any bytecode passed to core.do_async_callback
+	local get_finished_jobs = core.get_finished_jobs
+	core.do_async_callback = nil
+	core.get_finished_jobs = nil
+
 	core.register_globalstep(function(dtime)
-		for i, job in ipairs(core.get_finished_jobs()) do
+		for i, job in ipairs(get_finished_jobs()) do
 			handle_job(job.jobid, job.retval)
 		end
 	end)
@@ -31,7 +39,7 @@ function core.handle_async(func, parameter, callback)
 		return false
 	end
 
-	local jobid = core.do_async_callback(serialized_func, serialized_param)
+	local jobid = do_async_callback(serialized_func, serialized_param)
 
 	core.async_jobs[jobid] = callback
 
@@ -755,6 +755,27 @@ core.register_chatcommand("status", {
 	end,
 })
 
+core.register_chatcommand("profiler_trace", {
+	params = "[<seconds>]",
+	description = "record a profiler trace to the world directory",
+	privs = {server=true},
+	func = function(name, param)
+		local seconds = 10
+		if param ~= "" then
+			seconds = tonumber(param)
+			if not seconds or not (seconds > 0) then
+				return false, "Invalid duration, give a positive number of seconds."
+			end
+		end
+		local path = core.start_profiler_trace(seconds)
+		if not path then
+			return false, "A profiler trace is already being recorded."
+		end
+		return true, "Recording " .. seconds .. " seconds of profiler trace to "
+				.. path .. "; open it in chrome://tracing."
+	end,
+})
+
 core.register_chatcommand("time", {
 	params = "<0..23>:<0..59> | <0..24000>",
 	description = "set time of day",
@@ -43,7 +43,7 @@ elseif INIT == "mainmenu" then
 	else
 		dofile(core.get_mainmenu_path() .. DIR_DELIM .. "init.lua")
 	end
-elseif INIT == "async" then
+elseif INIT == "async" or INIT == "async_game" then
 	dofile(asyncpath .. "init.lua")
 else
 	error(("Unrecognized builtin initialization type %s!"):format(tostring(INIT)))
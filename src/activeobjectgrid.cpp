@@ -0,0 +1,176 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "activeobjectgrid.h"
+#include <math.h>
+#include "serverobject.h"
+#include "constants.h" // BS, MAP_BLOCKSIZE
+#include "util/numeric.h"
+
+#define GRID_CELL_SIZE (MAP_BLOCKSIZE * BS)
+
+v3s16 ActiveObjectGrid::getCellPos(v3f pos)
+{
+	// Clamp, so that objects flying off somewhere still get a valid cell
+	return v3s16(
+		rangelim(floor(pos.X / GRID_CELL_SIZE), S16_MIN, S16_MAX),
+		rangelim(floor(pos.Y / GRID_CELL_SIZE), S16_MIN, S16_MAX),
+		rangelim(floor(pos.Z / GRID_CELL_SIZE), S16_MIN, S16_MAX));
+}
+
+void ActiveObjectGrid::insert(ServerActiveObject *obj)
+{
+	v3s16 cellpos = getCellPos(obj->getBasePosition());
+
+	std::map<ServerActiveObject *, v3s16>::iterator n =
+			m_object_cells.find(obj);
+	if (n != m_object_cells.end()) {
+		// Already known, treat as a move
+		if (n->second == cellpos)
+			return;
+		removeFromCell(obj, n->second);
+		n->second = cellpos;
+	} else {
+		m_object_cells[obj] = cellpos;
+	}
+
+	m_cells[cellpos].push_back(obj);
+}
+
+void ActiveObjectGrid::remove(ServerActiveObject *obj)
+{
+	std::map<ServerActiveObject *, v3s16>::iterator n =
+			m_object_cells.find(obj);
+	if (n == m_object_cells.end())
+		return;
+
+	removeFromCell(obj, n->second);
+	m_object_cells.erase(n);
+}
+
+void ActiveObjectGrid::update(ServerActiveObject *obj)
+{
+	std::map<ServerActiveObject *, v3s16>::iterator n =
+			m_object_cells.find(obj);
+	if (n == m_object_cells.end())
+		return;
+
+	// Most movements stay inside the cell
+	v3s16 cellpos = getCellPos(obj->getBasePosition());
+	if (n->second == cellpos)
+		return;
+
+	removeFromCell(obj, n->second);
+	n->second = cellpos;
+	m_cells[cellpos].push_back(obj);
+}
+
+void ActiveObjectGrid::clear()
+{
+	m_cells.clear();
+	m_object_cells.clear();
+}
+
+void ActiveObjectGrid::removeFromCell(ServerActiveObject *obj, v3s16 cellpos)
+{
+	std::map<v3s16, Cell>::iterator c = m_cells.find(cellpos);
+	if (c == m_cells.end())
+		return;
+
+	Cell &cell = c->second;
+	for (size_t i = 0; i < cell.size(); i++) {
+		if (cell[i] != obj)
+			continue;
+		// Order inside a cell does not matter
+		cell[i] = cell.back();
+		cell.pop_back();
+		break;
+	}
+
+	if (cell.empty())
+		m_cells.erase(c);
+}
+
+void ActiveObjectGrid::getCellsInArea(std::vector<const Cell *> &cells,
+		const aabb3f &box) const
+{
+	v3s16 minp = getCellPos(box.MinEdge);
+	v3s16 maxp = getCellPos(box.MaxEdge);
+
+	u64 volume = (u64)(maxp.X - minp.X + 1) * (maxp.Y - minp.Y + 1)
+			* (maxp.Z - minp.Z + 1);
+
+	if (volume > m_cells.size()) {
+		// Sparse population (or huge area): cheaper to check every cell
+		for (std::map<v3s16, Cell>::const_iterator i = m_cells.begin();
+				i != m_cells.end(); ++i) {
+			const v3s16 &p = i->first;
+			if (p.X >= minp.X && p.X <= maxp.X &&
+					p.Y >= minp.Y && p.Y <= maxp.Y &&
+					p.Z >= minp.Z && p.Z <= maxp.Z)
+				cells.push_back(&i->second);
+		}
+		return;
+	}
+
+	// s32 counters, so that a range ending at S16_MAX terminates
+	for (s32 x = minp.X; x <= maxp.X; x++)
+	for (s32 y = minp.Y; y <= maxp.Y; y++)
+	for (s32 z = minp.Z; z <= maxp.Z; z++) {
+		std::map<v3s16, Cell>::const_iterator i = m_cells.find(v3s16(x, y, z));
+		if (i != m_cells.end())
+			cells.push_back(&i->second);
+	}
+}
+
+void ActiveObjectGrid::getObjectsInsideRadius(
+		std::vector<ServerActiveObject *> &objects,
+		v3f pos, float radius) const
+{
+	std::vector<const Cell *> cells;
+	getCellsInArea(cells, aabb3f(pos - v3f(radius, radius, radius),
+			pos + v3f(radius, radius, radius)));
+
+	float radius_sq = radius * radius;
+	for (size_t i = 0; i < cells.size(); i++) {
+		const Cell &cell = *cells[i];
+		for (size_t j = 0; j < cell.size(); j++) {
+			if (cell[j]->getBasePosition().getDistanceFromSQ(pos) > radius_sq)
+				continue;
+			objects.push_back(cell[j]);
+		}
+	}
+}
+
+void ActiveObjectGrid::getObjectsInArea(
+		std::vector<ServerActiveObject *> &objects,
+		const aabb3f &box) const
+{
+	std::vector<const Cell *> cells;
+	getCellsInArea(cells, box);
+
+	for (size_t i = 0; i < cells.size(); i++) {
+		const Cell &cell = *cells[i];
+		for (size_t j = 0; j < cell.size(); j++) {
+			if (!box.isPointInside(cell[j]->getBasePosition()))
+				continue;
+			objects.push_back(cell[j]);
+		}
+	}
+}
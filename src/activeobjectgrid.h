@@ -0,0 +1,78 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef ACTIVEOBJECTGRID_HEADER
+#define ACTIVEOBJECTGRID_HEADER
+
+#include <map>
+#include <vector>
+#include "irr_v3d.h"
+#include "irr_aabb3d.h"
+
+class ServerActiveObject;
+
+/*
+	Uniform grid over the positions of the active objects of a
+	ServerEnvironment, so that spatial queries only have to look at the
+	objects near the queried area instead of every active object.
+
+	Cells are MAP_BLOCKSIZE nodes wide. Objects are filed by their base
+	position and must be re-filed through update() whenever it changes;
+	ServerActiveObject::setBasePosition() takes care of that.
+
+	This is not thread-safe. Server uses an environment mutex.
+*/
+
+class ActiveObjectGrid
+{
+public:
+	void insert(ServerActiveObject *obj);
+	void remove(ServerActiveObject *obj);
+	// Re-file obj after its base position changed. Objects that have not
+	// been inserted are ignored.
+	void update(ServerActiveObject *obj);
+	void clear();
+
+	// Appends the objects whose base position is within radius of pos
+	void getObjectsInsideRadius(std::vector<ServerActiveObject *> &objects,
+			v3f pos, float radius) const;
+	// Appends the objects whose base position lies inside box
+	void getObjectsInArea(std::vector<ServerActiveObject *> &objects,
+			const aabb3f &box) const;
+
+	u32 getObjectCount() const { return m_object_cells.size(); }
+	u32 getCellCount() const { return m_cells.size(); }
+
+private:
+	typedef std::vector<ServerActiveObject *> Cell;
+
+	static v3s16 getCellPos(v3f pos);
+	void removeFromCell(ServerActiveObject *obj, v3s16 cellpos);
+
+	// Collects the non-empty cells overlapping box
+	void getCellsInArea(std::vector<const Cell *> &cells,
+			const aabb3f &box) const;
+
+	// TODO make these std::unordered_map
+	std::map<v3s16, Cell> m_cells;
+	// Cell every inserted object is currently filed in
+	std::map<ServerActiveObject *, v3s16> m_object_cells;
+};
+
+#endif
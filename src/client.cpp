@@ -62,7 +62,8 @@ extern gui::IGUIEnvironment* guienv;
 QueuedMeshUpdate::QueuedMeshUpdate():
 	p(-1337,-1337,-1337),
 	data(NULL),
-	ack_block_to_server(false)
+	ack_block_to_server(false),
+	urgent(false)
 {
 }
 
@@ -76,7 +77,8 @@ QueuedMeshUpdate::~QueuedMeshUpdate()
 	MeshUpdateQueue
 */
 
-MeshUpdateQueue::MeshUpdateQueue()
+MeshUpdateQueue::MeshUpdateQueue():
+	m_camera_block(0,0,0)
 {
 }
 
@@ -84,15 +86,24 @@ MeshUpdateQueue::~MeshUpdateQueue()
 {
 	MutexAutoLock lock(m_mutex);
 
-	for(std::vector<QueuedMeshUpdate*>::iterator
+	for(std::map<v3s16, QueuedMeshUpdate*>::iterator
 			i = m_queue.begin();
 			i != m_queue.end(); ++i)
 	{
-		QueuedMeshUpdate *q = *i;
+		QueuedMeshUpdate *q = i->second;
 		delete q;
 	}
 }
 
+u32 MeshUpdateQueue::getPriority(const QueuedMeshUpdate *q)
+{
+	if(q->urgent)
+		return 0;
+	v3s32 d(q->p.X - m_camera_block.X, q->p.Y - m_camera_block.Y,
+			q->p.Z - m_camera_block.Z);
+	return 1 + d.X * d.X + d.Y * d.Y + d.Z * d.Z;
+}
+
 /*
 	peer_id=0 adds with nobody to send to
 */
@@ -104,27 +115,26 @@ void MeshUpdateQueue::addBlock(v3s16 p, MeshMakeData *data, bool ack_block_to_se
 
 	MutexAutoLock lock(m_mutex);
 
-	if(urgent)
-		m_urgents.insert(p);
-
 	/*
 		Find if block is already in queue.
 		If it is, update the data and quit.
 	*/
-	for(std::vector<QueuedMeshUpdate*>::iterator
-			i = m_queue.begin();
-			i != m_queue.end(); ++i)
+	std::map<v3s16, QueuedMeshUpdate*>::iterator i = m_queue.find(p);
+	if(i != m_queue.end())
 	{
-		QueuedMeshUpdate *q = *i;
-		if(q->p == p)
+		QueuedMeshUpdate *q = i->second;
+		if(q->data)
+			delete q->data;
+		q->data = data;
+		if(ack_block_to_server)
+			q->ack_block_to_server = true;
+		if(urgent && !q->urgent)
 		{
-			if(q->data)
-				delete q->data;
-			q->data = data;
-			if(ack_block_to_server)
-				q->ack_block_to_server = true;
-			return;
+			m_order.erase(std::make_pair(getPriority(q), p));
+			q->urgent = true;
+			m_order.insert(std::make_pair(getPriority(q), p));
 		}
+		return;
 	}
 
 	/*
@@ -134,61 +144,156 @@ void MeshUpdateQueue::addBlock(v3s16 p, MeshMakeData *data, bool ack_block_to_se
 	q->p = p;
 	q->data = data;
 	q->ack_block_to_server = ack_block_to_server;
-	m_queue.push_back(q);
+	q->urgent = urgent;
+	m_queue[p] = q;
+	m_order.insert(std::make_pair(getPriority(q), p));
 }
 
 // Returned pointer must be deleted
-// Returns NULL if queue is empty
+// Returns NULL if queue is empty or all queued blocks are in progress
 QueuedMeshUpdate *MeshUpdateQueue::pop()
 {
 	MutexAutoLock lock(m_mutex);
 
-	bool must_be_urgent = !m_urgents.empty();
-	for(std::vector<QueuedMeshUpdate*>::iterator
-			i = m_queue.begin();
-			i != m_queue.end(); ++i)
+	for(std::set<std::pair<u32, v3s16> >::iterator
+			i = m_order.begin();
+			i != m_order.end(); ++i)
 	{
-		QueuedMeshUpdate *q = *i;
-		if(must_be_urgent && m_urgents.count(q->p) == 0)
+		v3s16 p = i->second;
+		if(m_in_progress.count(p) != 0)
 			continue;
-		m_queue.erase(i);
-		m_urgents.erase(q->p);
+		m_order.erase(i);
+		std::map<v3s16, QueuedMeshUpdate*>::iterator n = m_queue.find(p);
+		QueuedMeshUpdate *q = n->second;
+		m_queue.erase(n);
+		m_in_progress.insert(p);
 		return q;
 	}
 	return NULL;
 }
 
+void MeshUpdateQueue::setCameraBlock(v3s16 camera_block)
+{
+	MutexAutoLock lock(m_mutex);
+
+	if(camera_block == m_camera_block)
+		return;
+	m_camera_block = camera_block;
+
+	m_order.clear();
+	for(std::map<v3s16, QueuedMeshUpdate*>::iterator
+			i = m_queue.begin();
+			i != m_queue.end(); ++i)
+	{
+		m_order.insert(std::make_pair(getPriority(i->second), i->first));
+	}
+}
+
+void MeshUpdateQueue::done(v3s16 p)
+{
+	MutexAutoLock lock(m_mutex);
+	m_in_progress.erase(p);
+}
+
 /*
-	MeshUpdateThread
+	MeshUpdateWorkerThread
 */
 
-void MeshUpdateThread::enqueueUpdate(v3s16 p, MeshMakeData *data,
-		bool ack_block_to_server, bool urgent)
+MeshUpdateWorkerThread::MeshUpdateWorkerThread(MeshUpdateManager *manager,
+		u16 id):
+	UpdateThread("Mesh" + itos(id)),
+	m_manager(manager),
+	m_profiler_name("Client: Meshes made by worker #" + itos(id))
 {
-	m_queue_in.addBlock(p, data, ack_block_to_server, urgent);
-	deferUpdate();
 }
 
-void MeshUpdateThread::doUpdate()
+void MeshUpdateWorkerThread::doUpdate()
 {
 	QueuedMeshUpdate *q;
-	while ((q = m_queue_in.pop())) {
+	while ((q = m_manager->m_queue_in.pop())) {
 
 		ScopeProfiler sp(g_profiler, "Client: Mesh making");
 
-		MapBlockMesh *mesh_new = new MapBlockMesh(q->data, m_camera_offset);
+		MapBlockMesh *mesh_new = new MapBlockMesh(q->data,
+				m_manager->m_camera_offset);
 
 		MeshUpdateResult r;
 		r.p = q->p;
 		r.mesh = mesh_new;
 		r.ack_block_to_server = q->ack_block_to_server;
 
-		m_queue_out.push_back(r);
+		m_manager->m_queue_out.push_back(r);
+		// Only now another worker may pick up a newer version of the block
+		m_manager->m_queue_in.done(q->p);
+
+		g_profiler->add(m_profiler_name, 1);
 
 		delete q;
 	}
 }
 
+/*
+	MeshUpdateManager
+*/
+
+MeshUpdateManager::MeshUpdateManager()
+{
+	// If unspecified, leave a proc for the main thread and one for
+	// the server or some other misc thread
+	s16 nthreads = g_settings->getS16("mesh_generation_threads");
+	if (nthreads <= 0)
+		nthreads = Thread::getNumberOfProcessors() - 2;
+	if (nthreads < 1)
+		nthreads = 1;
+
+	for (s16 i = 0; i < nthreads; i++)
+		m_workers.push_back(new MeshUpdateWorkerThread(this, i));
+}
+
+MeshUpdateManager::~MeshUpdateManager()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		delete m_workers[i];
+}
+
+void MeshUpdateManager::start()
+{
+	infostream << "MeshUpdateManager: Starting " << m_workers.size()
+		<< " mesh generation threads" << std::endl;
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->start();
+}
+
+void MeshUpdateManager::stop()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->stop();
+}
+
+void MeshUpdateManager::wait()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->wait();
+}
+
+bool MeshUpdateManager::isRunning()
+{
+	for (size_t i = 0; i < m_workers.size(); i++) {
+		if (m_workers[i]->isRunning())
+			return true;
+	}
+	return false;
+}
+
+void MeshUpdateManager::enqueueUpdate(v3s16 p, MeshMakeData *data,
+		bool ack_block_to_server, bool urgent)
+{
+	m_queue_in.addBlock(p, data, ack_block_to_server, urgent);
+	// Idle workers wake up, busy ones pick it up after their current block
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->deferUpdate();
+}
+
 /*
 	Client
 */
@@ -217,7 +322,7 @@ Client::Client(
 	m_nodedef(nodedef),
 	m_sound(sound),
 	m_event(event),
-	m_mesh_update_thread(),
+	m_mesh_update_manager(),
 	m_env(
 		new ClientMap(this, this, control,
 			device->getSceneManager()->getRootSceneNode(),
@@ -272,7 +377,7 @@ Client::Client(
 void Client::Stop()
 {
 	//request all client managed threads to stop
-	m_mesh_update_thread.stop();
+	m_mesh_update_manager.stop();
 	// Save local server map
 	if (m_localdb) {
 		infostream << "Local map saving ended." << std::endl;
@@ -283,7 +388,7 @@ void Client::Stop()
 bool Client::isShutdown()
 {
 
-	if (!m_mesh_update_thread.isRunning()) return true;
+	if (!m_mesh_update_manager.isRunning()) return true;
 
 	return false;
 }
@@ -292,10 +397,10 @@ Client::~Client()
 {
 	m_con.Disconnect();
 
-	m_mesh_update_thread.stop();
-	m_mesh_update_thread.wait();
-	while (!m_mesh_update_thread.m_queue_out.empty()) {
-		MeshUpdateResult r = m_mesh_update_thread.m_queue_out.pop_frontNoEx();
+	m_mesh_update_manager.stop();
+	m_mesh_update_manager.wait();
+	while (!m_mesh_update_manager.m_queue_out.empty()) {
+		MeshUpdateResult r = m_mesh_update_manager.m_queue_out.pop_frontNoEx();
 		delete r.mesh;
 	}
 
@@ -529,19 +634,25 @@ void Client::step(float dtime)
 		}
 	}
 
+	/*
+		Make the blocks closest to the player first
+	*/
+	m_mesh_update_manager.setCameraBlock(
+			getNodeBlockPos(floatToInt(player->getPosition(), BS)));
+
 	/*
 		Replace updated meshes
 	*/
 	{
 		int num_processed_meshes = 0;
-		while (!m_mesh_update_thread.m_queue_out.empty())
+		while (!m_mesh_update_manager.m_queue_out.empty())
 		{
 			num_processed_meshes++;
 
 			MinimapMapblock *minimap_mapblock = NULL;
 			bool do_mapper_update = true;
 
-			MeshUpdateResult r = m_mesh_update_thread.m_queue_out.pop_frontNoEx();
+			MeshUpdateResult r = m_mesh_update_manager.m_queue_out.pop_frontNoEx();
 			MapBlock *block = m_env.getMap().getBlockNoCreateNoEx(r.p);
 			if (block) {
 				// Delete the old mesh
@@ -581,6 +692,9 @@ void Client::step(float dtime)
 
 		if (num_processed_meshes > 0)
 			g_profiler->graphAdd("num_processed_meshes", num_processed_meshes);
+
+		g_profiler->avg("Client: Mesh update queue length",
+				m_mesh_update_manager.getQueueSize());
 	}
 
 	/*
@@ -1607,7 +1721,7 @@ void Client::addUpdateMeshTask(v3s16 p, bool ack_to_server, bool urgent)
 	}
 
 	// Add task to queue
-	m_mesh_update_thread.enqueueUpdate(p, data, ack_to_server, urgent);
+	m_mesh_update_manager.enqueueUpdate(p, data, ack_to_server, urgent);
 }
 
 void Client::addUpdateMeshTaskWithEdge(v3s16 blockpos, bool ack_to_server, bool urgent)
@@ -1774,9 +1888,9 @@ void Client::afterContentReceived(IrrlichtDevice *device)
 	m_nodedef->updateTextures(this, texture_update_progress, &tu_args);
 	delete[] tu_args.text_base;
 
-	// Start mesh update thread after setting up content definitions
-	infostream<<"- Starting mesh update thread"<<std::endl;
-	m_mesh_update_thread.start();
+	// Start mesh update threads after setting up content definitions
+	infostream<<"- Starting mesh update threads"<<std::endl;
+	m_mesh_update_manager.start();
 
 	m_state = LC_Ready;
 	sendReady();
@@ -57,6 +57,7 @@ struct QueuedMeshUpdate
 	v3s16 p;
 	MeshMakeData *data;
 	bool ack_block_to_server;
+	bool urgent;
 
 	QueuedMeshUpdate();
 	~QueuedMeshUpdate();
@@ -69,7 +70,9 @@ enum LocalClientState {
 };
 
 /*
-	A thread-safe queue of mesh update tasks
+	A thread-safe queue of mesh update tasks.
+	Urgent blocks come first, then the others ordered by distance to the
+	camera block.
 */
 class MeshUpdateQueue
 {
@@ -85,9 +88,16 @@ class MeshUpdateQueue
 			bool ack_block_to_server, bool urgent);
 
 	// Returned pointer must be deleted
-	// Returns NULL if queue is empty
+	// Returns NULL if queue is empty or all queued blocks are in progress.
+	// The block is in progress until done() is called for it.
 	QueuedMeshUpdate * pop();
 
+	// Marks a block returned by pop() as finished
+	void done(v3s16 p);
+
+	// Reorders the queue if the camera moved to another block
+	void setCameraBlock(v3s16 camera_block);
+
 	u32 size()
 	{
 		MutexAutoLock lock(m_mutex);
@@ -95,8 +105,16 @@ class MeshUpdateQueue
 	}
 
 private:
-	std::vector<QueuedMeshUpdate*> m_queue;
-	std::set<v3s16> m_urgents;
+	// Smaller is handed out earlier
+	u32 getPriority(const QueuedMeshUpdate *q);
+
+	std::map<v3s16, QueuedMeshUpdate*> m_queue;
+	// Queued blocks in the order they are handed out
+	std::set<std::pair<u32, v3s16> > m_order;
+	v3s16 m_camera_block;
+	// Blocks currently being meshed. They are not handed out again until
+	// done, so that an older mesh can never replace a newer one.
+	std::set<v3s16> m_in_progress;
 	Mutex m_mutex;
 };
 
@@ -114,23 +132,55 @@ struct MeshUpdateResult
 	}
 };
 
-class MeshUpdateThread : public UpdateThread
+class MeshUpdateManager;
+
+/*
+	One of the threads making meshes for a MeshUpdateManager
+*/
+class MeshUpdateWorkerThread : public UpdateThread
 {
-private:
-	MeshUpdateQueue m_queue_in;
+public:
+	MeshUpdateWorkerThread(MeshUpdateManager *manager, u16 id);
 
 protected:
 	virtual void doUpdate();
 
+private:
+	MeshUpdateManager *m_manager;
+	// Profiler entry counting the meshes made by this worker
+	std::string m_profiler_name;
+};
+
+/*
+	A pool of worker threads sharing one MeshUpdateQueue.
+	Finished meshes of all workers end up in m_queue_out.
+*/
+class MeshUpdateManager
+{
 public:
+	MeshUpdateManager();
+	~MeshUpdateManager();
 
-	MeshUpdateThread() : UpdateThread("Mesh") {}
+	void start();
+	void stop();
+	void wait();
+	bool isRunning();
 
 	void enqueueUpdate(v3s16 p, MeshMakeData *data,
 			bool ack_block_to_server, bool urgent);
+	u32 getQueueSize() { return m_queue_in.size(); }
+	void setCameraBlock(v3s16 camera_block)
+	{ m_queue_in.setCameraBlock(camera_block); }
+
 	MutexedQueue<MeshUpdateResult> m_queue_out;
 
 	v3s16 m_camera_offset;
+
+private:
+	friend class MeshUpdateWorkerThread;
+
+	MeshUpdateQueue m_queue_in;
+	std::vector<MeshUpdateWorkerThread *> m_workers;
 };
 
 enum ClientEventType
@@ -395,6 +445,8 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	void handleCommand_OverrideDayNightRatio(NetworkPacket* pkt);
 	void handleCommand_LocalPlayerAnimations(NetworkPacket* pkt);
 	void handleCommand_EyeOffset(NetworkPacket* pkt);
+	void handleCommand_NodemetaChanged(NetworkPacket* pkt);
+	void handleCommand_InventoryDelta(NetworkPacket* pkt);
 	void handleCommand_SrpBytesSandB(NetworkPacket* pkt);
 
 	void ProcessData(NetworkPacket *pkt);
@@ -474,7 +526,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	void addUpdateMeshTaskForNode(v3s16 nodepos, bool ack_to_server=false, bool urgent=false);
 
 	void updateCameraOffset(v3s16 camera_offset)
-	{ m_mesh_update_thread.m_camera_offset = camera_offset; }
+	{ m_mesh_update_manager.m_camera_offset = camera_offset; }
 
 	// Get event from queue. CE_NONE is returned if queue is empty.
 	ClientEvent getClientEvent();
@@ -591,7 +643,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	MtEventManager *m_event;
 
 
-	MeshUpdateThread m_mesh_update_thread;
+	MeshUpdateManager m_mesh_update_manager;
 	ClientEnvironment m_env;
 	ParticleManager m_particle_manager;
 	con::Connection m_con;
@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "environment.h"
 #include "map.h"
 #include "emerge.h"
+#include "inventory.h"
 #include "serverobject.h"              // TODO this is used for cleanup of only
 #include "log.h"
 #include "util/srp.h"
@@ -61,6 +62,11 @@ void RemoteClient::ResendBlockIfOnWire(v3s16 p)
 	}
 }
 
+RemoteClient::~RemoteClient()
+{
+	delete m_sent_inventory;
+}
+
 void RemoteClient::GetNextBlocks (
 		ServerEnvironment *env,
 		EmergeManager * emerge,
@@ -69,6 +75,15 @@ void RemoteClient::GetNextBlocks (
 {
 	DSTACK(FUNCTION_NAME);
 
+	// Shared by all clients, created on the first call
+	static SettingHandle<u16> max_simul_sends_setting(
+		"max_simultaneous_block_sends_per_client");
+	static SettingHandle<float> min_time_from_building(
+		"full_block_send_enable_min_time_from_building");
+	static SettingHandle<s16> max_block_send_distance(
+		"max_block_send_distance");
+	static SettingHandle<s16> max_block_generate_distance(
+		"max_block_generate_distance");
 
 	// Increment timers
 	m_nothing_to_send_pause_timer -= dtime;
@@ -83,8 +98,7 @@ void RemoteClient::GetNextBlocks (
 		return;
 
 	// Won't send anything if already sending
-	if(m_blocks_sending.size() >= g_settings->getU16
-			("max_simultaneous_block_sends_per_client"))
+	if(m_blocks_sending.size() >= max_simul_sends_setting.get())
 	{
 		//infostream<<"Not sending any blocks, Queue full."<<std::endl;
 		return;
@@ -138,9 +152,7 @@ void RemoteClient::GetNextBlocks (
 
 	//infostream<<"d_start="<<d_start<<std::endl;
 
-	u16 max_simul_sends_setting = g_settings->getU16
-			("max_simultaneous_block_sends_per_client");
-	u16 max_simul_sends_usually = max_simul_sends_setting;
+	u16 max_simul_sends_usually = max_simul_sends_setting.get();
 
 	/*
 		Check the time from last addNode/removeNode.
@@ -148,8 +160,7 @@ void RemoteClient::GetNextBlocks (
 		Decrease send rate if player is building stuff.
 	*/
 	m_time_from_building += dtime;
-	if(m_time_from_building < g_settings->getFloat(
-				"full_block_send_enable_min_time_from_building"))
+	if(m_time_from_building < min_time_from_building.get())
 	{
 		max_simul_sends_usually
 			= LIMITED_MAX_SIMULTANEOUS_BLOCK_SENDS;
@@ -169,9 +180,9 @@ void RemoteClient::GetNextBlocks (
 	*/
 	s32 new_nearest_unsent_d = -1;
 
-	const s16 full_d_max = g_settings->getS16("max_block_send_distance");
+	const s16 full_d_max = max_block_send_distance.get();
 	s16 d_max = full_d_max;
-	s16 d_max_gen = g_settings->getS16("max_block_generate_distance");
+	s16 d_max_gen = max_block_generate_distance.get();
 
 	// Don't loop very much at a time
 	s16 max_d_increment_at_time = 2;
@@ -208,7 +219,7 @@ void RemoteClient::GetNextBlocks (
 
 			// If block is very close, allow full maximum
 			if(d <= BLOCK_SEND_DISABLE_LIMITS_MAX_D)
-				max_simul_dynamic = max_simul_sends_setting;
+				max_simul_dynamic = max_simul_sends_setting.get();
 
 			// Don't select too many blocks for sending
 			if (num_blocks_selected >= max_simul_dynamic) {
@@ -353,7 +364,7 @@ void RemoteClient::GetNextBlocks (
 	} else if(nearest_emergefull_d != -1){
 		new_nearest_unsent_d = nearest_emergefull_d;
 	} else {
-		if(d > g_settings->getS16("max_block_send_distance")){
+		if(d > full_d_max){
 			new_nearest_unsent_d = 0;
 			m_nothing_to_send_pause_timer = 2.0;
 		} else {
@@ -32,6 +32,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <set>
 
 class MapBlock;
+class Inventory;
 class ServerEnvironment;
 class EmergeManager;
 
@@ -254,6 +255,7 @@ class RemoteClient
 		chosen_mech(AUTH_MECHANISM_NONE),
 		auth_data(NULL),
 		m_time_from_building(9999),
+		m_sent_inventory(NULL),
 		m_pending_serialization_version(SER_FMT_VER_INVALID),
 		m_state(CS_Created),
 		m_nearest_unsent_d(0),
@@ -269,9 +271,7 @@ class RemoteClient
 		m_connection_time(getTime(PRECISION_SECONDS))
 	{
 	}
-	~RemoteClient()
-	{
-	}
+	~RemoteClient();
 
 	/*
 		Finds block that should be sent next to the client.
@@ -296,6 +296,12 @@ class RemoteClient
 	 */
 	void ResendBlockIfOnWire(v3s16 p);
 
+	// Whether the client has confirmed that it received the block
+	bool isBlockSent(v3s16 p) const
+	{
+		return m_blocks_sent.find(p) != m_blocks_sent.end();
+	}
+
 	s32 SendingCount()
 	{
 		return m_blocks_sending.size();
@@ -325,6 +331,13 @@ class RemoteClient
 	*/
 	std::set<u16> m_known_objects;
 
+	/*
+		The player's inventory as last sent to the client, later changes
+		are sent as a delta to it. NULL until the first whole inventory
+		is sent to a client that supports deltas.
+	*/
+	Inventory *m_sent_inventory;
+
 	ClientState getState()
 		{ return m_state; }
 
@@ -0,0 +1,155 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "database-files.h"
+
+#include "log.h"
+#include "filesys.h"
+#include "settings.h"
+#include "constants.h"
+#include "exceptions.h"
+#include "util/string.h"
+
+#include <fstream>
+#include <sstream>
+
+// Name stored in a player file, "" if it can't be read
+static std::string read_player_name(const std::string &path)
+{
+	std::ifstream is(path.c_str(), std::ios_base::binary);
+	if (!is.good())
+		return "";
+	Settings args;
+	if (!args.parseConfigLines(is, "PlayerArgsEnd") || !args.exists("name"))
+		return "";
+	return args.get("name");
+}
+
+
+PlayerDatabase_Files::PlayerDatabase_Files(const std::string &savedir) :
+	m_playersdir(savedir + DIR_DELIM + "players")
+{
+	if (!fs::CreateAllDirs(m_playersdir)) {
+		throw FileNotGoodException("Failed to create players directory "
+			+ m_playersdir);
+	}
+}
+
+std::string PlayerDatabase_Files::getPath(const std::string &name, u32 i)
+{
+	if (i == 0)
+		return m_playersdir + DIR_DELIM + name;
+	return m_playersdir + DIR_DELIM + name + itos(i - 1);
+}
+
+std::string PlayerDatabase_Files::findPlayer(const std::string &name,
+	std::string *free_path)
+{
+	std::map<std::string, std::string>::iterator it = m_paths.find(name);
+	if (it != m_paths.end())
+		return it->second;
+
+	if (free_path)
+		*free_path = "";
+
+	// Alternates can have gaps from removed players
+	for (u32 i = 0; i < PLAYER_FILE_ALTERNATE_TRIES; i++) {
+		std::string path = getPath(name, i);
+		if (!fs::PathExists(path)) {
+			if (free_path && free_path->empty())
+				*free_path = path;
+			continue;
+		}
+		if (read_player_name(path) == name) {
+			m_paths[name] = path;
+			return path;
+		}
+	}
+	return "";
+}
+
+bool PlayerDatabase_Files::savePlayer(const std::string &name,
+	const std::string &data)
+{
+	std::string free_path;
+	std::string path = findPlayer(name, &free_path);
+	if (path.empty()) {
+		if (free_path.empty()) {
+			infostream << "Didn't find free file for player " << name
+				<< std::endl;
+			return false;
+		}
+		path = free_path;
+	}
+
+	if (!fs::safeWriteToFile(path, data)) {
+		infostream << "Failed to write " << path << std::endl;
+		return false;
+	}
+	m_paths[name] = path;
+	return true;
+}
+
+std::string PlayerDatabase_Files::loadPlayer(const std::string &name)
+{
+	std::string path = findPlayer(name, NULL);
+	if (path.empty())
+		return "";
+
+	std::ifstream is(path.c_str(), std::ios_base::binary);
+	if (!is.good()) {
+		infostream << "Failed to open " << path << std::endl;
+		return "";
+	}
+	std::ostringstream os(std::ios_base::binary);
+	os << is.rdbuf();
+	return os.str();
+}
+
+bool PlayerDatabase_Files::removePlayer(const std::string &name)
+{
+	std::string path = findPlayer(name, NULL);
+	if (path.empty())
+		return true;
+
+	// The other alternates stay where they are, a file named like the
+	// last one may also belong to a player called e.g. "foo1"
+	if (!fs::DeleteSingleFileOrEmptyDirectory(path)) {
+		warningstream << "removePlayer: Failed to remove " << path
+			<< std::endl;
+		return false;
+	}
+	m_paths.erase(name);
+	return true;
+}
+
+void PlayerDatabase_Files::listPlayers(std::vector<std::string> &dst)
+{
+	std::vector<fs::DirListNode> files = fs::GetDirListing(m_playersdir);
+	for (size_t i = 0; i < files.size(); i++) {
+		if (files[i].dir)
+			continue;
+		std::string path = m_playersdir + DIR_DELIM + files[i].name;
+		std::string name = read_player_name(path);
+		if (name.empty())
+			continue;
+		m_paths[name] = path;
+		dst.push_back(name);
+	}
+}
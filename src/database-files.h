@@ -0,0 +1,57 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DATABASE_FILES_HEADER
+#define DATABASE_FILES_HEADER
+
+#include "database.h"
+#include <map>
+#include <string>
+
+/*
+	The old players directory with one text file per player.
+
+	Some file systems are not case-sensitive, so a player whose file name
+	is taken by another player is stored in <name>0, <name>1 and so on.
+	Removing a player leaves a gap, which the next new player fills.
+*/
+class PlayerDatabase_Files : public PlayerDatabase
+{
+public:
+	PlayerDatabase_Files(const std::string &savedir);
+
+	virtual bool savePlayer(const std::string &name, const std::string &data);
+	virtual std::string loadPlayer(const std::string &name);
+	virtual bool removePlayer(const std::string &name);
+	virtual void listPlayers(std::vector<std::string> &dst);
+
+private:
+	// Path of the i-th file a player with that name can be stored in
+	std::string getPath(const std::string &name, u32 i);
+	// Returns "" if the player has no file, sets free_path to the first
+	// unused one then
+	std::string findPlayer(const std::string &name, std::string *free_path);
+
+	std::string m_playersdir;
+
+	// Paths of the players found so far
+	std::map<std::string, std::string> m_paths;
+};
+
+#endif
@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/string.h"
 
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 
 
 #define ENSURE_STATUS_OK(s) \
@@ -90,6 +91,43 @@ bool Database_LevelDB::deleteBlock(const v3s16 &pos)
 	return true;
 }
 
+bool Database_LevelDB::saveBlocks(const std::vector<v3s16> &positions,
+		const std::vector<std::string> &data)
+{
+	leveldb::WriteBatch batch;
+	for (size_t i = 0; i < positions.size(); i++)
+		batch.Put(i64tos(getBlockAsInteger(positions[i])), data[i]);
+
+	leveldb::Status status = m_database->Write(leveldb::WriteOptions(), &batch);
+	if (!status.ok()) {
+		warningstream << "saveBlocks: LevelDB error saving "
+			<< positions.size() << " blocks: " << status.ToString() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void Database_LevelDB::loadBlocks(const std::vector<v3s16> &positions,
+		std::vector<std::string> &data)
+{
+	data.clear();
+	data.resize(positions.size());
+
+	// Keys are decimal strings, so blocks that are close to each other are
+	// not next to each other in the key order and an iterator doesn't help.
+	// Read all of them from one snapshot instead.
+	leveldb::ReadOptions options;
+	options.snapshot = m_database->GetSnapshot();
+	for (size_t i = 0; i < positions.size(); i++) {
+		leveldb::Status status = m_database->Get(options,
+			i64tos(getBlockAsInteger(positions[i])), &data[i]);
+		if (!status.ok())
+			data[i].clear();
+	}
+	m_database->ReleaseSnapshot(options.snapshot);
+}
+
 void Database_LevelDB::listAllLoadableBlocks(std::vector<v3s16> &dst)
 {
 	leveldb::Iterator* it = m_database->NewIterator(leveldb::ReadOptions());
@@ -100,5 +138,107 @@ void Database_LevelDB::listAllLoadableBlocks(std::vector<v3s16> &dst)
 	delete it;
 }
 
+
+PlayerDatabase_LevelDB::PlayerDatabase_LevelDB(const std::string &savedir) :
+	m_batch(NULL)
+{
+	leveldb::Options options;
+	options.create_if_missing = true;
+	leveldb::Status status = leveldb::DB::Open(options,
+		savedir + DIR_DELIM + "players.db", &m_database);
+	ENSURE_STATUS_OK(status);
+}
+
+PlayerDatabase_LevelDB::~PlayerDatabase_LevelDB()
+{
+	endSave();
+	delete m_database;
+}
+
+void PlayerDatabase_LevelDB::beginSave()
+{
+	if (!m_batch)
+		m_batch = new leveldb::WriteBatch();
+}
+
+void PlayerDatabase_LevelDB::endSave()
+{
+	writeBatch();
+	delete m_batch;
+	m_batch = NULL;
+}
+
+void PlayerDatabase_LevelDB::writeBatch()
+{
+	if (!m_batch)
+		return;
+	leveldb::Status status = m_database->Write(leveldb::WriteOptions(), m_batch);
+	m_batch->Clear();
+	if (!status.ok()) {
+		warningstream << "writeBatch: LevelDB error saving players: "
+			<< status.ToString() << std::endl;
+	}
+}
+
+bool PlayerDatabase_LevelDB::savePlayer(const std::string &name,
+	const std::string &data)
+{
+	if (m_batch) {
+		m_batch->Put(name, data);
+		return true;
+	}
+
+	leveldb::Status status = m_database->Put(leveldb::WriteOptions(),
+		name, data);
+	if (!status.ok()) {
+		warningstream << "savePlayer: LevelDB error saving player "
+			<< name << ": " << status.ToString() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+std::string PlayerDatabase_LevelDB::loadPlayer(const std::string &name)
+{
+	// Make the saves of this batch visible
+	writeBatch();
+
+	std::string datastr;
+	leveldb::Status status = m_database->Get(leveldb::ReadOptions(),
+		name, &datastr);
+
+	if (status.ok())
+		return datastr;
+	else
+		return "";
+}
+
+bool PlayerDatabase_LevelDB::removePlayer(const std::string &name)
+{
+	writeBatch();
+
+	leveldb::Status status = m_database->Delete(leveldb::WriteOptions(), name);
+	if (!status.ok()) {
+		warningstream << "removePlayer: LevelDB error deleting player "
+			<< name << ": " << status.ToString() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void PlayerDatabase_LevelDB::listPlayers(std::vector<std::string> &dst)
+{
+	writeBatch();
+
+	leveldb::Iterator* it = m_database->NewIterator(leveldb::ReadOptions());
+	for (it->SeekToFirst(); it->Valid(); it->Next()) {
+		dst.push_back(it->key().ToString());
+	}
+	ENSURE_STATUS_OK(it->status());  // Check for any errors found during the scan
+	delete it;
+}
+
 #endif // USE_LEVELDB
 
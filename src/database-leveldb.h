@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "database.h"
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 #include <string>
 
 class Database_LevelDB : public Database
@@ -37,12 +38,41 @@ class Database_LevelDB : public Database
 	virtual bool saveBlock(const v3s16 &pos, const std::string &data);
 	virtual std::string loadBlock(const v3s16 &pos);
 	virtual bool deleteBlock(const v3s16 &pos);
+	virtual bool saveBlocks(const std::vector<v3s16> &positions,
+			const std::vector<std::string> &data);
+	virtual void loadBlocks(const std::vector<v3s16> &positions,
+			std::vector<std::string> &data);
 	virtual void listAllLoadableBlocks(std::vector<v3s16> &dst);
 
 private:
 	leveldb::DB *m_database;
 };
 
+/*
+	Players in players.db, keyed by name
+*/
+class PlayerDatabase_LevelDB : public PlayerDatabase
+{
+public:
+	PlayerDatabase_LevelDB(const std::string &savedir);
+	~PlayerDatabase_LevelDB();
+
+	virtual void beginSave();
+	virtual void endSave();
+
+	virtual bool savePlayer(const std::string &name, const std::string &data);
+	virtual std::string loadPlayer(const std::string &name);
+	virtual bool removePlayer(const std::string &name);
+	virtual void listPlayers(std::vector<std::string> &dst);
+
+private:
+	void writeBatch();
+
+	leveldb::DB *m_database;
+	// Saves between beginSave() and endSave(), written at once
+	leveldb::WriteBatch *m_batch;
+};
+
 #endif // USE_LEVELDB
 
 #endif
@@ -160,6 +160,102 @@ bool Database_Redis::deleteBlock(const v3s16 &pos)
 	return true;
 }
 
+bool Database_Redis::saveBlocks(const std::vector<v3s16> &positions,
+		const std::vector<std::string> &data)
+{
+	if (positions.empty())
+		return true;
+
+	// HMSET <hash> <key> <data> [<key> <data> ...]
+	std::vector<std::string> keys(positions.size());
+	std::vector<const char *> argv;
+	std::vector<size_t> argvlen;
+	argv.push_back("HMSET");
+	argvlen.push_back(5);
+	argv.push_back(hash.c_str());
+	argvlen.push_back(hash.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		keys[i] = i64tos(getBlockAsInteger(positions[i]));
+		argv.push_back(keys[i].c_str());
+		argvlen.push_back(keys[i].size());
+		argv.push_back(data[i].c_str());
+		argvlen.push_back(data[i].size());
+	}
+
+	redisReply *reply = static_cast<redisReply *>(redisCommandArgv(ctx,
+			argv.size(), &argv[0], &argvlen[0]));
+	if (!reply) {
+		warningstream << "saveBlocks: redis command 'HMSET' failed on "
+			<< positions.size() << " blocks: " << ctx->errstr << std::endl;
+		return false;
+	}
+
+	if (reply->type == REDIS_REPLY_ERROR) {
+		warningstream << "saveBlocks: saving " << positions.size()
+			<< " blocks failed: " << std::string(reply->str, reply->len)
+			<< std::endl;
+		freeReplyObject(reply);
+		return false;
+	}
+
+	freeReplyObject(reply);
+	return true;
+}
+
+void Database_Redis::loadBlocks(const std::vector<v3s16> &positions,
+		std::vector<std::string> &data)
+{
+	data.clear();
+	data.resize(positions.size());
+	if (positions.empty())
+		return;
+
+	// HMGET <hash> <key> [<key> ...]
+	std::vector<std::string> keys(positions.size());
+	std::vector<const char *> argv;
+	std::vector<size_t> argvlen;
+	argv.push_back("HMGET");
+	argvlen.push_back(5);
+	argv.push_back(hash.c_str());
+	argvlen.push_back(hash.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		keys[i] = i64tos(getBlockAsInteger(positions[i]));
+		argv.push_back(keys[i].c_str());
+		argvlen.push_back(keys[i].size());
+	}
+
+	redisReply *reply = static_cast<redisReply *>(redisCommandArgv(ctx,
+			argv.size(), &argv[0], &argvlen[0]));
+	if (!reply) {
+		throw FileNotGoodException(std::string(
+			"Redis command 'HMGET %s ...' failed: ") + ctx->errstr);
+	}
+	switch (reply->type) {
+	case REDIS_REPLY_ARRAY:
+		for (size_t i = 0; i < reply->elements && i < positions.size(); i++) {
+			redisReply *elem = reply->element[i];
+			// Blocks not found in database are nil
+			if (elem->type == REDIS_REPLY_STRING)
+				data[i].assign(elem->str, elem->len);
+		}
+		freeReplyObject(reply);
+		return;
+	case REDIS_REPLY_ERROR: {
+		std::string errstr(reply->str, reply->len);
+		freeReplyObject(reply);
+		errorstream << "loadBlocks: loading " << positions.size()
+			<< " blocks failed: " << errstr << std::endl;
+		throw FileNotGoodException(std::string(
+			"Redis command 'HMGET %s ...' errored: ") + errstr);
+	}
+	}
+	errorstream << "loadBlocks: loading " << positions.size()
+		<< " blocks returned invalid reply type " << reply->type << std::endl;
+	freeReplyObject(reply);
+	throw FileNotGoodException(std::string(
+		"Redis command 'HMGET %s ...' gave invalid reply."));
+}
+
 void Database_Redis::listAllLoadableBlocks(std::vector<v3s16> &dst)
 {
 	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx, "HKEYS %s", hash.c_str()));
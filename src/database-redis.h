@@ -42,6 +42,10 @@ class Database_Redis : public Database
 	virtual bool saveBlock(const v3s16 &pos, const std::string &data);
 	virtual std::string loadBlock(const v3s16 &pos);
 	virtual bool deleteBlock(const v3s16 &pos);
+	virtual bool saveBlocks(const std::vector<v3s16> &positions,
+			const std::vector<std::string> &data);
+	virtual void loadBlocks(const std::vector<v3s16> &positions,
+			std::vector<std::string> &data);
 	virtual void listAllLoadableBlocks(std::vector<v3s16> &dst);
 
 private:
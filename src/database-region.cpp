@@ -0,0 +1,414 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+Region file format:
+	[0] u8[4] magic "MTRG"
+	[4] u8 version (1)
+	[5] u8[3] unused
+	[8] REGION_BLOCK_COUNT times:
+		u32 offset of the block data in sectors, 0 if there is no block
+		u32 length of the block data in bytes
+	Block data, each block starting at a sector boundary
+
+	Table entries pointing into the header or past the end of the file are
+	ignored when the file is opened; those blocks count as missing.
+
+	Blocks are indexed by (z * REGION_SIZE + y) * REGION_SIZE + x, with
+	x, y, z the position of the block inside the region.
+	A block takes exactly the sectors needed for its length. Sectors not
+	taken by any block in the table are free; they are found when the file
+	is opened and reused first fit, the file only grows if no free run is
+	long enough.
+	A saved block is always written to free sectors before its table entry
+	is changed, and its old sectors are only freed afterwards, so a crash
+	leaves either the old or the new block behind.
+*/
+
+#include "database-region.h"
+
+#include "log.h"
+#include "filesys.h"
+#include "exceptions.h"
+#include "util/numeric.h"
+#include "util/serialize.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#ifndef _WIN32
+	#include <sys/mman.h>
+#endif
+
+#define REGION_SIZE 32
+#define REGION_BLOCK_COUNT (REGION_SIZE * REGION_SIZE * REGION_SIZE)
+#define REGION_SECTOR_SIZE 256
+#define REGION_TABLE_OFFSET 8
+#define REGION_TABLE_SIZE (REGION_BLOCK_COUNT * 8)
+// First sector after the header
+#define REGION_DATA_SECTOR \
+	((REGION_TABLE_OFFSET + REGION_TABLE_SIZE + REGION_SECTOR_SIZE - 1) \
+		/ REGION_SECTOR_SIZE)
+#define REGION_VERSION 1
+// Maximum number of region files kept open
+#define REGION_MAX_OPEN 32
+
+struct Database_Region::Region
+{
+	FILE *file;
+	// A multiple of REGION_SECTOR_SIZE, unless the file was truncated
+	u32 file_size;
+	u32 offsets[REGION_BLOCK_COUNT];
+	u32 lengths[REGION_BLOCK_COUNT];
+	// One entry per sector of the file, including the header
+	std::vector<bool> sector_used;
+	u32 last_used;
+#ifndef _WIN32
+	// Read-only mapping of the first map_size bytes of the file
+	char *map;
+	size_t map_size;
+#endif
+};
+
+static inline u32 get_block_index(v3s16 pos)
+{
+	v3s16 p = pos - getContainerPos(pos, REGION_SIZE) * REGION_SIZE;
+	return (p.Z * REGION_SIZE + p.Y) * REGION_SIZE + p.X;
+}
+
+static inline u32 get_sector_count(u32 length)
+{
+	return (length + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE;
+}
+
+static void set_sectors_used(std::vector<bool> &sector_used, u32 offset,
+	u32 count, bool used)
+{
+	if (sector_used.size() < offset + count)
+		sector_used.resize(offset + count, false);
+	for (u32 s = offset; s < offset + count; s++)
+		sector_used[s] = used;
+}
+
+// Returns the first sector of a free run of count sectors
+static u32 find_free_sectors(const std::vector<bool> &sector_used, u32 count)
+{
+	u32 run = 0;
+	for (u32 s = REGION_DATA_SECTOR; s < sector_used.size(); s++) {
+		run = sector_used[s] ? 0 : run + 1;
+		if (run == count)
+			return s + 1 - count;
+	}
+	// Continue the free run at the end of the file, if any
+	return sector_used.size() - run;
+}
+
+static bool write_at(FILE *file, u32 offset, const void *data, size_t size)
+{
+	return fseek(file, offset, SEEK_SET) == 0 &&
+		fwrite(data, 1, size, file) == size;
+}
+
+
+Database_Region::Database_Region(const std::string &savedir) :
+	m_regiondir(savedir + DIR_DELIM + "map_regions"),
+	m_use_counter(0)
+{
+	if (!fs::CreateAllDirs(m_regiondir)) {
+		throw FileNotGoodException("Failed to create region directory "
+			+ m_regiondir);
+	}
+}
+
+Database_Region::~Database_Region()
+{
+	for (std::map<v3s16, Region *>::iterator it = m_regions.begin();
+			it != m_regions.end(); ++it)
+		closeRegion(it->second);
+}
+
+std::string Database_Region::getRegionPath(v3s16 regionpos)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "r.%d.%d.%d.mtr",
+		regionpos.X, regionpos.Y, regionpos.Z);
+	return m_regiondir + DIR_DELIM + name;
+}
+
+void Database_Region::closeRegion(Region *region)
+{
+#ifndef _WIN32
+	if (region->map)
+		munmap(region->map, region->map_size);
+#endif
+	fclose(region->file);
+	delete region;
+}
+
+Database_Region::Region *Database_Region::getRegion(v3s16 regionpos,
+	bool create)
+{
+	std::map<v3s16, Region *>::iterator it = m_regions.find(regionpos);
+	if (it != m_regions.end()) {
+		it->second->last_used = ++m_use_counter;
+		return it->second;
+	}
+
+	std::string path = getRegionPath(regionpos);
+	FILE *file = fopen(path.c_str(), "r+b");
+	if (!file && !create)
+		return NULL;
+
+	Region *region = new Region;
+	region->last_used = ++m_use_counter;
+#ifndef _WIN32
+	region->map = NULL;
+	region->map_size = 0;
+#endif
+
+	if (file) {
+		u8 header[REGION_TABLE_OFFSET];
+		u8 *table = new u8[REGION_TABLE_SIZE];
+		bool good = fread(header, 1, sizeof(header), file) == sizeof(header) &&
+			fread(table, 1, REGION_TABLE_SIZE, file) == REGION_TABLE_SIZE &&
+			memcmp(header, "MTRG", 4) == 0 &&
+			header[4] == REGION_VERSION &&
+			fseek(file, 0, SEEK_END) == 0;
+		long file_size = good ? ftell(file) : -1;
+		// Sector numbers and file offsets are u32
+		good = file_size >= 0 && (u64)file_size <= U32_MAX;
+		if (good) {
+			region->file_size = file_size;
+			u32 bad_entries = 0;
+			for (u32 i = 0; i < REGION_BLOCK_COUNT; i++) {
+				u32 offset = readU32(&table[i * 8]);
+				u32 length = readU32(&table[i * 8 + 4]);
+				if (length != 0 && (offset < REGION_DATA_SECTOR ||
+						(u64)offset * REGION_SECTOR_SIZE + length >
+						region->file_size)) {
+					bad_entries++;
+					offset = 0;
+					length = 0;
+				}
+				region->offsets[i] = offset;
+				region->lengths[i] = length;
+			}
+			if (bad_entries != 0) {
+				errorstream << "Region file " << path << " has "
+					<< bad_entries << " invalid block entries, "
+					<< "treating those blocks as missing" << std::endl;
+			}
+
+			set_sectors_used(region->sector_used, 0, REGION_DATA_SECTOR,
+				true);
+			for (u32 i = 0; i < REGION_BLOCK_COUNT; i++) {
+				if (region->lengths[i] != 0) {
+					set_sectors_used(region->sector_used, region->offsets[i],
+						get_sector_count(region->lengths[i]), true);
+				}
+			}
+			set_sectors_used(region->sector_used,
+				region->file_size / REGION_SECTOR_SIZE, 0, false);
+		}
+		delete[] table;
+		if (!good) {
+			fclose(file);
+			delete region;
+			throw FileNotGoodException("Invalid region file " + path);
+		}
+	} else {
+		file = fopen(path.c_str(), "w+b");
+		if (!file) {
+			delete region;
+			throw FileNotGoodException("Cannot create region file " + path);
+		}
+		// Header and an empty table, padded to the first data sector
+		std::string header(REGION_DATA_SECTOR * REGION_SECTOR_SIZE, '\0');
+		memcpy(&header[0], "MTRG", 4);
+		header[4] = REGION_VERSION;
+		if (!write_at(file, 0, header.data(), header.size()) ||
+				fflush(file) != 0) {
+			fclose(file);
+			delete region;
+			throw FileNotGoodException("Cannot write region file " + path);
+		}
+		memset(region->offsets, 0, sizeof(region->offsets));
+		memset(region->lengths, 0, sizeof(region->lengths));
+		region->file_size = header.size();
+		set_sectors_used(region->sector_used, 0, REGION_DATA_SECTOR, true);
+	}
+	region->file = file;
+
+	// Close the least recently used region if too many are open
+	if (m_regions.size() >= REGION_MAX_OPEN) {
+		std::map<v3s16, Region *>::iterator oldest = m_regions.begin();
+		for (it = m_regions.begin(); it != m_regions.end(); ++it) {
+			if (it->second->last_used < oldest->second->last_used)
+				oldest = it;
+		}
+		closeRegion(oldest->second);
+		m_regions.erase(oldest);
+	}
+
+	m_regions[regionpos] = region;
+	return region;
+}
+
+bool Database_Region::saveBlock(const v3s16 &pos, const std::string &data)
+{
+	Region *region = getRegion(getContainerPos(pos, REGION_SIZE), true);
+	u32 i = get_block_index(pos);
+
+	// The old sectors stay in use until the table points elsewhere
+	u32 sectors = get_sector_count(data.size());
+	u32 offset = find_free_sectors(region->sector_used, sectors);
+
+	// Pad to the sector boundary so that the file size stays aligned
+	std::string padded = data;
+	padded.resize(sectors * REGION_SECTOR_SIZE, '\0');
+
+	u8 entry[8];
+	writeU32(&entry[0], offset);
+	writeU32(&entry[4], data.size());
+
+	// Data first, so that the table never points at unwritten data
+	if (!write_at(region->file, offset * REGION_SECTOR_SIZE,
+				padded.data(), padded.size()) ||
+			fflush(region->file) != 0 ||
+			!write_at(region->file, REGION_TABLE_OFFSET + i * 8,
+				entry, sizeof(entry)) ||
+			fflush(region->file) != 0) {
+		warningstream << "saveBlock: Failed to write block " << PP(pos)
+			<< " to region file" << std::endl;
+		return false;
+	}
+
+	if (region->lengths[i] != 0) {
+		set_sectors_used(region->sector_used, region->offsets[i],
+			get_sector_count(region->lengths[i]), false);
+	}
+	set_sectors_used(region->sector_used, offset, sectors, true);
+	region->offsets[i] = offset;
+	region->lengths[i] = data.size();
+	region->file_size = MYMAX(region->file_size,
+		(offset + sectors) * REGION_SECTOR_SIZE);
+	return true;
+}
+
+std::string Database_Region::loadBlock(const v3s16 &pos)
+{
+	Region *region = getRegion(getContainerPos(pos, REGION_SIZE), false);
+	if (!region)
+		return "";
+	u32 i = get_block_index(pos);
+	u32 length = region->lengths[i];
+	if (length == 0)
+		return "";
+	size_t start = (size_t)region->offsets[i] * REGION_SECTOR_SIZE;
+	if (start + length > region->file_size) {
+		errorstream << "loadBlock: Block " << PP(pos)
+			<< " is past the end of its region file" << std::endl;
+		return "";
+	}
+
+#ifndef _WIN32
+	// Map the whole file, again if it has grown past the old mapping
+	if (start + length > region->map_size) {
+		if (region->map)
+			munmap(region->map, region->map_size);
+		region->map_size = region->file_size;
+		void *map = mmap(NULL, region->map_size, PROT_READ, MAP_SHARED,
+			fileno(region->file), 0);
+		if (map == MAP_FAILED) {
+			region->map = NULL;
+			region->map_size = 0;
+			errorstream << "loadBlock: Failed to map region file of block "
+				<< PP(pos) << std::endl;
+			return "";
+		}
+		region->map = (char *)map;
+	}
+	if (start + length > region->map_size) {
+		errorstream << "loadBlock: Block " << PP(pos)
+			<< " is past the end of the mapped region file" << std::endl;
+		return "";
+	}
+	return std::string(region->map + start, length);
+#else
+	std::string data(length, '\0');
+	if (fseek(region->file, start, SEEK_SET) != 0 ||
+			fread(&data[0], 1, length, region->file) != length) {
+		errorstream << "loadBlock: Failed to read block " << PP(pos)
+			<< " from region file" << std::endl;
+		return "";
+	}
+	return data;
+#endif
+}
+
+bool Database_Region::deleteBlock(const v3s16 &pos)
+{
+	Region *region = getRegion(getContainerPos(pos, REGION_SIZE), false);
+	if (!region)
+		return true;
+	u32 i = get_block_index(pos);
+
+	u8 entry[8];
+	memset(entry, 0, sizeof(entry));
+	if (!write_at(region->file, REGION_TABLE_OFFSET + i * 8,
+				entry, sizeof(entry)) ||
+			fflush(region->file) != 0) {
+		warningstream << "deleteBlock: Failed to delete block " << PP(pos)
+			<< " from region file" << std::endl;
+		return false;
+	}
+
+	if (region->lengths[i] != 0) {
+		set_sectors_used(region->sector_used, region->offsets[i],
+			get_sector_count(region->lengths[i]), false);
+	}
+	region->offsets[i] = 0;
+	region->lengths[i] = 0;
+	return true;
+}
+
+void Database_Region::listAllLoadableBlocks(std::vector<v3s16> &dst)
+{
+	std::vector<fs::DirListNode> files = fs::GetDirListing(m_regiondir);
+	for (size_t f = 0; f < files.size(); f++) {
+		int x, y, z;
+		char end;
+		if (files[f].dir || sscanf(files[f].name.c_str(),
+				"r.%d.%d.%d.mt%c", &x, &y, &z, &end) != 4 || end != 'r')
+			continue;
+
+		// Only the offset table of each region is read
+		v3s16 regionpos(x, y, z);
+		Region *region = getRegion(regionpos, false);
+		if (!region)
+			continue;
+		for (s16 bz = 0; bz < REGION_SIZE; bz++)
+		for (s16 by = 0; by < REGION_SIZE; by++)
+		for (s16 bx = 0; bx < REGION_SIZE; bx++) {
+			v3s16 pos = regionpos * REGION_SIZE + v3s16(bx, by, bz);
+			if (region->lengths[get_block_index(pos)] != 0)
+				dst.push_back(pos);
+		}
+	}
+}
@@ -0,0 +1,58 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DATABASE_REGION_HEADER
+#define DATABASE_REGION_HEADER
+
+#include "database.h"
+#include <map>
+#include <string>
+
+/*
+	Stores the blocks of each REGION_SIZE^3 block cube in one region file,
+	which starts with a table of the offset and length of every block.
+	Looking up a block is an index into that table.
+*/
+class Database_Region : public Database
+{
+public:
+	Database_Region(const std::string &savedir);
+	~Database_Region();
+
+	virtual bool saveBlock(const v3s16 &pos, const std::string &data);
+	virtual std::string loadBlock(const v3s16 &pos);
+	virtual bool deleteBlock(const v3s16 &pos);
+	virtual void listAllLoadableBlocks(std::vector<v3s16> &dst);
+
+private:
+	struct Region;
+
+	// Returns NULL if the region file doesn't exist and create is false
+	Region *getRegion(v3s16 regionpos, bool create);
+	void closeRegion(Region *region);
+	std::string getRegionPath(v3s16 regionpos);
+
+	std::string m_regiondir;
+
+	// Open region files
+	std::map<v3s16, Region *> m_regions;
+	u32 m_use_counter;
+};
+
+#endif
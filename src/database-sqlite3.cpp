@@ -19,9 +19,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 /*
 SQLite format specification:
-	blocks:
+	blocks (map.sqlite):
 		(PK) INT id
 		BLOB data
+	player (players.sqlite):
+		(PK) TEXT name
+		BLOB data
 */
 
 
@@ -35,6 +38,7 @@ SQLite format specification:
 #include "util/string.h"
 
 #include <cassert>
+#include <map>
 
 // When to print messages when the database is being held locked by another process
 // Note: I've seen occasional delays of over 250ms while running minetestmapper.
@@ -44,6 +48,10 @@ SQLite format specification:
 #define BUSY_FATAL_TRESHOLD	3000	// Allow SQLITE_BUSY to be returned, which will cause a minetest crash.
 #define BUSY_ERROR_INTERVAL	10000	// Safety net: report again every 10 seconds
 
+// Number of positions in the IN list of the bulk read statement.
+// Must stay below SQLITE_MAX_VARIABLE_NUMBER (999 by default).
+#define SQLITE_READ_MANY_COUNT	128
+
 
 #define SQLRES(s, r, m) \
 	if ((s) != (r)) { \
@@ -110,6 +118,7 @@ Database_SQLite3::Database_SQLite3(const std::string &savedir) :
 	m_savedir(savedir),
 	m_database(NULL),
 	m_stmt_read(NULL),
+	m_stmt_read_many(NULL),
 	m_stmt_write(NULL),
 	m_stmt_list(NULL),
 	m_stmt_delete(NULL),
@@ -183,6 +192,14 @@ void Database_SQLite3::verifyDatabase()
 	PREPARE_STATEMENT(delete, "DELETE FROM `blocks` WHERE `pos` = ?");
 	PREPARE_STATEMENT(list, "SELECT `pos` FROM `blocks`");
 
+	std::string read_many = "SELECT `pos`, `data` FROM `blocks` WHERE `pos` IN (?";
+	for (int i = 1; i < SQLITE_READ_MANY_COUNT; i++)
+		read_many += ", ?";
+	read_many += ")";
+	SQLOK(sqlite3_prepare_v2(m_database, read_many.c_str(), -1,
+			&m_stmt_read_many, NULL),
+		"Failed to prepare bulk read query");
+
 	m_initialized = true;
 
 	verbosestream << "ServerMap: SQLite3 database opened." << std::endl;
@@ -261,6 +278,72 @@ std::string Database_SQLite3::loadBlock(const v3s16 &pos)
 	return s;
 }
 
+bool Database_SQLite3::saveBlocks(const std::vector<v3s16> &positions,
+		const std::vector<std::string> &data)
+{
+	verifyDatabase();
+
+	// Use a single transaction unless the caller already started one
+	bool own_transaction = sqlite3_get_autocommit(m_database) != 0;
+	if (own_transaction)
+		beginSave();
+
+	bool success = true;
+	for (size_t i = 0; i < positions.size(); i++) {
+		if (!saveBlock(positions[i], data[i]))
+			success = false;
+	}
+
+	if (own_transaction)
+		endSave();
+
+	return success;
+}
+
+void Database_SQLite3::loadBlocks(const std::vector<v3s16> &positions,
+		std::vector<std::string> &data)
+{
+	verifyDatabase();
+
+	data.clear();
+	data.resize(positions.size());
+
+	// Map from database key to indices in positions
+	std::multimap<s64, size_t> indices;
+	for (size_t i = 0; i < positions.size(); i++)
+		indices.insert(std::make_pair(getBlockAsInteger(positions[i]), i));
+
+	std::multimap<s64, size_t>::iterator it = indices.begin();
+	while (it != indices.end()) {
+		// Fill the IN list, repeating the last key for unused parameters
+		s64 key = it->first;
+		for (int n = 1; n <= SQLITE_READ_MANY_COUNT; n++) {
+			if (it != indices.end()) {
+				key = it->first;
+				it = indices.upper_bound(key);
+			}
+			SQLOK(sqlite3_bind_int64(m_stmt_read_many, n, key),
+				"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+		}
+
+		while (sqlite3_step(m_stmt_read_many) == SQLITE_ROW) {
+			s64 pos = sqlite3_column_int64(m_stmt_read_many, 0);
+			const char *blob = (const char *) sqlite3_column_blob(m_stmt_read_many, 1);
+			size_t len = sqlite3_column_bytes(m_stmt_read_many, 1);
+			if (!blob)
+				continue;
+
+			std::pair<std::multimap<s64, size_t>::iterator,
+				std::multimap<s64, size_t>::iterator> range =
+					indices.equal_range(pos);
+			for (std::multimap<s64, size_t>::iterator i = range.first;
+					i != range.second; ++i)
+				data[i->second].assign(blob, len);
+		}
+		sqlite3_reset(m_stmt_read_many);
+	}
+}
+
 void Database_SQLite3::createDatabase()
 {
 	assert(m_database); // Pre-condition
@@ -286,6 +369,7 @@ void Database_SQLite3::listAllLoadableBlocks(std::vector<v3s16> &dst)
 Database_SQLite3::~Database_SQLite3()
 {
 	FINALIZE_STATEMENT(m_stmt_read)
+	FINALIZE_STATEMENT(m_stmt_read_many)
 	FINALIZE_STATEMENT(m_stmt_write)
 	FINALIZE_STATEMENT(m_stmt_list)
 	FINALIZE_STATEMENT(m_stmt_begin)
@@ -295,3 +379,143 @@ Database_SQLite3::~Database_SQLite3()
 	SQLOK(sqlite3_close(m_database), "Failed to close database");
 }
 
+
+
+PlayerDatabase_SQLite3::PlayerDatabase_SQLite3(const std::string &savedir) :
+	m_database(NULL),
+	m_stmt_read(NULL),
+	m_stmt_write(NULL),
+	m_stmt_delete(NULL),
+	m_stmt_list(NULL),
+	m_stmt_begin(NULL),
+	m_stmt_end(NULL)
+{
+	std::string dbp = savedir + DIR_DELIM + "players.sqlite";
+
+	if (!fs::CreateAllDirs(savedir)) {
+		throw FileNotGoodException("Failed to create database "
+				"save directory");
+	}
+
+	SQLOK(sqlite3_open_v2(dbp.c_str(), &m_database,
+			SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL),
+		std::string("Failed to open SQLite3 database file ") + dbp);
+
+	SQLOK(sqlite3_busy_handler(m_database, Database_SQLite3::busyHandler,
+		m_busy_handler_data), "Failed to set SQLite3 busy handler");
+
+	SQLOK(sqlite3_exec(m_database,
+		"CREATE TABLE IF NOT EXISTS `player` (\n"
+		"	`name` TEXT PRIMARY KEY,\n"
+		"	`data` BLOB\n"
+		");\n",
+		NULL, NULL, NULL),
+		"Failed to create player table");
+
+	std::string query_str = std::string("PRAGMA synchronous = ")
+			 + itos(g_settings->getU16("sqlite_synchronous"));
+	SQLOK(sqlite3_exec(m_database, query_str.c_str(), NULL, NULL, NULL),
+		"Failed to modify sqlite3 synchronous mode");
+
+	PREPARE_STATEMENT(begin, "BEGIN");
+	PREPARE_STATEMENT(end, "COMMIT");
+	PREPARE_STATEMENT(read, "SELECT `data` FROM `player` WHERE `name` = ? LIMIT 1");
+#ifdef __ANDROID__
+	PREPARE_STATEMENT(write, "INSERT INTO `player` (`name`, `data`) VALUES (?, ?)");
+#else
+	PREPARE_STATEMENT(write, "REPLACE INTO `player` (`name`, `data`) VALUES (?, ?)");
+#endif
+	PREPARE_STATEMENT(delete, "DELETE FROM `player` WHERE `name` = ?");
+	PREPARE_STATEMENT(list, "SELECT `name` FROM `player`");
+
+	verbosestream << "ServerEnvironment: SQLite3 player database opened."
+		<< std::endl;
+}
+
+PlayerDatabase_SQLite3::~PlayerDatabase_SQLite3()
+{
+	FINALIZE_STATEMENT(m_stmt_read)
+	FINALIZE_STATEMENT(m_stmt_write)
+	FINALIZE_STATEMENT(m_stmt_delete)
+	FINALIZE_STATEMENT(m_stmt_list)
+	FINALIZE_STATEMENT(m_stmt_begin)
+	FINALIZE_STATEMENT(m_stmt_end)
+
+	SQLOK(sqlite3_close(m_database), "Failed to close database");
+}
+
+void PlayerDatabase_SQLite3::beginSave()
+{
+	SQLRES(sqlite3_step(m_stmt_begin), SQLITE_DONE,
+		"Failed to start SQLite3 transaction");
+	sqlite3_reset(m_stmt_begin);
+}
+
+void PlayerDatabase_SQLite3::endSave()
+{
+	SQLRES(sqlite3_step(m_stmt_end), SQLITE_DONE,
+		"Failed to commit SQLite3 transaction");
+	sqlite3_reset(m_stmt_end);
+}
+
+bool PlayerDatabase_SQLite3::savePlayer(const std::string &name,
+	const std::string &data)
+{
+#ifdef __ANDROID__
+	// REPLACE doesn't work on Android, see Database_SQLite3::saveBlock()
+	removePlayer(name);
+#endif
+
+	SQLOK(sqlite3_bind_text(m_stmt_write, 1, name.data(), name.size(), NULL),
+		"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+	SQLOK(sqlite3_bind_blob(m_stmt_write, 2, data.data(), data.size(), NULL),
+		"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+
+	SQLRES(sqlite3_step(m_stmt_write), SQLITE_DONE, "Failed to save player")
+	sqlite3_reset(m_stmt_write);
+
+	return true;
+}
+
+std::string PlayerDatabase_SQLite3::loadPlayer(const std::string &name)
+{
+	SQLOK(sqlite3_bind_text(m_stmt_read, 1, name.data(), name.size(), NULL),
+		"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+
+	std::string s;
+	if (sqlite3_step(m_stmt_read) == SQLITE_ROW) {
+		const char *data = (const char *) sqlite3_column_blob(m_stmt_read, 0);
+		size_t len = sqlite3_column_bytes(m_stmt_read, 0);
+		if (data)
+			s = std::string(data, len);
+	}
+	sqlite3_reset(m_stmt_read);
+
+	return s;
+}
+
+bool PlayerDatabase_SQLite3::removePlayer(const std::string &name)
+{
+	SQLOK(sqlite3_bind_text(m_stmt_delete, 1, name.data(), name.size(), NULL),
+		"Internal error: failed to bind query at " __FILE__ ":" TOSTRING(__LINE__));
+
+	bool good = sqlite3_step(m_stmt_delete) == SQLITE_DONE;
+	sqlite3_reset(m_stmt_delete);
+
+	if (!good) {
+		warningstream << "removePlayer: Player failed to delete "
+			<< name << ": " << sqlite3_errmsg(m_database) << std::endl;
+	}
+	return good;
+}
+
+void PlayerDatabase_SQLite3::listPlayers(std::vector<std::string> &dst)
+{
+	while (sqlite3_step(m_stmt_list) == SQLITE_ROW) {
+		const char *name = (const char *) sqlite3_column_text(m_stmt_list, 0);
+		size_t len = sqlite3_column_bytes(m_stmt_list, 0);
+		if (name)
+			dst.push_back(std::string(name, len));
+	}
+	sqlite3_reset(m_stmt_list);
+}
@@ -38,10 +38,17 @@ class Database_SQLite3 : public Database
 	virtual bool saveBlock(const v3s16 &pos, const std::string &data);
 	virtual std::string loadBlock(const v3s16 &pos);
 	virtual bool deleteBlock(const v3s16 &pos);
+	virtual bool saveBlocks(const std::vector<v3s16> &positions,
+			const std::vector<std::string> &data);
+	virtual void loadBlocks(const std::vector<v3s16> &positions,
+			std::vector<std::string> &data);
 	virtual void listAllLoadableBlocks(std::vector<v3s16> &dst);
 	virtual bool initialized() const { return m_initialized; }
 	~Database_SQLite3();
 
+	// Also used by PlayerDatabase_SQLite3
+	static int busyHandler(void *data, int count);
+
 private:
 	// Open the database
 	void openDatabase();
@@ -58,6 +65,8 @@ class Database_SQLite3 : public Database
 
 	sqlite3 *m_database;
 	sqlite3_stmt *m_stmt_read;
+	// Reads up to SQLITE_READ_MANY_COUNT blocks
+	sqlite3_stmt *m_stmt_read_many;
 	sqlite3_stmt *m_stmt_write;
 	sqlite3_stmt *m_stmt_list;
 	sqlite3_stmt *m_stmt_delete;
@@ -65,8 +74,35 @@ class Database_SQLite3 : public Database
 	sqlite3_stmt *m_stmt_end;
 
 	s64 m_busy_handler_data[2];
+};
 
-	static int busyHandler(void *data, int count);
+/*
+	Players in players.sqlite, looked up by the name primary key
+*/
+class PlayerDatabase_SQLite3 : public PlayerDatabase
+{
+public:
+	PlayerDatabase_SQLite3(const std::string &savedir);
+	~PlayerDatabase_SQLite3();
+
+	virtual void beginSave();
+	virtual void endSave();
+
+	virtual bool savePlayer(const std::string &name, const std::string &data);
+	virtual std::string loadPlayer(const std::string &name);
+	virtual bool removePlayer(const std::string &name);
+	virtual void listPlayers(std::vector<std::string> &dst);
+
+private:
+	sqlite3 *m_database;
+	sqlite3_stmt *m_stmt_read;
+	sqlite3_stmt *m_stmt_write;
+	sqlite3_stmt *m_stmt_delete;
+	sqlite3_stmt *m_stmt_list;
+	sqlite3_stmt *m_stmt_begin;
+	sqlite3_stmt *m_stmt_end;
+
+	s64 m_busy_handler_data[2];
 };
 
 #endif
@@ -48,6 +48,27 @@ static inline s64 pythonmodulo(s64 i, s16 mod)
 }
 
 
+bool Database::saveBlocks(const std::vector<v3s16> &positions,
+		const std::vector<std::string> &data)
+{
+	bool success = true;
+	for (size_t i = 0; i < positions.size(); i++) {
+		if (!saveBlock(positions[i], data[i]))
+			success = false;
+	}
+	return success;
+}
+
+
+void Database::loadBlocks(const std::vector<v3s16> &positions,
+		std::vector<std::string> &data)
+{
+	data.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); i++)
+		data[i] = loadBlock(positions[i]);
+}
+
+
 s64 Database::getBlockAsInteger(const v3s16 &pos)
 {
 	return (u64) pos.Z * 0x1000000 +
@@ -41,6 +41,15 @@ class Database
 	virtual std::string loadBlock(const v3s16 &pos) = 0;
 	virtual bool deleteBlock(const v3s16 &pos) = 0;
 
+	// Bulk versions of saveBlock() and loadBlock(), positions[i] belongs
+	// to data[i]. Backends override these to do a single round trip.
+	// saveBlocks() returns false if any of the blocks failed to save.
+	// loadBlocks() sets data[i] to "" if block i is not in the database.
+	virtual bool saveBlocks(const std::vector<v3s16> &positions,
+			const std::vector<std::string> &data);
+	virtual void loadBlocks(const std::vector<v3s16> &positions,
+			std::vector<std::string> &data);
+
 	static s64 getBlockAsInteger(const v3s16 &pos);
 	static v3s16 getIntegerAsBlock(s64 i);
 
@@ -49,5 +58,24 @@ class Database
 	virtual bool initialized() const { return true; }
 };
 
+/*
+	Storage of the players of a world, keyed by player name.
+	The data is what Player::serialize() writes.
+*/
+class PlayerDatabase
+{
+public:
+	virtual ~PlayerDatabase() {}
+
+	virtual void beginSave() {}
+	virtual void endSave() {}
+
+	virtual bool savePlayer(const std::string &name, const std::string &data) = 0;
+	// Returns "" if there is no such player
+	virtual std::string loadPlayer(const std::string &name) = 0;
+	virtual bool removePlayer(const std::string &name) = 0;
+	virtual void listPlayers(std::vector<std::string> &dst) = 0;
+};
+
 #endif
 
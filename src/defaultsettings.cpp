@@ -179,6 +179,7 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("repeat_rightclick_time", "0.25");
 	settings->setDefault("enable_particles", "true");
 	settings->setDefault("enable_mesh_cache", "false");
+	settings->setDefault("mesh_generation_threads", "0");
 	settings->setDefault("enable_vbo", "true");
 
 	settings->setDefault("enable_minimap", "true");
@@ -278,6 +279,8 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("server_unload_unused_data_timeout", "29");
 	settings->setDefault("max_objects_per_block", "49");
 	settings->setDefault("server_map_save_interval", "5.3");
+	settings->setDefault("server_map_save_async", "true");
+	settings->setDefault("server_map_save_queue_limit", "1024");
 	settings->setDefault("sqlite_synchronous", "2");
 	settings->setDefault("full_block_send_enable_min_time_from_building", "2.0");
 	settings->setDefault("dedicated_server_step", "0.1");
@@ -291,6 +294,7 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("emergequeue_limit_diskonly", "32");
 	settings->setDefault("emergequeue_limit_generate", "32");
 	settings->setDefault("num_emerge_threads", "1");
+	settings->setDefault("num_emerge_load_threads", "1");
 	settings->setDefault("secure.enable_security", "false");
 	settings->setDefault("secure.trusted_mods", "");
 	settings->setDefault("secure.http_mods", "");
@@ -312,6 +316,8 @@ void set_default_settings(Settings *settings)
 	//liquid stuff
 	settings->setDefault("liquid_loop_max", "100000");
 	settings->setDefault("liquid_queue_purge_time", "0");
+	settings->setDefault("liquid_threads", "0");
+	settings->setDefault("async_threads", "0");
 	settings->setDefault("liquid_update", "1.0");
 
 	//mapgen stuff
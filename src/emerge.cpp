@@ -64,8 +64,9 @@ class EmergeThread : public Thread {
 public:
 	bool enable_mapgen_debug_info;
 	int id;
+	EmergePool pool;
 
-	EmergeThread(Server *server, int ethreadid);
+	EmergeThread(Server *server, int ethreadid, EmergePool pool);
 	~EmergeThread();
 
 	void *run();
@@ -91,6 +92,9 @@ class EmergeThread : public Thread {
 
 	bool popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata);
 
+	// Load pool
+	EmergeAction getBlock(v3s16 pos, MapBlock **block);
+	// Generate pool
 	EmergeAction getBlockOrStartGen(
 		v3s16 pos, bool allow_gen, MapBlock **block, BlockMakeData *data);
 	MapBlock *finishGen(v3s16 pos, BlockMakeData *bmdata,
@@ -141,6 +145,12 @@ EmergeManager::EmergeManager(IGameDef *gamedef)
 	if (nthreads < 1)
 		nthreads = 1;
 
+	s16 nloadthreads = 0;
+	if (!g_settings->getS16NoEx("num_emerge_load_threads", nloadthreads))
+		nloadthreads = 1;
+	if (nloadthreads < 1)
+		nloadthreads = 1;
+
 	m_qlimit_total = g_settings->getU16("emergequeue_limit_total");
 	if (!g_settings->getU16NoEx("emergequeue_limit_diskonly", m_qlimit_diskonly))
 		m_qlimit_diskonly = nthreads * 5 + 1;
@@ -155,27 +165,32 @@ EmergeManager::EmergeManager(IGameDef *gamedef)
 	if (m_qlimit_generate < 1)
 		m_qlimit_generate = 1;
 
+	for (s16 i = 0; i < nloadthreads; i++)
+		m_threads[EMERGE_POOL_LOAD].push_back(
+			new EmergeThread((Server *)gamedef, i, EMERGE_POOL_LOAD));
 	for (s16 i = 0; i < nthreads; i++)
-		m_threads.push_back(new EmergeThread((Server *)gamedef, i));
+		m_threads[EMERGE_POOL_GENERATE].push_back(
+			new EmergeThread((Server *)gamedef, i, EMERGE_POOL_GENERATE));
+
+	for (int p = 0; p < EMERGE_POOL_COUNT; p++)
+		m_pool_queue_size[p] = 0;
 
-	infostream << "EmergeManager: using " << nthreads << " threads" << std::endl;
+	infostream << "EmergeManager: using " << nloadthreads << " load threads and "
+		<< nthreads << " generate threads" << std::endl;
 }
 
 
 EmergeManager::~EmergeManager()
 {
-	for (u32 i = 0; i != m_threads.size(); i++) {
-		EmergeThread *thread = m_threads[i];
+	stopThreads();
 
-		if (m_threads_active) {
-			thread->stop();
-			thread->signal();
-			thread->wait();
-		}
+	for (int p = 0; p < EMERGE_POOL_COUNT; p++) {
+		for (u32 i = 0; i != m_threads[p].size(); i++)
+			delete m_threads[p][i];
+	}
 
-		delete thread;
+	for (u32 i = 0; i != m_mapgens.size(); i++)
 		delete m_mapgens[i];
-	}
 
 	delete biomemgr;
 	delete oremgr;
@@ -213,7 +228,9 @@ void EmergeManager::initMapgens()
 		params.sparams->readParams(g_settings);
 	}
 
-	for (u32 i = 0; i != m_threads.size(); i++) {
+	const std::vector<EmergeThread *> &generators =
+		m_threads[EMERGE_POOL_GENERATE];
+	for (u32 i = 0; i != generators.size(); i++) {
 		Mapgen *mg = mgfactory->createMapgen(i, &params, this);
 		m_mapgens.push_back(mg);
 	}
@@ -222,9 +239,11 @@ void EmergeManager::initMapgens()
 
 Mapgen *EmergeManager::getCurrentMapgen()
 {
-	for (u32 i = 0; i != m_threads.size(); i++) {
-		if (m_threads[i]->isCurrentThread())
-			return m_threads[i]->m_mapgen;
+	const std::vector<EmergeThread *> &generators =
+		m_threads[EMERGE_POOL_GENERATE];
+	for (u32 i = 0; i != generators.size(); i++) {
+		if (generators[i]->isCurrentThread())
+			return generators[i]->m_mapgen;
 	}
 
 	return NULL;
@@ -236,8 +255,10 @@ void EmergeManager::startThreads()
 	if (m_threads_active)
 		return;
 
-	for (u32 i = 0; i != m_threads.size(); i++)
-		m_threads[i]->start();
+	for (int p = 0; p < EMERGE_POOL_COUNT; p++) {
+		for (u32 i = 0; i != m_threads[p].size(); i++)
+			m_threads[p][i]->start();
+	}
 
 	m_threads_active = true;
 }
@@ -249,14 +270,18 @@ void EmergeManager::stopThreads()
 		return;
 
 	// Request thread stop in parallel
-	for (u32 i = 0; i != m_threads.size(); i++) {
-		m_threads[i]->stop();
-		m_threads[i]->signal();
+	for (int p = 0; p < EMERGE_POOL_COUNT; p++) {
+		for (u32 i = 0; i != m_threads[p].size(); i++) {
+			m_threads[p][i]->stop();
+			m_threads[p][i]->signal();
+		}
 	}
 
 	// Then do the waiting for each
-	for (u32 i = 0; i != m_threads.size(); i++)
-		m_threads[i]->wait();
+	for (int p = 0; p < EMERGE_POOL_COUNT; p++) {
+		for (u32 i = 0; i != m_threads[p].size(); i++)
+			m_threads[p][i]->wait();
+	}
 
 	m_threads_active = false;
 }
@@ -304,7 +329,8 @@ bool EmergeManager::enqueueBlockEmergeEx(
 		if (entry_already_exists)
 			return true;
 
-		thread = getOptimalThread();
+		// Everything is looked up by a loader first
+		thread = getOptimalThread(EMERGE_POOL_LOAD);
 		thread->pushBlock(blockpos);
 	}
 
@@ -401,16 +427,16 @@ bool EmergeManager::pushBlockEmergeData(
 	void *callback_param,
 	bool *entry_already_exists)
 {
-	u16 &count_peer = m_peer_queue_count[peer_requested];
+	// New entries go to the load pool. Generation is limited separately
+	// when a loader passes the block on, see pushBlockToGenerate().
+	u16 &count_peer = m_peer_queue_count[EMERGE_POOL_LOAD][peer_requested];
 
 	if ((flags & BLOCK_EMERGE_FORCE_QUEUE) == 0) {
-		if (m_blocks_enqueued.size() >= m_qlimit_total)
+		if (m_pool_queue_size[EMERGE_POOL_LOAD] >= m_qlimit_total)
 			return false;
 
 		if (peer_requested != PEER_ID_INEXISTENT) {
-			u16 qlimit_peer = (flags & BLOCK_EMERGE_ALLOW_GEN) ?
-				m_qlimit_generate : m_qlimit_diskonly;
-			if (count_peer >= qlimit_peer)
+			if (count_peer >= m_qlimit_diskonly)
 				return false;
 		}
 	}
@@ -429,14 +455,67 @@ bool EmergeManager::pushBlockEmergeData(
 	} else {
 		bedata.flags = flags;
 		bedata.peer_requested = peer_requested;
+		bedata.pool = EMERGE_POOL_LOAD;
+		bedata.time_queued = porting::getTimeMs();
 
 		count_peer++;
+		m_pool_queue_size[EMERGE_POOL_LOAD]++;
 	}
 
 	return true;
 }
 
 
+bool EmergeManager::pushBlockToGenerate(v3s16 pos,
+	const BlockEmergeData &bedata)
+{
+	EmergeThread *thread = NULL;
+
+	{
+		MutexAutoLock queuelock(m_queue_mutex);
+
+		u16 &count_peer =
+			m_peer_queue_count[EMERGE_POOL_GENERATE][bedata.peer_requested];
+
+		if ((bedata.flags & BLOCK_EMERGE_FORCE_QUEUE) == 0) {
+			if (m_pool_queue_size[EMERGE_POOL_GENERATE] >= m_qlimit_total)
+				return false;
+
+			if (bedata.peer_requested != PEER_ID_INEXISTENT &&
+					count_peer >= m_qlimit_generate)
+				return false;
+		}
+
+		std::pair<std::map<v3s16, BlockEmergeData>::iterator, bool> findres;
+		findres = m_blocks_enqueued.insert(std::make_pair(pos, bedata));
+
+		// The block was requested again in the meantime; whoever processes
+		// that request runs our callbacks too
+		if (!findres.second) {
+			BlockEmergeData &existing = findres.first->second;
+			existing.flags |= bedata.flags;
+			existing.callbacks.insert(existing.callbacks.end(),
+				bedata.callbacks.begin(), bedata.callbacks.end());
+			return true;
+		}
+
+		BlockEmergeData &newdata = findres.first->second;
+		newdata.pool = EMERGE_POOL_GENERATE;
+		newdata.time_queued = porting::getTimeMs();
+
+		count_peer++;
+		m_pool_queue_size[EMERGE_POOL_GENERATE]++;
+
+		thread = getOptimalThread(EMERGE_POOL_GENERATE);
+		thread->pushBlock(pos);
+	}
+
+	thread->signal();
+
+	return true;
+}
+
+
 bool EmergeManager::popBlockEmergeData(
 	v3s16 pos,
 	BlockEmergeData *bedata)
@@ -450,38 +529,43 @@ bool EmergeManager::popBlockEmergeData(
 
 	*bedata = it->second;
 
-	it2 = m_peer_queue_count.find(bedata->peer_requested);
-	if (it2 == m_peer_queue_count.end())
+	std::map<u16, u16> &peer_queue_count = m_peer_queue_count[bedata->pool];
+	it2 = peer_queue_count.find(bedata->peer_requested);
+	if (it2 == peer_queue_count.end())
 		return false;
 
 	u16 &count_peer = it2->second;
 	assert(count_peer != 0);
 	count_peer--;
 
+	assert(m_pool_queue_size[bedata->pool] != 0);
+	m_pool_queue_size[bedata->pool]--;
+
 	m_blocks_enqueued.erase(it);
 
 	return true;
 }
 
 
-EmergeThread *EmergeManager::getOptimalThread()
+EmergeThread *EmergeManager::getOptimalThread(EmergePool pool)
 {
-	size_t nthreads = m_threads.size();
+	const std::vector<EmergeThread *> &threads = m_threads[pool];
+	size_t nthreads = threads.size();
 
 	FATAL_ERROR_IF(nthreads == 0, "No emerge threads!");
 
 	size_t index = 0;
-	size_t nitems_lowest = m_threads[0]->m_block_queue.size();
+	size_t nitems_lowest = threads[0]->m_block_queue.size();
 
 	for (size_t i = 1; i < nthreads; i++) {
-		size_t nitems = m_threads[i]->m_block_queue.size();
+		size_t nitems = threads[i]->m_block_queue.size();
 		if (nitems < nitems_lowest) {
 			index = i;
 			nitems_lowest = nitems;
 		}
 	}
 
-	return m_threads[index];
+	return threads[index];
 }
 
 
@@ -489,15 +573,17 @@ EmergeThread *EmergeManager::getOptimalThread()
 //// EmergeThread
 ////
 
-EmergeThread::EmergeThread(Server *server, int ethreadid) :
+EmergeThread::EmergeThread(Server *server, int ethreadid, EmergePool epool) :
 	enable_mapgen_debug_info(false),
 	id(ethreadid),
+	pool(epool),
 	m_server(server),
 	m_map(NULL),
 	m_emerge(NULL),
 	m_mapgen(NULL)
 {
-	m_name = "Emerge-" + itos(ethreadid);
+	m_name = (epool == EMERGE_POOL_LOAD ? "EmergeLoad-" : "Emerge-")
+		+ itos(ethreadid);
 }
 
 
@@ -571,8 +657,7 @@ bool EmergeThread::popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata)
 }
 
 
-EmergeAction EmergeThread::getBlockOrStartGen(
-	v3s16 pos, bool allow_gen, MapBlock **block, BlockMakeData *bmdata)
+EmergeAction EmergeThread::getBlock(v3s16 pos, MapBlock **block)
 {
 	MutexAutoLock envlock(m_server->m_env_mutex);
 
@@ -586,7 +671,24 @@ EmergeAction EmergeThread::getBlockOrStartGen(
 	if (*block && (*block)->isGenerated())
 		return EMERGE_FROM_DISK;
 
-	// 3). Attempt to start generation
+	// Not generated yet
+	return EMERGE_CANCELLED;
+}
+
+
+EmergeAction EmergeThread::getBlockOrStartGen(
+	v3s16 pos, bool allow_gen, MapBlock **block, BlockMakeData *bmdata)
+{
+	MutexAutoLock envlock(m_server->m_env_mutex);
+
+	// 1). Attempt to fetch block from memory, it may have been generated
+	// along with another block since a loader looked for it.
+	// The disk has already been checked by the loader.
+	*block = m_map->getBlockNoCreateNoEx(pos);
+	if (*block && !(*block)->isDummy() && (*block)->isGenerated())
+		return EMERGE_FROM_MEMORY;
+
+	// 2). Attempt to start generation
 	if (allow_gen && m_map->initBlockMake(pos, bmdata))
 		return EMERGE_GENERATED;
 
@@ -655,9 +757,14 @@ void *EmergeThread::run()
 
 	m_map    = (ServerMap *)&(m_server->m_env->getMap());
 	m_emerge = m_server->m_emerge;
-	m_mapgen = m_emerge->m_mapgens[id];
+	if (pool == EMERGE_POOL_GENERATE)
+		m_mapgen = m_emerge->m_mapgens[id];
 	enable_mapgen_debug_info = m_emerge->enable_mapgen_debug_info;
 
+	const char *latency_name = (pool == EMERGE_POOL_LOAD) ?
+		"EmergeThread: load pool latency [ms]" :
+		"EmergeThread: generate pool latency [ms]";
+
 	try {
 	while (!stopRequested()) {
 		std::map<v3s16, MapBlock *> modified_blocks;
@@ -677,7 +784,19 @@ void *EmergeThread::run()
 		bool allow_gen = bedata.flags & BLOCK_EMERGE_ALLOW_GEN;
 		EMERGE_DBG_OUT("pos=" PP(pos) " allow_gen=" << allow_gen);
 
-		action = getBlockOrStartGen(pos, allow_gen, &block, &bmdata);
+		if (pool == EMERGE_POOL_LOAD) {
+			action = getBlock(pos, &block);
+			g_profiler->avg(latency_name,
+				porting::getTimeMs() - bedata.time_queued);
+
+			// Hand missing blocks to the generators
+			if (action == EMERGE_CANCELLED && allow_gen &&
+					m_emerge->pushBlockToGenerate(pos, bedata))
+				continue;
+		} else {
+			action = getBlockOrStartGen(pos, allow_gen, &block, &bmdata);
+		}
+
 		if (action == EMERGE_GENERATED) {
 			{
 				ScopeProfiler sp(g_profiler,
@@ -693,6 +812,10 @@ void *EmergeThread::run()
 			block = finishGen(pos, &bmdata, &modified_blocks);
 		}
 
+		if (pool == EMERGE_POOL_GENERATE)
+			g_profiler->avg(latency_name,
+				porting::getTimeMs() - bedata.time_queued);
+
 		runCompletionCallbacks(pos, action, bedata.callbacks);
 
 		if (block)
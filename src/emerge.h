@@ -82,10 +82,24 @@ typedef std::vector<
 	>
 > EmergeCallbackList;
 
+// Emerge threads are split into pools, so that loading blocks that already
+// exist never has to wait behind the generation of new ones
+enum EmergePool {
+	// Blocks are looked up in memory and on disk
+	EMERGE_POOL_LOAD,
+	// Blocks that were not found by a loader are generated
+	EMERGE_POOL_GENERATE,
+	EMERGE_POOL_COUNT
+};
+
 struct BlockEmergeData {
 	u16 peer_requested;
 	u16 flags;
 	EmergeCallbackList callbacks;
+	// Pool the block is queued in
+	EmergePool pool;
+	// When the block was queued in that pool, in ms
+	u64 time_queued;
 };
 
 class EmergeManager {
@@ -147,19 +161,22 @@ class EmergeManager {
 
 private:
 	std::vector<Mapgen *> m_mapgens;
-	std::vector<EmergeThread *> m_threads;
+	// Thread i of the generate pool uses m_mapgens[i]
+	std::vector<EmergeThread *> m_threads[EMERGE_POOL_COUNT];
 	bool m_threads_active;
 
 	Mutex m_queue_mutex;
 	std::map<v3s16, BlockEmergeData> m_blocks_enqueued;
-	std::map<u16, u16> m_peer_queue_count;
+	// Per pool
+	std::map<u16, u16> m_peer_queue_count[EMERGE_POOL_COUNT];
+	u32 m_pool_queue_size[EMERGE_POOL_COUNT];
 
 	u16 m_qlimit_total;
 	u16 m_qlimit_diskonly;
 	u16 m_qlimit_generate;
 
 	// Requires m_queue_mutex held
-	EmergeThread *getOptimalThread();
+	EmergeThread *getOptimalThread(EmergePool pool);
 
 	bool pushBlockEmergeData(
 		v3s16 pos,
@@ -171,6 +188,10 @@ class EmergeManager {
 
 	bool popBlockEmergeData(v3s16 pos, BlockEmergeData *bedata);
 
+	// Queues a block that a loader could not find for generation.
+	// Returns false if the generate pool is full.
+	bool pushBlockToGenerate(v3s16 pos, const BlockEmergeData &bedata);
+
 	friend class EmergeThread;
 
 	DISABLE_CLASS_COPY(EmergeManager);
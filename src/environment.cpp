@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include <fstream>
+#include <algorithm>
 #include "environment.h"
 #include "filesys.h"
 #include "porting.h"
@@ -43,6 +44,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "daynightratio.h"
 #include "map.h"
 #include "emerge.h"
+#include "config.h"
+#include "database-files.h"
+#include "database-sqlite3.h"
+#if USE_LEVELDB
+#include "database-leveldb.h"
+#endif
 #include "util/serialize.h"
 #include "threading/mutex_auto_lock.h"
 
@@ -510,69 +517,144 @@ void LBMManager::applyLBMs(ServerEnvironment *env, MapBlock *block, u32 stamp)
 	ActiveBlockList
 */
 
-void fillRadiusBlock(v3s16 p0, s16 r, std::set<v3s16> &list)
+void ActiveBlockList::addRef(v3s16 p, s32 delta)
+{
+	std::map<v3s16, u32>::iterator i = m_refs.find(p);
+	if (i == m_refs.end()) {
+		if (delta <= 0)
+			return;
+		m_refs[p] = delta;
+		m_changed.insert(p);
+		return;
+	}
+
+	if ((s32)i->second + delta > 0) {
+		i->second += delta;
+		return;
+	}
+	m_refs.erase(i);
+	m_changed.insert(p);
+}
+
+void ActiveBlockList::addRefs(v3s16 p0, s16 radius, const v3s16 *skip0,
+		s32 delta)
 {
 	v3s16 p;
-	for(p.X=p0.X-r; p.X<=p0.X+r; p.X++)
-	for(p.Y=p0.Y-r; p.Y<=p0.Y+r; p.Y++)
-	for(p.Z=p0.Z-r; p.Z<=p0.Z+r; p.Z++)
+	for(p.X=p0.X-radius; p.X<=p0.X+radius; p.X++)
+	for(p.Y=p0.Y-radius; p.Y<=p0.Y+radius; p.Y++)
+	for(p.Z=p0.Z-radius; p.Z<=p0.Z+radius; p.Z++)
 	{
-		// Set in list
-		list.insert(p);
+		// Blocks in both areas keep their count
+		if (skip0 && abs(p.X - skip0->X) <= radius &&
+				abs(p.Y - skip0->Y) <= radius &&
+				abs(p.Z - skip0->Z) <= radius)
+			continue;
+		addRef(p, delta);
 	}
 }
 
-void ActiveBlockList::update(std::vector<v3s16> &active_positions,
+void ActiveBlockList::update(const std::map<u16, v3s16> &active_positions,
 		s16 radius,
 		std::set<v3s16> &blocks_removed,
 		std::set<v3s16> &blocks_added)
 {
 	/*
-		Create the new list
+		Count everything again if the radius has changed
 	*/
-	std::set<v3s16> newlist = m_forceloaded_list;
-	for(std::vector<v3s16>::iterator i = active_positions.begin();
-			i != active_positions.end(); ++i)
-	{
-		fillRadiusBlock(*i, radius, newlist);
+	if (radius != m_radius) {
+		for (std::map<u16, v3s16>::iterator i = m_positions.begin();
+				i != m_positions.end(); ++i)
+			addRefs(i->second, m_radius, NULL, -1);
+		m_positions.clear();
+		m_radius = radius;
 	}
 
 	/*
-		Find out which blocks on the old list are not on the new list
+		Players that left or moved to another block
 	*/
-	// Go through old list
-	for(std::set<v3s16>::iterator i = m_list.begin();
-			i != m_list.end(); ++i)
-	{
-		v3s16 p = *i;
-		// If not on new list, it's been removed
-		if(newlist.find(p) == newlist.end())
-			blocks_removed.insert(p);
+	for (std::map<u16, v3s16>::iterator i = m_positions.begin();
+			i != m_positions.end(); ) {
+		std::map<u16, v3s16>::const_iterator n =
+			active_positions.find(i->first);
+		if (n == active_positions.end()) {
+			addRefs(i->second, radius, NULL, -1);
+			m_positions.erase(i++);
+			continue;
+		}
+		if (n->second != i->second) {
+			addRefs(n->second, radius, &i->second, 1);
+			addRefs(i->second, radius, &n->second, -1);
+			i->second = n->second;
+		}
+		++i;
 	}
 
 	/*
-		Find out which blocks on the new list are not on the old list
+		Players that joined
 	*/
-	// Go through new list
-	for(std::set<v3s16>::iterator i = newlist.begin();
-			i != newlist.end(); ++i)
-	{
-		v3s16 p = *i;
-		// If not on old list, it's been added
-		if(m_list.find(p) == m_list.end())
-			blocks_added.insert(p);
+	for (std::map<u16, v3s16>::const_iterator i = active_positions.begin();
+			i != active_positions.end(); ++i) {
+		if (m_positions.find(i->first) != m_positions.end())
+			continue;
+		addRefs(i->second, radius, NULL, 1);
+		m_positions[i->first] = i->second;
 	}
 
 	/*
-		Update m_list
+		Forceloaded blocks, changed directly by the scripting API
 	*/
-	m_list.clear();
-	for(std::set<v3s16>::iterator i = newlist.begin();
-			i != newlist.end(); ++i)
-	{
+	for (std::set<v3s16>::iterator i = m_forceloaded_counted.begin();
+			i != m_forceloaded_counted.end(); ) {
+		if (m_forceloaded_list.find(*i) != m_forceloaded_list.end()) {
+			++i;
+			continue;
+		}
+		addRef(*i, -1);
+		m_forceloaded_counted.erase(i++);
+	}
+	for (std::set<v3s16>::iterator i = m_forceloaded_list.begin();
+			i != m_forceloaded_list.end(); ++i) {
+		if (m_forceloaded_counted.insert(*i).second)
+			addRef(*i, 1);
+	}
+
+	/*
+		Only blocks whose count left or reached zero can have changed
+	*/
+	for (std::set<v3s16>::iterator i = m_changed.begin();
+			i != m_changed.end(); ++i) {
 		v3s16 p = *i;
-		m_list.insert(p);
+		bool wanted = m_refs.find(p) != m_refs.end();
+		if (wanted && m_list.insert(p).second)
+			blocks_added.insert(p);
+		else if (!wanted && m_list.erase(p))
+			blocks_removed.insert(p);
+	}
+	m_changed.clear();
+
+	for (std::set<v3s16>::iterator i = m_retry.begin();
+			i != m_retry.end(); ++i) {
+		v3s16 p = *i;
+		if (m_refs.find(p) != m_refs.end() && m_list.insert(p).second)
+			blocks_added.insert(p);
 	}
+	m_retry.clear();
+}
+
+void ActiveBlockList::retryLater(v3s16 p)
+{
+	m_list.erase(p);
+	m_retry.insert(p);
+}
+
+void ActiveBlockList::clear()
+{
+	m_list.clear();
+	m_refs.clear();
+	m_changed.clear();
+	m_retry.clear();
+	m_positions.clear();
+	m_forceloaded_counted.clear();
 }
 
 /*
@@ -586,6 +668,7 @@ ServerEnvironment::ServerEnvironment(ServerMap *map,
 	m_script(scriptIface),
 	m_gamedef(gamedef),
 	m_path_world(path_world),
+	m_player_database(NULL),
 	m_send_recommended_timer(0),
 	m_active_block_interval_overload_skip(0),
 	m_game_time(0),
@@ -594,6 +677,23 @@ ServerEnvironment::ServerEnvironment(ServerMap *map,
 	m_recommended_send_interval(0.1),
 	m_max_lag_estimate(0.1)
 {
+	// Determine which player database backend to use
+	std::string conf_path = path_world + DIR_DELIM + "world.mt";
+	Settings conf;
+	bool succeeded = conf.readConfigFile(conf_path.c_str());
+	if (!succeeded || !conf.exists("player_backend")) {
+		// Keep the players directory of old worlds
+		if (fs::PathExists(path_world + DIR_DELIM + "players"))
+			conf.set("player_backend", "files");
+		else
+			conf.set("player_backend", "sqlite3");
+
+		if (!conf.updateConfigFile(conf_path.c_str()))
+			errorstream << "ServerEnvironment::ServerEnvironment(): "
+				<< "Failed to update world.mt!" << std::endl;
+	}
+	m_player_database = createPlayerDatabase(conf.get("player_backend"),
+		path_world);
 }
 
 ServerEnvironment::~ServerEnvironment()
@@ -608,6 +708,8 @@ ServerEnvironment::~ServerEnvironment()
 	// Drop/delete map
 	m_map->drop();
 
+	delete m_player_database;
+
 	// Delete ActiveBlockModifiers
 	for(std::vector<ABMWithState>::iterator
 			i = m_abms.begin(); i != m_abms.end(); ++i){
@@ -664,65 +766,62 @@ void ServerEnvironment::kickAllPlayers(AccessDeniedCode reason,
 	}
 }
 
-void ServerEnvironment::saveLoadedPlayers()
+PlayerDatabase *ServerEnvironment::createPlayerDatabase(
+	const std::string &name, const std::string &savedir)
 {
-	std::string players_path = m_path_world + DIR_DELIM "players";
-	fs::CreateDir(players_path);
+	if (name == "sqlite3")
+		return new PlayerDatabase_SQLite3(savedir);
+	if (name == "files")
+		return new PlayerDatabase_Files(savedir);
+	#if USE_LEVELDB
+	else if (name == "leveldb")
+		return new PlayerDatabase_LevelDB(savedir);
+	#endif
+	else
+		throw BaseException(std::string("Player database backend ") + name
+			+ " not supported.");
+}
 
+void ServerEnvironment::saveLoadedPlayers()
+{
+	// Write all modified players in one go
+	m_player_database->beginSave();
 	for (std::vector<Player*>::iterator it = m_players.begin();
 			it != m_players.end();
 			++it) {
 		RemotePlayer *player = static_cast<RemotePlayer*>(*it);
-		if (player->checkModified()) {
-			player->save(players_path);
-		}
+		if (player->checkModified())
+			savePlayer(player);
 	}
+	m_player_database->endSave();
 }
 
 void ServerEnvironment::savePlayer(RemotePlayer *player)
 {
-	std::string players_path = m_path_world + DIR_DELIM "players";
-	fs::CreateDir(players_path);
-
-	player->save(players_path);
+	std::ostringstream ss(std::ios_base::binary);
+	player->serialize(ss);
+	if (m_player_database->savePlayer(player->getName(), ss.str()))
+		player->setModified(false);
 }
 
 Player *ServerEnvironment::loadPlayer(const std::string &playername)
 {
-	bool newplayer = false;
-	bool found = false;
-	std::string players_path = m_path_world + DIR_DELIM "players" DIR_DELIM;
-	std::string path = players_path + playername;
+	std::string data = m_player_database->loadPlayer(playername);
+	if (data.empty()) {
+		infostream << "Player data for player " << playername
+				<< " not found" << std::endl;
+		return NULL;
+	}
 
+	bool newplayer = false;
 	RemotePlayer *player = static_cast<RemotePlayer *>(getPlayer(playername.c_str()));
 	if (!player) {
 		player = new RemotePlayer(m_gamedef, "");
 		newplayer = true;
 	}
 
-	for (u32 i = 0; i < PLAYER_FILE_ALTERNATE_TRIES; i++) {
-		//// Open file and deserialize
-		std::ifstream is(path.c_str(), std::ios_base::binary);
-		if (!is.good())
-			continue;
-		player->deSerialize(is, path);
-		is.close();
-
-		if (player->getName() == playername) {
-			found = true;
-			break;
-		}
-
-		path = players_path + playername + itos(i);
-	}
-
-	if (!found) {
-		infostream << "Player file for player " << playername
-				<< " not found" << std::endl;
-		if (newplayer)
-			delete player;
-		return NULL;
-	}
+	std::istringstream is(data, std::ios_base::binary);
+	player->deSerialize(is, playername);
 
 	if (newplayer)
 		addPlayer(player);
@@ -813,86 +912,103 @@ void ServerEnvironment::loadDefaultMeta()
 	m_lbm_mgr.loadIntroductionTimes("", m_gamedef, m_game_time);
 }
 
-struct ActiveABM
+void ABMDispatchTable::compile(const std::vector<ABMWithState> &abms,
+		INodeDefManager *ndef)
 {
-	ActiveBlockModifier *abm;
-	int chance;
-	std::set<content_t> required_neighbors;
-};
+	m_triggers.clear();
+	m_neighbors.clear();
+	m_neighbors.resize(abms.size());
+
+	for (size_t abm_i = 0; abm_i < abms.size(); abm_i++) {
+		ActiveBlockModifier *abm = abms[abm_i].abm;
+
+		// Required neighbors
+		std::set<content_t> neighbor_ids;
+		std::set<std::string> required_neighbors_s
+				= abm->getRequiredNeighbors();
+		for (std::set<std::string>::iterator
+				i = required_neighbors_s.begin();
+				i != required_neighbors_s.end(); ++i)
+			ndef->getIds(*i, neighbor_ids);
+
+		if (!neighbor_ids.empty()) {
+			std::vector<bool> &neighbors = m_neighbors[abm_i];
+			// The set is ordered, so its last element is the largest id
+			neighbors.resize((size_t)*neighbor_ids.rbegin() + 1, false);
+			for (std::set<content_t>::const_iterator
+					k = neighbor_ids.begin(); k != neighbor_ids.end(); ++k)
+				neighbors[*k] = true;
+		}
+
+		// Trigger contents
+		std::set<content_t> trigger_ids;
+		std::set<std::string> contents_s = abm->getTriggerContents();
+		for (std::set<std::string>::iterator
+				i = contents_s.begin(); i != contents_s.end(); ++i)
+			ndef->getIds(*i, trigger_ids);
+
+		for (std::set<content_t>::const_iterator
+				k = trigger_ids.begin(); k != trigger_ids.end(); ++k) {
+			content_t c = *k;
+			if (c >= m_triggers.size())
+				m_triggers.resize((size_t)c + 1);
+			m_triggers[c].push_back(abm_i);
+		}
+	}
+
+	m_compiled = true;
+}
 
 class ABMHandler
 {
 private:
 	ServerEnvironment *m_env;
-	std::map<content_t, std::vector<ActiveABM> > m_aabms;
+	const ABMDispatchTable &m_table;
+	// Per ABM, the chance to use in this run; 0 if it does not run
+	std::vector<int> m_chances;
+	bool m_any_active;
 public:
 	ABMHandler(std::vector<ABMWithState> &abms,
+			const ABMDispatchTable &table,
 			float dtime_s, ServerEnvironment *env,
 			bool use_timers):
-		m_env(env)
+		m_env(env),
+		m_table(table),
+		m_chances(abms.size(), 0),
+		m_any_active(false)
 	{
 		if(dtime_s < 0.001)
 			return;
-		INodeDefManager *ndef = env->getGameDef()->ndef();
-		for(std::vector<ABMWithState>::iterator
-				i = abms.begin(); i != abms.end(); ++i) {
-			ActiveBlockModifier *abm = i->abm;
+		for (size_t abm_i = 0; abm_i < abms.size(); abm_i++) {
+			ABMWithState &state = abms[abm_i];
+			ActiveBlockModifier *abm = state.abm;
 			float trigger_interval = abm->getTriggerInterval();
 			if(trigger_interval < 0.001)
 				trigger_interval = 0.001;
 			float actual_interval = dtime_s;
 			if(use_timers){
-				i->timer += dtime_s;
-				if(i->timer < trigger_interval)
+				state.timer += dtime_s;
+				if(state.timer < trigger_interval)
 					continue;
-				i->timer -= trigger_interval;
+				state.timer -= trigger_interval;
 				actual_interval = trigger_interval;
 			}
 			float chance = abm->getTriggerChance();
 			if(chance == 0)
 				chance = 1;
-			ActiveABM aabm;
-			aabm.abm = abm;
+			int active_chance;
 			if(abm->getSimpleCatchUp()) {
 				float intervals = actual_interval / trigger_interval;
 				if(intervals == 0)
 					continue;
-				aabm.chance = chance / intervals;
-				if(aabm.chance == 0)
-					aabm.chance = 1;
+				active_chance = chance / intervals;
+				if(active_chance == 0)
+					active_chance = 1;
 			} else {
-				aabm.chance = chance;
-			}
-			// Trigger neighbors
-			std::set<std::string> required_neighbors_s
-					= abm->getRequiredNeighbors();
-			for(std::set<std::string>::iterator
-					i = required_neighbors_s.begin();
-					i != required_neighbors_s.end(); ++i)
-			{
-				ndef->getIds(*i, aabm.required_neighbors);
-			}
-			// Trigger contents
-			std::set<std::string> contents_s = abm->getTriggerContents();
-			for(std::set<std::string>::iterator
-					i = contents_s.begin(); i != contents_s.end(); ++i)
-			{
-				std::set<content_t> ids;
-				ndef->getIds(*i, ids);
-				for(std::set<content_t>::const_iterator k = ids.begin();
-						k != ids.end(); ++k)
-				{
-					content_t c = *k;
-					std::map<content_t, std::vector<ActiveABM> >::iterator j;
-					j = m_aabms.find(c);
-					if(j == m_aabms.end()){
-						std::vector<ActiveABM> aabmlist;
-						m_aabms[c] = aabmlist;
-						j = m_aabms.find(c);
-					}
-					j->second.push_back(aabm);
-				}
+				active_chance = chance;
 			}
+			m_chances[abm_i] = active_chance;
+			m_any_active = true;
 		}
 	}
 	// Find out how many objects the given block and its neighbours contain.
@@ -925,7 +1041,7 @@ class ABMHandler
 	}
 	void apply(MapBlock *block)
 	{
-		if(m_aabms.empty())
+		if(!m_any_active)
 			return;
 
 		ServerMap *map = &m_env->getServerMap();
@@ -941,20 +1057,28 @@ class ABMHandler
 		{
 			MapNode n = block->getNodeNoEx(p0);
 			content_t c = n.getContent();
-			v3s16 p = p0 + block->getPosRelative();
 
-			std::map<content_t, std::vector<ActiveABM> >::iterator j;
-			j = m_aabms.find(c);
-			if(j == m_aabms.end())
+			const std::vector<u16> *abm_indices = m_table.lookup(c);
+			if(abm_indices == NULL)
 				continue;
 
-			for(std::vector<ActiveABM>::iterator
-					i = j->second.begin(); i != j->second.end(); ++i) {
-				if(myrand() % i->chance != 0)
+			v3s16 p = p0 + block->getPosRelative();
+			// Neighbors of nodes not on the block border are in this block
+			bool inner = p0.X > 0 && p0.X < MAP_BLOCKSIZE - 1 &&
+					p0.Y > 0 && p0.Y < MAP_BLOCKSIZE - 1 &&
+					p0.Z > 0 && p0.Z < MAP_BLOCKSIZE - 1;
+
+			for(std::vector<u16>::const_iterator
+					i = abm_indices->begin(); i != abm_indices->end(); ++i) {
+				u16 abm_i = *i;
+				int chance = m_chances[abm_i];
+				if(chance == 0)
+					continue;
+				if(myrand() % chance != 0)
 					continue;
 
 				// Check neighbors
-				if(!i->required_neighbors.empty())
+				if(m_table.requiresNeighbors(abm_i))
 				{
 					v3s16 p1;
 					for(p1.X = p.X-1; p1.X <= p.X+1; p1.X++)
@@ -963,22 +1087,22 @@ class ABMHandler
 					{
 						if(p1 == p)
 							continue;
-						MapNode n = map->getNodeNoEx(p1);
-						content_t c = n.getContent();
-						std::set<content_t>::const_iterator k;
-						k = i->required_neighbors.find(c);
-						if(k != i->required_neighbors.end()){
+						content_t c = inner ?
+							block->getNodeNoEx(p1 - block->getPosRelative()).getContent() :
+							map->getNodeNoEx(p1).getContent();
+						if(m_table.isNeighbor(abm_i, c))
 							goto neighbor_found;
-						}
 					}
 					// No required neighbor found
 					continue;
 				}
 neighbor_found:
 
+				ActiveBlockModifier *abm = m_env->getABM(abm_i);
+
 				// Call all the trigger variations
-				i->abm->trigger(m_env, p, n);
-				i->abm->trigger(m_env, p, n,
+				abm->trigger(m_env, p, n);
+				abm->trigger(m_env, p, n,
 						active_object_count, active_object_count_wider);
 
 				// Count surrounding objects again if the abms added any
@@ -1030,28 +1154,35 @@ void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 	m_lbm_mgr.applyLBMs(this, block, stamp);
 
 	// Run node timers
-	std::map<v3s16, NodeTimer> elapsed_timers =
-		block->m_node_timers.step((float)dtime_s);
-	if(!elapsed_timers.empty()){
-		MapNode n;
-		for(std::map<v3s16, NodeTimer>::iterator
-				i = elapsed_timers.begin();
-				i != elapsed_timers.end(); ++i){
-			n = block->getNodeNoEx(i->first);
-			v3s16 p = i->first + block->getPosRelative();
-			if(m_script->node_on_timer(p,n,i->second.elapsed))
-				block->setNodeTimer(i->first,NodeTimer(i->second.timeout,0));
-		}
+	std::vector<std::pair<v3s16, NodeTimer> > elapsed_timers;
+	block->m_node_timers.step((float)dtime_s, elapsed_timers);
+	for (size_t i = 0; i < elapsed_timers.size(); i++) {
+		v3s16 p_rel = elapsed_timers[i].first;
+		const NodeTimer &t = elapsed_timers[i].second;
+		MapNode n = block->getNodeNoEx(p_rel);
+		v3s16 p = p_rel + block->getPosRelative();
+		if(m_script->node_on_timer(p,n,t.elapsed))
+			block->setNodeTimer(p_rel,NodeTimer(t.timeout,0));
 	}
 
 	/* Handle ActiveBlockModifiers */
-	ABMHandler abmhandler(m_abms, dtime_s, this, false);
+	ABMHandler abmhandler(m_abms, getABMTable(), dtime_s, this, false);
 	abmhandler.apply(block);
 }
 
 void ServerEnvironment::addActiveBlockModifier(ActiveBlockModifier *abm)
 {
 	m_abms.push_back(ABMWithState(abm));
+	m_abm_table.invalidate();
+}
+
+const ABMDispatchTable &ServerEnvironment::getABMTable()
+{
+	// Node definitions are final by the time ABMs are registered, so the
+	// table only has to be rebuilt when the ABM list changes
+	if (!m_abm_table.isCompiled())
+		m_abm_table.compile(m_abms, m_gamedef->ndef());
+	return m_abm_table;
 }
 
 void ServerEnvironment::addLoadingBlockModifierDef(LoadingBlockModifierDef *lbm)
@@ -1124,17 +1255,30 @@ bool ServerEnvironment::swapNode(v3s16 p, const MapNode &n)
 
 void ServerEnvironment::getObjectsInsideRadius(std::vector<u16> &objects, v3f pos, float radius)
 {
-	for(std::map<u16, ServerActiveObject*>::iterator
-			i = m_active_objects.begin();
-			i != m_active_objects.end(); ++i)
-	{
-		ServerActiveObject* obj = i->second;
-		u16 id = i->first;
-		v3f objectpos = obj->getBasePosition();
-		if(objectpos.getDistanceFrom(pos) > radius)
-			continue;
-		objects.push_back(id);
-	}
+	std::vector<ServerActiveObject *> found;
+	m_active_object_grid.getObjectsInsideRadius(found, pos, radius);
+
+	size_t start = objects.size();
+	for (size_t i = 0; i < found.size(); i++)
+		objects.push_back(found[i]->getId());
+	// Keep the id order callers got when this walked m_active_objects
+	std::sort(objects.begin() + start, objects.end());
+}
+
+void ServerEnvironment::getObjectsInArea(std::vector<u16> &objects, const aabb3f &box)
+{
+	std::vector<ServerActiveObject *> found;
+	m_active_object_grid.getObjectsInArea(found, box);
+
+	size_t start = objects.size();
+	for (size_t i = 0; i < found.size(); i++)
+		objects.push_back(found[i]->getId());
+	std::sort(objects.begin() + start, objects.end());
+}
+
+void ServerEnvironment::updateActiveObjectPosition(ServerActiveObject *obj)
+{
+	m_active_object_grid.update(obj);
 }
 
 void ServerEnvironment::clearObjects(ClearObjectsMode mode)
@@ -1170,6 +1314,7 @@ void ServerEnvironment::clearObjects(ClearObjectsMode mode)
 		obj->removingFromEnvironment();
 		// Deregister in scripting api
 		m_script->removeObjectReference(obj);
+		m_active_object_grid.remove(obj);
 
 		// Delete active object
 		if (obj->environmentDeletes())
@@ -1333,7 +1478,7 @@ void ServerEnvironment::step(float dtime)
 		/*
 			Get player block positions
 		*/
-		std::vector<v3s16> players_blockpos;
+		std::map<u16, v3s16> players_blockpos;
 		for(std::vector<Player*>::iterator
 				i = m_players.begin();
 				i != m_players.end(); ++i) {
@@ -1344,7 +1489,7 @@ void ServerEnvironment::step(float dtime)
 
 			v3s16 blockpos = getNodeBlockPos(
 					floatToInt(player->getPosition(), BS));
-			players_blockpos.push_back(blockpos);
+			players_blockpos[player->peer_id] = blockpos;
 		}
 
 		/*
@@ -1391,7 +1536,7 @@ void ServerEnvironment::step(float dtime)
 
 			MapBlock *block = m_map->getBlockOrEmerge(p);
 			if(block==NULL){
-				m_active_blocks.m_list.erase(p);
+				m_active_blocks.retryLater(p);
 				continue;
 			}
 
@@ -1408,6 +1553,7 @@ void ServerEnvironment::step(float dtime)
 		ScopeProfiler sp(g_profiler, "SEnv: mess in act. blocks avg per interval", SPT_AVG);
 
 		float dtime = m_cache_nodetimer_interval;
+		std::vector<std::pair<v3s16, NodeTimer> > elapsed_timers;
 
 		for(std::set<v3s16>::iterator
 				i = m_active_blocks.m_list.begin();
@@ -1433,19 +1579,16 @@ void ServerEnvironment::step(float dtime)
 				block->raiseModified(MOD_STATE_WRITE_AT_UNLOAD,
 					MOD_REASON_BLOCK_EXPIRED);
 
-			// Run node timers
-			std::map<v3s16, NodeTimer> elapsed_timers =
-				block->m_node_timers.step((float)dtime);
-			if(!elapsed_timers.empty()){
-				MapNode n;
-				for(std::map<v3s16, NodeTimer>::iterator
-						i = elapsed_timers.begin();
-						i != elapsed_timers.end(); ++i){
-					n = block->getNodeNoEx(i->first);
-					p = i->first + block->getPosRelative();
-					if(m_script->node_on_timer(p,n,i->second.elapsed))
-						block->setNodeTimer(i->first,NodeTimer(i->second.timeout,0));
-				}
+			// Run node timers, only the elapsed ones are touched
+			elapsed_timers.clear();
+			block->m_node_timers.step((float)dtime, elapsed_timers);
+			for (size_t j = 0; j < elapsed_timers.size(); j++) {
+				v3s16 p_rel = elapsed_timers[j].first;
+				const NodeTimer &t = elapsed_timers[j].second;
+				MapNode n = block->getNodeNoEx(p_rel);
+				p = p_rel + block->getPosRelative();
+				if(m_script->node_on_timer(p,n,t.elapsed))
+					block->setNodeTimer(p_rel,NodeTimer(t.timeout,0));
 			}
 		}
 	}
@@ -1461,7 +1604,8 @@ void ServerEnvironment::step(float dtime)
 		TimeTaker timer("modify in active blocks per interval");
 
 		// Initialize handling of ActiveBlockModifiers
-		ABMHandler abmhandler(m_abms, m_cache_abm_interval, this, true);
+		ABMHandler abmhandler(m_abms, getABMTable(), m_cache_abm_interval,
+				this, true);
 
 		for(std::set<v3s16>::iterator
 				i = m_active_blocks.m_list.begin();
@@ -1651,27 +1795,48 @@ void ServerEnvironment::getAddedActiveObjects(Player *player, s16 radius,
 		player_radius_f = 0;
 
 	/*
-		Go through the object list,
+		Collect the candidates: non-player objects come from the grid, while
+		players are taken from the (short) player list since their radius
+		may be unlimited.
+	*/
+	v3f player_pos = player->getPosition();
+	std::vector<ServerActiveObject *> candidates;
+	m_active_object_grid.getObjectsInsideRadius(candidates,
+			player_pos, radius_f);
+	size_t grid_count = candidates.size();
+
+	for (std::vector<Player *>::iterator i = m_players.begin();
+			i != m_players.end(); ++i) {
+		ServerActiveObject *sao = (*i)->getPlayerSAO();
+		if (sao)
+			candidates.push_back(sao);
+	}
+
+	/*
+		Go through the candidates,
 		- discard m_removed objects,
 		- discard objects that are too far away,
 		- discard objects that are found in current_objects.
-		- add remaining objects to added_objects
+		- add remaining objects to added_objects, in id order
 	*/
-	for(std::map<u16, ServerActiveObject*>::iterator
-			i = m_active_objects.begin();
-			i != m_active_objects.end(); ++i) {
-		u16 id = i->first;
+	std::vector<u16> added;
+	for (size_t i = 0; i < candidates.size(); i++) {
+		ServerActiveObject *object = candidates[i];
 
-		// Get object
-		ServerActiveObject *object = i->second;
-		if(object == NULL)
+		// Players are taken from the player list only
+		if (i < grid_count && object->getType() == ACTIVEOBJECT_TYPE_PLAYER)
+			continue;
+
+		u16 id = object->getId();
+		// Player objects may not be (or no longer be) in the environment
+		if (i >= grid_count && getActiveObject(id) != object)
 			continue;
 
 		// Discard if removed or deactivating
 		if(object->m_removed || object->m_pending_deactivation)
 			continue;
 
-		f32 distance_f = object->getBasePosition().getDistanceFrom(player->getPosition());
+		f32 distance_f = object->getBasePosition().getDistanceFrom(player_pos);
 		if (object->getType() == ACTIVEOBJECT_TYPE_PLAYER) {
 			// Discard if too far
 			if (distance_f > player_radius_f && player_radius_f != 0)
@@ -1684,9 +1849,14 @@ void ServerEnvironment::getAddedActiveObjects(Player *player, s16 radius,
 		n = current_objects.find(id);
 		if(n != current_objects.end())
 			continue;
-		// Add to added_objects
-		added_objects.push(id);
+		added.push_back(id);
 	}
+
+	// Keep the id order clients got when this walked m_active_objects,
+	// the grid returns objects in cell order
+	std::sort(added.begin(), added.end());
+	for (size_t i = 0; i < added.size(); i++)
+		added_objects.push(added[i]);
 }
 
 /*
@@ -1827,6 +1997,7 @@ u16 ServerEnvironment::addActiveObjectRaw(ServerActiveObject *object,
 			<<"added (id="<<object->getId()<<")"<<std::endl;*/
 
 	m_active_objects[object->getId()] = object;
+	m_active_object_grid.insert(object);
 
 	verbosestream<<"ServerEnvironment::addActiveObjectRaw(): "
 			<<"Added id="<<object->getId()<<"; there are now "
@@ -1941,6 +2112,7 @@ void ServerEnvironment::removeRemovedObjects()
 		obj->removingFromEnvironment();
 		// Deregister in scripting api
 		m_script->removeObjectReference(obj);
+		m_active_object_grid.remove(obj);
 
 		// Delete
 		if(obj->environmentDeletes())
@@ -2302,6 +2474,7 @@ void ServerEnvironment::deactivateFarObjects(bool force_delete)
 		obj->removingFromEnvironment();
 		// Deregister in scripting api
 		m_script->removeObjectReference(obj);
+		m_active_object_grid.remove(obj);
 
 		// Delete active object
 		if(obj->environmentDeletes())
@@ -36,6 +36,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <map>
 #include "irr_v3d.h"
 #include "activeobject.h"
+#include "activeobjectgrid.h"
 #include "util/numeric.h"
 #include "mapnode.h"
 #include "mapblock.h"
@@ -44,10 +45,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "network/networkprotocol.h" // for AccessDeniedCode
 
 class ServerEnvironment;
+class PlayerDatabase;
 class ActiveBlockModifier;
 class ServerActiveObject;
 class ITextureSource;
 class IGameDef;
+class INodeDefManager;
 class Map;
 class ServerMap;
 class ClientMap;
@@ -185,6 +188,48 @@ struct ABMWithState
 	ABMWithState(ActiveBlockModifier *abm_);
 };
 
+/*
+	The trigger and neighbor contents of a list of ABMs, resolved against
+	the node definitions once instead of every time ABMs are run.
+*/
+class ABMDispatchTable
+{
+public:
+	ABMDispatchTable():
+		m_compiled(false)
+	{}
+
+	void compile(const std::vector<ABMWithState> &abms, INodeDefManager *ndef);
+	// Has to be compiled again before the next use
+	void invalidate() { m_compiled = false; }
+	bool isCompiled() const { return m_compiled; }
+
+	// Indices of the ABMs triggering on content c, or NULL if none does
+	const std::vector<u16> *lookup(content_t c) const
+	{
+		if (c >= m_triggers.size() || m_triggers[c].empty())
+			return NULL;
+		return &m_triggers[c];
+	}
+
+	bool requiresNeighbors(u16 abm_index) const
+	{ return !m_neighbors[abm_index].empty(); }
+
+	bool isNeighbor(u16 abm_index, content_t c) const
+	{
+		const std::vector<bool> &neighbors = m_neighbors[abm_index];
+		return c < neighbors.size() && neighbors[c];
+	}
+
+private:
+	bool m_compiled;
+	// Indexed by content_t; ABM indices triggering on that content
+	std::vector<std::vector<u16> > m_triggers;
+	// Per ABM, bitset indexed by content_t of the required neighbors.
+	// Empty if the ABM does not require any.
+	std::vector<std::vector<bool> > m_neighbors;
+};
+
 struct LoadingBlockModifierDef
 {
 	// Set of contents to trigger on
@@ -260,10 +305,24 @@ class LBMManager
 	List of active blocks, used by ServerEnvironment
 */
 
+/*
+	The blocks around the players and the forceloaded blocks.
+
+	Every block has a count of the players near it and of being
+	forceloaded. update() only changes the counts of blocks that players
+	moved away from or towards, so a block becomes active or inactive
+	when its count leaves or reaches zero.
+*/
+
 class ActiveBlockList
 {
 public:
-	void update(std::vector<v3s16> &active_positions,
+	ActiveBlockList():
+		m_radius(-1)
+	{}
+
+	// active_positions holds the block position of each player, by peer id
+	void update(const std::map<u16, v3s16> &active_positions,
 			s16 radius,
 			std::set<v3s16> &blocks_removed,
 			std::set<v3s16> &blocks_added);
@@ -272,14 +331,31 @@ class ActiveBlockList
 		return (m_list.find(p) != m_list.end());
 	}
 
-	void clear(){
-		m_list.clear();
-	}
+	// Drops a block that could not be activated, the next update
+	// reports it as added again
+	void retryLater(v3s16 p);
+
+	void clear();
 
 	std::set<v3s16> m_list;
 	std::set<v3s16> m_forceloaded_list;
 
 private:
+	// Adds delta to the counts of the blocks within radius of p0 that
+	// are not within radius of skip0 (if not NULL)
+	void addRefs(v3s16 p0, s16 radius, const v3s16 *skip0, s32 delta);
+	void addRef(v3s16 p, s32 delta);
+
+	// TODO make this std::unordered_map
+	std::map<v3s16, u32> m_refs;
+	// Blocks whose count left or reached zero since the last update
+	std::set<v3s16> m_changed;
+	// Blocks to report as added again
+	std::set<v3s16> m_retry;
+	// Player positions and forceloaded blocks the counts include
+	std::map<u16, v3s16> m_positions;
+	std::set<v3s16> m_forceloaded_counted;
+	s16 m_radius;
 };
 
 /*
@@ -328,6 +404,9 @@ class ServerEnvironment : public Environment
 	void savePlayer(RemotePlayer *player);
 	Player *loadPlayer(const std::string &playername);
 
+	static PlayerDatabase *createPlayerDatabase(const std::string &name,
+		const std::string &savedir);
+
 	/*
 		Save and load time of day and game timer
 	*/
@@ -402,6 +481,7 @@ class ServerEnvironment : public Environment
 	*/
 
 	void addActiveBlockModifier(ActiveBlockModifier *abm);
+	ActiveBlockModifier *getABM(u16 index) { return m_abms[index].abm; }
 	void addLoadingBlockModifierDef(LoadingBlockModifierDef *lbm);
 
 	/*
@@ -417,6 +497,12 @@ class ServerEnvironment : public Environment
 	// Find all active objects inside a radius around a point
 	void getObjectsInsideRadius(std::vector<u16> &objects, v3f pos, float radius);
 
+	// Find all active objects whose position lies inside a box
+	void getObjectsInArea(std::vector<u16> &objects, const aabb3f &box);
+
+	// Called by ServerActiveObject when its base position changed
+	void updateActiveObjectPosition(ServerActiveObject *obj);
+
 	// Clear objects, loading and going through every MapBlock
 	void clearObjects(ClearObjectsMode mode);
 
@@ -478,6 +564,9 @@ class ServerEnvironment : public Environment
 	*/
 	void deactivateFarObjects(bool force_delete);
 
+	// Returns m_abm_table, compiling it first if needed
+	const ABMDispatchTable &getABMTable();
+
 	/*
 		Member variables
 	*/
@@ -490,8 +579,12 @@ class ServerEnvironment : public Environment
 	IGameDef *m_gamedef;
 	// World path
 	const std::string m_path_world;
+	// Player storage, chosen by player_backend in world.mt
+	PlayerDatabase *m_player_database;
 	// Active object list
 	std::map<u16, ServerActiveObject*> m_active_objects;
+	// Spatial index over m_active_objects
+	ActiveObjectGrid m_active_object_grid;
 	// Outgoing network message buffer for active objects
 	std::queue<ActiveObjectMessage> m_active_object_messages;
 	// Some timers
@@ -513,6 +606,8 @@ class ServerEnvironment : public Environment
 	u32 m_last_clear_objects_time;
 	// Active block modifiers
 	std::vector<ABMWithState> m_abms;
+	// m_abms resolved to content ids, see ABMDispatchTable
+	ABMDispatchTable m_abm_table;
 	LBMManager m_lbm_mgr;
 	// An interval for generally sending object positions and stuff
 	float m_recommended_send_interval;
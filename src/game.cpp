@@ -1712,6 +1712,11 @@ class Game {
 	f32  m_cache_mouse_sensitivity;
 	f32  m_repeat_right_click_time;
 
+	// Read in every frame
+	SettingHandle<float> m_sound_volume;
+	SettingHandle<float> m_fps_max;
+	SettingHandle<float> m_pause_fps_max;
+
 #ifdef __ANDROID__
 	bool m_cache_hold_aux1;
 	bool m_android_chat_open;
@@ -1739,7 +1744,10 @@ Game::Game() :
 	sky(NULL),
 	local_inventory(NULL),
 	hud(NULL),
-	mapper(NULL)
+	mapper(NULL),
+	m_sound_volume("sound_volume"),
+	m_fps_max("fps_max"),
+	m_pause_fps_max("pause_fps_max")
 {
 	g_settings->registerChangedCallback("doubletap_jump",
 		&settingChangedCallback, this);
@@ -3545,7 +3553,7 @@ void Game::updateSound(f32 dtime)
 			      v3f(0, 0, 0), // velocity
 			      camera->getDirection(),
 			      camera->getCameraNode()->getUpVector());
-	sound->setListenerGain(g_settings->getFloat("sound_volume"));
+	sound->setListenerGain(m_sound_volume.get());
 
 
 	//	Update sound maker
@@ -4403,8 +4411,8 @@ inline void Game::limitFps(FpsControl *fps_timings, f32 *dtime)
 		fps_timings->busy_time = 0;
 
 	u32 frametime_min = 1000 / (g_menumgr.pausesGame()
-			? g_settings->getFloat("pause_fps_max")
-			: g_settings->getFloat("fps_max"));
+			? m_pause_fps_max.get()
+			: m_fps_max.get());
 
 	if (fps_timings->busy_time < frametime_min) {
 		fps_timings->sleep_time = frametime_min - fps_timings->busy_time;
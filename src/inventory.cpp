@@ -995,6 +995,135 @@ void Inventory::deSerialize(std::istream &is)
 	}
 }
 
+enum InventoryDeltaType
+{
+	INVENTORY_DELTA_SLOTS,
+	INVENTORY_DELTA_LIST,
+	INVENTORY_DELTA_REMOVED
+};
+
+static bool items_equal(const ItemStack &a, const ItemStack &b)
+{
+	if (a.empty() || b.empty())
+		return a.empty() == b.empty();
+	return a.name == b.name && a.count == b.count && a.wear == b.wear &&
+		a.metadata == b.metadata;
+}
+
+// Item metadata can make the string longer than 65535 bytes
+static void serialize_delta_item(std::ostream &os, const ItemStack &item)
+{
+	os << serializeLongString(item.empty() ? "" : item.getItemString());
+}
+
+bool Inventory::serializeDelta(std::ostream &os, Inventory &old) const
+{
+	std::ostringstream lists_os(std::ios_base::binary);
+	u16 list_count = 0;
+	bool lists_changed = false;
+
+	for (u32 i = 0; i < old.m_lists.size(); i++) {
+		const std::string &name = old.m_lists[i]->getName();
+		if (getListIndex(name) != -1)
+			continue;
+		lists_os << serializeString(name);
+		writeU8(lists_os, INVENTORY_DELTA_REMOVED);
+		list_count++;
+		lists_changed = true;
+	}
+
+	for (u32 i = 0; i < m_lists.size(); i++) {
+		const InventoryList *list = m_lists[i];
+		InventoryList *old_list = old.getList(list->getName());
+
+		// New or resized lists are sent whole
+		if (!old_list || old_list->getSize() != list->getSize() ||
+				old_list->getWidth() != list->getWidth()) {
+			lists_os << serializeString(list->getName());
+			writeU8(lists_os, INVENTORY_DELTA_LIST);
+			writeU32(lists_os, list->getSize());
+			writeU32(lists_os, list->getWidth());
+			for (u32 j = 0; j < list->getSize(); j++)
+				serialize_delta_item(lists_os, list->getItem(j));
+			list_count++;
+			lists_changed = true;
+			continue;
+		}
+
+		std::ostringstream slots_os(std::ios_base::binary);
+		u32 slot_count = 0;
+		for (u32 j = 0; j < list->getSize(); j++) {
+			const ItemStack &item = list->getItem(j);
+			if (items_equal(item, old_list->getItem(j)))
+				continue;
+			writeU32(slots_os, j);
+			serialize_delta_item(slots_os, item);
+			old_list->changeItem(j, item);
+			slot_count++;
+		}
+		if (slot_count == 0)
+			continue;
+
+		lists_os << serializeString(list->getName());
+		writeU8(lists_os, INVENTORY_DELTA_SLOTS);
+		writeU32(lists_os, slot_count);
+		lists_os << slots_os.str();
+		list_count++;
+	}
+
+	writeU16(os, list_count);
+	os << lists_os.str();
+
+	if (lists_changed)
+		old = *this;
+	return list_count != 0;
+}
+
+void Inventory::deSerializeDelta(std::istream &is)
+{
+	m_dirty = true;
+
+	u16 list_count = readU16(is);
+	for (u16 i = 0; i < list_count; i++) {
+		std::string name = deSerializeString(is);
+		u8 type = readU8(is);
+
+		if (type == INVENTORY_DELTA_REMOVED) {
+			deleteList(name);
+			continue;
+		}
+
+		InventoryList *list;
+		u32 slot_count;
+		if (type == INVENTORY_DELTA_LIST) {
+			u32 size = readU32(is);
+			list = addList(name, size);
+			if (!list)
+				throw SerializationError("invalid inventory list: " + name);
+			list->setWidth(readU32(is));
+			slot_count = size;
+		} else if (type == INVENTORY_DELTA_SLOTS) {
+			list = getList(name);
+			if (!list)
+				throw SerializationError("unknown inventory list: " + name);
+			slot_count = readU32(is);
+		} else {
+			throw SerializationError("invalid inventory delta type");
+		}
+
+		for (u32 j = 0; j < slot_count; j++) {
+			u32 index = type == INVENTORY_DELTA_LIST ? j : readU32(is);
+			if (index >= list->getSize())
+				throw SerializationError("inventory slot out of range");
+			ItemStack item;
+			std::string itemstring = deSerializeLongString(is);
+			if (!itemstring.empty())
+				item.deSerialize(itemstring, m_itemdef);
+			list->changeItem(index, item);
+		}
+	}
+}
+
 InventoryList * Inventory::addList(const std::string &name, u32 size)
 {
 	m_dirty = true;
@@ -279,6 +279,16 @@ class Inventory
 	void serialize(std::ostream &os) const;
 	void deSerialize(std::istream &is);
 
+	/*
+		Binary difference to an older state of this inventory, containing
+		only the changed slots (see TOCLIENT_INVENTORY_DELTA).
+		old is updated to match this inventory.
+		Returns false if nothing changed.
+	*/
+	bool serializeDelta(std::ostream &os, Inventory &old) const;
+	// Applies a difference written by serializeDelta
+	void deSerializeDelta(std::istream &is);
+
 	InventoryList * addList(const std::string &name, u32 size);
 	InventoryList * getList(const std::string &name);
 	const InventoryList * getList(const std::string &name) const;
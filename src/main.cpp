@@ -46,6 +46,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "guiEngine.h"
 #include "map.h"
 #include "player.h"
+#include "environment.h"
 #include "mapsector.h"
 #include "fontengine.h"
 #include "gameparams.h"
@@ -112,6 +113,7 @@ static bool determine_subgame(GameParams *game_params);
 
 static bool run_dedicated_server(const GameParams &game_params, const Settings &cmd_args);
 static bool migrate_database(const GameParams &game_params, const Settings &cmd_args);
+static bool migrate_players(const GameParams &game_params, const Settings &cmd_args);
 
 /**********************************************************************/
 
@@ -295,6 +297,8 @@ static void set_allowed_options(OptionList *allowed_options)
 			_("Set gameid (\"--gameid list\" prints available ones)"))));
 	allowed_options->insert(std::make_pair("migrate", ValueSpec(VALUETYPE_STRING,
 			_("Migrate from current map backend to another (Only works when using minetestserver or with --server)"))));
+	allowed_options->insert(std::make_pair("migrate-players", ValueSpec(VALUETYPE_STRING,
+			_("Migrate from current players backend to another (Only works when using minetestserver or with --server)"))));
 	allowed_options->insert(std::make_pair("terminal", ValueSpec(VALUETYPE_FLAG,
 			_("Feature an interactive terminal (Only works when using minetestserver or with --server)"))));
 #ifndef SERVER
@@ -830,6 +834,8 @@ static bool run_dedicated_server(const GameParams &game_params, const Settings &
 	// Database migration
 	if (cmd_args.exists("migrate"))
 		return migrate_database(game_params, cmd_args);
+	if (cmd_args.exists("migrate-players"))
+		return migrate_players(game_params, cmd_args);
 
 	if (cmd_args.exists("terminal")) {
 #if USE_CURSES
@@ -925,7 +931,7 @@ static bool migrate_database(const GameParams &game_params, const Settings &cmd_
 	if (!world_mt.exists("backend")) {
 		errorstream << "Please specify your current backend in world.mt:"
 			<< std::endl
-			<< "	backend = {sqlite3|leveldb|redis|dummy}"
+			<< "	backend = {sqlite3|leveldb|redis|region|dummy}"
 			<< std::endl;
 		return false;
 	}
@@ -945,16 +951,31 @@ static bool migrate_database(const GameParams &game_params, const Settings &cmd_
 	std::vector<v3s16> blocks;
 	old_db->listAllLoadableBlocks(blocks);
 	new_db->beginSave();
-	for (std::vector<v3s16>::const_iterator it = blocks.begin(); it != blocks.end(); ++it) {
+	// Copy in batches, so that backends can do bulk loads and saves
+	const size_t batch_size = 0xFF;
+	for (size_t start = 0; start < blocks.size(); start += batch_size) {
 		if (kill) return false;
 
-		const std::string &data = old_db->loadBlock(*it);
-		if (!data.empty()) {
-			new_db->saveBlock(*it, data);
-		} else {
-			errorstream << "Failed to load block " << PP(*it) << ", skipping it." << std::endl;
+		std::vector<v3s16> batch(blocks.begin() + start,
+			blocks.begin() + MYMIN(start + batch_size, blocks.size()));
+		std::vector<std::string> data;
+		old_db->loadBlocks(batch, data);
+
+		std::vector<v3s16> positions;
+		std::vector<std::string> found;
+		for (size_t i = 0; i < batch.size(); i++) {
+			if (!data[i].empty()) {
+				positions.push_back(batch[i]);
+				found.push_back("");
+				found.back().swap(data[i]);
+			} else {
+				errorstream << "Failed to load block " << PP(batch[i]) << ", skipping it." << std::endl;
+			}
 		}
-		if (++count % 0xFF == 0 && time(NULL) - last_update_time >= 1) {
+		new_db->saveBlocks(positions, found);
+		count += positions.size();
+
+		if (time(NULL) - last_update_time >= 1) {
 			std::cerr << " Migrated " << count << " blocks, "
 				<< (100.0 * count / blocks.size()) << "% completed.\r";
 			new_db->endSave();
@@ -977,3 +998,66 @@ static bool migrate_database(const GameParams &game_params, const Settings &cmd_
 	return true;
 }
 
+static bool migrate_players(const GameParams &game_params, const Settings &cmd_args)
+{
+	std::string migrate_to = cmd_args.get("migrate-players");
+	Settings world_mt;
+	std::string world_mt_path = game_params.world_path + DIR_DELIM + "world.mt";
+	if (!world_mt.readConfigFile(world_mt_path.c_str())) {
+		errorstream << "Cannot read world.mt!" << std::endl;
+		return false;
+	}
+	// Worlds from before player_backend existed keep their players in files
+	std::string backend = world_mt.exists("player_backend") ?
+		world_mt.get("player_backend") : "files";
+	if (backend == migrate_to) {
+		errorstream << "Cannot migrate: new backend is same"
+			<< " as the old one" << std::endl;
+		return false;
+	}
+	PlayerDatabase *old_db = ServerEnvironment::createPlayerDatabase(backend,
+			game_params.world_path),
+		*new_db = ServerEnvironment::createPlayerDatabase(migrate_to,
+			game_params.world_path);
+
+	u32 count = 0;
+	time_t last_update_time = 0;
+	bool &kill = *porting::signal_handler_killstatus();
+
+	std::vector<std::string> players;
+	old_db->listPlayers(players);
+	new_db->beginSave();
+	for (size_t i = 0; i < players.size(); i++) {
+		if (kill) return false;
+
+		std::string data = old_db->loadPlayer(players[i]);
+		if (data.empty()) {
+			errorstream << "Failed to load player " << players[i]
+				<< ", skipping it." << std::endl;
+			continue;
+		}
+		new_db->savePlayer(players[i], data);
+		count++;
+
+		if (time(NULL) - last_update_time >= 1) {
+			std::cerr << " Migrated " << count << " players, "
+				<< (100.0 * count / players.size()) << "% completed.\r";
+			new_db->endSave();
+			new_db->beginSave();
+			last_update_time = time(NULL);
+		}
+	}
+	std::cerr << std::endl;
+	new_db->endSave();
+	delete old_db;
+	delete new_db;
+
+	actionstream << "Successfully migrated " << count << " players" << std::endl;
+	world_mt.set("player_backend", migrate_to);
+	if (!world_mt.updateConfigFile(world_mt_path.c_str()))
+		errorstream << "Failed to update world.mt!" << std::endl;
+	else
+		actionstream << "world.mt updated" << std::endl;
+
+	return true;
+}
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapblock.h"
 #include "filesys.h"
 #include "voxel.h"
+#include "voxelalgorithms.h"
 #include "porting.h"
 #include "serialization.h"
 #include "nodemetadata.h"
@@ -41,7 +42,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server.h"
 #include "database.h"
 #include "database-dummy.h"
+#include "database-region.h"
 #include "database-sqlite3.h"
+#include "threading/thread.h"
+#include "threading/semaphore.h"
+#include "threading/event.h"
+#include "threading/mutex_auto_lock.h"
+#include "util/thread.h"
+#include "util/string.h"
+#include <algorithm>
 #include <deque>
 #include <queue>
 #if USE_LEVELDB
@@ -65,12 +74,20 @@ Map::Map(std::ostream &dout, IGameDef *gamedef):
 	m_transforming_liquid_loop_count_multiplier(1.0f),
 	m_unprocessed_count(0),
 	m_inc_trending_up_start_time(0),
-	m_queue_size_timer_started(false)
+	m_queue_size_timer_started(false),
+	m_liquid_workers(NULL),
+	m_liquid_loop_max("liquid_loop_max"),
+	m_liquid_queue_purge_time("liquid_queue_purge_time")
 {
 }
 
+// Defined with the LiquidWorkerPool class below
+static void delete_liquid_workers(LiquidWorkerPool *pool);
+
 Map::~Map()
 {
+	delete_liquid_workers(m_liquid_workers);
+
 	/*
 		Free all MapSectors
 	*/
@@ -138,12 +155,7 @@ MapSector * Map::getSectorNoGenerate(v2s16 p)
 
 MapBlock * Map::getBlockNoCreateNoEx(v3s16 p3d)
 {
-	v2s16 p2d(p3d.X, p3d.Z);
-	MapSector * sector = getSectorNoGenerateNoEx(p2d);
-	if(sector == NULL)
-		return NULL;
-	MapBlock *block = sector->getBlockNoCreateNoEx(p3d.Y);
-	return block;
+	return m_block_index.get(p3d);
 }
 
 MapBlock * Map::getBlockNoCreate(v3s16 p3d)
@@ -667,6 +679,89 @@ s16 Map::propagateSunlight(v3s16 start,
 	return y + 1;
 }
 
+/*
+	Light never travels further than a MapBlock, so the light around some
+	cleared blocks can be redone in a VoxelManipulator that holds them and
+	the blocks around them. Blocks close to each other share one, as long
+	as it doesn't get too big.
+*/
+#define LIGHTING_GROUP_MAX_BLOCKS 6
+
+void Map::relightBlockGroups(enum LightBank bank,
+		const std::vector<v3s16> &blocks,
+		std::map<v3s16, u8> &unlight_from,
+		std::set<v3s16> &light_sources,
+		std::map<v3s16, MapBlock*> &modified_blocks)
+{
+	INodeDefManager *nodemgr = m_gamedef->ndef();
+
+	// In blocks, without the border
+	std::vector<VoxelArea> groups;
+	for (size_t i = 0; i < blocks.size(); i++) {
+		size_t g = 0;
+		for (; g < groups.size(); g++) {
+			VoxelArea joined = groups[g];
+			joined.addPoint(blocks[i]);
+			v3s16 extent = joined.getExtent();
+			if (extent.X <= LIGHTING_GROUP_MAX_BLOCKS &&
+					extent.Y <= LIGHTING_GROUP_MAX_BLOCKS &&
+					extent.Z <= LIGHTING_GROUP_MAX_BLOCKS) {
+				groups[g] = joined;
+				break;
+			}
+		}
+		if (g == groups.size())
+			groups.push_back(VoxelArea(blocks[i], blocks[i]));
+	}
+
+	for (size_t g = 0; g < groups.size(); g++) {
+		const VoxelArea &group = groups[g];
+
+		MMVManip vmanip(this);
+		vmanip.initialEmerge(group.MinEdge - v3s16(1,1,1),
+			group.MaxEdge + v3s16(1,1,1), false);
+
+		voxalgo::LightSpreader spreader(vmanip, nodemgr);
+		for (std::map<v3s16, u8>::iterator it = unlight_from.begin();
+				it != unlight_from.end(); ++it) {
+			if (group.contains(getNodeBlockPos(it->first)))
+				spreader.addUnlightFrom(bank, it->first, it->second);
+		}
+		for (std::set<v3s16>::iterator it = light_sources.begin();
+				it != light_sources.end(); ++it) {
+			if (group.contains(getNodeBlockPos(*it)))
+				spreader.addLightSource(bank, *it);
+		}
+
+		spreader.unspreadLight(bank);
+		spreader.spreadLight(bank);
+
+		// Only write back the blocks whose light changed
+		std::set<v3s16> changed_blocks;
+		const std::vector<v3s16> &changed = spreader.getChangedNodes();
+		v3s16 blockpos_last;
+		for (size_t i = 0; i < changed.size(); i++) {
+			v3s16 blockpos = getNodeBlockPos(changed[i]);
+			if (i != 0 && blockpos == blockpos_last)
+				continue;
+			changed_blocks.insert(blockpos);
+			blockpos_last = blockpos;
+		}
+
+		for (std::set<v3s16>::iterator it = changed_blocks.begin();
+				it != changed_blocks.end(); ++it) {
+			MapBlock *block = getBlockNoCreateNoEx(*it);
+			if (block == NULL || block->isDummy())
+				continue;
+			block->copyFrom(vmanip);
+			// Includes neighbours of the cleared blocks, which the callers
+			// don't know about
+			block->raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_RELIGHT);
+			modified_blocks[*it] = block;
+		}
+	}
+}
+
 void Map::updateLighting(enum LightBank bank,
 		std::map<v3s16, MapBlock*> & a_blocks,
 		std::map<v3s16, MapBlock*> & modified_blocks)
@@ -688,6 +783,8 @@ void Map::updateLighting(enum LightBank bank,
 
 	std::map<v3s16, u8> unlight_from;
 
+	std::vector<v3s16> cleared_blocks;
+
 	int num_bottom_invalid = 0;
 
 	{
@@ -707,6 +804,7 @@ void Map::updateLighting(enum LightBank bank,
 			v3s16 pos = block->getPos();
 			v3s16 posnodes = block->getPosRelative();
 			modified_blocks[pos] = block;
+			cleared_blocks.push_back(pos);
 			//blocks_to_update[pos] = block;
 
 			/*
@@ -809,32 +907,12 @@ void Map::updateLighting(enum LightBank bank,
 	}
 #endif
 
-#if 1
 	{
-		//TimeTaker timer("unspreadLight");
-		unspreadLight(bank, unlight_from, light_sources, modified_blocks);
+		//TimeTaker timer("relightBlockGroups");
+		relightBlockGroups(bank, cleared_blocks, unlight_from, light_sources,
+			modified_blocks);
 	}
 
-	/*if(debug)
-	{
-		u32 diff = modified_blocks.size() - count_was;
-		count_was = modified_blocks.size();
-		infostream<<"unspreadLight modified "<<diff<<std::endl;
-	}*/
-
-	{
-		//TimeTaker timer("spreadLight");
-		spreadLight(bank, light_sources, modified_blocks);
-	}
-
-	/*if(debug)
-	{
-		u32 diff = modified_blocks.size() - count_was;
-		count_was = modified_blocks.size();
-		infostream<<"spreadLight modified "<<diff<<std::endl;
-	}*/
-#endif
-
 #if 0
 	{
 		//MapVoxelManipulator vmanip(this);
@@ -1401,11 +1479,9 @@ bool Map::getDayNightDiff(v3s16 blockpos)
 }
 
 struct TimeOrderedMapBlock {
-	MapSector *sect;
 	MapBlock *block;
 
-	TimeOrderedMapBlock(MapSector *sect, MapBlock *block) :
-		sect(sect),
+	TimeOrderedMapBlock(MapBlock *block) :
 		block(block)
 	{}
 
@@ -1433,69 +1509,49 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 
 	beginSave();
 
+	MapBlockVect blocks;
+	m_block_index.getBlocks(blocks);
+
 	// If there is no practical limit, we spare creation of mapblock_queue
 	if (max_loaded_blocks == U32_MAX) {
-		for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
-				si != m_sectors.end(); ++si) {
-			MapSector *sector = si->second;
-
-			bool all_blocks_deleted = true;
-
-			MapBlockVect blocks;
-			sector->getBlocks(blocks);
-
-			for (MapBlockVect::iterator i = blocks.begin();
-					i != blocks.end(); ++i) {
-				MapBlock *block = (*i);
-
-				block->incrementUsageTimer(dtime);
+		for (MapBlockVect::iterator i = blocks.begin();
+				i != blocks.end(); ++i) {
+			MapBlock *block = (*i);
 
-				if (block->refGet() == 0
-						&& block->getUsageTimer() > unload_timeout) {
-					v3s16 p = block->getPos();
+			block->incrementUsageTimer(dtime);
 
-					// Save if modified
-					if (block->getModified() != MOD_STATE_CLEAN
-							&& save_before_unloading) {
-						modprofiler.add(block->getModifiedReasonString(), 1);
-						if (!saveBlock(block))
-							continue;
-						saved_blocks_count++;
-					}
+			if (block->refGet() == 0
+					&& block->getUsageTimer() > unload_timeout) {
+				v3s16 p = block->getPos();
 
-					// Delete from memory
-					sector->deleteBlock(block);
+				// Save if modified
+				if (block->getModified() != MOD_STATE_CLEAN
+						&& save_before_unloading) {
+					modprofiler.add(block->getModifiedReasonString(), 1);
+					if (!saveBlock(block))
+						continue;
+					saved_blocks_count++;
+				}
 
-					if (unloaded_blocks)
-						unloaded_blocks->push_back(p);
+				// Delete from memory
+				getSectorNoGenerateNoEx(v2s16(p.X, p.Z))->deleteBlock(block);
 
-					deleted_blocks_count++;
-				} else {
-					all_blocks_deleted = false;
-					block_count_all++;
-				}
-			}
+				if (unloaded_blocks)
+					unloaded_blocks->push_back(p);
 
-			if (all_blocks_deleted) {
-				sector_deletion_queue.push_back(si->first);
+				deleted_blocks_count++;
+			} else {
+				block_count_all++;
 			}
 		}
 	} else {
 		std::priority_queue<TimeOrderedMapBlock> mapblock_queue;
-		for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
-				si != m_sectors.end(); ++si) {
-			MapSector *sector = si->second;
-
-			MapBlockVect blocks;
-			sector->getBlocks(blocks);
-
-			for(MapBlockVect::iterator i = blocks.begin();
-					i != blocks.end(); ++i) {
-				MapBlock *block = (*i);
+		for (MapBlockVect::iterator i = blocks.begin();
+				i != blocks.end(); ++i) {
+			MapBlock *block = (*i);
 
-				block->incrementUsageTimer(dtime);
-				mapblock_queue.push(TimeOrderedMapBlock(sector, block));
-			}
+			block->incrementUsageTimer(dtime);
+			mapblock_queue.push(TimeOrderedMapBlock(block));
 		}
 		block_count_all = mapblock_queue.size();
 		// Delete old blocks, and blocks over the limit from the memory
@@ -1520,7 +1576,7 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 			}
 
 			// Delete from memory
-			b.sect->deleteBlock(block);
+			getSectorNoGenerateNoEx(v2s16(p.X, p.Z))->deleteBlock(block);
 
 			if (unloaded_blocks)
 				unloaded_blocks->push_back(p);
@@ -1528,16 +1584,17 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 			deleted_blocks_count++;
 			block_count_all--;
 		}
-		// Delete empty sectors
-		for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
-			si != m_sectors.end(); ++si) {
-			if (si->second->empty()) {
-				sector_deletion_queue.push_back(si->first);
-			}
-		}
 	}
 	endSave();
 
+	// Delete empty sectors
+	for (std::map<v2s16, MapSector*>::iterator si = m_sectors.begin();
+		si != m_sectors.end(); ++si) {
+		if (si->second->empty()) {
+			sector_deletion_queue.push_back(si->first);
+		}
+	}
+
 	// Finally delete the empty sectors
 	deleteSectors(sector_deletion_queue);
 
@@ -1614,6 +1671,408 @@ s32 Map::transforming_liquid_size() {
         return m_transforming_liquid.size();
 }
 
+/*
+	LiquidUpdate
+
+	What one queued liquid node turns into. Decided by the liquid workers
+	from the map as it was at the start of the step, so that the decisions
+	don't depend on each other; applied by the server thread afterwards.
+*/
+struct LiquidUpdate {
+	v3s16 p;
+	MapNode n_old;
+	MapNode n_new;
+	bool changed;
+	// Viscosity has held the level back, check again next step
+	bool reflow;
+	// Neighbors to queue, in the order the old loop queued them
+	v3s16 queue[12];
+	u8 num_queue;
+};
+
+static void decide_liquid_update(Map *map, INodeDefManager *nodemgr,
+	LiquidUpdate &u)
+{
+	const v3s16 p0 = u.p;
+	MapNode n0 = map->getNodeNoEx(p0);
+	u.n_old = n0;
+	u.changed = false;
+	u.reflow = false;
+	u.num_queue = 0;
+
+	/*
+		Collect information about current node
+	 */
+	s8 liquid_level = -1;
+	content_t liquid_kind = CONTENT_IGNORE;
+	content_t floodable_node = CONTENT_AIR;
+	const ContentFeatures &cf = nodemgr->get(n0);
+	LiquidType liquid_type = cf.liquid_type;
+	switch (liquid_type) {
+		case LIQUID_SOURCE:
+			liquid_level = LIQUID_LEVEL_SOURCE;
+			liquid_kind = nodemgr->getId(cf.liquid_alternative_flowing);
+			break;
+		case LIQUID_FLOWING:
+			liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
+			liquid_kind = n0.getContent();
+			break;
+		case LIQUID_NONE:
+			// if this node is 'floodable', it *could* be transformed
+			// into a liquid, otherwise, continue with the next node.
+			if (!cf.floodable)
+				return;
+			floodable_node = n0.getContent();
+			liquid_kind = CONTENT_AIR;
+			break;
+	}
+
+	/*
+		Collect information about the environment
+	 */
+	const v3s16 *dirs = g_6dirs;
+	NodeNeighbor sources[6]; // surrounding sources
+	int num_sources = 0;
+	NodeNeighbor flows[6]; // surrounding flowing liquid nodes
+	int num_flows = 0;
+	NodeNeighbor airs[6]; // surrounding air
+	int num_airs = 0;
+	NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
+	int num_neutrals = 0;
+	bool flowing_down = false;
+	for (u16 i = 0; i < 6; i++) {
+		NeighborType nt = NEIGHBOR_SAME_LEVEL;
+		switch (i) {
+			case 1:
+				nt = NEIGHBOR_UPPER;
+				break;
+			case 4:
+				nt = NEIGHBOR_LOWER;
+				break;
+		}
+		v3s16 npos = p0 + dirs[i];
+		NodeNeighbor nb(map->getNodeNoEx(npos), nt, npos);
+		const ContentFeatures &cfnb = nodemgr->get(nb.n);
+		switch (nodemgr->get(nb.n.getContent()).liquid_type) {
+			case LIQUID_NONE:
+				if (cfnb.floodable) {
+					airs[num_airs++] = nb;
+					// if the current node is a water source the neighbor
+					// should be enqueded for transformation regardless of whether the
+					// current node changes or not.
+					if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
+						u.queue[u.num_queue++] = npos;
+					// if the current node happens to be a flowing node, it will start to flow down here.
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				} else {
+					neutrals[num_neutrals++] = nb;
+					// If neutral below is ignore prevent water spreading outwards
+					if (nb.t == NEIGHBOR_LOWER &&
+							nb.n.getContent() == CONTENT_IGNORE)
+						flowing_down = true;
+				}
+				break;
+			case LIQUID_SOURCE:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = nodemgr->getId(cfnb.liquid_alternative_flowing);
+				if (nodemgr->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					// Do not count bottom source, it will screw things up
+					if(dirs[i].Y != -1)
+						sources[num_sources++] = nb;
+				}
+				break;
+			case LIQUID_FLOWING:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = nodemgr->getId(cfnb.liquid_alternative_flowing);
+				if (nodemgr->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					flows[num_flows++] = nb;
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				}
+				break;
+		}
+	}
+
+	/*
+		decide on the type (and possibly level) of the current node
+	 */
+	content_t new_node_content;
+	s8 new_node_level = -1;
+	s8 max_node_level = -1;
+
+	u8 range = nodemgr->get(liquid_kind).liquid_range;
+	if (range > LIQUID_LEVEL_MAX + 1)
+		range = LIQUID_LEVEL_MAX + 1;
+
+	if ((num_sources >= 2 && nodemgr->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
+		// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
+		// or the flowing alternative of the first of the surrounding sources (if it's air), so
+		// it's perfectly safe to use liquid_kind here to determine the new node content.
+		new_node_content = nodemgr->getId(nodemgr->get(liquid_kind).liquid_alternative_source);
+	} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
+		// liquid_kind is set properly, see above
+		max_node_level = new_node_level = LIQUID_LEVEL_MAX;
+		if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+	} else {
+		// no surrounding sources, so get the maximum level that can flow into this node
+		for (u16 i = 0; i < num_flows; i++) {
+			u8 nb_liquid_level = (flows[i].n.param2 & LIQUID_LEVEL_MASK);
+			switch (flows[i].t) {
+				case NEIGHBOR_UPPER:
+					if (nb_liquid_level + WATER_DROP_BOOST > max_node_level) {
+						max_node_level = LIQUID_LEVEL_MAX;
+						if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
+							max_node_level = nb_liquid_level + WATER_DROP_BOOST;
+					} else if (nb_liquid_level > max_node_level) {
+						max_node_level = nb_liquid_level;
+					}
+					break;
+				case NEIGHBOR_LOWER:
+					break;
+				case NEIGHBOR_SAME_LEVEL:
+					if ((flows[i].n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
+							nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
+						max_node_level = nb_liquid_level - 1;
+					break;
+			}
+		}
+
+		u8 viscosity = nodemgr->get(liquid_kind).liquid_viscosity;
+		if (viscosity > 1 && max_node_level != liquid_level) {
+			// amount to gain, limited by viscosity
+			// must be at least 1 in absolute value
+			s8 level_inc = max_node_level - liquid_level;
+			if (level_inc < -viscosity || level_inc > viscosity)
+				new_node_level = liquid_level + level_inc/viscosity;
+			else if (level_inc < 0)
+				new_node_level = liquid_level - 1;
+			else if (level_inc > 0)
+				new_node_level = liquid_level + 1;
+			if (new_node_level != max_node_level)
+				u.reflow = true;
+		} else {
+			new_node_level = max_node_level;
+		}
+
+		if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+
+	}
+
+	/*
+		check if anything has changed. if not, just continue with the next node.
+	 */
+	if (new_node_content == n0.getContent() &&
+			(nodemgr->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
+			((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
+			((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
+			== flowing_down)))
+		return;
+
+
+	/*
+		update the current node
+	 */
+	//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
+	if (nodemgr->get(new_node_content).liquid_type == LIQUID_FLOWING) {
+		// set level to last 3 bits, flowing down bit to 4th bit
+		n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
+	} else {
+		// set the liquid level and flow bit to 0
+		n0.param2 = ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
+	}
+	n0.setContent(new_node_content);
+	u.n_new = n0;
+	u.changed = true;
+
+	/*
+		enqueue neighbors for update if neccessary
+	 */
+	switch (nodemgr->get(n0.getContent()).liquid_type) {
+		case LIQUID_SOURCE:
+		case LIQUID_FLOWING:
+			// make sure source flows into all neighboring nodes
+			for (u16 i = 0; i < num_flows; i++)
+				if (flows[i].t != NEIGHBOR_UPPER)
+					u.queue[u.num_queue++] = flows[i].p;
+			for (u16 i = 0; i < num_airs; i++)
+				if (airs[i].t != NEIGHBOR_UPPER)
+					u.queue[u.num_queue++] = airs[i].p;
+			break;
+		case LIQUID_NONE:
+			// this flow has turned to air; neighboring flows might need to do the same
+			for (u16 i = 0; i < num_flows; i++)
+				u.queue[u.num_queue++] = flows[i].p;
+			break;
+	}
+}
+
+/*
+	LiquidWorkerPool
+
+	Decides the liquid updates of one step in parallel. The updates are
+	sorted by MapBlock and each MapBlock is a region handed out to one
+	thread as a whole. The threads only read from the map, while the
+	server thread waits with the environment locked.
+*/
+
+class LiquidWorkerPool;
+
+class LiquidWorkerThread : public Thread
+{
+public:
+	LiquidWorkerThread(LiquidWorkerPool *pool, u32 id):
+		Thread("Liquid #" + itos(id)),
+		m_pool(pool)
+	{}
+
+	void *run();
+
+	// Posted once per step
+	Semaphore m_start;
+
+private:
+	LiquidWorkerPool *m_pool;
+};
+
+class LiquidWorkerPool
+{
+public:
+	// Starts num_threads - 1 threads, the caller of run() is the last one
+	LiquidWorkerPool(Map *map, INodeDefManager *nodemgr, u32 num_threads);
+	~LiquidWorkerPool();
+
+	/*
+		Fills in updates. Region i is the range
+		[region_starts[i], region_starts[i + 1]) of the updates.
+	*/
+	void run(std::vector<LiquidUpdate> &updates,
+		const std::vector<u32> &region_starts);
+
+	u32 getThreadCount() const { return m_threads.size() + 1; }
+
+private:
+	friend class LiquidWorkerThread;
+
+	// Takes regions until none are left
+	void processRegions();
+
+	Map *m_map;
+	INodeDefManager *m_nodemgr;
+	std::vector<LiquidWorkerThread *> m_threads;
+
+	std::vector<LiquidUpdate> *m_updates;
+	const std::vector<u32> *m_region_starts;
+	Mutex m_next_region_mutex;
+	u32 m_next_region;
+	// Posted by every thread once it has run out of regions
+	Semaphore m_done;
+};
+
+void *LiquidWorkerThread::run()
+{
+	DSTACK(FUNCTION_NAME);
+	BEGIN_DEBUG_EXCEPTION_HANDLER
+
+	while (!stopRequested()) {
+		if (!m_start.wait(100))
+			continue;
+		m_pool->processRegions();
+		m_pool->m_done.post();
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER
+	return NULL;
+}
+
+LiquidWorkerPool::LiquidWorkerPool(Map *map, INodeDefManager *nodemgr,
+	u32 num_threads):
+	m_map(map),
+	m_nodemgr(nodemgr),
+	m_updates(NULL),
+	m_region_starts(NULL),
+	m_next_region(0)
+{
+	for (u32 i = 1; i < num_threads; i++) {
+		LiquidWorkerThread *thread = new LiquidWorkerThread(this, i);
+		thread->start();
+		m_threads.push_back(thread);
+	}
+}
+
+LiquidWorkerPool::~LiquidWorkerPool()
+{
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i]->stop();
+	for (size_t i = 0; i < m_threads.size(); i++) {
+		m_threads[i]->wait();
+		delete m_threads[i];
+	}
+}
+
+void LiquidWorkerPool::run(std::vector<LiquidUpdate> &updates,
+	const std::vector<u32> &region_starts)
+{
+	m_updates = &updates;
+	m_region_starts = &region_starts;
+	m_next_region = 0;
+
+	// Waking the threads costs more than a single region takes
+	u32 num_regions = region_starts.size() - 1;
+	u32 num_helpers = MYMIN(m_threads.size(), num_regions - 1);
+
+	for (u32 i = 0; i < num_helpers; i++)
+		m_threads[i]->m_start.post();
+	processRegions();
+	for (u32 i = 0; i < num_helpers; i++)
+		m_done.wait();
+
+	m_updates = NULL;
+	m_region_starts = NULL;
+}
+
+void LiquidWorkerPool::processRegions()
+{
+	u32 num_regions = m_region_starts->size() - 1;
+	for (;;) {
+		u32 region;
+		{
+			MutexAutoLock lock(m_next_region_mutex);
+			if (m_next_region >= num_regions)
+				return;
+			region = m_next_region++;
+		}
+		// Each update is written by exactly one thread
+		for (u32 i = (*m_region_starts)[region];
+				i < (*m_region_starts)[region + 1]; i++)
+			decide_liquid_update(m_map, m_nodemgr, (*m_updates)[i]);
+	}
+}
+
+static void delete_liquid_workers(LiquidWorkerPool *pool)
+{
+	delete pool;
+}
+
+struct LiquidUpdateRegionOrder {
+	bool operator() (const LiquidUpdate &a, const LiquidUpdate &b) const
+	{
+		return getNodeBlockPos(a.p) < getNodeBlockPos(b.p);
+	}
+};
+
 void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks)
 {
 
@@ -1622,19 +2081,15 @@ void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks)
 	DSTACK(FUNCTION_NAME);
 	//TimeTaker timer("transformLiquids()");
 
-	u32 loopcount = 0;
 	u32 initial_size = m_transforming_liquid.size();
 
 	/*if(initial_size != 0)
 		infostream<<"transformLiquids(): initial_size="<<initial_size<<std::endl;*/
 
-	// list of nodes that due to viscosity have not reached their max level height
-	std::deque<v3s16> must_reflow;
-
 	// List of MapBlocks that will require a lighting update (due to lava)
 	std::map<v3s16, MapBlock *> lighting_modified_blocks;
 
-	u32 liquid_loop_max = g_settings->getS32("liquid_loop_max");
+	u32 liquid_loop_max = m_liquid_loop_max.get();
 	u32 loop_max = liquid_loop_max;
 
 #if 0
@@ -1654,274 +2109,99 @@ void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks)
 	loop_max *= m_transforming_liquid_loop_count_multiplier;
 #endif
 
-	while (m_transforming_liquid.size() != 0)
-	{
-		// This should be done here so that it is done when continue is used
-		if (loopcount >= initial_size || loopcount >= loop_max)
-			break;
-		loopcount++;
-
-		/*
-			Get a queued transforming liquid node
-		*/
-		v3s16 p0 = m_transforming_liquid.front();
+	/*
+		Take the nodes of this step off the queue. Nodes queued while
+		applying the updates are left for the next step.
+	*/
+	std::vector<LiquidUpdate> updates(MYMIN(initial_size, loop_max));
+	for (size_t i = 0; i < updates.size(); i++) {
+		updates[i].p = m_transforming_liquid.front();
 		m_transforming_liquid.pop_front();
+	}
 
-		MapNode n0 = getNodeNoEx(p0);
-
-		/*
-			Collect information about current node
-		 */
-		s8 liquid_level = -1;
-		content_t liquid_kind = CONTENT_IGNORE;
-		content_t floodable_node = CONTENT_AIR;
-		const ContentFeatures &cf = nodemgr->get(n0);
-		LiquidType liquid_type = cf.liquid_type;
-		switch (liquid_type) {
-			case LIQUID_SOURCE:
-				liquid_level = LIQUID_LEVEL_SOURCE;
-				liquid_kind = nodemgr->getId(cf.liquid_alternative_flowing);
-				break;
-			case LIQUID_FLOWING:
-				liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
-				liquid_kind = n0.getContent();
-				break;
-			case LIQUID_NONE:
-				// if this node is 'floodable', it *could* be transformed
-				// into a liquid, otherwise, continue with the next node.
-				if (!cf.floodable)
-					continue;
-				floodable_node = n0.getContent();
-				liquid_kind = CONTENT_AIR;
-				break;
+	if (!updates.empty()) {
+		// Group by MapBlock, keeping the queue order within each block
+		std::stable_sort(updates.begin(), updates.end(),
+			LiquidUpdateRegionOrder());
+		std::vector<u32> region_starts;
+		for (u32 i = 0; i < updates.size(); i++) {
+			if (i == 0 || getNodeBlockPos(updates[i].p) !=
+					getNodeBlockPos(updates[i - 1].p))
+				region_starts.push_back(i);
 		}
-
-		/*
-			Collect information about the environment
-		 */
-		const v3s16 *dirs = g_6dirs;
-		NodeNeighbor sources[6]; // surrounding sources
-		int num_sources = 0;
-		NodeNeighbor flows[6]; // surrounding flowing liquid nodes
-		int num_flows = 0;
-		NodeNeighbor airs[6]; // surrounding air
-		int num_airs = 0;
-		NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
-		int num_neutrals = 0;
-		bool flowing_down = false;
-		for (u16 i = 0; i < 6; i++) {
-			NeighborType nt = NEIGHBOR_SAME_LEVEL;
-			switch (i) {
-				case 1:
-					nt = NEIGHBOR_UPPER;
-					break;
-				case 4:
-					nt = NEIGHBOR_LOWER;
-					break;
-			}
-			v3s16 npos = p0 + dirs[i];
-			NodeNeighbor nb(getNodeNoEx(npos), nt, npos);
-			const ContentFeatures &cfnb = nodemgr->get(nb.n);
-			switch (nodemgr->get(nb.n.getContent()).liquid_type) {
-				case LIQUID_NONE:
-					if (cfnb.floodable) {
-						airs[num_airs++] = nb;
-						// if the current node is a water source the neighbor
-						// should be enqueded for transformation regardless of whether the
-						// current node changes or not.
-						if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
-							m_transforming_liquid.push_back(npos);
-						// if the current node happens to be a flowing node, it will start to flow down here.
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					} else {
-						neutrals[num_neutrals++] = nb;
-						// If neutral below is ignore prevent water spreading outwards
-						if (nb.t == NEIGHBOR_LOWER &&
-								nb.n.getContent() == CONTENT_IGNORE)
-							flowing_down = true;
-					}
-					break;
-				case LIQUID_SOURCE:
-					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = nodemgr->getId(cfnb.liquid_alternative_flowing);
-					if (nodemgr->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						// Do not count bottom source, it will screw things up
-						if(dirs[i].Y != -1)
-							sources[num_sources++] = nb;
-					}
-					break;
-				case LIQUID_FLOWING:
-					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = nodemgr->getId(cfnb.liquid_alternative_flowing);
-					if (nodemgr->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						flows[num_flows++] = nb;
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					}
-					break;
-			}
+		region_starts.push_back(updates.size());
+
+		if (!m_liquid_workers) {
+			s16 nthreads = g_settings->getS16("liquid_threads");
+			if (nthreads <= 0)
+				nthreads = MYMIN(Thread::getNumberOfProcessors() - 1, 4);
+			if (nthreads < 1)
+				nthreads = 1;
+			m_liquid_workers = new LiquidWorkerPool(this, nodemgr, nthreads);
 		}
+		m_liquid_workers->run(updates, region_starts);
+	}
 
-		/*
-			decide on the type (and possibly level) of the current node
-		 */
-		content_t new_node_content;
-		s8 new_node_level = -1;
-		s8 max_node_level = -1;
-
-		u8 range = nodemgr->get(liquid_kind).liquid_range;
-		if (range > LIQUID_LEVEL_MAX + 1)
-			range = LIQUID_LEVEL_MAX + 1;
-
-		if ((num_sources >= 2 && nodemgr->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
-			// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
-			// or the flowing alternative of the first of the surrounding sources (if it's air), so
-			// it's perfectly safe to use liquid_kind here to determine the new node content.
-			new_node_content = nodemgr->getId(nodemgr->get(liquid_kind).liquid_alternative_source);
-		} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
-			// liquid_kind is set properly, see above
-			max_node_level = new_node_level = LIQUID_LEVEL_MAX;
-			if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
-		} else {
-			// no surrounding sources, so get the maximum level that can flow into this node
-			for (u16 i = 0; i < num_flows; i++) {
-				u8 nb_liquid_level = (flows[i].n.param2 & LIQUID_LEVEL_MASK);
-				switch (flows[i].t) {
-					case NEIGHBOR_UPPER:
-						if (nb_liquid_level + WATER_DROP_BOOST > max_node_level) {
-							max_node_level = LIQUID_LEVEL_MAX;
-							if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
-								max_node_level = nb_liquid_level + WATER_DROP_BOOST;
-						} else if (nb_liquid_level > max_node_level) {
-							max_node_level = nb_liquid_level;
-						}
-						break;
-					case NEIGHBOR_LOWER:
-						break;
-					case NEIGHBOR_SAME_LEVEL:
-						if ((flows[i].n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
-								nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
-							max_node_level = nb_liquid_level - 1;
-						break;
-				}
-			}
-
-			u8 viscosity = nodemgr->get(liquid_kind).liquid_viscosity;
-			if (viscosity > 1 && max_node_level != liquid_level) {
-				// amount to gain, limited by viscosity
-				// must be at least 1 in absolute value
-				s8 level_inc = max_node_level - liquid_level;
-				if (level_inc < -viscosity || level_inc > viscosity)
-					new_node_level = liquid_level + level_inc/viscosity;
-				else if (level_inc < 0)
-					new_node_level = liquid_level - 1;
-				else if (level_inc > 0)
-					new_node_level = liquid_level + 1;
-				if (new_node_level != max_node_level)
-					must_reflow.push_back(p0);
+	/*
+		Apply the updates in region order. This doesn't depend on the
+		number of threads, so neither does the result.
+	*/
+	u32 num_changed = 0;
+	for (size_t i = 0; i < updates.size(); i++) {
+		const LiquidUpdate &u = updates[i];
+		const v3s16 &p0 = u.p;
+
+		if (u.changed) {
+			num_changed++;
+			MapNode n0 = u.n_new;
+
+			// Find out whether there is a suspect for this action
+			std::string suspect;
+			if (m_gamedef->rollback())
+				suspect = m_gamedef->rollback()->getSuspect(p0, 83, 1);
+
+			if (m_gamedef->rollback() && !suspect.empty()) {
+				// Blame suspect
+				RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
+				// Get old node for rollback
+				RollbackNode rollback_oldnode(this, p0, m_gamedef);
+				// Set node
+				setNode(p0, n0);
+				// Report
+				RollbackNode rollback_newnode(this, p0, m_gamedef);
+				RollbackAction action;
+				action.setSetNode(p0, rollback_oldnode, rollback_newnode);
+				m_gamedef->rollback()->reportAction(action);
 			} else {
-				new_node_level = max_node_level;
+				// Set node
+				setNode(p0, n0);
 			}
 
-			if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
-
-		}
-
-		/*
-			check if anything has changed. if not, just continue with the next node.
-		 */
-		if (new_node_content == n0.getContent() &&
-				(nodemgr->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
-				((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
-				((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
-				== flowing_down)))
-			continue;
-
-
-		/*
-			update the current node
-		 */
-		MapNode n00 = n0;
-		//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
-		if (nodemgr->get(new_node_content).liquid_type == LIQUID_FLOWING) {
-			// set level to last 3 bits, flowing down bit to 4th bit
-			n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
-		} else {
-			// set the liquid level and flow bit to 0
-			n0.param2 = ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
-		}
-		n0.setContent(new_node_content);
-
-		// Find out whether there is a suspect for this action
-		std::string suspect;
-		if (m_gamedef->rollback())
-			suspect = m_gamedef->rollback()->getSuspect(p0, 83, 1);
-
-		if (m_gamedef->rollback() && !suspect.empty()) {
-			// Blame suspect
-			RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
-			// Get old node for rollback
-			RollbackNode rollback_oldnode(this, p0, m_gamedef);
-			// Set node
-			setNode(p0, n0);
-			// Report
-			RollbackNode rollback_newnode(this, p0, m_gamedef);
-			RollbackAction action;
-			action.setSetNode(p0, rollback_oldnode, rollback_newnode);
-			m_gamedef->rollback()->reportAction(action);
-		} else {
-			// Set node
-			setNode(p0, n0);
+			v3s16 blockpos = getNodeBlockPos(p0);
+			MapBlock *block = getBlockNoCreateNoEx(blockpos);
+			if (block != NULL) {
+				modified_blocks[blockpos] =  block;
+				// If new or old node emits light, MapBlock requires lighting update
+				if (nodemgr->get(n0).light_source != 0 ||
+						nodemgr->get(u.n_old).light_source != 0)
+					lighting_modified_blocks[block->getPos()] = block;
+			}
 		}
 
-		v3s16 blockpos = getNodeBlockPos(p0);
-		MapBlock *block = getBlockNoCreateNoEx(blockpos);
-		if (block != NULL) {
-			modified_blocks[blockpos] =  block;
-			// If new or old node emits light, MapBlock requires lighting update
-			if (nodemgr->get(n0).light_source != 0 ||
-					nodemgr->get(n00).light_source != 0)
-				lighting_modified_blocks[block->getPos()] = block;
-		}
+		for (u8 j = 0; j < u.num_queue; j++)
+			m_transforming_liquid.push_back(u.queue[j]);
+	}
+	//infostream<<"Map::transformLiquids(): processed="<<updates.size()<<std::endl;
 
-		/*
-			enqueue neighbors for update if neccessary
-		 */
-		switch (nodemgr->get(n0.getContent()).liquid_type) {
-			case LIQUID_SOURCE:
-			case LIQUID_FLOWING:
-				// make sure source flows into all neighboring nodes
-				for (u16 i = 0; i < num_flows; i++)
-					if (flows[i].t != NEIGHBOR_UPPER)
-						m_transforming_liquid.push_back(flows[i].p);
-				for (u16 i = 0; i < num_airs; i++)
-					if (airs[i].t != NEIGHBOR_UPPER)
-						m_transforming_liquid.push_back(airs[i].p);
-				break;
-			case LIQUID_NONE:
-				// this flow has turned to air; neighboring flows might need to do the same
-				for (u16 i = 0; i < num_flows; i++)
-					m_transforming_liquid.push_back(flows[i].p);
-				break;
-		}
+	// nodes that due to viscosity have not reached their max level height
+	for (size_t i = 0; i < updates.size(); i++) {
+		if (updates[i].reflow)
+			m_transforming_liquid.push_back(updates[i].p);
 	}
-	//infostream<<"Map::transformLiquids(): loopcount="<<loopcount<<std::endl;
 
-	for (std::deque<v3s16>::iterator iter = must_reflow.begin(); iter != must_reflow.end(); ++iter)
-		m_transforming_liquid.push_back(*iter);
+	g_profiler->avg("Server: liquid queue length", m_transforming_liquid.size());
+	g_profiler->avg("Server: liquid nodes processed per step", updates.size());
+	g_profiler->avg("Server: liquid nodes changed per step", num_changed);
 
 	updateLighting(lighting_modified_blocks, modified_blocks);
 
@@ -1929,7 +2209,7 @@ void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks)
 	/* ----------------------------------------------------------------------
 	 * Manage the queue so that it does not grow indefinately
 	 */
-	u16 time_until_purge = g_settings->getU16("liquid_queue_purge_time");
+	u16 time_until_purge = m_liquid_queue_purge_time.get();
 
 	if (time_until_purge == 0)
 		return; // Feature disabled
@@ -2051,6 +2331,7 @@ bool Map::setNodeMetadata(v3s16 p, NodeMetadata *meta)
 		return false;
 	}
 	block->m_node_metadata.set(p_rel, meta);
+	block->clearNetworkCache();
 	return true;
 }
 
@@ -2066,6 +2347,7 @@ void Map::removeNodeMetadata(v3s16 p)
 		return;
 	}
 	block->m_node_metadata.remove(p_rel);
+	block->clearNetworkCache();
 }
 
 NodeTimer Map::getNodeTimer(v3s16 p)
@@ -2119,13 +2401,225 @@ void Map::removeNodeTimer(v3s16 p)
 	block->m_node_timers.remove(p_rel);
 }
 
+/*
+	MapSaveThread
+
+	Compresses block snapshots taken by ServerMap::saveBlock() and writes
+	them to the database in batches, each batch with one saveBlocks() call.
+*/
+
+// Maximum number of blocks written in one database transaction
+#define MAP_SAVE_BATCH_SIZE 256
+
+class MapSaveThread : public Thread
+{
+public:
+	MapSaveThread(Database *db, Mutex *db_mutex, u32 queue_limit);
+	~MapSaveThread();
+
+	void *run();
+
+	// Queues a snapshot for writing and takes ownership of it.
+	// Blocks while queue_limit snapshots are already queued.
+	void enqueue(MapBlockDiskSnapshot *snap);
+	// Gets the newest data of the block at pos that has not been written
+	// yet, in the database format. Returns false if there is none.
+	bool getPendingBlob(v3s16 pos, std::string &blob);
+	// Drops the writes of the block at pos that have not been done yet.
+	// Call before deleting the block from the database.
+	void cancel(v3s16 pos);
+	// Blocks until everything queued so far has been written
+	void flush();
+	u32 getQueueSize();
+
+private:
+	void writeBatch(const std::vector<MapBlockDiskSnapshot *> &batch);
+
+	Database *m_db;
+	Mutex *m_db_mutex;
+
+	Mutex m_queue_mutex;
+	std::deque<MapBlockDiskSnapshot *> m_queue;
+	// Queued or in-flight snapshots per block position, oldest first
+	std::map<v3s16, std::deque<MapBlockDiskSnapshot *> > m_pending;
+	// Pending snapshots that must not be written anymore
+	std::set<MapBlockDiskSnapshot *> m_cancelled;
+	u32 m_pending_count;
+
+	// Posted once per queued snapshot
+	Semaphore m_queued;
+	// Free queue slots, for backpressure
+	Semaphore m_free_slots;
+	// Signaled whenever the queue runs empty, for flush()
+	Event m_drained;
+};
+
+MapSaveThread::MapSaveThread(Database *db, Mutex *db_mutex, u32 queue_limit):
+	Thread("MapSave"),
+	m_db(db),
+	m_db_mutex(db_mutex),
+	m_pending_count(0),
+	m_queued(0),
+	m_free_slots(MYMAX(queue_limit, 1))
+{
+}
+
+MapSaveThread::~MapSaveThread()
+{
+	for (std::deque<MapBlockDiskSnapshot *>::iterator i = m_queue.begin();
+			i != m_queue.end(); ++i)
+		delete *i;
+}
+
+void MapSaveThread::enqueue(MapBlockDiskSnapshot *snap)
+{
+	m_free_slots.wait();
+
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		m_queue.push_back(snap);
+		m_pending[snap->pos].push_back(snap);
+		m_pending_count++;
+	}
+
+	m_queued.post();
+}
+
+/*
+	[0] u8 serialization version
+	[1] data
+*/
+static std::string serialize_snapshot(const MapBlockDiskSnapshot &snap)
+{
+	std::ostringstream o(std::ios_base::binary);
+	o.write((char*) &snap.version, 1);
+	MapBlock::serializeDiskSnapshot(o, snap);
+	return o.str();
+}
+
+bool MapSaveThread::getPendingBlob(v3s16 pos, std::string &blob)
+{
+	// Snapshots are only deleted with the lock held
+	MutexAutoLock lock(m_queue_mutex);
+	std::map<v3s16, std::deque<MapBlockDiskSnapshot *> >::iterator n =
+		m_pending.find(pos);
+	if (n == m_pending.end() || m_cancelled.count(n->second.back()))
+		return false;
+	blob = serialize_snapshot(*n->second.back());
+	return true;
+}
+
+void MapSaveThread::cancel(v3s16 pos)
+{
+	MutexAutoLock lock(m_queue_mutex);
+	std::map<v3s16, std::deque<MapBlockDiskSnapshot *> >::iterator n =
+		m_pending.find(pos);
+	if (n != m_pending.end())
+		m_cancelled.insert(n->second.begin(), n->second.end());
+}
+
+void MapSaveThread::flush()
+{
+	// The event may still be set from an earlier time the queue ran
+	// empty, so check again after each wakeup
+	while (getQueueSize() > 0)
+		m_drained.wait();
+}
+
+u32 MapSaveThread::getQueueSize()
+{
+	MutexAutoLock lock(m_queue_mutex);
+	return m_pending_count;
+}
+
+void *MapSaveThread::run()
+{
+	DSTACK(FUNCTION_NAME);
+	BEGIN_DEBUG_EXCEPTION_HANDLER
+
+	// Everything queued before stop() was requested is still written
+	while (!stopRequested() || getQueueSize() > 0) {
+		if (!m_queued.wait(100))
+			continue;
+
+		// Take whatever else is already queued along into the same batch
+		std::vector<MapBlockDiskSnapshot *> batch;
+		do {
+			MutexAutoLock lock(m_queue_mutex);
+			batch.push_back(m_queue.front());
+			m_queue.pop_front();
+		} while (batch.size() < MAP_SAVE_BATCH_SIZE && m_queued.wait(0));
+
+		m_free_slots.post(batch.size());
+
+		// Keep draining the queue even if a batch fails, or enqueue() and
+		// flush() would wait forever
+		try {
+			writeBatch(batch);
+		} catch (std::exception &e) {
+			errorstream << "MapSaveThread: Failed to save "
+				<< batch.size() << " blocks: " << e.what() << std::endl;
+		}
+
+		MutexAutoLock lock(m_queue_mutex);
+		for (size_t i = 0; i < batch.size(); i++) {
+			std::map<v3s16, std::deque<MapBlockDiskSnapshot *> >::iterator n =
+				m_pending.find(batch[i]->pos);
+			// Written in queue order, so it is the oldest one
+			n->second.pop_front();
+			if (n->second.empty())
+				m_pending.erase(n);
+			m_cancelled.erase(batch[i]);
+			delete batch[i];
+		}
+		m_pending_count -= batch.size();
+		if (m_pending_count == 0)
+			m_drained.signal();
+	}
+
+	END_DEBUG_EXCEPTION_HANDLER
+	return NULL;
+}
+
+void MapSaveThread::writeBatch(const std::vector<MapBlockDiskSnapshot *> &batch)
+{
+	// Compress without holding the database lock
+	std::vector<std::string> blobs(batch.size());
+	for (size_t i = 0; i < batch.size(); i++)
+		blobs[i] = serialize_snapshot(*batch[i]);
+
+	MutexAutoLock lock(*m_db_mutex);
+
+	// Checked with the database locked, so that a block deleted after
+	// cancel() is not written again
+	std::vector<v3s16> positions;
+	{
+		MutexAutoLock queue_lock(m_queue_mutex);
+		size_t kept = 0;
+		for (size_t i = 0; i < batch.size(); i++) {
+			if (m_cancelled.count(batch[i]))
+				continue;
+			positions.push_back(batch[i]->pos);
+			blobs[kept++].swap(blobs[i]);
+		}
+		blobs.resize(kept);
+	}
+	if (positions.empty())
+		return;
+
+	if (!m_db->saveBlocks(positions, blobs))
+		errorstream << "MapSaveThread: Failed to save some of "
+			<< batch.size() << " blocks" << std::endl;
+}
+
 /*
 	ServerMap
 */
 ServerMap::ServerMap(std::string savedir, IGameDef *gamedef, EmergeManager *emerge):
 	Map(dout_server, gamedef),
 	m_emerge(emerge),
-	m_map_metadata_changed(true)
+	m_map_metadata_changed(true),
+	m_save_thread(NULL)
 {
 	verbosestream<<FUNCTION_NAME<<std::endl;
 
@@ -2147,6 +2641,12 @@ ServerMap::ServerMap(std::string savedir, IGameDef *gamedef, EmergeManager *emer
 	if (!conf.updateConfigFile(conf_path.c_str()))
 		errorstream << "ServerMap::ServerMap(): Failed to update world.mt!" << std::endl;
 
+	if (g_settings->getBool("server_map_save_async")) {
+		m_save_thread = new MapSaveThread(dbase, &m_db_mutex,
+			MYMAX(g_settings->getS32("server_map_save_queue_limit"), 1));
+		m_save_thread->start();
+	}
+
 	m_savedir = savedir;
 	m_map_saving_enabled = false;
 
@@ -2235,6 +2735,15 @@ ServerMap::~ServerMap()
 				<<", exception: "<<e.what()<<std::endl;
 	}
 
+	/*
+		Write out whatever is still queued before closing the database
+	*/
+	if (m_save_thread) {
+		m_save_thread->stop();
+		m_save_thread->wait();
+		delete m_save_thread;
+	}
+
 	/*
 		Close database if it was opened
 	*/
@@ -2288,7 +2797,18 @@ bool ServerMap::initBlockMake(v3s16 blockpos, BlockMakeData *data)
 	data->nodedef = m_gamedef->ndef();
 
 	/*
-		Create the whole area of this and the neighboring blocks
+		Load everything of this and the neighboring blocks that is on disk
+		at once
+	*/
+	std::vector<v3s16> positions;
+	for (s16 x = full_bpmin.X; x <= full_bpmax.X; x++)
+	for (s16 z = full_bpmin.Z; z <= full_bpmax.Z; z++)
+	for (s16 y = full_bpmin.Y; y <= full_bpmax.Y; y++)
+		positions.push_back(v3s16(x, y, z));
+	loadBlocks(positions);
+
+	/*
+		Create the rest of the area
 	*/
 	for (s16 x = full_bpmin.X; x <= full_bpmax.X; x++)
 	for (s16 z = full_bpmin.Z; z <= full_bpmax.Z; z++) {
@@ -2300,8 +2820,8 @@ bool ServerMap::initBlockMake(v3s16 blockpos, BlockMakeData *data)
 		for (s16 y = full_bpmin.Y; y <= full_bpmax.Y; y++) {
 			v3s16 p(x, y, z);
 
-			MapBlock *block = emergeBlock(p, false);
-			if (block == NULL) {
+			MapBlock *block = getBlockNoCreateNoEx(p);
+			if (block == NULL || block->isDummy()) {
 				block = createBlock(p);
 
 				// Block gets sunlight if this is true.
@@ -2956,6 +3476,10 @@ void ServerMap::save(ModifiedState save_level)
 	if(save_started)
 		endSave();
 
+	if (m_save_thread)
+		g_profiler->avg("ServerMap: save queue length",
+				m_save_thread->getQueueSize());
+
 	/*
 		Only print if something happened or saved whole map
 	*/
@@ -2978,6 +3502,9 @@ void ServerMap::listAllLoadableBlocks(std::vector<v3s16> &dst)
 		errorstream << "Map::listAllLoadableBlocks(): Result will be missing "
 				<< "all blocks that are stored in flat files." << std::endl;
 	}
+	if (m_save_thread)
+		m_save_thread->flush();
+	MutexAutoLock lock(m_db_mutex);
 	dbase->listAllLoadableBlocks(dst);
 }
 
@@ -3232,6 +3759,8 @@ Database *ServerMap::createDatabase(
 		return new Database_SQLite3(savedir);
 	if (name == "dummy")
 		return new Database_Dummy();
+	if (name == "region")
+		return new Database_Region(savedir);
 	#if USE_LEVELDB
 	else if (name == "leveldb")
 		return new Database_LevelDB(savedir);
@@ -3246,17 +3775,43 @@ Database *ServerMap::createDatabase(
 
 void ServerMap::beginSave()
 {
+	// The save thread does its own transactions
+	if (m_save_thread)
+		return;
+	MutexAutoLock lock(m_db_mutex);
 	dbase->beginSave();
 }
 
 void ServerMap::endSave()
 {
+	if (m_save_thread)
+		return;
+	MutexAutoLock lock(m_db_mutex);
 	dbase->endSave();
 }
 
 bool ServerMap::saveBlock(MapBlock *block)
 {
-	return saveBlock(block, dbase);
+	if (!m_save_thread) {
+		MutexAutoLock lock(m_db_mutex);
+		return saveBlock(block, dbase);
+	}
+
+	// Dummy blocks are not written
+	if (block->isDummy()) {
+		warningstream << "saveBlock: Not writing dummy block "
+			<< PP(block->getPos()) << std::endl;
+		return true;
+	}
+
+	// Only copy the data here, the save thread compresses and writes it
+	MapBlockDiskSnapshot *snap = new MapBlockDiskSnapshot;
+	block->snapshotForDisk(*snap, SER_FMT_VER_HIGHEST_WRITE);
+	m_save_thread->enqueue(snap);
+
+	// The snapshot is what goes to disk now, so clear modified flag
+	block->resetModified();
+	return true;
 }
 
 bool ServerMap::saveBlock(MapBlock *block, Database *db)
@@ -3443,12 +3998,65 @@ MapBlock* ServerMap::loadBlock(v3s16 blockpos)
 
 	std::string ret;
 
-	ret = dbase->loadBlock(blockpos);
+	// The database may still have an older version of a block that is
+	// waiting to be written
+	if (!m_save_thread || !m_save_thread->getPendingBlob(blockpos, ret)) {
+		MutexAutoLock lock(m_db_mutex);
+		ret = dbase->loadBlock(blockpos);
+	}
 	if (ret != "") {
 		loadBlock(&ret, blockpos, createSector(p2d), false);
 		return getBlockNoCreateNoEx(blockpos);
 	}
 	// Not found in database, try the files
+	return loadBlockFromFiles(blockpos);
+}
+
+void ServerMap::loadBlocks(const std::vector<v3s16> &positions)
+{
+	DSTACK(FUNCTION_NAME);
+
+	// Blocks still waiting to be written are taken from the save queue,
+	// the database may have an older version of them
+	std::vector<v3s16> to_load;
+	std::vector<std::pair<v3s16, std::string> > pending;
+	for (size_t i = 0; i < positions.size(); i++) {
+		MapBlock *block = getBlockNoCreateNoEx(positions[i]);
+		if (block && !block->isDummy())
+			continue;
+		std::string blob;
+		if (m_save_thread && m_save_thread->getPendingBlob(positions[i], blob))
+			pending.push_back(std::make_pair(positions[i], blob));
+		else
+			to_load.push_back(positions[i]);
+	}
+
+	for (size_t i = 0; i < pending.size(); i++) {
+		v3s16 p = pending[i].first;
+		loadBlock(&pending[i].second, p, createSector(v2s16(p.X, p.Z)), false);
+	}
+
+	if (to_load.empty())
+		return;
+
+	std::vector<std::string> blobs;
+	{
+		MutexAutoLock lock(m_db_mutex);
+		dbase->loadBlocks(to_load, blobs);
+	}
+
+	for (size_t i = 0; i < to_load.size(); i++) {
+		v3s16 p = to_load[i];
+		if (blobs[i] != "")
+			loadBlock(&blobs[i], p, createSector(v2s16(p.X, p.Z)), false);
+		else
+			loadBlockFromFiles(p);
+	}
+}
+
+MapBlock *ServerMap::loadBlockFromFiles(v3s16 blockpos)
+{
+	v2s16 p2d(blockpos.X, blockpos.Z);
 
 	// The directory layout we're going to load from.
 	//  1 - original sectors/xxxxzzzz/
@@ -3509,8 +4117,15 @@ MapBlock* ServerMap::loadBlock(v3s16 blockpos)
 
 bool ServerMap::deleteBlock(v3s16 blockpos)
 {
-	if (!dbase->deleteBlock(blockpos))
-		return false;
+	// A pending write would bring the block back
+	if (m_save_thread)
+		m_save_thread->cancel(blockpos);
+
+	{
+		MutexAutoLock lock(m_db_mutex);
+		if (!dbase->deleteBlock(blockpos))
+			return false;
+	}
 
 	MapBlock *block = getBlockNoCreateNoEx(blockpos);
 	if (block) {
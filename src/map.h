@@ -33,6 +33,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "modifiedstate.h"
 #include "util/container.h"
 #include "nodetimer.h"
+#include "mapblock_hashmap.h"
+#include "threading/mutex.h"
+#include "settings.h"
 
 class Settings;
 class Database;
@@ -40,6 +43,8 @@ class ClientMap;
 class MapSector;
 class ServerMapSector;
 class MapBlock;
+class MapSaveThread;
+class LiquidWorkerPool;
 class NodeMetadata;
 class IGameDef;
 class IRollbackManager;
@@ -67,6 +72,9 @@ enum MapEditEventType{
 	// Node metadata of block changed (not knowing which node exactly)
 	// p stores block coordinate
 	MEET_BLOCK_NODE_METADATA_CHANGED,
+	// Node metadata changed
+	// p stores node coordinate
+	MEET_NODE_METADATA_CHANGED,
 	// Anything else (modified_blocks are set unsent)
 	MEET_OTHER
 };
@@ -104,6 +112,8 @@ struct MapEditEvent
 			return VoxelArea(p);
 		case MEET_SWAPNODE:
 			return VoxelArea(p);
+		case MEET_NODE_METADATA_CHANGED:
+			return VoxelArea(p);
 		case MEET_BLOCK_NODE_METADATA_CHANGED:
 		{
 			v3s16 np1 = p*MAP_BLOCKSIZE;
@@ -229,6 +239,13 @@ class Map /*: public NodeContainer*/
 	s16 propagateSunlight(v3s16 start,
 			std::map<v3s16, MapBlock*> & modified_blocks);
 
+	// Unspreads and spreads the light around cleared blocks
+	void relightBlockGroups(enum LightBank bank,
+			const std::vector<v3s16> &blocks,
+			std::map<v3s16, u8> &unlight_from,
+			std::set<v3s16> &light_sources,
+			std::map<v3s16, MapBlock*> &modified_blocks);
+
 	void updateLighting(enum LightBank bank,
 			std::map<v3s16, MapBlock*>  & a_blocks,
 			std::map<v3s16, MapBlock*> & modified_blocks);
@@ -344,6 +361,7 @@ class Map /*: public NodeContainer*/
 
 protected:
 	friend class LuaVoxelManip;
+	friend class MapSector;
 
 	std::ostream &m_dout; // A bit deprecated, could be removed
 
@@ -353,6 +371,10 @@ class Map /*: public NodeContainer*/
 
 	std::map<v2s16, MapSector*> m_sectors;
 
+	// All blocks of all sectors, for lookups by position.
+	// Kept up to date by MapSector.
+	MapBlockHashMap m_block_index;
+
 	// Be sure to set this to NULL when the cached sector is deleted
 	MapSector *m_sector_cache;
 	v2s16 m_sector_cache_p;
@@ -366,6 +388,12 @@ class Map /*: public NodeContainer*/
 	u32 m_inc_trending_up_start_time; // milliseconds
 	bool m_queue_size_timer_started;
 
+	// Created by the first transformLiquids() call
+	LiquidWorkerPool *m_liquid_workers;
+
+	SettingHandle<s32> m_liquid_loop_max;
+	SettingHandle<u16> m_liquid_queue_purge_time;
+
 	DISABLE_CLASS_COPY(Map);
 };
 
@@ -491,6 +519,10 @@ class ServerMap : public Map
 	// This will generate a sector with getSector if not found.
 	void loadBlock(std::string sectordir, std::string blockfile, MapSector *sector, bool save_after_load=false);
 	MapBlock* loadBlock(v3s16 p);
+	// Loads the blocks that are not in memory yet with a single database
+	// request. Blocks found neither in the database nor in the legacy
+	// sector files are left alone.
+	void loadBlocks(const std::vector<v3s16> &positions);
 	// Database version
 	void loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool save_after_load=false);
 
@@ -526,7 +558,17 @@ class ServerMap : public Map
 		This is reset to false when written on disk.
 	*/
 	bool m_map_metadata_changed;
+
+	// Legacy sectors/ and sectors2/ directories, used if a block is not
+	// in the database
+	MapBlock *loadBlockFromFiles(v3s16 blockpos);
+
 	Database *dbase;
+	// Serializes access to dbase between the server and the save thread
+	Mutex m_db_mutex;
+	// Writes saved blocks to dbase in the background, NULL if saving is
+	// synchronous
+	MapSaveThread *m_save_thread;
 };
 
 
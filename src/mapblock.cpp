@@ -58,6 +58,7 @@ static const char *modified_reason_strings[] = {
 	"deactivateFarObjects: Static data moved out",
 	"deactivateFarObjects: Static data changed considerably",
 	"finishBlockMake: expireDayNightDiff",
+	"Map::relightBlockGroups",
 	"unknown",
 };
 
@@ -370,6 +371,9 @@ void MapBlock::copyFrom(VoxelManipulator &dst)
 	// Copy from VoxelManipulator to data
 	dst.copyTo(data, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
+
+	// The node data was written directly, bypassing raiseModified()
+	clearNetworkCache();
 }
 
 void MapBlock::actuallyUpdateDayNightDiff()
@@ -554,6 +558,20 @@ static void correctBlockNodeIds(const NameIdMapping *nimap, MapNode *nodes,
 	}
 }
 
+u8 MapBlock::getSerializationFlags()
+{
+	u8 flags = 0;
+	if(is_underground)
+		flags |= 0x01;
+	if(getDayNightDiff())
+		flags |= 0x02;
+	if(m_lighting_expired)
+		flags |= 0x04;
+	if(m_generated == false)
+		flags |= 0x08;
+	return flags;
+}
+
 void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 {
 	if(!ser_ver_supported(version))
@@ -566,78 +584,112 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 
 	FATAL_ERROR_IF(version < SER_FMT_VER_LOWEST_WRITE, "Serialisation version error");
 
+	if(disk)
+	{
+		MapBlockDiskSnapshot snap;
+		snapshotForDisk(snap, version);
+		serializeDiskSnapshot(os, snap);
+		return;
+	}
+
 	// First byte
-	u8 flags = 0;
-	if(is_underground)
-		flags |= 0x01;
-	if(getDayNightDiff())
-		flags |= 0x02;
-	if(m_lighting_expired)
-		flags |= 0x04;
-	if(m_generated == false)
-		flags |= 0x08;
-	writeU8(os, flags);
+	writeU8(os, getSerializationFlags());
 
 	/*
 		Bulk node data
 	*/
-	NameIdMapping nimap;
-	if(disk)
-	{
-		MapNode *tmp_nodes = new MapNode[nodecount];
-		for(u32 i=0; i<nodecount; i++)
-			tmp_nodes[i] = data[i];
-		getBlockNodeIdMapping(&nimap, tmp_nodes, m_gamedef->ndef());
-
-		u8 content_width = 2;
-		u8 params_width = 2;
-		writeU8(os, content_width);
-		writeU8(os, params_width);
-		MapNode::serializeBulk(os, version, tmp_nodes, nodecount,
-				content_width, params_width, true);
-		delete[] tmp_nodes;
-	}
-	else
+	u8 content_width = 2;
+	u8 params_width = 2;
+	writeU8(os, content_width);
+	writeU8(os, params_width);
+	MapNode::serializeBulk(os, version, data, nodecount,
+			content_width, params_width, true);
+
+	/*
+		Node metadata
+	*/
+	std::ostringstream oss(std::ios_base::binary);
+	m_node_metadata.serialize(oss);
+	compressZlib(oss.str(), os);
+}
+
+void MapBlock::snapshotForDisk(MapBlockDiskSnapshot &snap, u8 version)
+{
+	if(!ser_ver_supported(version))
+		throw VersionMismatchException("ERROR: MapBlock format not supported");
+
+	if(data == NULL)
 	{
-		u8 content_width = 2;
-		u8 params_width = 2;
-		writeU8(os, content_width);
-		writeU8(os, params_width);
-		MapNode::serializeBulk(os, version, data, nodecount,
-				content_width, params_width, true);
+		throw SerializationError("ERROR: Not writing dummy block.");
 	}
 
+	FATAL_ERROR_IF(version < SER_FMT_VER_LOWEST_WRITE, "Serialisation version error");
+
+	snap.pos = m_pos;
+	snap.version = version;
+	snap.flags = getSerializationFlags();
+
+	/*
+		Bulk node data
+	*/
+	snap.nodes.assign(data, data + nodecount);
+	NameIdMapping nimap;
+	getBlockNodeIdMapping(&nimap, &snap.nodes[0], m_gamedef->ndef());
+
 	/*
 		Node metadata
 	*/
 	std::ostringstream oss(std::ios_base::binary);
 	m_node_metadata.serialize(oss);
-	compressZlib(oss.str(), os);
+	snap.metadata = oss.str();
 
 	/*
 		Data that goes to disk, but not the network
 	*/
-	if(disk)
-	{
-		if(version <= 24){
-			// Node timers
-			m_node_timers.serialize(os, version);
-		}
+	std::ostringstream os(std::ios_base::binary);
+	if(version <= 24){
+		// Node timers
+		m_node_timers.serialize(os, version);
+	}
 
-		// Static objects
-		m_static_objects.serialize(os);
+	// Static objects
+	m_static_objects.serialize(os);
 
-		// Timestamp
-		writeU32(os, getTimestamp());
+	// Timestamp
+	writeU32(os, getTimestamp());
 
-		// Write block-specific node definition id mapping
-		nimap.serialize(os);
+	// Write block-specific node definition id mapping
+	nimap.serialize(os);
 
-		if(version >= 25){
-			// Node timers
-			m_node_timers.serialize(os, version);
-		}
+	if(version >= 25){
+		// Node timers
+		m_node_timers.serialize(os, version);
 	}
+	snap.tail = os.str();
+}
+
+void MapBlock::serializeDiskSnapshot(std::ostream &os,
+	const MapBlockDiskSnapshot &snap)
+{
+	// First byte
+	writeU8(os, snap.flags);
+
+	/*
+		Bulk node data
+	*/
+	u8 content_width = 2;
+	u8 params_width = 2;
+	writeU8(os, content_width);
+	writeU8(os, params_width);
+	MapNode::serializeBulk(os, snap.version, &snap.nodes[0], nodecount,
+			content_width, params_width, true);
+
+	/*
+		Node metadata
+	*/
+	compressZlib(snap.metadata, os);
+
+	os.write(snap.tail.c_str(), snap.tail.size());
 }
 
 void MapBlock::serializeNetworkSpecific(std::ostream &os, u16 net_proto_version)
@@ -655,6 +707,35 @@ void MapBlock::serializeNetworkSpecific(std::ostream &os, u16 net_proto_version)
 	}
 }
 
+const std::string &MapBlock::getNetworkSerialization(u8 version,
+	u16 net_proto_version, bool *cache_hit)
+{
+	for (std::vector<NetworkCacheEntry>::iterator
+			i = m_network_cache.begin();
+			i != m_network_cache.end(); ++i) {
+		if (i->version == version &&
+				i->net_proto_version == net_proto_version) {
+			if (cache_hit)
+				*cache_hit = true;
+			return i->data;
+		}
+	}
+
+	std::ostringstream os(std::ios_base::binary);
+	serialize(os, version, false);
+	serializeNetworkSpecific(os, net_proto_version);
+
+	NetworkCacheEntry entry;
+	entry.version = version;
+	entry.net_proto_version = net_proto_version;
+	m_network_cache.push_back(entry);
+	m_network_cache.back().data = os.str();
+
+	if (cache_hit)
+		*cache_hit = false;
+	return m_network_cache.back().data;
+}
+
 void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 {
 	if(!ser_ver_supported(version))
@@ -21,6 +21,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define MAPBLOCK_HEADER
 
 #include <set>
+#include <string>
+#include <vector>
 #include "debug.h"
 #include "irr_v3d.h"
 #include "mapnode.h"
@@ -121,7 +123,39 @@ class NodeContainer
 #define MOD_REASON_STATIC_DATA_REMOVED       (1 << 16)
 #define MOD_REASON_STATIC_DATA_CHANGED       (1 << 17)
 #define MOD_REASON_EXPIRE_DAYNIGHTDIFF       (1 << 18)
-#define MOD_REASON_UNKNOWN                   (1 << 19)
+#define MOD_REASON_RELIGHT                   (1 << 19)
+#define MOD_REASON_UNKNOWN                   (1 << 20)
+
+// Reasons that can change what is sent to clients: nodes, node metadata
+// and the flags. Timestamps and static objects are only saved to disk.
+#define MOD_REASON_NETWORK_MASK (MOD_REASON_INITIAL | MOD_REASON_REALLOCATE | \
+	MOD_REASON_SET_IS_UNDERGROUND | MOD_REASON_SET_LIGHTING_EXPIRED | \
+	MOD_REASON_SET_GENERATED | MOD_REASON_SET_NODE | \
+	MOD_REASON_SET_NODE_NO_CHECK | MOD_REASON_REPORT_META_CHANGE | \
+	MOD_REASON_EXPIRE_DAYNIGHTDIFF | MOD_REASON_RELIGHT | MOD_REASON_UNKNOWN)
+
+////
+//// Disk serialization snapshot
+////
+
+/*
+	Everything MapBlock::serialize() writes to disk, captured as plain data
+	so that the compression and the actual write can happen later, without
+	access to the MapBlock (see MapSaveThread).
+*/
+struct MapBlockDiskSnapshot
+{
+	v3s16 pos;
+	u8 version;
+	u8 flags;
+	// Node data, content ids remapped to the block's name-id mapping
+	std::vector<MapNode> nodes;
+	// Uncompressed node metadata
+	std::string metadata;
+	// Data following the node metadata (static objects, timestamp,
+	// name-id mapping and node timers)
+	std::string tail;
+};
 
 ////
 //// MapBlock itself
@@ -158,6 +192,9 @@ class MapBlock /*: public NodeContainer*/
 	////
 	void raiseModified(u32 mod, u32 reason=MOD_REASON_UNKNOWN)
 	{
+		if (reason & MOD_REASON_NETWORK_MASK)
+			clearNetworkCache();
+
 		if (mod > m_modified) {
 			m_modified = mod;
 			m_modified_reason = reason;
@@ -513,6 +550,37 @@ class MapBlock /*: public NodeContainer*/
 	void serializeNetworkSpecific(std::ostream &os, u16 net_proto_version);
 	void deSerializeNetworkSpecific(std::istream &is);
 
+	// Split form of serialize(os, version, true): the snapshot is cheap to
+	// take, serializeDiskSnapshot() does the compression and may be called
+	// from any thread.
+	// Precondition: version >= SER_FMT_VER_LOWEST_WRITE
+	void snapshotForDisk(MapBlockDiskSnapshot &snap, u8 version);
+	static void serializeDiskSnapshot(std::ostream &os,
+		const MapBlockDiskSnapshot &snap);
+
+	////
+	//// Network serialization cache
+	////
+
+	/*
+		Returns serialize(version, false) followed by
+		serializeNetworkSpecific(net_proto_version), which is what
+		TOCLIENT_BLOCKDATA carries.
+
+		The result is kept until the block is modified, so a block sent to
+		many clients is only serialized and compressed once per
+		(version, net_proto_version) pair. If cache_hit is not NULL it is
+		set to whether the cached data could be reused.
+	*/
+	const std::string &getNetworkSerialization(u8 version,
+		u16 net_proto_version, bool *cache_hit = NULL);
+
+	inline void clearNetworkCache()
+	{
+		if (!m_network_cache.empty())
+			m_network_cache.clear();
+	}
+
 private:
 	/*
 		Private methods
@@ -520,6 +588,9 @@ class MapBlock /*: public NodeContainer*/
 
 	void deSerialize_pre22(std::istream &is, u8 version, bool disk);
 
+	// First byte of the serialized block
+	u8 getSerializationFlags();
+
 	/*
 		Used only internally, because changes can't be tracked
 	*/
@@ -633,6 +704,19 @@ class MapBlock /*: public NodeContainer*/
 		the list of blocks to be drawn.
 	*/
 	int m_refcount;
+
+	/*
+		Serialized network data, see getNetworkSerialization().
+		Usually holds a single entry, unless clients with different
+		protocol versions are connected.
+	*/
+	struct NetworkCacheEntry
+	{
+		u8 version;
+		u16 net_proto_version;
+		std::string data;
+	};
+	std::vector<NetworkCacheEntry> m_network_cache;
 };
 
 typedef std::vector<MapBlock*> MapBlockVect;
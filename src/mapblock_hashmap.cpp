@@ -0,0 +1,123 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "mapblock_hashmap.h"
+#include <cassert>
+
+#define MIN_CAPACITY 64
+
+MapBlockHashMap::MapBlockHashMap() :
+	m_count(0)
+{
+	resize(MIN_CAPACITY);
+}
+
+void MapBlockHashMap::set(v3s16 p, MapBlock *block)
+{
+	assert(block != NULL);
+
+	u64 key = packPos(p);
+	u32 i = hashKey(key) & m_mask;
+	for (; m_slots[i].block != NULL; i = (i + 1) & m_mask) {
+		if (m_slots[i].key == key) {
+			m_slots[i].block = block;
+			return;
+		}
+	}
+
+	m_slots[i].key = key;
+	m_slots[i].block = block;
+	m_count++;
+
+	// Keep the load factor at or below 1/2
+	if (m_count * 2 > m_slots.size())
+		resize(m_slots.size() * 2);
+}
+
+bool MapBlockHashMap::remove(v3s16 p)
+{
+	u64 key = packPos(p);
+	u32 i = hashKey(key) & m_mask;
+	for (; m_slots[i].key != key; i = (i + 1) & m_mask) {
+		if (m_slots[i].block == NULL)
+			return false;
+	}
+	if (m_slots[i].block == NULL)
+		return false;
+
+	/*
+		Shift the following entries of the probe sequence back, so that
+		there are no gaps between any entry and its home slot
+	*/
+	for (u32 j = (i + 1) & m_mask; m_slots[j].block != NULL;
+			j = (j + 1) & m_mask) {
+		u32 home = hashKey(m_slots[j].key) & m_mask;
+		// Move unless home lies cyclically in (i, j]
+		bool stays = (i <= j) ? (i < home && home <= j) :
+			(i < home || home <= j);
+		if (!stays) {
+			m_slots[i] = m_slots[j];
+			i = j;
+		}
+	}
+	m_slots[i].block = NULL;
+	m_count--;
+
+	if (m_slots.size() > MIN_CAPACITY && m_count * 8 < m_slots.size())
+		resize(m_slots.size() / 2);
+
+	return true;
+}
+
+void MapBlockHashMap::clear()
+{
+	m_slots.clear();
+	m_count = 0;
+	resize(MIN_CAPACITY);
+}
+
+void MapBlockHashMap::getBlocks(std::vector<MapBlock *> &dest) const
+{
+	dest.reserve(dest.size() + m_count);
+	for (size_t i = 0; i < m_slots.size(); i++) {
+		if (m_slots[i].block != NULL)
+			dest.push_back(m_slots[i].block);
+	}
+}
+
+void MapBlockHashMap::resize(u32 capacity)
+{
+	std::vector<Slot> old;
+	old.swap(m_slots);
+
+	Slot empty;
+	empty.key = 0;
+	empty.block = NULL;
+	m_slots.assign(capacity, empty);
+	m_mask = capacity - 1;
+
+	for (size_t n = 0; n < old.size(); n++) {
+		if (old[n].block == NULL)
+			continue;
+		u32 i = hashKey(old[n].key) & m_mask;
+		while (m_slots[i].block != NULL)
+			i = (i + 1) & m_mask;
+		m_slots[i] = old[n];
+	}
+}
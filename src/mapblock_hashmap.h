@@ -0,0 +1,87 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MAPBLOCK_HASHMAP_HEADER
+#define MAPBLOCK_HASHMAP_HEADER
+
+#include "irrlichttypes.h"
+#include "irr_v3d.h"
+#include <vector>
+
+class MapBlock;
+
+/*
+	Flat index of all MapBlocks of a Map, keyed by block position.
+
+	Open addressing with linear probing; a lookup is a hash and usually a
+	single compare, instead of the two tree walks through the sectors.
+	Does not own the blocks, the MapSectors still do.
+*/
+class MapBlockHashMap
+{
+public:
+	MapBlockHashMap();
+
+	MapBlock *get(v3s16 p) const
+	{
+		u64 key = packPos(p);
+		for (u32 i = hashKey(key) & m_mask; ; i = (i + 1) & m_mask) {
+			const Slot &slot = m_slots[i];
+			if (slot.block == NULL)
+				return NULL;
+			if (slot.key == key)
+				return slot.block;
+		}
+	}
+
+	// Replaces the block if there already is one at p
+	void set(v3s16 p, MapBlock *block);
+	// Returns false if there was no block at p
+	bool remove(v3s16 p);
+	void clear();
+
+	u32 size() const { return m_count; }
+	void getBlocks(std::vector<MapBlock *> &dest) const;
+
+private:
+	struct Slot {
+		u64 key;
+		// NULL if the slot is empty
+		MapBlock *block;
+	};
+
+	static u64 packPos(v3s16 p)
+	{
+		return (u64)(u16)p.X | ((u64)(u16)p.Y << 16) | ((u64)(u16)p.Z << 32);
+	}
+
+	static u32 hashKey(u64 key)
+	{
+		return (u32)((key * 0x9e3779b97f4a7c15ULL) >> 32);
+	}
+
+	void resize(u32 capacity);
+
+	// Size is a power of two and at least twice m_count
+	std::vector<Slot> m_slots;
+	u32 m_mask;
+	u32 m_count;
+};
+
+#endif
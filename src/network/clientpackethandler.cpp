@@ -23,9 +23,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "clientmedia.h"
 #include "log.h"
 #include "map.h"
+#include "mapblock.h"
 #include "mapsector.h"
 #include "minimap.h"
 #include "nodedef.h"
+#include "nodemetadata.h"
 #include "serialization.h"
 #include "server.h"
 #include "util/strfnd.h"
@@ -623,7 +625,7 @@ void Client::handleCommand_AnnounceMedia(NetworkPacket* pkt)
 
 	// Mesh update thread must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
 
 	for (u16 i = 0; i < num_files; i++) {
 		std::string name, sha1_base64;
@@ -696,7 +698,7 @@ void Client::handleCommand_Media(NetworkPacket* pkt)
 
 	// Mesh update thread must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
 
 	for (u32 i=0; i < num_files; i++) {
 		std::string name;
@@ -722,7 +724,7 @@ void Client::handleCommand_NodeDef(NetworkPacket* pkt)
 
 	// Mesh update thread must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
 
 	// Decompress node definitions
 	std::string datastring(pkt->getString(0), pkt->getSize());
@@ -749,7 +751,7 @@ void Client::handleCommand_ItemDef(NetworkPacket* pkt)
 
 	// Mesh update thread must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
 
 	// Decompress item definitions
 	std::string datastring(pkt->getString(0), pkt->getSize());
@@ -869,6 +871,44 @@ void Client::handleCommand_DetachedInventory(NetworkPacket* pkt)
 	inv->deSerialize(is);
 }
 
+void Client::handleCommand_InventoryDelta(NetworkPacket* pkt)
+{
+	std::string datastring(pkt->getString(0), pkt->getSize());
+	std::istringstream is(datastring, std::ios_base::binary);
+
+	std::string name = deSerializeString(is);
+
+	if (name.empty()) {
+		// Always sent after the whole inventory
+		if (!m_inventory_from_server) {
+			errorstream << "Client: Inventory delta before inventory"
+					<< std::endl;
+			return;
+		}
+
+		// The delta is relative to the inventory from the server, which
+		// also resets any local predictions
+		m_inventory_from_server->deSerializeDelta(is);
+		m_inventory_from_server_age = 0.0;
+
+		Player *player = m_env.getLocalPlayer();
+		assert(player != NULL);
+		player->inventory = *m_inventory_from_server;
+		m_inventory_updated = true;
+		return;
+	}
+
+	// A delta may arrive before the whole inventory on joining
+	std::map<std::string, Inventory*>::iterator i =
+			m_detached_inventories.find(name);
+	if (i == m_detached_inventories.end()) {
+		infostream << "Client: Ignoring delta of unknown detached inventory \""
+				<< name << "\"" << std::endl;
+		return;
+	}
+	i->second->deSerializeDelta(is);
+}
+
 void Client::handleCommand_ShowFormSpec(NetworkPacket* pkt)
 {
 	std::string formspec = pkt->readLongString();
@@ -1190,6 +1230,51 @@ void Client::handleCommand_EyeOffset(NetworkPacket* pkt)
 	*pkt >> player->eye_offset_first >> player->eye_offset_third;
 }
 
+void Client::handleCommand_NodemetaChanged(NetworkPacket* pkt)
+{
+	if (pkt->getSize() < 1)
+		return;
+
+	// Decompress the changes
+	std::istringstream tmp_is(pkt->readLongString(), std::ios::binary);
+	std::ostringstream tmp_os;
+	decompressZlib(tmp_is, tmp_os);
+	std::istringstream is(tmp_os.str(), std::ios::binary);
+
+	Map &map = m_env.getMap();
+	u32 count = readU32(is);
+	for (u32 i = 0; i < count; i++) {
+		v3s16 p = readV3S16(is);
+		bool has_meta = readU8(is) != 0;
+
+		// The block may have been unloaded in the meantime
+		v3s16 blockpos = getNodeBlockPos(p);
+		MapBlock *block = map.getBlockNoCreateNoEx(blockpos);
+		NodeMetadataList *list = block ? &block->m_node_metadata : NULL;
+		v3s16 p_rel = p - blockpos * MAP_BLOCKSIZE;
+
+		if (!has_meta) {
+			if (list)
+				list->remove(p_rel);
+			continue;
+		}
+
+		// Update existing metadata in place, a formspec may be
+		// showing its inventory
+		NodeMetadata *meta = list ? list->get(p_rel) : NULL;
+		if (meta) {
+			meta->deSerialize(is);
+			continue;
+		}
+		meta = new NodeMetadata(m_itemdef);
+		meta->deSerialize(is);
+		if (list)
+			list->set(p_rel, meta);
+		else
+			delete meta;
+	}
+}
+
 void Client::handleCommand_SrpBytesSandB(NetworkPacket* pkt)
 {
 	if ((m_chosen_auth_mech != AUTH_MECHANISM_LEGACY_PASSWORD)
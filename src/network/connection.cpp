@@ -71,6 +71,11 @@ static inline float CALC_DTIME(unsigned int lasttime, unsigned int curtime) {
 
 #define PING_TIMEOUT 5.0
 
+/* maximum number of datagrams read from the socket at once */
+#define RECEIVE_BATCH_SIZE 32
+/* maximum number of datagrams collected before they are sent at once */
+#define SEND_BATCH_SIZE 64
+
 static u16 readPeerId(u8 *packetdata)
 {
 	return readU16(&packetdata[4]);
@@ -205,18 +210,36 @@ SharedBuffer<u8> makeReliablePacket(
 	ReliablePacketBuffer
 */
 
-ReliablePacketBuffer::ReliablePacketBuffer(): m_list_size(0) {}
+#define RPB_MIN_CAPACITY 64
+// An empty buffer gives back the memory of a ring larger than this
+#define RPB_KEEP_CAPACITY 1024
+
+ReliablePacketBuffer::ReliablePacketBuffer():
+	m_slots(RPB_MIN_CAPACITY),
+	m_first_seqnum(0),
+	m_span(0),
+	m_list_size(0),
+	m_next_send_id(0),
+	m_time(0.0),
+	m_oldest_non_answered_ack(0)
+{}
+
+ReliablePacketBuffer::~ReliablePacketBuffer()
+{
+	for (size_t i = 0; i < m_slots.size(); i++)
+		delete m_slots[i].packet;
+}
 
 void ReliablePacketBuffer::print()
 {
 	MutexAutoLock listlock(m_list_mutex);
 	LOG(dout_con<<"Dump of ReliablePacketBuffer:" << std::endl);
 	unsigned int index = 0;
-	for(std::list<BufferedPacket>::iterator i = m_list.begin();
-		i != m_list.end();
-		++i)
+	for (u32 offset = 0; offset < m_span; offset++)
 	{
-		u16 s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
+		u16 s = m_first_seqnum + offset;
+		if (findSlot(s) == NULL)
+			continue;
 		LOG(dout_con<<index<< ":" << s << std::endl);
 		index++;
 	}
@@ -224,7 +247,7 @@ void ReliablePacketBuffer::print()
 bool ReliablePacketBuffer::empty()
 {
 	MutexAutoLock listlock(m_list_mutex);
-	return m_list.empty();
+	return m_list_size == 0;
 }
 
 u32 ReliablePacketBuffer::size()
@@ -234,80 +257,114 @@ u32 ReliablePacketBuffer::size()
 
 bool ReliablePacketBuffer::containsPacket(u16 seqnum)
 {
-	return !(findPacket(seqnum) == m_list.end());
+	return findSlot(seqnum) != NULL;
 }
 
-RPBSearchResult ReliablePacketBuffer::findPacket(u16 seqnum)
+ReliablePacketBuffer::Slot *ReliablePacketBuffer::findSlot(u16 seqnum)
 {
-	std::list<BufferedPacket>::iterator i = m_list.begin();
-	for(; i != m_list.end(); ++i)
-	{
-		u16 s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
-		/*dout_con<<"findPacket(): finding seqnum="<<seqnum
-				<<", comparing to s="<<s<<std::endl;*/
-		if (s == seqnum)
-			break;
+	if ((u16)(seqnum - m_first_seqnum) >= m_span)
+		return NULL;
+	Slot &slot = m_slots[seqnum & (m_slots.size() - 1)];
+	return slot.packet ? &slot : NULL;
+}
+
+BufferedPacket ReliablePacketBuffer::removeSlot(Slot &slot)
+{
+	BufferedPacket p = *slot.packet;
+	p.time = m_time - slot.sent_at;
+	p.totaltime = m_time - slot.buffered_at;
+	delete slot.packet;
+	slot.packet = NULL;
+	--m_list_size;
+
+	if (m_list_size == 0) {
+		m_span = 0;
+		m_resend_queue.clear();
+		if (m_slots.size() > RPB_KEEP_CAPACITY)
+			std::vector<Slot>(RPB_MIN_CAPACITY).swap(m_slots);
+		m_oldest_non_answered_ack = 0;
+		return p;
 	}
-	return i;
+
+	// Shrink the window to the packets left
+	u32 mask = m_slots.size() - 1;
+	while (m_slots[m_first_seqnum & mask].packet == NULL) {
+		m_first_seqnum++;
+		m_span--;
+	}
+	while (m_slots[(u16)(m_first_seqnum + m_span - 1) & mask].packet == NULL)
+		m_span--;
+
+	if (m_resend_queue.size() > 2 * m_list_size + RPB_MIN_CAPACITY)
+		compactResendQueue();
+
+	m_oldest_non_answered_ack = m_first_seqnum;
+	return p;
 }
-RPBSearchResult ReliablePacketBuffer::notFound()
+
+void ReliablePacketBuffer::reserve(u32 span)
+{
+	if (span <= m_slots.size())
+		return;
+
+	u32 capacity = m_slots.size();
+	while (capacity < span)
+		capacity *= 2;
+
+	std::vector<Slot> slots(capacity);
+	for (u32 offset = 0; offset < m_span; offset++) {
+		u16 s = m_first_seqnum + offset;
+		slots[s & (capacity - 1)] = m_slots[s & (m_slots.size() - 1)];
+	}
+	m_slots.swap(slots);
+}
+
+void ReliablePacketBuffer::queueResend(u16 seqnum, Slot &slot)
 {
-	return m_list.end();
+	slot.sent_at = m_time;
+	slot.send_id = m_next_send_id++;
+	m_resend_queue.push_back(ResendEntry(seqnum, slot.send_id));
 }
+
+// Drops the entries of packets that were acknowledged or sent again
+void ReliablePacketBuffer::compactResendQueue()
+{
+	std::deque<ResendEntry> queue;
+	for (std::deque<ResendEntry>::iterator i = m_resend_queue.begin();
+			i != m_resend_queue.end(); ++i) {
+		Slot *slot = findSlot(i->seqnum);
+		if (slot && slot->send_id == i->send_id)
+			queue.push_back(*i);
+	}
+	m_resend_queue.swap(queue);
+}
+
 bool ReliablePacketBuffer::getFirstSeqnum(u16& result)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	if (m_list.empty())
+	if (m_list_size == 0)
 		return false;
-	BufferedPacket p = *m_list.begin();
-	result = readU16(&p.data[BASE_HEADER_SIZE+1]);
+	result = m_first_seqnum;
 	return true;
 }
 
 BufferedPacket ReliablePacketBuffer::popFirst()
 {
 	MutexAutoLock listlock(m_list_mutex);
-	if (m_list.empty())
+	if (m_list_size == 0)
 		throw NotFoundException("Buffer is empty");
-	BufferedPacket p = *m_list.begin();
-	m_list.erase(m_list.begin());
-	--m_list_size;
-
-	if (m_list_size == 0) {
-		m_oldest_non_answered_ack = 0;
-	} else {
-		m_oldest_non_answered_ack =
-				readU16(&(*m_list.begin()).data[BASE_HEADER_SIZE+1]);
-	}
-	return p;
+	return removeSlot(*findSlot(m_first_seqnum));
 }
 BufferedPacket ReliablePacketBuffer::popSeqnum(u16 seqnum)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	RPBSearchResult r = findPacket(seqnum);
-	if (r == notFound()) {
+	Slot *slot = findSlot(seqnum);
+	if (slot == NULL) {
 		LOG(dout_con<<"Sequence number: " << seqnum
 				<< " not found in reliable buffer"<<std::endl);
 		throw NotFoundException("seqnum not found in buffer");
 	}
-	BufferedPacket p = *r;
-
-
-	RPBSearchResult next = r;
-	++next;
-	if (next != notFound()) {
-		u16 s = readU16(&(next->data[BASE_HEADER_SIZE+1]));
-		m_oldest_non_answered_ack = s;
-	}
-
-	m_list.erase(r);
-	--m_list_size;
-
-	if (m_list_size == 0)
-	{ m_oldest_non_answered_ack = 0; }
-	else
-	{ m_oldest_non_answered_ack = readU16(&(*m_list.begin()).data[BASE_HEADER_SIZE+1]);	}
-	return p;
+	return removeSlot(*slot);
 }
 void ReliablePacketBuffer::insert(BufferedPacket &p,u16 next_expected)
 {
@@ -336,48 +393,27 @@ void ReliablePacketBuffer::insert(BufferedPacket &p,u16 next_expected)
 		return;
 	}
 
-	++m_list_size;
-	sanity_check(m_list_size <= SEQNUM_MAX+1);	// FIXME: Handle the error?
-
-	// Find the right place for the packet and insert it there
-	// If list is empty, just add it
-	if (m_list.empty())
-	{
-		m_list.push_back(p);
-		m_oldest_non_answered_ack = seqnum;
-		// Done.
-		return;
-	}
-
-	// Otherwise find the right place
-	std::list<BufferedPacket>::iterator i = m_list.begin();
-	// Find the first packet in the list which has a higher seqnum
-	u16 s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
-
-	/* case seqnum is smaller then next_expected seqnum */
-	/* this is true e.g. on wrap around */
-	if (seqnum < next_expected) {
-		while(((s < seqnum) || (s >= next_expected)) && (i != m_list.end())) {
-			++i;
-			if (i != m_list.end())
-				s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
-		}
-	}
-	/* non wrap around case (at least for incoming and next_expected */
-	else
-	{
-		while(((s < seqnum) && (s >= next_expected)) && (i != m_list.end())) {
-			++i;
-			if (i != m_list.end())
-				s = readU16(&(i->data[BASE_HEADER_SIZE+1]));
-		}
-	}
-
-	if (s == seqnum) {
+	// Extend the window to seqnum, on the side given by next_expected
+	if (m_list_size == 0) {
+		m_first_seqnum = seqnum;
+		m_span = 1;
+	} else if ((u16)(seqnum - next_expected) <
+			(u16)(m_first_seqnum - next_expected)) {
+		u32 span = m_span + (u16)(m_first_seqnum - seqnum);
+		reserve(span);
+		m_first_seqnum = seqnum;
+		m_span = span;
+	} else if ((u16)(seqnum - m_first_seqnum) >= m_span) {
+		u32 span = (u16)(seqnum - m_first_seqnum) + 1;
+		reserve(span);
+		m_span = span;
+	}
+
+	Slot &slot = m_slots[seqnum & (m_slots.size() - 1)];
+	if (slot.packet != NULL) {
 		if (
-			(readU16(&(i->data[BASE_HEADER_SIZE+1])) != seqnum) ||
-			(i->data.getSize() != p.data.getSize()) ||
-			(i->address != p.address)
+			(slot.packet->data.getSize() != p.data.getSize()) ||
+			(slot.packet->address != p.address)
 			)
 		{
 			/* if this happens your maximum transfer window may be to big */
@@ -385,8 +421,9 @@ void ReliablePacketBuffer::insert(BufferedPacket &p,u16 next_expected)
 					"Duplicated seqnum %d non matching packet detected:\n",
 					seqnum);
 			fprintf(stderr, "Old: seqnum: %05d size: %04d, address: %s\n",
-					readU16(&(i->data[BASE_HEADER_SIZE+1])),i->data.getSize(),
-					i->address.serializeString().c_str());
+					readU16(&(slot.packet->data[BASE_HEADER_SIZE+1])),
+					slot.packet->data.getSize(),
+					slot.packet->address.serializeString().c_str());
 			fprintf(stderr, "New: seqnum: %05d size: %04u, address: %s\n",
 					readU16(&(p.data[BASE_HEADER_SIZE+1])),p.data.getSize(),
 					p.address.serializeString().c_str());
@@ -395,29 +432,22 @@ void ReliablePacketBuffer::insert(BufferedPacket &p,u16 next_expected)
 
 		/* nothing to do this seems to be a resent packet */
 		/* for paranoia reason data should be compared */
-		--m_list_size;
-	}
-	/* insert or push back */
-	else if (i != m_list.end()) {
-		m_list.insert(i, p);
-	}
-	else {
-		m_list.push_back(p);
+		return;
 	}
 
+	slot.packet = new BufferedPacket(p);
+	slot.buffered_at = m_time;
+	queueResend(seqnum, slot);
+	++m_list_size;
+
 	/* update last packet number */
-	m_oldest_non_answered_ack = readU16(&(*m_list.begin()).data[BASE_HEADER_SIZE+1]);
+	m_oldest_non_answered_ack = m_first_seqnum;
 }
 
 void ReliablePacketBuffer::incrementTimeouts(float dtime)
 {
 	MutexAutoLock listlock(m_list_mutex);
-	for(std::list<BufferedPacket>::iterator i = m_list.begin();
-		i != m_list.end(); ++i)
-	{
-		i->time += dtime;
-		i->totaltime += dtime;
-	}
+	m_time += dtime;
 }
 
 std::list<BufferedPacket> ReliablePacketBuffer::getTimedOuts(float timeout,
@@ -425,17 +455,30 @@ std::list<BufferedPacket> ReliablePacketBuffer::getTimedOuts(float timeout,
 {
 	MutexAutoLock listlock(m_list_mutex);
 	std::list<BufferedPacket> timed_outs;
-	for(std::list<BufferedPacket>::iterator i = m_list.begin();
-		i != m_list.end(); ++i)
-	{
-		if (i->time >= timeout) {
-			timed_outs.push_back(*i);
+	while (!m_resend_queue.empty()) {
+		ResendEntry entry = m_resend_queue.front();
+		Slot *slot = findSlot(entry.seqnum);
 
-			//this packet will be sent right afterwards reset timeout here
-			i->time = 0.0;
-			if (timed_outs.size() >= max_packets)
-				break;
+		// Acknowledged or sent again since
+		if (slot == NULL || slot->send_id != entry.send_id) {
+			m_resend_queue.pop_front();
+			continue;
 		}
+
+		// Everything after this was sent later
+		if (m_time - slot->sent_at < timeout)
+			break;
+
+		m_resend_queue.pop_front();
+		BufferedPacket p = *slot->packet;
+		p.time = m_time - slot->sent_at;
+		p.totaltime = m_time - slot->buffered_at;
+		timed_outs.push_back(p);
+
+		//this packet will be sent right afterwards reset timeout here
+		queueResend(entry.seqnum, *slot);
+		if (timed_outs.size() >= max_packets)
+			break;
 	}
 	return timed_outs;
 }
@@ -479,8 +522,7 @@ SharedBuffer<u8> IncomingSplitBuffer::insert(BufferedPacket &p, bool reliable)
 	// Add if doesn't exist
 	if (m_buf.find(seqnum) == m_buf.end())
 	{
-		IncomingSplitPacket *sp = new IncomingSplitPacket();
-		sp->chunk_count = chunk_count;
+		IncomingSplitPacket *sp = new IncomingSplitPacket(chunk_count);
 		sp->reliable = reliable;
 		m_buf[seqnum] = sp;
 	}
@@ -497,6 +539,13 @@ SharedBuffer<u8> IncomingSplitBuffer::insert(BufferedPacket &p, bool reliable)
 				<<" != sp->reliable="<<sp->reliable
 				<<std::endl);
 
+	if (chunk_num >= sp->chunk_count) {
+		LOG(derr_con<<"Connection: WARNING: chunk_num="<<chunk_num
+				<<" >= sp->chunk_count="<<sp->chunk_count
+				<<std::endl);
+		return SharedBuffer<u8>();
+	}
+
 	// If chunk already exists, ignore it.
 	// Sometimes two identical packets may arrive when there is network
 	// lag and the server re-sends stuff.
@@ -510,27 +559,21 @@ SharedBuffer<u8> IncomingSplitBuffer::insert(BufferedPacket &p, bool reliable)
 
 	// Set chunk data in buffer
 	sp->chunks[chunk_num] = chunkdata;
+	sp->chunks_received++;
+	sp->totalsize += chunkdatasize;
 
 	// If not all chunks are received, return empty buffer
 	if (sp->allReceived() == false)
 		return SharedBuffer<u8>();
 
-	// Calculate total size
-	u32 totalsize = 0;
-	for(std::map<u16, SharedBuffer<u8> >::iterator i = sp->chunks.begin();
-		i != sp->chunks.end(); ++i)
-	{
-		totalsize += i->second.getSize();
-	}
-
-	SharedBuffer<u8> fulldata(totalsize);
+	SharedBuffer<u8> fulldata(sp->totalsize);
 
 	// Copy chunks to data buffer
 	u32 start = 0;
-	for(u32 chunk_i=0; chunk_i<sp->chunk_count;
-			chunk_i++)
+	for(std::map<u16, SharedBuffer<u8> >::iterator i = sp->chunks.begin();
+			i != sp->chunks.end(); ++i)
 	{
-		SharedBuffer<u8> buf = sp->chunks[chunk_i];
+		const SharedBuffer<u8> &buf = i->second;
 		u16 chunkdatasize = buf.getSize();
 		memcpy(&fulldata[start], *buf, chunkdatasize);
 		start += chunkdatasize;;
@@ -1316,6 +1359,8 @@ void * ConnectionSendThread::run()
 		/* send non reliable packets */
 		sendPackets(dtime);
 
+		flushSendBatch();
+
 		END_DEBUG_EXCEPTION_HANDLER
 	}
 
@@ -1485,17 +1530,36 @@ void ConnectionSendThread::runTimeouts(float dtime)
 
 void ConnectionSendThread::rawSend(const BufferedPacket &packet)
 {
-	try{
-		m_connection->m_udpSocket.Send(packet.address, *packet.data,
-				packet.data.getSize());
-		LOG(dout_con <<m_connection->getDesc()
-				<< " rawSend: " << packet.data.getSize()
-				<< " bytes sent" << std::endl);
-	} catch(SendFailedException &e) {
+	/* packets are sent at the end of the iteration, all at once */
+	m_send_batch.push_back(packet);
+	if (m_send_batch.size() >= SEND_BATCH_SIZE)
+		flushSendBatch();
+}
+
+void ConnectionSendThread::flushSendBatch()
+{
+	if (m_send_batch.empty())
+		return;
+
+	std::vector<UDPDatagram> datagrams(m_send_batch.size());
+	for (size_t i = 0; i < m_send_batch.size(); i++) {
+		datagrams[i].address = m_send_batch[i].address;
+		datagrams[i].data = *m_send_batch[i].data;
+		datagrams[i].size = m_send_batch[i].data.getSize();
+	}
+
+	int sent = m_connection->m_udpSocket.SendBatch(&datagrams[0],
+			datagrams.size());
+	LOG(dout_con <<m_connection->getDesc()
+			<< " rawSend: " << sent << " of " << datagrams.size()
+			<< " packets sent" << std::endl);
+	if (sent != (int)datagrams.size()) {
 		LOG(derr_con<<m_connection->getDesc()
-				<<"Connection::rawSend(): SendFailedException: "
-				<<packet.address.serializeString()<<std::endl);
+				<<"Connection::flushSendBatch(): failed to send "
+				<<(datagrams.size() - sent)<<" packets"<<std::endl);
 	}
+
+	m_send_batch.clear();
 }
 
 void ConnectionSendThread::sendAsPacketReliable(BufferedPacket& p, Channel* channel)
@@ -2111,7 +2175,12 @@ void ConnectionReceiveThread::receive()
 	// theoretical reliable upper boundary of a udp packet for all IPv6 enabled
 	// infrastructure
 	unsigned int packet_maxsize = 1500;
-	SharedBuffer<u8> packetdata(packet_maxsize);
+	std::vector<u8> packetdata(packet_maxsize * RECEIVE_BATCH_SIZE);
+	UDPDatagram datagrams[RECEIVE_BATCH_SIZE];
+	for (u32 i = 0; i < RECEIVE_BATCH_SIZE; i++) {
+		datagrams[i].data = &packetdata[i * packet_maxsize];
+		datagrams[i].capacity = packet_maxsize;
+	}
 
 	bool packet_queued = true;
 
@@ -2122,147 +2191,155 @@ void ConnectionReceiveThread::receive()
 	while( (loop_count < 10) &&
 			(m_connection->m_udpSocket.WaitData(50))) {
 		loop_count++;
-		try {
-			if (packet_queued) {
-				bool data_left = true;
-				u16 peer_id;
-				SharedBuffer<u8> resultdata;
-				while(data_left) {
-					try {
-						data_left = getFromBuffers(peer_id, resultdata);
-						if (data_left) {
-							ConnectionEvent e;
-							e.dataReceived(peer_id, resultdata);
-							m_connection->putEvent(e);
+
+		/* take everything that is queued up to the batch size */
+		int count = m_connection->m_udpSocket.ReceiveBatch(datagrams,
+				RECEIVE_BATCH_SIZE);
+
+		for (int i = 0; i < count; i++) {
+			try {
+				if (packet_queued) {
+					bool data_left = true;
+					u16 peer_id;
+					SharedBuffer<u8> resultdata;
+					while(data_left) {
+						try {
+							data_left = getFromBuffers(peer_id, resultdata);
+							if (data_left) {
+								ConnectionEvent e;
+								e.dataReceived(peer_id, resultdata);
+								m_connection->putEvent(e);
+							}
+						}
+						catch(ProcessedSilentlyException &e) {
+							/* try reading again */
 						}
 					}
-					catch(ProcessedSilentlyException &e) {
-						/* try reading again */
-					}
+					packet_queued = false;
 				}
-				packet_queued = false;
-			}
 
-			Address sender;
-			s32 received_size = m_connection->m_udpSocket.Receive(sender, *packetdata, packet_maxsize);
+				Address &sender = datagrams[i].address;
+				s32 received_size = datagrams[i].size;
+				u8 *packetdata = (u8 *)datagrams[i].data;
 
-			if ((received_size < BASE_HEADER_SIZE) ||
-				(readU32(&packetdata[0]) != m_connection->GetProtocolID()))
-			{
-				LOG(derr_con<<m_connection->getDesc()
-						<<"Receive(): Invalid incoming packet, "
-						<<"size: " << received_size
-						<<", protocol: "
-						<< ((received_size >= 4) ? readU32(&packetdata[0]) : -1)
-						<< std::endl);
-				continue;
-			}
+				if ((received_size < BASE_HEADER_SIZE) ||
+					(readU32(&packetdata[0]) != m_connection->GetProtocolID()))
+				{
+					LOG(derr_con<<m_connection->getDesc()
+							<<"Receive(): Invalid incoming packet, "
+							<<"size: " << received_size
+							<<", protocol: "
+							<< ((received_size >= 4) ? readU32(&packetdata[0]) : -1)
+							<< std::endl);
+					continue;
+				}
 
-			u16 peer_id          = readPeerId(*packetdata);
-			u8 channelnum        = readChannel(*packetdata);
+				u16 peer_id          = readPeerId(packetdata);
+				u8 channelnum        = readChannel(packetdata);
 
-			if (channelnum > CHANNEL_COUNT-1) {
-				LOG(derr_con<<m_connection->getDesc()
-						<<"Receive(): Invalid channel "<<channelnum<<std::endl);
-				throw InvalidIncomingDataException("Channel doesn't exist");
-			}
+				if (channelnum > CHANNEL_COUNT-1) {
+					LOG(derr_con<<m_connection->getDesc()
+							<<"Receive(): Invalid channel "<<channelnum<<std::endl);
+					throw InvalidIncomingDataException("Channel doesn't exist");
+				}
 
-			/* preserve original peer_id for later usage */
-			u16 packet_peer_id   = peer_id;
+				/* preserve original peer_id for later usage */
+				u16 packet_peer_id   = peer_id;
 
-			/* Try to identify peer by sender address (may happen on join) */
-			if (peer_id == PEER_ID_INEXISTENT) {
-				peer_id = m_connection->lookupPeer(sender);
-			}
+				/* Try to identify peer by sender address (may happen on join) */
+				if (peer_id == PEER_ID_INEXISTENT) {
+					peer_id = m_connection->lookupPeer(sender);
+				}
 
-			/* The peer was not found in our lists. Add it. */
-			if (peer_id == PEER_ID_INEXISTENT) {
-				peer_id = m_connection->createPeer(sender, MTP_MINETEST_RELIABLE_UDP, 0);
-			}
+				/* The peer was not found in our lists. Add it. */
+				if (peer_id == PEER_ID_INEXISTENT) {
+					peer_id = m_connection->createPeer(sender, MTP_MINETEST_RELIABLE_UDP, 0);
+				}
 
-			PeerHelper peer = m_connection->getPeerNoEx(peer_id);
+				PeerHelper peer = m_connection->getPeerNoEx(peer_id);
 
-			if (!peer) {
-				LOG(dout_con<<m_connection->getDesc()
-						<<" got packet from unknown peer_id: "
-						<<peer_id<<" Ignoring."<<std::endl);
-				continue;
-			}
+				if (!peer) {
+					LOG(dout_con<<m_connection->getDesc()
+							<<" got packet from unknown peer_id: "
+							<<peer_id<<" Ignoring."<<std::endl);
+					continue;
+				}
 
-			// Validate peer address
+				// Validate peer address
 
-			Address peer_address;
+				Address peer_address;
 
-			if (peer->getAddress(MTP_UDP, peer_address)) {
-				if (peer_address != sender) {
-					LOG(derr_con<<m_connection->getDesc()
-							<<m_connection->getDesc()
-							<<" Peer "<<peer_id<<" sending from different address."
-							" Ignoring."<<std::endl);
-					continue;
+				if (peer->getAddress(MTP_UDP, peer_address)) {
+					if (peer_address != sender) {
+						LOG(derr_con<<m_connection->getDesc()
+								<<m_connection->getDesc()
+								<<" Peer "<<peer_id<<" sending from different address."
+								" Ignoring."<<std::endl);
+						continue;
+					}
 				}
-			}
-			else {
-
-				bool invalid_address = true;
-				if (invalid_address) {
-					LOG(derr_con<<m_connection->getDesc()
-							<<m_connection->getDesc()
-							<<" Peer "<<peer_id<<" unknown."
-							" Ignoring."<<std::endl);
-					continue;
+				else {
+
+					bool invalid_address = true;
+					if (invalid_address) {
+						LOG(derr_con<<m_connection->getDesc()
+								<<m_connection->getDesc()
+								<<" Peer "<<peer_id<<" unknown."
+								" Ignoring."<<std::endl);
+						continue;
+					}
 				}
-			}
 
 
-			/* mark peer as seen with id */
-			if (!(packet_peer_id == PEER_ID_INEXISTENT))
-				peer->setSentWithID();
+				/* mark peer as seen with id */
+				if (!(packet_peer_id == PEER_ID_INEXISTENT))
+					peer->setSentWithID();
 
-			peer->ResetTimeout();
+				peer->ResetTimeout();
 
-			Channel *channel = 0;
+				Channel *channel = 0;
 
-			if (dynamic_cast<UDPPeer*>(&peer) != 0)
-			{
-				channel = &(dynamic_cast<UDPPeer*>(&peer)->channels[channelnum]);
-			}
+				if (dynamic_cast<UDPPeer*>(&peer) != 0)
+				{
+					channel = &(dynamic_cast<UDPPeer*>(&peer)->channels[channelnum]);
+				}
 
-			if (channel != 0) {
-				channel->UpdateBytesReceived(received_size);
-			}
+				if (channel != 0) {
+					channel->UpdateBytesReceived(received_size);
+				}
 
-			// Throw the received packet to channel->processPacket()
+				// Throw the received packet to channel->processPacket()
 
-			// Make a new SharedBuffer from the data without the base headers
-			SharedBuffer<u8> strippeddata(received_size - BASE_HEADER_SIZE);
-			memcpy(*strippeddata, &packetdata[BASE_HEADER_SIZE],
-					strippeddata.getSize());
+				// Make a new SharedBuffer from the data without the base headers
+				SharedBuffer<u8> strippeddata(received_size - BASE_HEADER_SIZE);
+				memcpy(*strippeddata, &packetdata[BASE_HEADER_SIZE],
+						strippeddata.getSize());
 
-			try{
-				// Process it (the result is some data with no headers made by us)
-				SharedBuffer<u8> resultdata = processPacket
-						(channel, strippeddata, peer_id, channelnum, false);
+				try{
+					// Process it (the result is some data with no headers made by us)
+					SharedBuffer<u8> resultdata = processPacket
+							(channel, strippeddata, peer_id, channelnum, false);
 
-				LOG(dout_con<<m_connection->getDesc()
-						<<" ProcessPacket from peer_id: " << peer_id
-						<< ",channel: " << (channelnum & 0xFF) << ", returned "
-						<< resultdata.getSize() << " bytes" <<std::endl);
+					LOG(dout_con<<m_connection->getDesc()
+							<<" ProcessPacket from peer_id: " << peer_id
+							<< ",channel: " << (channelnum & 0xFF) << ", returned "
+							<< resultdata.getSize() << " bytes" <<std::endl);
 
-				ConnectionEvent e;
-				e.dataReceived(peer_id, resultdata);
-				m_connection->putEvent(e);
+					ConnectionEvent e;
+					e.dataReceived(peer_id, resultdata);
+					m_connection->putEvent(e);
+				}
+				catch(ProcessedSilentlyException &e) {
+				}
+				catch(ProcessedQueued &e) {
+					packet_queued = true;
+				}
 			}
-			catch(ProcessedSilentlyException &e) {
+			catch(InvalidIncomingDataException &e) {
 			}
-			catch(ProcessedQueued &e) {
-				packet_queued = true;
+			catch(ProcessedSilentlyException &e) {
 			}
 		}
-		catch(InvalidIncomingDataException &e) {
-		}
-		catch(ProcessedSilentlyException &e) {
-		}
 	}
 }
 
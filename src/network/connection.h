@@ -31,8 +31,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/numeric.h"
 #include <iostream>
 #include <fstream>
+#include <deque>
 #include <list>
 #include <map>
+#include <vector>
 
 class NetworkPacket;
 
@@ -210,20 +212,27 @@ SharedBuffer<u8> makeReliablePacket(
 
 struct IncomingSplitPacket
 {
-	IncomingSplitPacket()
+	IncomingSplitPacket(u32 a_chunk_count):
+		chunks_received(0),
+		chunk_count(a_chunk_count),
+		totalsize(0)
 	{
 		time = 0.0;
 		reliable = false;
 	}
-	// Key is chunk number, value is data without headers
+	// Key is chunk number, value is data without headers.
+	// Only holds the chunks that have arrived, chunk_count comes from
+	// the peer and can't be trusted to size anything.
 	std::map<u16, SharedBuffer<u8> > chunks;
+	u32 chunks_received;
 	u32 chunk_count;
+	u32 totalsize; // Of the chunks received so far
 	float time; // Seconds from adding
 	bool reliable; // If true, isn't deleted on timeout
 
 	bool allReceived()
 	{
-		return (chunks.size() == chunk_count);
+		return (chunks_received == chunk_count);
 	}
 };
 
@@ -317,12 +326,20 @@ with a buffer in the receiving and transmitting end.
 	for fast access to the smallest one.
 */
 
-typedef std::list<BufferedPacket>::iterator RPBSearchResult;
+/*
+	Reliable packets of a channel, by sequence number.
 
+	Packet seqnum is kept in slot seqnum & (capacity - 1) of a ring that
+	grows up to the whole 16 bit sequence number space, so lookups don't
+	search. The resend queue has the packets in the order they were last
+	sent; as they all share one timeout, the timed out ones are at its
+	front.
+*/
 class ReliablePacketBuffer
 {
 public:
 	ReliablePacketBuffer();
+	~ReliablePacketBuffer();
 
 	bool getFirstSeqnum(u16& result);
 
@@ -337,16 +354,47 @@ class ReliablePacketBuffer
 	void print();
 	bool empty();
 	bool containsPacket(u16 seqnum);
-	RPBSearchResult notFound();
 	u32 size();
 
 
 private:
-	RPBSearchResult findPacket(u16 seqnum);
-
-	std::list<BufferedPacket> m_list;
+	struct Slot
+	{
+		Slot(): packet(NULL), buffered_at(0.0), sent_at(0.0), send_id(0) {}
+		BufferedPacket *packet; // NULL if the slot is empty
+		double buffered_at;
+		double sent_at;
+		// Matches the resend queue entry of the last send
+		u32 send_id;
+	};
+
+	struct ResendEntry
+	{
+		ResendEntry(u16 a_seqnum, u32 a_send_id):
+			seqnum(a_seqnum), send_id(a_send_id) {}
+		u16 seqnum;
+		u32 send_id;
+	};
+
+	// Returns NULL if there is no packet with seqnum
+	Slot *findSlot(u16 seqnum);
+	BufferedPacket removeSlot(Slot &slot);
+	void reserve(u32 span);
+	void queueResend(u16 seqnum, Slot &slot);
+	void compactResendQueue();
+
+	// Size is a power of two, at least m_span
+	std::vector<Slot> m_slots;
+	// All packets are in [m_first_seqnum, m_first_seqnum + m_span)
+	u16 m_first_seqnum;
+	u32 m_span;
 	u32 m_list_size;
 
+	std::deque<ResendEntry> m_resend_queue;
+	u32 m_next_send_id;
+	// Seconds passed to incrementTimeouts()
+	double m_time;
+
 	u16 m_oldest_non_answered_ack;
 
 	Mutex m_list_mutex;
@@ -932,6 +980,7 @@ class ConnectionSendThread : public Thread {
 private:
 	void runTimeouts    (float dtime);
 	void rawSend        (const BufferedPacket &packet);
+	void flushSendBatch ();
 	bool rawSendAsPacket(u16 peer_id, u8 channelnum,
 							SharedBuffer<u8> data, bool reliable);
 
@@ -962,6 +1011,8 @@ class ConnectionSendThread : public Thread {
 	float                 m_timeout;
 	std::queue<OutgoingPacket> m_outgoing_queue;
 	Semaphore             m_send_sleep_semaphore;
+	/* packets passed to rawSend() that are not sent yet */
+	std::vector<BufferedPacket> m_send_batch;
 
 	unsigned int          m_iteration_packets_avaialble;
 	unsigned int          m_max_commands_per_iteration;
@@ -136,9 +136,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 		backface_culling: backwards compatibility for playing with
 		newer client on pre-27 servers.
 		Add nodedef v3 - connected nodeboxes
+	PROTOCOL_VERSION 28:
+		Add TOCLIENT_NODEMETA_CHANGED, changed node metadata is no longer
+			sent as the whole block
+		Add TOCLIENT_INVENTORY_DELTA, changed inventories are no longer
+			sent whole
 */
 
-#define LATEST_PROTOCOL_VERSION 27
+#define LATEST_PROTOCOL_VERSION 28
 
 // Server's supported network protocol range
 #define SERVER_PROTOCOL_VERSION_MIN 13
@@ -591,6 +596,45 @@ enum ToClientCommand
 		u32 id
 	*/
 
+	TOCLIENT_NODEMETA_CHANGED = 0x54,
+	/*
+		u32 length of the next item
+		zlib-compressed serialized metadata changes:
+			u32 count
+			for each:
+				v3s16 node position
+				u8 has metadata (0 if it was removed)
+				if has metadata:
+					NodeMetadata
+	*/
+
+	TOCLIENT_INVENTORY_DELTA = 0x55,
+	/*
+		Changes to the player's inventory or a detached inventory since
+		the last TOCLIENT_INVENTORY, TOCLIENT_DETACHED_INVENTORY or
+		TOCLIENT_INVENTORY_DELTA for it.
+
+		u16 len
+		u8[len] detached inventory name, empty for the player's inventory
+		u16 count of changed lists
+		for each:
+			u16 len
+			u8[len] list name
+			u8 type (0: changed slots, 1: whole list, 2: list removed)
+			if type == 0:
+				u32 count of changed slots
+				for each:
+					u32 slot index
+					u32 len
+					u8[len] item string, empty for an empty slot
+			if type == 1:
+				u32 list size
+				u32 list width
+				for each slot:
+					u32 len
+					u8[len] item string, empty for an empty slot
+	*/
+
 	TOCLIENT_SRP_BYTES_S_B = 0x60,
 	/*
 		Belonging to AUTH_MECHANISM_LEGACY_PASSWORD and AUTH_MECHANISM_SRP.
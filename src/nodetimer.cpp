@@ -47,24 +47,26 @@ void NodeTimerList::serialize(std::ostream &os, u8 map_format_version) const
 {
 	if (map_format_version == 24) {
 		// Version 0 is a placeholder for "nothing to see here; go away."
-		if (m_data.empty()) {
+		if (m_positions.empty()) {
 			writeU8(os, 0); // version
 			return;
 		}
 		writeU8(os, 1); // version
-		writeU16(os, m_data.size());
+		writeU16(os, m_positions.size());
 	}
 
 	if (map_format_version >= 25) {
 		writeU8(os, 2 + 4 + 4); // length of the data for a single timer
-		writeU16(os, m_data.size());
+		writeU16(os, m_positions.size());
 	}
 
-	for (std::map<v3s16, NodeTimer>::const_iterator
-			i = m_data.begin();
-			i != m_data.end(); ++i) {
+	// Sorted by position
+	for (std::map<v3s16, TimerQueue::iterator>::const_iterator
+			i = m_positions.begin();
+			i != m_positions.end(); ++i) {
 		v3s16 p = i->first;
-		NodeTimer t = i->second;
+		f32 timeout = i->second->second.timeout;
+		NodeTimer t(timeout, timeout - (i->second->first - m_time));
 
 		u16 p16 = p.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE + p.Y * MAP_BLOCKSIZE + p.X;
 		writeU16(os, p16);
@@ -74,7 +76,7 @@ void NodeTimerList::serialize(std::ostream &os, u8 map_format_version) const
 
 void NodeTimerList::deSerialize(std::istream &is, u8 map_format_version)
 {
-	m_data.clear();
+	clear();
 
 	if(map_format_version == 24){
 		u8 timer_version = readU8(is);
@@ -115,7 +117,7 @@ void NodeTimerList::deSerialize(std::istream &is, u8 map_format_version)
 			continue;
 		}
 
-		if(m_data.find(p) != m_data.end())
+		if(m_positions.find(p) != m_positions.end())
 		{
 			warningstream<<"NodeTimerList::deSerialize(): "
 					<<"already set data at position"
@@ -124,31 +126,63 @@ void NodeTimerList::deSerialize(std::istream &is, u8 map_format_version)
 			continue;
 		}
 
-		m_data.insert(std::make_pair(p, t));
+		set(p, t);
 	}
 }
 
-std::map<v3s16, NodeTimer> NodeTimerList::step(float dtime)
+NodeTimer NodeTimerList::get(v3s16 p) const
 {
-	std::map<v3s16, NodeTimer> elapsed_timers;
-	// Increment timers
-	for(std::map<v3s16, NodeTimer>::iterator
-			i = m_data.begin();
-			i != m_data.end(); ++i){
-		v3s16 p = i->first;
-		NodeTimer t = i->second;
-		t.elapsed += dtime;
-		if(t.elapsed >= t.timeout)
-			elapsed_timers.insert(std::make_pair(p, t));
-		else
-			i->second = t;
+	std::map<v3s16, TimerQueue::iterator>::const_iterator n =
+		m_positions.find(p);
+	if (n == m_positions.end())
+		return NodeTimer();
+	f32 timeout = n->second->second.timeout;
+	return NodeTimer(timeout, timeout - (n->second->first - m_time));
+}
+
+void NodeTimerList::remove(v3s16 p)
+{
+	std::map<v3s16, TimerQueue::iterator>::iterator n = m_positions.find(p);
+	if (n == m_positions.end())
+		return;
+	m_timers.erase(n->second);
+	m_positions.erase(n);
+}
+
+void NodeTimerList::set(v3s16 p, NodeTimer t)
+{
+	remove(p);
+	TimerData data;
+	data.p = p;
+	data.timeout = t.timeout;
+	TimerQueue::iterator i = m_timers.insert(
+		std::make_pair(m_time + t.timeout - t.elapsed, data));
+	m_positions[p] = i;
+}
+
+void NodeTimerList::clear()
+{
+	m_timers.clear();
+	m_positions.clear();
+	// Keep the clock small, it is only meaningful relative to the timers
+	m_time = 0;
+}
+
+void NodeTimerList::step(float dtime,
+	std::vector<std::pair<v3s16, NodeTimer> > &dest)
+{
+	if (m_timers.empty()) {
+		m_time = 0;
+		return;
 	}
-	// Delete elapsed timers
-	for(std::map<v3s16, NodeTimer>::const_iterator
-			i = elapsed_timers.begin();
-			i != elapsed_timers.end(); ++i){
-		v3s16 p = i->first;
-		m_data.erase(p);
+
+	m_time += dtime;
+	while (!m_timers.empty() && m_timers.begin()->first <= m_time) {
+		TimerQueue::iterator i = m_timers.begin();
+		const TimerData &data = i->second;
+		dest.push_back(std::make_pair(data.p, NodeTimer(data.timeout,
+			data.timeout + (m_time - i->first))));
+		m_positions.erase(data.p);
+		m_timers.erase(i);
 	}
-	return elapsed_timers;
 }
@@ -21,8 +21,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define NODETIMER_HEADER
 
 #include "irr_v3d.h"
+#include "util/basic_macros.h"
 #include <iostream>
 #include <map>
+#include <vector>
 
 /*
 	NodeTimer provides per-node timed callback functionality.
@@ -49,42 +51,47 @@ class NodeTimer
 
 /*
 	List of timers of all the nodes of a block
+
+	Timers are ordered by the time at which they elapse, on a clock that
+	advances with step(). A step only touches the timers that elapse.
 */
 
 class NodeTimerList
 {
 public:
-	NodeTimerList() {}
+	NodeTimerList(): m_time(0) {}
 	~NodeTimerList() {}
 	
 	void serialize(std::ostream &os, u8 map_format_version) const;
 	void deSerialize(std::istream &is, u8 map_format_version);
 	
 	// Get timer
-	NodeTimer get(v3s16 p){
-		std::map<v3s16, NodeTimer>::iterator n = m_data.find(p);
-		if(n == m_data.end())
-			return NodeTimer();
-		return n->second;
-	}
+	NodeTimer get(v3s16 p) const;
 	// Deletes timer
-	void remove(v3s16 p){
-		m_data.erase(p);
-	}
+	void remove(v3s16 p);
 	// Deletes old timer and sets a new one
-	void set(v3s16 p, NodeTimer t){
-		m_data[p] = t;
-	}
+	void set(v3s16 p, NodeTimer t);
 	// Deletes all timers
-	void clear(){
-		m_data.clear();
-	}
+	void clear();
 
-	// A step in time. Returns map of elapsed timers.
-	std::map<v3s16, NodeTimer> step(float dtime);
+	// A step in time. Removes the elapsed timers and adds them to dest.
+	void step(float dtime, std::vector<std::pair<v3s16, NodeTimer> > &dest);
 
 private:
-	std::map<v3s16, NodeTimer> m_data;
+	// m_positions points into m_timers
+	DISABLE_CLASS_COPY(NodeTimerList);
+
+	struct TimerData {
+		v3s16 p;
+		f32 timeout;
+	};
+	typedef std::multimap<double, TimerData> TimerQueue;
+
+	// Timers by the time at which they elapse
+	TimerQueue m_timers;
+	// Timers by node position
+	std::map<v3s16, TimerQueue::iterator> m_positions;
+	double m_time;
 };
 
 #endif
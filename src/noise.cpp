@@ -32,20 +32,22 @@
 #include "util/string.h"
 #include "exceptions.h"
 
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) && \
+		(defined(__clang__) || __GNUC__ > 4 || \
+		(__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+	#define NOISE_X86_SIMD 1
+	#include <immintrin.h>
+	#define NOISE_TARGET_SSE2 __attribute__((target("sse2")))
+	#define NOISE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define NOISE_X86_SIMD 0
+#endif
+
 #define NOISE_MAGIC_X    1619
 #define NOISE_MAGIC_Y    31337
 #define NOISE_MAGIC_Z    52591
 #define NOISE_MAGIC_SEED 1013
 
-typedef float (*Interp2dFxn)(
-		float v00, float v10, float v01, float v11,
-		float x, float y);
-
-typedef float (*Interp3dFxn)(
-		float v000, float v100, float v010, float v110,
-		float v001, float v101, float v011, float v111,
-		float x, float y, float z);
-
 float cos_lookup[16] = {
 	1.0,  0.9238,  0.7071,  0.3826, 0, -0.3826, -0.7071, -0.9238,
 	1.0, -0.9238, -0.7071, -0.3826, 0,  0.3826,  0.7071,  0.9238
@@ -156,23 +158,27 @@ s32 PcgRandom::randNormalDist(s32 min, s32 max, int num_trials)
 
 ///////////////////////////////////////////////////////////////////////////////
 
-float noise2d(int x, int y, int seed)
+// n is the sum of the NOISE_MAGIC_* products of a lattice point
+static inline float lattice_value(u32 n)
 {
-	unsigned int n = (NOISE_MAGIC_X * x + NOISE_MAGIC_Y * y
-			+ NOISE_MAGIC_SEED * seed) & 0x7fffffff;
+	n &= 0x7fffffff;
 	n = (n >> 13) ^ n;
 	n = (n * (n * n * 60493 + 19990303) + 1376312589) & 0x7fffffff;
 	return 1.f - (float)(int)n / 0x40000000;
 }
 
 
+float noise2d(int x, int y, int seed)
+{
+	return lattice_value((u32)NOISE_MAGIC_X * x + (u32)NOISE_MAGIC_Y * y
+			+ (u32)NOISE_MAGIC_SEED * seed);
+}
+
+
 float noise3d(int x, int y, int z, int seed)
 {
-	unsigned int n = (NOISE_MAGIC_X * x + NOISE_MAGIC_Y * y + NOISE_MAGIC_Z * z
-			+ NOISE_MAGIC_SEED * seed) & 0x7fffffff;
-	n = (n >> 13) ^ n;
-	n = (n * (n * n * 60493 + 19990303) + 1376312589) & 0x7fffffff;
-	return 1.f - (float)(int)n / 0x40000000;
+	return lattice_value((u32)NOISE_MAGIC_X * x + (u32)NOISE_MAGIC_Y * y
+			+ (u32)NOISE_MAGIC_Z * z + (u32)NOISE_MAGIC_SEED * seed);
 }
 
 
@@ -416,6 +422,360 @@ float NoisePerlin3D(NoiseParams *np, float x, float y, float z, int seed)
 }
 
 
+/*
+	Kernels of the noise maps.
+
+	The SSE2 and AVX2 versions do exactly the float operations of the scalar
+	ones, in the same order and without fused multiply-adds, so all of them
+	give bit-identical maps.
+*/
+struct NoiseKernels {
+	NoiseSimdLevel level;
+	// dest[i] = value of the lattice point x0 + i of the row with the
+	// NOISE_MAGIC_* sum base (everything but the x term)
+	void (*fillLatticeRow)(float *dest, u32 count, s32 x0, u32 base);
+	// dest[i] = a[i] + (b[i] - a[i]) * t
+	void (*interpolate)(float *dest, const float *a, const float *b,
+		float t, u32 count);
+	// interpolate() between a0 and b0 and between a1 and b1 by ty, then
+	// between those two by tz
+	void (*interpolate2)(float *dest, const float *a0, const float *b0,
+		const float *a1, const float *b1, float ty, float tz, u32 count);
+	// result[i] += g * grad[i] (or fabs(grad[i]))
+	void (*accumulate)(float *result, const float *grad, float g,
+		size_t count, bool absvalue);
+	// result[i] += gmap[i] * grad[i] (or fabs(grad[i])),
+	// gmap[i] *= persistence_map[i]
+	void (*accumulateMap)(float *result, const float *grad, float *gmap,
+		const float *persistence_map, size_t count, bool absvalue);
+};
+
+
+static void fill_lattice_row_scalar(float *dest, u32 count, s32 x0, u32 base)
+{
+	u32 n = (u32)NOISE_MAGIC_X * x0 + base;
+	for (u32 i = 0; i != count; i++, n += NOISE_MAGIC_X)
+		dest[i] = lattice_value(n);
+}
+
+static void interpolate_scalar(float *dest, const float *a, const float *b,
+	float t, u32 count)
+{
+	for (u32 i = 0; i != count; i++)
+		dest[i] = linearInterpolation(a[i], b[i], t);
+}
+
+static void interpolate2_scalar(float *dest, const float *a0, const float *b0,
+	const float *a1, const float *b1, float ty, float tz, u32 count)
+{
+	for (u32 i = 0; i != count; i++) {
+		float u = linearInterpolation(a0[i], b0[i], ty);
+		float v = linearInterpolation(a1[i], b1[i], ty);
+		dest[i] = linearInterpolation(u, v, tz);
+	}
+}
+
+static void accumulate_scalar(float *result, const float *grad, float g,
+	size_t count, bool absvalue)
+{
+	if (absvalue) {
+		for (size_t i = 0; i != count; i++)
+			result[i] += g * fabsf(grad[i]);
+	} else {
+		for (size_t i = 0; i != count; i++)
+			result[i] += g * grad[i];
+	}
+}
+
+static void accumulate_map_scalar(float *result, const float *grad,
+	float *gmap, const float *persistence_map, size_t count, bool absvalue)
+{
+	if (absvalue) {
+		for (size_t i = 0; i != count; i++) {
+			result[i] += gmap[i] * fabsf(grad[i]);
+			gmap[i] *= persistence_map[i];
+		}
+	} else {
+		for (size_t i = 0; i != count; i++) {
+			result[i] += gmap[i] * grad[i];
+			gmap[i] *= persistence_map[i];
+		}
+	}
+}
+
+static const NoiseKernels g_noise_kernels_scalar = {
+	NOISE_SIMD_NONE,
+	fill_lattice_row_scalar,
+	interpolate_scalar,
+	interpolate2_scalar,
+	accumulate_scalar,
+	accumulate_map_scalar,
+};
+
+
+#if NOISE_X86_SIMD
+
+// SSE2 has no 32 bit multiply, build it from two 32x32->64 bit ones
+NOISE_TARGET_SSE2 static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(
+		_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+		_mm_shuffle_epi32(odd,  _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+NOISE_TARGET_SSE2 static void fill_lattice_row_sse2(float *dest, u32 count,
+	s32 x0, u32 base)
+{
+	const __m128i mask = _mm_set1_epi32(0x7fffffff);
+	const __m128i c1 = _mm_set1_epi32(60493);
+	const __m128i c2 = _mm_set1_epi32(19990303);
+	const __m128i c3 = _mm_set1_epi32(1376312589);
+	const __m128i step = _mm_set1_epi32(4 * NOISE_MAGIC_X);
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 divisor = _mm_set1_ps(0x40000000);
+
+	u32 start = (u32)NOISE_MAGIC_X * x0 + base;
+	__m128i sum = _mm_add_epi32(_mm_set1_epi32(start),
+		_mm_setr_epi32(0, NOISE_MAGIC_X, 2 * NOISE_MAGIC_X, 3 * NOISE_MAGIC_X));
+
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i n = _mm_and_si128(sum, mask);
+		n = _mm_xor_si128(_mm_srli_epi32(n, 13), n);
+		__m128i t = _mm_add_epi32(mullo_epi32_sse2(mullo_epi32_sse2(n, n), c1), c2);
+		n = _mm_and_si128(_mm_add_epi32(mullo_epi32_sse2(n, t), c3), mask);
+		_mm_storeu_ps(dest + i, _mm_sub_ps(one,
+			_mm_div_ps(_mm_cvtepi32_ps(n), divisor)));
+		sum = _mm_add_epi32(sum, step);
+	}
+	fill_lattice_row_scalar(dest + i, count - i, x0 + i, base);
+}
+
+NOISE_TARGET_SSE2 static void interpolate_sse2(float *dest, const float *a,
+	const float *b, float t, u32 count)
+{
+	const __m128 vt = _mm_set1_ps(t);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 va = _mm_loadu_ps(a + i);
+		__m128 vb = _mm_loadu_ps(b + i);
+		_mm_storeu_ps(dest + i,
+			_mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), vt)));
+	}
+	interpolate_scalar(dest + i, a + i, b + i, t, count - i);
+}
+
+NOISE_TARGET_SSE2 static void interpolate2_sse2(float *dest,
+	const float *a0, const float *b0, const float *a1, const float *b1,
+	float ty, float tz, u32 count)
+{
+	const __m128 vty = _mm_set1_ps(ty);
+	const __m128 vtz = _mm_set1_ps(tz);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 va0 = _mm_loadu_ps(a0 + i);
+		__m128 va1 = _mm_loadu_ps(a1 + i);
+		__m128 u = _mm_add_ps(va0,
+			_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b0 + i), va0), vty));
+		__m128 v = _mm_add_ps(va1,
+			_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b1 + i), va1), vty));
+		_mm_storeu_ps(dest + i, _mm_add_ps(u, _mm_mul_ps(_mm_sub_ps(v, u), vtz)));
+	}
+	interpolate2_scalar(dest + i, a0 + i, b0 + i, a1 + i, b1 + i,
+		ty, tz, count - i);
+}
+
+NOISE_TARGET_SSE2 static void accumulate_sse2(float *result, const float *grad,
+	float g, size_t count, bool absvalue)
+{
+	// Clearing the sign bit is exactly what fabs() does
+	const __m128 absmask = _mm_castsi128_ps(
+		_mm_set1_epi32(absvalue ? 0x7fffffff : 0xffffffff));
+	const __m128 vg = _mm_set1_ps(g);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 v = _mm_and_ps(_mm_loadu_ps(grad + i), absmask);
+		_mm_storeu_ps(result + i,
+			_mm_add_ps(_mm_loadu_ps(result + i), _mm_mul_ps(vg, v)));
+	}
+	accumulate_scalar(result + i, grad + i, g, count - i, absvalue);
+}
+
+NOISE_TARGET_SSE2 static void accumulate_map_sse2(float *result,
+	const float *grad, float *gmap, const float *persistence_map,
+	size_t count, bool absvalue)
+{
+	const __m128 absmask = _mm_castsi128_ps(
+		_mm_set1_epi32(absvalue ? 0x7fffffff : 0xffffffff));
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 vg = _mm_loadu_ps(gmap + i);
+		__m128 v = _mm_and_ps(_mm_loadu_ps(grad + i), absmask);
+		_mm_storeu_ps(result + i,
+			_mm_add_ps(_mm_loadu_ps(result + i), _mm_mul_ps(vg, v)));
+		_mm_storeu_ps(gmap + i,
+			_mm_mul_ps(vg, _mm_loadu_ps(persistence_map + i)));
+	}
+	accumulate_map_scalar(result + i, grad + i, gmap + i,
+		persistence_map + i, count - i, absvalue);
+}
+
+static const NoiseKernels g_noise_kernels_sse2 = {
+	NOISE_SIMD_SSE2,
+	fill_lattice_row_sse2,
+	interpolate_sse2,
+	interpolate2_sse2,
+	accumulate_sse2,
+	accumulate_map_sse2,
+};
+
+
+NOISE_TARGET_AVX2 static void fill_lattice_row_avx2(float *dest, u32 count,
+	s32 x0, u32 base)
+{
+	const __m256i mask = _mm256_set1_epi32(0x7fffffff);
+	const __m256i c1 = _mm256_set1_epi32(60493);
+	const __m256i c2 = _mm256_set1_epi32(19990303);
+	const __m256i c3 = _mm256_set1_epi32(1376312589);
+	const __m256i step = _mm256_set1_epi32(8 * NOISE_MAGIC_X);
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256 divisor = _mm256_set1_ps(0x40000000);
+
+	u32 start = (u32)NOISE_MAGIC_X * x0 + base;
+	__m256i sum = _mm256_add_epi32(_mm256_set1_epi32(start),
+		_mm256_setr_epi32(0, NOISE_MAGIC_X, 2 * NOISE_MAGIC_X,
+			3 * NOISE_MAGIC_X, 4 * NOISE_MAGIC_X, 5 * NOISE_MAGIC_X,
+			6 * NOISE_MAGIC_X, 7 * NOISE_MAGIC_X));
+
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i n = _mm256_and_si256(sum, mask);
+		n = _mm256_xor_si256(_mm256_srli_epi32(n, 13), n);
+		__m256i t = _mm256_add_epi32(
+			_mm256_mullo_epi32(_mm256_mullo_epi32(n, n), c1), c2);
+		n = _mm256_and_si256(
+			_mm256_add_epi32(_mm256_mullo_epi32(n, t), c3), mask);
+		_mm256_storeu_ps(dest + i, _mm256_sub_ps(one,
+			_mm256_div_ps(_mm256_cvtepi32_ps(n), divisor)));
+		sum = _mm256_add_epi32(sum, step);
+	}
+	fill_lattice_row_scalar(dest + i, count - i, x0 + i, base);
+}
+
+NOISE_TARGET_AVX2 static void interpolate_avx2(float *dest, const float *a,
+	const float *b, float t, u32 count)
+{
+	const __m256 vt = _mm256_set1_ps(t);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 va = _mm256_loadu_ps(a + i);
+		__m256 vb = _mm256_loadu_ps(b + i);
+		_mm256_storeu_ps(dest + i,
+			_mm256_add_ps(va, _mm256_mul_ps(_mm256_sub_ps(vb, va), vt)));
+	}
+	interpolate_scalar(dest + i, a + i, b + i, t, count - i);
+}
+
+NOISE_TARGET_AVX2 static void interpolate2_avx2(float *dest,
+	const float *a0, const float *b0, const float *a1, const float *b1,
+	float ty, float tz, u32 count)
+{
+	const __m256 vty = _mm256_set1_ps(ty);
+	const __m256 vtz = _mm256_set1_ps(tz);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 va0 = _mm256_loadu_ps(a0 + i);
+		__m256 va1 = _mm256_loadu_ps(a1 + i);
+		__m256 u = _mm256_add_ps(va0,
+			_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(b0 + i), va0), vty));
+		__m256 v = _mm256_add_ps(va1,
+			_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(b1 + i), va1), vty));
+		_mm256_storeu_ps(dest + i,
+			_mm256_add_ps(u, _mm256_mul_ps(_mm256_sub_ps(v, u), vtz)));
+	}
+	interpolate2_scalar(dest + i, a0 + i, b0 + i, a1 + i, b1 + i,
+		ty, tz, count - i);
+}
+
+NOISE_TARGET_AVX2 static void accumulate_avx2(float *result, const float *grad,
+	float g, size_t count, bool absvalue)
+{
+	const __m256 absmask = _mm256_castsi256_ps(
+		_mm256_set1_epi32(absvalue ? 0x7fffffff : 0xffffffff));
+	const __m256 vg = _mm256_set1_ps(g);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 v = _mm256_and_ps(_mm256_loadu_ps(grad + i), absmask);
+		_mm256_storeu_ps(result + i,
+			_mm256_add_ps(_mm256_loadu_ps(result + i), _mm256_mul_ps(vg, v)));
+	}
+	accumulate_scalar(result + i, grad + i, g, count - i, absvalue);
+}
+
+NOISE_TARGET_AVX2 static void accumulate_map_avx2(float *result,
+	const float *grad, float *gmap, const float *persistence_map,
+	size_t count, bool absvalue)
+{
+	const __m256 absmask = _mm256_castsi256_ps(
+		_mm256_set1_epi32(absvalue ? 0x7fffffff : 0xffffffff));
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 vg = _mm256_loadu_ps(gmap + i);
+		__m256 v = _mm256_and_ps(_mm256_loadu_ps(grad + i), absmask);
+		_mm256_storeu_ps(result + i,
+			_mm256_add_ps(_mm256_loadu_ps(result + i), _mm256_mul_ps(vg, v)));
+		_mm256_storeu_ps(gmap + i,
+			_mm256_mul_ps(vg, _mm256_loadu_ps(persistence_map + i)));
+	}
+	accumulate_map_scalar(result + i, grad + i, gmap + i,
+		persistence_map + i, count - i, absvalue);
+}
+
+static const NoiseKernels g_noise_kernels_avx2 = {
+	NOISE_SIMD_AVX2,
+	fill_lattice_row_avx2,
+	interpolate_avx2,
+	interpolate2_avx2,
+	accumulate_avx2,
+	accumulate_map_avx2,
+};
+
+#endif // NOISE_X86_SIMD
+
+
+static const NoiseKernels *get_noise_kernels(NoiseSimdLevel level)
+{
+#if NOISE_X86_SIMD
+	__builtin_cpu_init();
+	if (level >= NOISE_SIMD_AVX2 && __builtin_cpu_supports("avx2"))
+		return &g_noise_kernels_avx2;
+	if (level >= NOISE_SIMD_SSE2 && __builtin_cpu_supports("sse2"))
+		return &g_noise_kernels_sse2;
+#endif
+	return &g_noise_kernels_scalar;
+}
+
+// Picked once at startup, before any mapgen thread runs
+static const NoiseKernels *g_noise_kernels = get_noise_kernels(NOISE_SIMD_AVX2);
+
+NoiseSimdLevel getSupportedNoiseSimdLevel()
+{
+	return get_noise_kernels(NOISE_SIMD_AVX2)->level;
+}
+
+NoiseSimdLevel getNoiseSimdLevel()
+{
+	return g_noise_kernels->level;
+}
+
+void setNoiseSimdLevel(NoiseSimdLevel level)
+{
+	g_noise_kernels = get_noise_kernels(level);
+}
+
+
 Noise::Noise(NoiseParams *np_, int seed, u32 sx, u32 sy, u32 sz)
 {
 	memcpy(&np, np_, sizeof(np));
@@ -428,6 +788,10 @@ Noise::Noise(NoiseParams *np_, int seed, u32 sx, u32 sy, u32 sz)
 	this->gradient_buf = NULL;
 	this->result       = NULL;
 
+	this->column_cell_buf  = NULL;
+	this->column_t_buf     = NULL;
+	this->lattice_rows_buf = NULL;
+
 	allocBuffers();
 }
 
@@ -438,6 +802,9 @@ Noise::~Noise()
 	delete[] persist_buf;
 	delete[] noise_buf;
 	delete[] result;
+	delete[] column_cell_buf;
+	delete[] column_t_buf;
+	delete[] lattice_rows_buf;
 }
 
 
@@ -456,12 +823,18 @@ void Noise::allocBuffers()
 	delete[] gradient_buf;
 	delete[] persist_buf;
 	delete[] result;
+	delete[] column_cell_buf;
+	delete[] column_t_buf;
+	this->column_cell_buf = NULL;
+	this->column_t_buf    = NULL;
 
 	try {
 		size_t bufsize = sx * sy * sz;
 		this->persist_buf  = NULL;
 		this->gradient_buf = new float[bufsize];
 		this->result       = new float[bufsize];
+		this->column_cell_buf = new u32[sx];
+		this->column_t_buf    = new float[sx];
 	} catch (std::bad_alloc &e) {
 		throw InvalidNoiseParamsException();
 	}
@@ -520,8 +893,11 @@ void Noise::resizeNoiseBuf(bool is3d)
 	size_t nlz = is3d ? (size_t)ceil(num_noise_points_z) + 3 : 1;
 
 	delete[] noise_buf;
+	delete[] lattice_rows_buf;
+	lattice_rows_buf = NULL;
 	try {
 		noise_buf = new float[nlx * nly * nlz];
+		lattice_rows_buf = new float[sx * nly * nlz];
 	} catch (std::bad_alloc &e) {
 		throw InvalidNoiseParamsException();
 	}
@@ -538,60 +914,73 @@ void Noise::resizeNoiseBuf(bool is3d)
  * Another optimization that could save half as many noise calls is to carry over
  * values from the previous noise lattice as midpoints in the new lattice for the
  * next octave.
+ *
+ * The x interpolation only depends on the column, so it is done once for every
+ * lattice row instead of once for every row of the map.  What is left for each
+ * map row is interpolating between whole lattice rows, which the kernels do
+ * several columns at a time.
  */
-#define idx(x, y) ((y) * nlx + (x))
+void Noise::interpolateLatticeRows(u32 nlx, u32 num_rows,
+		float u, float step_x, bool eased)
+{
+	u32 noisex = 0;
+	for (u32 i = 0; i != sx; i++) {
+		column_cell_buf[i] = noisex;
+		column_t_buf[i] = eased ? easeCurve(u) : u;
+
+		u += step_x;
+		if (u >= 1.0) {
+			u -= 1.0;
+			noisex++;
+		}
+	}
+
+	for (u32 j = 0; j != num_rows; j++) {
+		const float *lattice_row = &noise_buf[j * nlx];
+		float *row = &lattice_rows_buf[j * sx];
+		for (u32 i = 0; i != sx; i++) {
+			const float *cell = &lattice_row[column_cell_buf[i]];
+			row[i] = linearInterpolation(cell[0], cell[1], column_t_buf[i]);
+		}
+	}
+}
+
+
 void Noise::gradientMap2D(
 		float x, float y,
 		float step_x, float step_y,
 		int seed)
 {
-	float v00, v01, v10, v11, u, v, orig_u;
-	u32 index, i, j, noisex, noisey;
+	float u, v;
+	u32 j, noisey;
 	u32 nlx, nly;
 	s32 x0, y0;
+	const NoiseKernels *kernels = g_noise_kernels;
 
 	bool eased = np.flags & (NOISE_FLAG_DEFAULTS | NOISE_FLAG_EASED);
-	Interp2dFxn interpolate = eased ?
-		biLinearInterpolation : biLinearInterpolationNoEase;
 
 	x0 = floor(x);
 	y0 = floor(y);
 	u = x - (float)x0;
 	v = y - (float)y0;
-	orig_u = u;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
-	index = 0;
-	for (j = 0; j != nly; j++)
-		for (i = 0; i != nlx; i++)
-			noise_buf[index++] = noise2d(x0 + i, y0 + j, seed);
+	for (j = 0; j != nly; j++) {
+		kernels->fillLatticeRow(&noise_buf[j * nlx], nlx, x0,
+			(u32)NOISE_MAGIC_Y * (y0 + j) + (u32)NOISE_MAGIC_SEED * seed);
+	}
+
+	interpolateLatticeRows(nlx, nly, u, step_x, eased);
 
 	//calculate interpolations
-	index  = 0;
 	noisey = 0;
 	for (j = 0; j != sy; j++) {
-		v00 = noise_buf[idx(0, noisey)];
-		v10 = noise_buf[idx(1, noisey)];
-		v01 = noise_buf[idx(0, noisey + 1)];
-		v11 = noise_buf[idx(1, noisey + 1)];
-
-		u = orig_u;
-		noisex = 0;
-		for (i = 0; i != sx; i++) {
-			gradient_buf[index++] = interpolate(v00, v10, v01, v11, u, v);
-
-			u += step_x;
-			if (u >= 1.0) {
-				u -= 1.0;
-				noisex++;
-				v00 = v10;
-				v01 = v11;
-				v10 = noise_buf[idx(noisex + 1, noisey)];
-				v11 = noise_buf[idx(noisex + 1, noisey + 1)];
-			}
-		}
+		kernels->interpolate(&gradient_buf[j * sx],
+			&lattice_rows_buf[noisey * sx],
+			&lattice_rows_buf[(noisey + 1) * sx],
+			eased ? easeCurve(v) : v, sx);
 
 		v += step_y;
 		if (v >= 1.0) {
@@ -600,24 +989,21 @@ void Noise::gradientMap2D(
 		}
 	}
 }
-#undef idx
 
 
-#define idx(x, y, z) ((z) * nly * nlx + (y) * nlx + (x))
+#define row(y, z) (&lattice_rows_buf[((z) * nly + (y)) * sx])
 void Noise::gradientMap3D(
 		float x, float y, float z,
 		float step_x, float step_y, float step_z,
 		int seed)
 {
-	float v000, v010, v100, v110;
-	float v001, v011, v101, v111;
-	float u, v, w, orig_u, orig_v;
-	u32 index, i, j, k, noisex, noisey, noisez;
+	float u, v, w, orig_v;
+	u32 index, j, k, noisey, noisez;
 	u32 nlx, nly, nlz;
 	s32 x0, y0, z0;
+	const NoiseKernels *kernels = g_noise_kernels;
 
-	Interp3dFxn interpolate = (np.flags & NOISE_FLAG_EASED) ?
-		triLinearInterpolation : triLinearInterpolationNoEase;
+	bool eased = np.flags & NOISE_FLAG_EASED;
 
 	x0 = floor(x);
 	y0 = floor(y);
@@ -625,58 +1011,34 @@ void Noise::gradientMap3D(
 	u = x - (float)x0;
 	v = y - (float)y0;
 	w = z - (float)z0;
-	orig_u = u;
 	orig_v = v;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
 	nlz = (u32)(w + sz * step_z) + 2;
-	index = 0;
 	for (k = 0; k != nlz; k++)
-		for (j = 0; j != nly; j++)
-			for (i = 0; i != nlx; i++)
-				noise_buf[index++] = noise3d(x0 + i, y0 + j, z0 + k, seed);
+		for (j = 0; j != nly; j++) {
+			kernels->fillLatticeRow(&noise_buf[(k * nly + j) * nlx], nlx, x0,
+				(u32)NOISE_MAGIC_Y * (y0 + j) + (u32)NOISE_MAGIC_Z * (z0 + k)
+				+ (u32)NOISE_MAGIC_SEED * seed);
+		}
+
+	interpolateLatticeRows(nlx, nly * nlz, u, step_x, eased);
 
 	//calculate interpolations
 	index  = 0;
-	noisey = 0;
 	noisez = 0;
 	for (k = 0; k != sz; k++) {
+		float tz = eased ? easeCurve(w) : w;
 		v = orig_v;
 		noisey = 0;
 		for (j = 0; j != sy; j++) {
-			v000 = noise_buf[idx(0, noisey,     noisez)];
-			v100 = noise_buf[idx(1, noisey,     noisez)];
-			v010 = noise_buf[idx(0, noisey + 1, noisez)];
-			v110 = noise_buf[idx(1, noisey + 1, noisez)];
-			v001 = noise_buf[idx(0, noisey,     noisez + 1)];
-			v101 = noise_buf[idx(1, noisey,     noisez + 1)];
-			v011 = noise_buf[idx(0, noisey + 1, noisez + 1)];
-			v111 = noise_buf[idx(1, noisey + 1, noisez + 1)];
-
-			u = orig_u;
-			noisex = 0;
-			for (i = 0; i != sx; i++) {
-				gradient_buf[index++] = interpolate(
-					v000, v100, v010, v110,
-					v001, v101, v011, v111,
-					u, v, w);
-
-				u += step_x;
-				if (u >= 1.0) {
-					u -= 1.0;
-					noisex++;
-					v000 = v100;
-					v010 = v110;
-					v100 = noise_buf[idx(noisex + 1, noisey,     noisez)];
-					v110 = noise_buf[idx(noisex + 1, noisey + 1, noisez)];
-					v001 = v101;
-					v011 = v111;
-					v101 = noise_buf[idx(noisex + 1, noisey,     noisez + 1)];
-					v111 = noise_buf[idx(noisex + 1, noisey + 1, noisez + 1)];
-				}
-			}
+			kernels->interpolate2(&gradient_buf[index],
+				row(noisey, noisez),     row(noisey + 1, noisez),
+				row(noisey, noisez + 1), row(noisey + 1, noisez + 1),
+				eased ? easeCurve(v) : v, tz, sx);
+			index += sx;
 
 			v += step_y;
 			if (v >= 1.0) {
@@ -692,7 +1054,7 @@ void Noise::gradientMap3D(
 		}
 	}
 }
-#undef idx
+#undef row
 
 
 float *Noise::perlinMap2D(float x, float y, float *persistence_map)
@@ -773,27 +1135,12 @@ float *Noise::perlinMap3D(float x, float y, float z, float *persistence_map)
 void Noise::updateResults(float g, float *gmap,
 	float *persistence_map, size_t bufsize)
 {
-	// This looks very ugly, but it is 50-70% faster than having
-	// conditional statements inside the loop
-	if (np.flags & NOISE_FLAG_ABSVALUE) {
-		if (persistence_map) {
-			for (size_t i = 0; i != bufsize; i++) {
-				result[i] += gmap[i] * fabs(gradient_buf[i]);
-				gmap[i] *= persistence_map[i];
-			}
-		} else {
-			for (size_t i = 0; i != bufsize; i++)
-				result[i] += g * fabs(gradient_buf[i]);
-		}
+	bool absvalue = np.flags & NOISE_FLAG_ABSVALUE;
+
+	if (persistence_map) {
+		g_noise_kernels->accumulateMap(result, gradient_buf, gmap,
+			persistence_map, bufsize, absvalue);
 	} else {
-		if (persistence_map) {
-			for (size_t i = 0; i != bufsize; i++) {
-				result[i] += gmap[i] * gradient_buf[i];
-				gmap[i] *= persistence_map[i];
-			}
-		} else {
-			for (size_t i = 0; i != bufsize; i++)
-				result[i] += g * gradient_buf[i];
-		}
+		g_noise_kernels->accumulate(result, gradient_buf, g, bufsize, absvalue);
 	}
 }
@@ -196,9 +196,17 @@ class Noise {
 	}
 
 private:
+	// Per column of the map: lattice cell and (eased) offset into it
+	u32 *column_cell_buf;
+	float *column_t_buf;
+	// Every lattice row, already interpolated along x to the sx columns
+	float *lattice_rows_buf;
+
 	void allocBuffers();
 	void resizeNoiseBuf(bool is3d);
 	void updateResults(float g, float *gmap, float *persistence_map, size_t bufsize);
+	void interpolateLatticeRows(u32 nlx, u32 num_rows,
+		float u, float step_x, bool eased);
 
 };
 
@@ -224,6 +232,21 @@ inline float NoisePerlin3D_PO(NoiseParams *np, float x, float xoff,
 		seed);
 }
 
+/*
+	Instruction sets the noise map kernels can use. All of them give
+	bit-identical results; the best one the CPU supports is picked at startup.
+*/
+enum NoiseSimdLevel {
+	NOISE_SIMD_NONE,
+	NOISE_SIMD_SSE2,
+	NOISE_SIMD_AVX2
+};
+
+NoiseSimdLevel getSupportedNoiseSimdLevel();
+NoiseSimdLevel getNoiseSimdLevel();
+// For tests and benchmarks; the level is clamped to the supported one
+void setNoiseSimdLevel(NoiseSimdLevel level);
+
 // Return value: -1 ... 1
 float noise2d(int x, int y, int seed);
 float noise3d(int x, int y, int z, int seed);
@@ -425,8 +425,6 @@ class RemotePlayer : public Player
 	RemotePlayer(IGameDef *gamedef, const char *name);
 	virtual ~RemotePlayer() {}
 
-	void save(std::string savedir);
-
 	PlayerSAO *getPlayerSAO()
 	{ return m_sao; }
 	void setPlayerSAO(PlayerSAO *sao)
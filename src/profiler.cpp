@@ -18,6 +18,350 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "profiler.h"
+#include "threads.h"
+#include "threading/atomic.h"
+#include "util/serialize.h"    // serializeJsonString()
+
+// Scopes recorded per thread at most while tracing
+#define PROFILER_TRACE_MAX_EVENTS 1000000
+
+#if defined(_MSC_VER)
+	#define PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+	#define PROFILER_THREAD_LOCAL __thread
+#endif
+
+// Ids start at 1, 0 means that a thread has not used any Profiler yet.
+// Defined before main_profiler, which takes the first one.
+static Atomic<u32> next_profiler_id(1);
 
 static Profiler main_profiler;
 Profiler *g_profiler = &main_profiler;
+
+struct ProfilerTraceEvent
+{
+	std::string name;
+	// Relative to the start of the trace
+	u32 start_us;
+	u32 duration_us;
+	u16 depth;
+};
+
+struct ProfilerThreadData
+{
+	threadid_t thread_id;
+	// Number of the thread in traces
+	u32 trace_tid;
+
+	// Protects the values, only contended while they are merged
+	Mutex mutex;
+	std::map<std::string, float> data;
+	std::map<std::string, int> avgcounts;
+	std::map<std::string, float> graphvalues;
+	std::vector<ProfilerTraceEvent> trace;
+
+	// Open ScopeProfilers, only used by the thread itself
+	u16 depth;
+};
+
+// Last thread data used by this thread, and the Profiler it belongs to
+static PROFILER_THREAD_LOCAL u32 t_profiler_id = 0;
+static PROFILER_THREAD_LOCAL ProfilerThreadData *t_thread_data = NULL;
+
+
+Profiler::Profiler() :
+	m_id(next_profiler_id++),
+	m_tracing(false),
+	m_trace_start_us(0)
+{
+}
+
+Profiler::~Profiler()
+{
+	for (size_t i = 0; i < m_threads.size(); i++)
+		delete m_threads[i];
+}
+
+ProfilerThreadData *Profiler::getThreadData()
+{
+	if (t_profiler_id == m_id)
+		return t_thread_data;
+
+	threadid_t thread_id = thr_get_current_thread_id();
+	ProfilerThreadData *t = NULL;
+	{
+		MutexAutoLock lock(m_mutex);
+		// Another Profiler was used in between, or the thread is new
+		for (size_t i = 0; i < m_threads.size(); i++) {
+			if (thr_compare_thread_id(m_threads[i]->thread_id, thread_id)) {
+				t = m_threads[i];
+				break;
+			}
+		}
+		if (!t) {
+			t = new ProfilerThreadData();
+			t->thread_id = thread_id;
+			t->trace_tid = m_threads.size() + 1;
+			t->depth = 0;
+			m_threads.push_back(t);
+		}
+	}
+
+	t_profiler_id = m_id;
+	t_thread_data = t;
+	return t;
+}
+
+void Profiler::mergeThreads()
+{
+	for (size_t i = 0; i < m_threads.size(); i++) {
+		ProfilerThreadData *t = m_threads[i];
+		MutexAutoLock lock(t->mutex);
+
+		for (std::map<std::string, float>::iterator
+				n = t->data.begin(); n != t->data.end(); ++n)
+			m_data[n->first] += n->second;
+		t->data.clear();
+
+		for (std::map<std::string, int>::iterator
+				n = t->avgcounts.begin(); n != t->avgcounts.end(); ++n) {
+			int &count = m_avgcounts[n->first];
+			if (n->second == -2)
+				count = -2;
+			else if (count != -2)
+				count = MYMAX(count, 0) + n->second;
+		}
+		t->avgcounts.clear();
+
+		for (std::map<std::string, float>::iterator
+				n = t->graphvalues.begin(); n != t->graphvalues.end(); ++n)
+			m_graphvalues[n->first] += n->second;
+		t->graphvalues.clear();
+	}
+}
+
+void Profiler::add(const std::string &name, float value)
+{
+	ProfilerThreadData *t = getThreadData();
+	MutexAutoLock lock(t->mutex);
+	{
+		/* No average shall have been used; mark add used as -2 */
+		std::map<std::string, int>::iterator n = t->avgcounts.find(name);
+		if(n == t->avgcounts.end())
+			t->avgcounts[name] = -2;
+		else{
+			if(n->second == -1)
+				n->second = -2;
+			assert(n->second == -2);
+		}
+	}
+	{
+		std::map<std::string, float>::iterator n = t->data.find(name);
+		if(n == t->data.end())
+			t->data[name] = value;
+		else
+			n->second += value;
+	}
+}
+
+void Profiler::avg(const std::string &name, float value)
+{
+	ProfilerThreadData *t = getThreadData();
+	MutexAutoLock lock(t->mutex);
+	int &count = t->avgcounts[name];
+
+	assert(count != -2);
+	count = MYMAX(count, 0) + 1;
+	t->data[name] += value;
+}
+
+void Profiler::clear()
+{
+	MutexAutoLock lock(m_mutex);
+	mergeThreads();
+	for(std::map<std::string, float>::iterator
+			i = m_data.begin();
+			i != m_data.end(); ++i)
+	{
+		i->second = 0;
+	}
+	m_avgcounts.clear();
+}
+
+float Profiler::getValue(const std::string &name)
+{
+	MutexAutoLock lock(m_mutex);
+	mergeThreads();
+
+	std::map<std::string, float>::const_iterator numerator = m_data.find(name);
+	if (numerator == m_data.end())
+		return 0.f;
+
+	std::map<std::string, int>::const_iterator denominator = m_avgcounts.find(name);
+	if (denominator != m_avgcounts.end()){
+		if (denominator->second >= 1)
+			return numerator->second / denominator->second;
+	}
+
+	return numerator->second;
+}
+
+void Profiler::printPage(std::ostream &o, u32 page, u32 pagecount)
+{
+	MutexAutoLock lock(m_mutex);
+	mergeThreads();
+
+	u32 minindex, maxindex;
+	paging(m_data.size(), page, pagecount, minindex, maxindex);
+
+	for(std::map<std::string, float>::iterator
+			i = m_data.begin();
+			i != m_data.end(); ++i)
+	{
+		if(maxindex == 0)
+			break;
+		maxindex--;
+
+		if(minindex != 0)
+		{
+			minindex--;
+			continue;
+		}
+
+		std::string name = i->first;
+		int avgcount = 1;
+		std::map<std::string, int>::iterator n = m_avgcounts.find(name);
+		if(n != m_avgcounts.end()){
+			if(n->second >= 1)
+				avgcount = n->second;
+		}
+		o<<"  "<<name<<": ";
+		s32 clampsize = 40;
+		s32 space = clampsize - name.size();
+		for(s32 j=0; j<space; j++)
+		{
+			if(j%2 == 0 && j < space - 1)
+				o<<"-";
+			else
+				o<<" ";
+		}
+		o<<(i->second / avgcount);
+		o<<std::endl;
+	}
+}
+
+void Profiler::graphAdd(const std::string &id, float value)
+{
+	ProfilerThreadData *t = getThreadData();
+	MutexAutoLock lock(t->mutex);
+	std::map<std::string, float>::iterator i =
+			t->graphvalues.find(id);
+	if(i == t->graphvalues.end())
+		t->graphvalues[id] = value;
+	else
+		i->second += value;
+}
+
+void Profiler::graphGet(GraphValues &result)
+{
+	MutexAutoLock lock(m_mutex);
+	mergeThreads();
+	result = m_graphvalues;
+	m_graphvalues.clear();
+}
+
+void Profiler::remove(const std::string& name)
+{
+	MutexAutoLock lock(m_mutex);
+	mergeThreads();
+	m_avgcounts.erase(name);
+	m_data.erase(name);
+}
+
+void Profiler::startTrace()
+{
+	MutexAutoLock lock(m_mutex);
+	for (size_t i = 0; i < m_threads.size(); i++) {
+		MutexAutoLock tlock(m_threads[i]->mutex);
+		m_threads[i]->trace.clear();
+	}
+	m_trace_start_us = porting::getTimeUs();
+	m_tracing = true;
+}
+
+u32 Profiler::stopTrace(std::ostream &os)
+{
+	MutexAutoLock lock(m_mutex);
+	m_tracing = false;
+
+	u32 count = 0;
+	os << "{\"traceEvents\":[";
+	for (size_t i = 0; i < m_threads.size(); i++) {
+		ProfilerThreadData *t = m_threads[i];
+		std::vector<ProfilerTraceEvent> trace;
+		{
+			MutexAutoLock tlock(t->mutex);
+			trace.swap(t->trace);
+		}
+		if (trace.empty())
+			continue;
+
+		os << (count == 0 ? "\n" : ",\n")
+			<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+			<< t->trace_tid << ",\"args\":{\"name\":\"Thread "
+			<< t->trace_tid << "\"}}";
+		for (size_t n = 0; n < trace.size(); n++) {
+			const ProfilerTraceEvent &e = trace[n];
+			os << ",\n{\"name\":" << serializeJsonString(e.name)
+				<< ",\"ph\":\"X\",\"pid\":1,\"tid\":" << t->trace_tid
+				<< ",\"ts\":" << e.start_us << ",\"dur\":" << e.duration_us
+				<< ",\"args\":{\"depth\":" << e.depth << "}}";
+		}
+		count += trace.size();
+	}
+	os << "\n]}\n";
+
+	return count;
+}
+
+void Profiler::beginScope()
+{
+	getThreadData()->depth++;
+}
+
+void Profiler::endScope(const std::string &name, int type, u32 start_us,
+	u32 duration_us)
+{
+	ProfilerThreadData *t = getThreadData();
+	t->depth--;
+
+	float duration = duration_us / 1000000.0;
+	switch (type) {
+	case SPT_ADD:
+		add(name, duration);
+		break;
+	case SPT_AVG:
+		avg(name, duration);
+		break;
+	case SPT_GRAPH_ADD:
+		graphAdd(name, duration);
+		break;
+	}
+
+	if (!m_tracing)
+		return;
+
+	// Scopes that were already open when the trace started are left out
+	if ((s32)(start_us - m_trace_start_us) < 0)
+		return;
+
+	MutexAutoLock lock(t->mutex);
+	if (t->trace.size() >= PROFILER_TRACE_MAX_EVENTS)
+		return;
+	ProfilerTraceEvent e;
+	e.name = name;
+	e.start_us = start_us - m_trace_start_us;
+	e.duration_us = duration_us;
+	e.depth = t->depth;
+	t->trace.push_back(e);
+}
@@ -23,12 +23,15 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes.h"
 #include <string>
 #include <map>
+#include <vector>
+#include <ostream>
 
 #include "threading/mutex.h"
 #include "threading/mutex_auto_lock.h"
 #include "util/timetaker.h"
 #include "util/numeric.h"      // paging()
 #include "debug.h"             // assert()
+#include "porting.h"
 
 #define MAX_PROFILER_TEXT_ROWS 20
 
@@ -36,156 +39,74 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 class Profiler;
 extern Profiler *g_profiler;
 
+struct ProfilerThreadData;
+
 /*
 	Time profiler
+
+	Values are collected per thread, so that threads never wait for each
+	other while profiling. They are merged when they are read.
 */
 
 class Profiler
 {
 public:
-	Profiler()
-	{
-	}
-
-	void add(const std::string &name, float value)
-	{
-		MutexAutoLock lock(m_mutex);
-		{
-			/* No average shall have been used; mark add used as -2 */
-			std::map<std::string, int>::iterator n = m_avgcounts.find(name);
-			if(n == m_avgcounts.end())
-				m_avgcounts[name] = -2;
-			else{
-				if(n->second == -1)
-					n->second = -2;
-				assert(n->second == -2);
-			}
-		}
-		{
-			std::map<std::string, float>::iterator n = m_data.find(name);
-			if(n == m_data.end())
-				m_data[name] = value;
-			else
-				n->second += value;
-		}
-	}
+	Profiler();
+	~Profiler();
 
-	void avg(const std::string &name, float value)
-	{
-		MutexAutoLock lock(m_mutex);
-		int &count = m_avgcounts[name];
-
-		assert(count != -2);
-		count = MYMAX(count, 0) + 1;
-		m_data[name] += value;
-	}
-
-	void clear()
-	{
-		MutexAutoLock lock(m_mutex);
-		for(std::map<std::string, float>::iterator
-				i = m_data.begin();
-				i != m_data.end(); ++i)
-		{
-			i->second = 0;
-		}
-		m_avgcounts.clear();
-	}
+	void add(const std::string &name, float value);
+	void avg(const std::string &name, float value);
+	void clear();
 
 	void print(std::ostream &o)
 	{
 		printPage(o, 1, 1);
 	}
 
-	float getValue(const std::string &name) const
-	{
-		std::map<std::string, float>::const_iterator numerator = m_data.find(name);
-		if (numerator == m_data.end())
-			return 0.f;
-
-		std::map<std::string, int>::const_iterator denominator = m_avgcounts.find(name);
-		if (denominator != m_avgcounts.end()){
-			if (denominator->second >= 1)
-				return numerator->second / denominator->second;
-		}
+	float getValue(const std::string &name);
+	void printPage(std::ostream &o, u32 page, u32 pagecount);
 
-		return numerator->second;
-	}
+	typedef std::map<std::string, float> GraphValues;
 
-	void printPage(std::ostream &o, u32 page, u32 pagecount)
-	{
-		MutexAutoLock lock(m_mutex);
-
-		u32 minindex, maxindex;
-		paging(m_data.size(), page, pagecount, minindex, maxindex);
-
-		for(std::map<std::string, float>::iterator
-				i = m_data.begin();
-				i != m_data.end(); ++i)
-		{
-			if(maxindex == 0)
-				break;
-			maxindex--;
-
-			if(minindex != 0)
-			{
-				minindex--;
-				continue;
-			}
-
-			std::string name = i->first;
-			int avgcount = 1;
-			std::map<std::string, int>::iterator n = m_avgcounts.find(name);
-			if(n != m_avgcounts.end()){
-				if(n->second >= 1)
-					avgcount = n->second;
-			}
-			o<<"  "<<name<<": ";
-			s32 clampsize = 40;
-			s32 space = clampsize - name.size();
-			for(s32 j=0; j<space; j++)
-			{
-				if(j%2 == 0 && j < space - 1)
-					o<<"-";
-				else
-					o<<" ";
-			}
-			o<<(i->second / avgcount);
-			o<<std::endl;
-		}
-	}
+	void graphAdd(const std::string &id, float value);
+	void graphGet(GraphValues &result);
 
-	typedef std::map<std::string, float> GraphValues;
+	void remove(const std::string& name);
 
-	void graphAdd(const std::string &id, float value)
-	{
-		MutexAutoLock lock(m_mutex);
-		std::map<std::string, float>::iterator i =
-				m_graphvalues.find(id);
-		if(i == m_graphvalues.end())
-			m_graphvalues[id] = value;
-		else
-			i->second += value;
-	}
-	void graphGet(GraphValues &result)
-	{
-		MutexAutoLock lock(m_mutex);
-		result = m_graphvalues;
-		m_graphvalues.clear();
-	}
+	/*
+		While tracing, every ScopeProfiler is also recorded with its start
+		time, duration, thread and nesting depth.
+	*/
+	void startTrace();
+	// Stops tracing and writes the recorded scopes as Chrome trace event
+	// JSON (chrome://tracing). Returns the number of scopes written.
+	u32 stopTrace(std::ostream &os);
+	bool isTracing() const { return m_tracing; }
 
-	void remove(const std::string& name)
-	{
-		MutexAutoLock lock(m_mutex);
-		m_avgcounts.erase(name);
-		m_data.erase(name);
-	}
+	// Used by ScopeProfiler
+	void beginScope();
+	void endScope(const std::string &name, int type, u32 start_us,
+		u32 duration_us);
 
 private:
+	ProfilerThreadData *getThreadData();
+	// Moves the values of all threads into m_data, m_avgcounts and
+	// m_graphvalues. Needs m_mutex.
+	void mergeThreads();
+
+	// Unique among all Profilers, to tell them apart in thread-local caches
+	u32 m_id;
+
+	// Protects everything below and the list of threads
 	Mutex m_mutex;
+	std::vector<ProfilerThreadData *> m_threads;
 	std::map<std::string, float> m_data;
 	std::map<std::string, int> m_avgcounts;
 	std::map<std::string, float> m_graphvalues;
+
+	// Only changed with m_mutex held, read without it by the scopes
+	volatile bool m_tracing;
+	u32 m_trace_start_us;
 };
 
 enum ScopeProfilerType{
@@ -201,51 +122,39 @@ class ScopeProfiler
 			enum ScopeProfilerType type = SPT_ADD):
 		m_profiler(profiler),
 		m_name(name),
-		m_timer(NULL),
 		m_type(type)
 	{
-		if(m_profiler)
-			m_timer = new TimeTaker(m_name.c_str());
+		start();
 	}
 	// name is copied
 	ScopeProfiler(Profiler *profiler, const char *name,
 			enum ScopeProfilerType type = SPT_ADD):
 		m_profiler(profiler),
 		m_name(name),
-		m_timer(NULL),
 		m_type(type)
 	{
-		if(m_profiler)
-			m_timer = new TimeTaker(m_name.c_str());
+		start();
 	}
 	~ScopeProfiler()
 	{
-		if(m_timer)
-		{
-			float duration_ms = m_timer->stop(true);
-			float duration = duration_ms / 1000.0;
-			if(m_profiler){
-				switch(m_type){
-				case SPT_ADD:
-					m_profiler->add(m_name, duration);
-					break;
-				case SPT_AVG:
-					m_profiler->avg(m_name, duration);
-					break;
-				case SPT_GRAPH_ADD:
-					m_profiler->graphAdd(m_name, duration);
-					break;
-				}
-			}
-			delete m_timer;
+		if (m_profiler) {
+			m_profiler->endScope(m_name, m_type, m_start_us,
+				porting::getTimeUs() - m_start_us);
 		}
 	}
 private:
+	void start()
+	{
+		if (m_profiler) {
+			m_profiler->beginScope();
+			m_start_us = porting::getTimeUs();
+		}
+	}
+
 	Profiler *m_profiler;
 	std::string m_name;
-	TimeTaker *m_timer;
+	u32 m_start_us;
 	enum ScopeProfilerType m_type;
 };
 
 #endif
-
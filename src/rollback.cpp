@@ -31,6 +31,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "inventorymanager.h" // deserializing InventoryLocations
 #include "sqlite3.h"
 #include "filesys.h"
+#include "porting.h"
+#include "profiler.h"
+#include "threading/thread.h"
+#include "threading/mutex_auto_lock.h"
 
 #define POINTS_PER_NODE (16.0)
 
@@ -80,11 +84,44 @@ struct Entity {
 };
 
 
+class RollbackWriteThread : public Thread
+{
+public:
+	RollbackWriteThread(RollbackManager *manager) :
+		Thread("RollbackWrite"),
+		m_manager(manager)
+	{}
+
+	void *run()
+	{
+		DSTACK(FUNCTION_NAME);
+		BEGIN_DEBUG_EXCEPTION_HANDLER
+
+		while (!stopRequested()) {
+			if (!m_manager->pending_sem.wait(100))
+				continue;
+			// Whatever is queued by now goes into the same commit
+			while (m_manager->pending_sem.wait(0))
+				;
+			m_manager->writePending();
+		}
+
+		END_DEBUG_EXCEPTION_HANDLER
+		return NULL;
+	}
+
+private:
+	RollbackManager *m_manager;
+};
+
+
 
 RollbackManager::RollbackManager(const std::string & world_path,
 		IGameDef * gamedef_) :
 	gamedef(gamedef_),
-	current_actor_is_guess(false)
+	current_actor_is_guess(false),
+	write_thread(NULL),
+	pending_since(0)
 {
 	verbosestream << "RollbackManager::RollbackManager(" << world_path
 		<< ")" << std::endl;
@@ -102,11 +139,18 @@ RollbackManager::RollbackManager(const std::string & world_path,
 		migrate(txt_filename);
 		fs::DeleteSingleFileOrEmptyDirectory(migrating_flag);
 	}
+
+	write_thread = new RollbackWriteThread(this);
+	write_thread->start();
 }
 
 
 RollbackManager::~RollbackManager()
 {
+	write_thread->stop();
+	write_thread->wait();
+	delete write_thread;
+
 	flush();
 
 	SQLOK(sqlite3_finalize(stmt_insert));
@@ -890,15 +934,31 @@ std::string RollbackManager::getSuspect(v3s16 p, float nearness_shortcut,
 }
 
 
-void RollbackManager::flush()
+void RollbackManager::writePending()
 {
-	sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+	// Queries take this lock too, so they never miss actions that were
+	// taken off the queue but not committed yet
+	MutexAutoLock db_lock(db_mutex);
+	writePendingLocked();
+}
+
 
-	std::list<RollbackAction>::const_iterator iter;
+void RollbackManager::writePendingLocked()
+{
+	std::vector<RollbackAction> actions;
+	u32 queued_since;
+	{
+		MutexAutoLock lock(queue_mutex);
+		actions.swap(pending_actions);
+		queued_since = pending_since;
+	}
+	if (actions.empty())
+		return;
 
-	for (iter  = action_todisk_buffer.begin();
-			iter != action_todisk_buffer.end();
-			++iter) {
+	sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+
+	for (std::vector<RollbackAction>::const_iterator iter = actions.begin();
+			iter != actions.end(); ++iter) {
 		if (iter->actor == "") {
 			continue;
 		}
@@ -907,34 +967,47 @@ void RollbackManager::flush()
 	}
 
 	sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
-	action_todisk_buffer.clear();
+
+	g_profiler->avg("Rollback: actions per commit", actions.size());
+	g_profiler->avg("Rollback: journal lag [ms]",
+		porting::getTimeMs() - queued_since);
+}
+
+
+void RollbackManager::flush()
+{
+	writePending();
 }
 
 
 void RollbackManager::addAction(const RollbackAction & action)
 {
-	action_todisk_buffer.push_back(action);
 	action_latest_buffer.push_back(action);
 
-	// Flush to disk sometimes
-	if (action_todisk_buffer.size() >= 500) {
-		flush();
+	{
+		MutexAutoLock lock(queue_mutex);
+		if (pending_actions.empty())
+			pending_since = porting::getTimeMs();
+		pending_actions.push_back(action);
 	}
+	pending_sem.post();
 }
 
 std::list<RollbackAction> RollbackManager::getEntriesSince(time_t first_time)
 {
-	flush();
+	MutexAutoLock lock(db_mutex);
+	writePendingLocked();
 	return getActionsSince(first_time);
 }
 
 std::list<RollbackAction> RollbackManager::getNodeActors(v3s16 pos, int range,
 		time_t seconds, int limit)
 {
-	flush();
 	time_t cur_time = time(0);
 	time_t first_time = cur_time - seconds;
 
+	MutexAutoLock lock(db_mutex);
+	writePendingLocked();
 	return getActionsSince_range(first_time, pos, range, limit);
 }
 
@@ -945,8 +1018,8 @@ std::list<RollbackAction> RollbackManager::getRevertActions(
 	time_t cur_time = time(0);
 	time_t first_time = cur_time - seconds;
 
-	flush();
-
+	MutexAutoLock lock(db_mutex);
+	writePendingLocked();
 	return getActionsSince(first_time, actor_filter);
 }
 
@@ -26,8 +26,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <list>
 #include <vector>
 #include "sqlite3.h"
+#include "threading/mutex.h"
+#include "threading/semaphore.h"
 
 class IGameDef;
+class RollbackWriteThread;
 
 struct ActionRow;
 struct Entity;
@@ -44,6 +47,7 @@ class RollbackManager: public IRollbackManager
 	void setActor(const std::string & actor, bool is_guess);
 	std::string getSuspect(v3s16 p, float nearness_shortcut,
 			float min_nearness);
+	// Writes the pending actions on the calling thread
 	void flush();
 
 	void addAction(const RollbackAction & action);
@@ -54,6 +58,13 @@ class RollbackManager: public IRollbackManager
 			const std::string & actor_filter, time_t seconds);
 
 private:
+	friend class RollbackWriteThread;
+
+	// Writes all pending actions in one transaction
+	void writePending();
+	// Same, with db_mutex already held. Queries call this first so that
+	// they see every action added before them.
+	void writePendingLocked();
 	void registerNewActor(const int id, const std::string & name);
 	void registerNewNode(const int id, const std::string & name);
 	int getActorId(const std::string & name);
@@ -85,9 +96,23 @@ class RollbackManager: public IRollbackManager
 	std::string current_actor;
 	bool current_actor_is_guess;
 
-	std::list<RollbackAction> action_todisk_buffer;
 	std::list<RollbackAction> action_latest_buffer;
 
+	/*
+		Actions are written to the database by a separate thread.
+		The queue mutex is only held to append to or to take the whole
+		pending list, the writes happen outside of it.
+	*/
+	RollbackWriteThread *write_thread;
+	Mutex queue_mutex;
+	std::vector<RollbackAction> pending_actions;
+	// When the oldest pending action was queued [ms]
+	u32 pending_since;
+	// Posted once per queued action
+	Semaphore pending_sem;
+	// Held while using the database and the known actors and nodes
+	Mutex db_mutex;
+
 	std::string database_path;
 	sqlite3 * db;
 	sqlite3_stmt * stmt_insert;
@@ -36,6 +36,7 @@ extern "C" {
 /******************************************************************************/
 AsyncEngine::AsyncEngine() :
 	initDone(false),
+	sandboxed(false),
 	jobIdCounter(0)
 {
 }
@@ -86,9 +87,10 @@ bool AsyncEngine::registerFunction(const char* name, lua_CFunction func)
 }
 
 /******************************************************************************/
-void AsyncEngine::initialize(unsigned int numEngines)
+void AsyncEngine::initialize(unsigned int numEngines, bool sandboxed)
 {
 	initDone = true;
+	this->sandboxed = sandboxed;
 
 	for (unsigned int i = 0; i < numEngines; i++) {
 		AsyncWorkerThread *toAdd = new AsyncWorkerThread(this,
@@ -225,7 +227,7 @@ AsyncWorkerThread::AsyncWorkerThread(AsyncEngine* jobDispatcher,
 	int top = lua_gettop(L);
 
 	// Push builtin initialization type
-	lua_pushstring(L, "async");
+	lua_pushstring(L, jobDispatcher->sandboxed ? "async_game" : "async");
 	lua_setglobal(L, "INIT");
 
 	jobDispatcher->prepareEnvironment(L, top);
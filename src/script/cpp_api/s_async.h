@@ -80,8 +80,10 @@ class AsyncEngine {
 	/**
 	 * Create async engine tasks and lock function registration
 	 * @param numEngines Number of async threads to be started
+	 * @param sandboxed Run jobs in an environment with only safe functions,
+	 *   for jobs of game mods
 	 */
-	void initialize(unsigned int numEngines);
+	void initialize(unsigned int numEngines, bool sandboxed = false);
 
 	/**
 	 * Queue an async job
@@ -131,6 +133,9 @@ class AsyncEngine {
 	// Variable locking the engine against further modification
 	bool initDone;
 
+	// Whether jobs are run in a sandbox
+	bool sandboxed;
+
 	// Internal store for registred functions
 	std::map<std::string, lua_CFunction> functionList;
 
@@ -57,12 +57,12 @@ void NodeMetaRef::reportMetadataChange(NodeMetaRef *ref)
 {
 	// NOTE: This same code is in rollback_interface.cpp
 	// Inform other things that the metadata has changed
-	v3s16 blockpos = getNodeBlockPos(ref->m_p);
 	MapEditEvent event;
-	event.type = MEET_BLOCK_NODE_METADATA_CHANGED;
-	event.p = blockpos;
+	event.type = MEET_NODE_METADATA_CHANGED;
+	event.p = ref->m_p;
 	ref->m_env->getMap().dispatchEvent(&event);
 	// Set the block to be saved
+	v3s16 blockpos = getNodeBlockPos(ref->m_p);
 	MapBlock *block = ref->m_env->getMap().getBlockNoCreateNoEx(blockpos);
 	if (block) {
 		block->raiseModified(MOD_STATE_WRITE_NEEDED,
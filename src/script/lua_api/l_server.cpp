@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/c_converter.h"
 #include "common/c_content.h"
 #include "cpp_api/s_base.h"
+#include "scripting_game.h"
 #include "server.h"
 #include "environment.h"
 #include "player.h"
@@ -408,6 +409,22 @@ int ModApiServer::l_get_worldpath(lua_State *L)
 	return 1;
 }
 
+// start_profiler_trace(seconds)
+int ModApiServer::l_start_profiler_trace(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	float seconds = luaL_checknumber(L, 1);
+	if (!(seconds > 0)) // Also false for NaN
+		throw LuaError("start_profiler_trace: seconds must be positive");
+	std::string path = getServer(L)->startProfilerTrace(seconds);
+	if (path.empty()) {
+		lua_pushnil(L);
+		return 1;
+	}
+	lua_pushstring(L, path.c_str());
+	return 1;
+}
+
 // sound_play(spec, parameters)
 int ModApiServer::l_sound_play(lua_State *L)
 {
@@ -504,11 +521,32 @@ int ModApiServer::l_cause_error(lua_State *L)
 }
 #endif
 
+// do_async_callback(serialized_func, serialized_param)
+int ModApiServer::l_do_async_callback(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	size_t func_length, param_length;
+	const char *func = luaL_checklstring(L, 1, &func_length);
+	const char *param = luaL_checklstring(L, 2, &param_length);
+	lua_pushinteger(L, getServer(L)->getScriptIface()->queueAsync(
+		std::string(func, func_length), std::string(param, param_length)));
+	return 1;
+}
+
+// get_finished_jobs()
+int ModApiServer::l_get_finished_jobs(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	getServer(L)->getScriptIface()->pushFinishedAsyncJobs(L);
+	return 1;
+}
+
 void ModApiServer::Initialize(lua_State *L, int top)
 {
 	API_FCT(request_shutdown);
 	API_FCT(get_server_status);
 	API_FCT(get_worldpath);
+	API_FCT(start_profiler_trace);
 	API_FCT(is_singleplayer);
 
 	API_FCT(get_current_modname);
@@ -535,6 +573,9 @@ void ModApiServer::Initialize(lua_State *L, int top)
 
 	API_FCT(get_last_run_mod);
 	API_FCT(set_last_run_mod);
+
+	API_FCT(do_async_callback);
+	API_FCT(get_finished_jobs);
 #ifndef NDEBUG
 	API_FCT(cause_error);
 #endif
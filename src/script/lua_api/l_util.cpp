@@ -435,7 +435,7 @@ void ModApiUtil::Initialize(lua_State *L, int top)
 	API_FCT(request_insecure_environment);
 }
 
-void ModApiUtil::InitializeAsync(AsyncEngine& engine)
+void ModApiUtil::InitializeAsync(AsyncEngine& engine, bool file_access)
 {
 	ASYNC_API_FCT(log);
 
@@ -457,7 +457,10 @@ void ModApiUtil::InitializeAsync(AsyncEngine& engine)
 	ASYNC_API_FCT(compress);
 	ASYNC_API_FCT(decompress);
 
-	ASYNC_API_FCT(mkdir);
-	ASYNC_API_FCT(get_dir_list);
+	// Not checked by mod security in async threads
+	if (file_access) {
+		ASYNC_API_FCT(mkdir);
+		ASYNC_API_FCT(get_dir_list);
+	}
 }
 
@@ -98,7 +98,7 @@ class ModApiUtil : public ModApiBase {
 public:
 	static void Initialize(lua_State *L, int top);
 
-	static void InitializeAsync(AsyncEngine& engine);
+	static void InitializeAsync(AsyncEngine& engine, bool file_access = true);
 
 };
 
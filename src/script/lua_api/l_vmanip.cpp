@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "map.h"
 #include "server.h"
 #include "mapgen.h"
+#include "util/string.h"
 
 // garbage collector
 int LuaVoxelManip::gc_object(lua_State *L)
@@ -346,6 +347,25 @@ int LuaVoxelManip::l_update_map(lua_State *L)
 	return 0;
 }
 
+int LuaVoxelManip::l_get_buffer(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	checkobject(L, 1);
+	std::string field = luaL_optstring(L, 2, "content");
+
+	if (field == "content")
+		LuaVoxelManipBuffer::create(L, 1, LuaVoxelManipBuffer::FIELD_CONTENT);
+	else if (field == "param1")
+		LuaVoxelManipBuffer::create(L, 1, LuaVoxelManipBuffer::FIELD_PARAM1);
+	else if (field == "param2")
+		LuaVoxelManipBuffer::create(L, 1, LuaVoxelManipBuffer::FIELD_PARAM2);
+	else
+		throw LuaError("Unknown VoxelManip buffer field: " + field);
+
+	return 1;
+}
+
 int LuaVoxelManip::l_was_modified(lua_State *L)
 {
 	NO_MAP_LOCK_REQUIRED;
@@ -473,7 +493,202 @@ const luaL_reg LuaVoxelManip::methods[] = {
 	luamethod(LuaVoxelManip, set_light_data),
 	luamethod(LuaVoxelManip, get_param2_data),
 	luamethod(LuaVoxelManip, set_param2_data),
+	luamethod(LuaVoxelManip, get_buffer),
 	luamethod(LuaVoxelManip, was_modified),
 	luamethod(LuaVoxelManip, get_emerged_area),
 	{0,0}
 };
+
+/*
+  VoxelManipBuffer
+ */
+
+// garbage collector
+int LuaVoxelManipBuffer::gc_object(lua_State *L)
+{
+	LuaVoxelManipBuffer *o = *(LuaVoxelManipBuffer **)(lua_touserdata(L, 1));
+	delete o;
+
+	return 0;
+}
+
+// buffer[i], falls back to the methods for other keys
+int LuaVoxelManipBuffer::mt_index(lua_State *L)
+{
+	if (lua_type(L, 2) == LUA_TNUMBER)
+		return l_get(L);
+
+	lua_pushvalue(L, 2);
+	lua_rawget(L, lua_upvalueindex(1));
+	return 1;
+}
+
+// buffer[i] = value
+int LuaVoxelManipBuffer::mt_newindex(lua_State *L)
+{
+	if (lua_type(L, 2) != LUA_TNUMBER)
+		throw LuaError("VoxelManip buffers can only be indexed by numbers");
+
+	return l_set(L);
+}
+
+// #buffer
+int LuaVoxelManipBuffer::mt_len(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	lua_pushinteger(L, o->m_vm->vm->m_area.getVolume());
+	return 1;
+}
+
+MapNode &LuaVoxelManipBuffer::checkNode(lua_State *L, int narg)
+{
+	// Checked on every access, read_from_map() may have changed the area
+	MMVManip *vm = m_vm->vm;
+	lua_Integer i = luaL_checkinteger(L, narg);
+	if (i < 1 || i > (lua_Integer)vm->m_area.getVolume())
+		throw LuaError("VoxelManip buffer index out of bounds: " + itos(i));
+	return vm->m_data[i - 1];
+}
+
+// get(i)
+int LuaVoxelManipBuffer::l_get(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	const MapNode &n = o->checkNode(L, 2);
+
+	switch (o->m_field) {
+	case FIELD_CONTENT:
+		lua_pushinteger(L, n.getContent());
+		break;
+	case FIELD_PARAM1:
+		lua_pushinteger(L, n.param1);
+		break;
+	case FIELD_PARAM2:
+		lua_pushinteger(L, n.param2);
+		break;
+	}
+	return 1;
+}
+
+// set(i, value)
+int LuaVoxelManipBuffer::l_set(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	MapNode &n = o->checkNode(L, 2);
+	lua_Integer value = luaL_checkinteger(L, 3);
+
+	switch (o->m_field) {
+	case FIELD_CONTENT:
+		n.setContent(value);
+		break;
+	case FIELD_PARAM1:
+		n.param1 = value;
+		break;
+	case FIELD_PARAM2:
+		n.param2 = value;
+		break;
+	}
+	return 0;
+}
+
+// get_pointer() -> lightuserdata pointing to the first node, for the LuaJIT FFI
+int LuaVoxelManipBuffer::l_get_pointer(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	LuaVoxelManipBuffer *o = checkobject(L, 1);
+	MMVManip *vm = o->m_vm->vm;
+	if (vm->m_data == NULL || vm->m_area.getVolume() == 0) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_pushlightuserdata(L, vm->m_data);
+	return 1;
+}
+
+LuaVoxelManipBuffer::LuaVoxelManipBuffer(LuaVoxelManip *vm, Field field) :
+	m_vm(vm),
+	m_field(field)
+{
+}
+
+void LuaVoxelManipBuffer::create(lua_State *L, int vm_idx, Field field)
+{
+	if (vm_idx < 0)
+		vm_idx = lua_gettop(L) + vm_idx + 1;
+	LuaVoxelManipBuffer *o =
+		new LuaVoxelManipBuffer(LuaVoxelManip::checkobject(L, vm_idx), field);
+
+	*(void **)(lua_newuserdata(L, sizeof(void *))) = o;
+	luaL_getmetatable(L, className);
+	lua_setmetatable(L, -2);
+
+	// Keep the VoxelManip alive as long as the buffer
+	lua_newtable(L);
+	lua_pushvalue(L, vm_idx);
+	lua_rawseti(L, -2, 1);
+	lua_setfenv(L, -2);
+}
+
+LuaVoxelManipBuffer *LuaVoxelManipBuffer::checkobject(lua_State *L, int narg)
+{
+	NO_MAP_LOCK_REQUIRED;
+
+	luaL_checktype(L, narg, LUA_TUSERDATA);
+
+	void *ud = luaL_checkudata(L, narg, className);
+	if (!ud)
+		luaL_typerror(L, narg, className);
+
+	return *(LuaVoxelManipBuffer **)ud;  // unbox pointer
+}
+
+void LuaVoxelManipBuffer::Register(lua_State *L)
+{
+	lua_newtable(L);
+	int methodtable = lua_gettop(L);
+	luaL_newmetatable(L, className);
+	int metatable = lua_gettop(L);
+
+	lua_pushliteral(L, "__metatable");
+	lua_pushvalue(L, methodtable);
+	lua_settable(L, metatable);  // hide metatable from Lua getmetatable()
+
+	// Numeric keys are nodes, the others methods
+	lua_pushliteral(L, "__index");
+	lua_pushvalue(L, methodtable);
+	lua_pushcclosure(L, mt_index, 1);
+	lua_settable(L, metatable);
+
+	lua_pushliteral(L, "__newindex");
+	lua_pushcfunction(L, mt_newindex);
+	lua_settable(L, metatable);
+
+	lua_pushliteral(L, "__len");
+	lua_pushcfunction(L, mt_len);
+	lua_settable(L, metatable);
+
+	lua_pushliteral(L, "__gc");
+	lua_pushcfunction(L, gc_object);
+	lua_settable(L, metatable);
+
+	lua_pop(L, 1);  // drop metatable
+
+	luaL_openlib(L, 0, methods, 0);  // fill methodtable
+	lua_pop(L, 1);  // drop methodtable
+}
+
+const char LuaVoxelManipBuffer::className[] = "VoxelManipBuffer";
+const luaL_reg LuaVoxelManipBuffer::methods[] = {
+	luamethod(LuaVoxelManipBuffer, get),
+	luamethod(LuaVoxelManipBuffer, set),
+	luamethod(LuaVoxelManipBuffer, get_pointer),
+	{0,0}
+};
@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 class Map;
 class MapBlock;
 class MMVManip;
+struct MapNode;
 
 /*
   VoxelManip
@@ -60,6 +61,8 @@ class LuaVoxelManip : public ModApiBase {
 	static int l_get_param2_data(lua_State *L);
 	static int l_set_param2_data(lua_State *L);
 
+	static int l_get_buffer(lua_State *L);
+
 	static int l_was_modified(lua_State *L);
 	static int l_get_emerged_area(lua_State *L);
 
@@ -80,4 +83,49 @@ class LuaVoxelManip : public ModApiBase {
 	static void Register(lua_State *L);
 };
 
+/*
+  VoxelManipBuffer
+
+  Gives access to one field of the nodes of a VoxelManip in place, without
+  copying them into a table.
+ */
+class LuaVoxelManipBuffer : public ModApiBase {
+public:
+	enum Field {
+		FIELD_CONTENT,
+		FIELD_PARAM1,
+		FIELD_PARAM2
+	};
+
+private:
+	// Kept alive by the environment table of the userdata
+	LuaVoxelManip *m_vm;
+	Field m_field;
+
+	static const char className[];
+	static const luaL_reg methods[];
+
+	static int gc_object(lua_State *L);
+	static int mt_index(lua_State *L);
+	static int mt_newindex(lua_State *L);
+	static int mt_len(lua_State *L);
+
+	static int l_get(lua_State *L);
+	static int l_set(lua_State *L);
+	static int l_get_pointer(lua_State *L);
+
+	// Node at the 1-based index at narg, throws if out of bounds
+	MapNode &checkNode(lua_State *L, int narg);
+
+public:
+	LuaVoxelManipBuffer(LuaVoxelManip *vm, Field field);
+
+	// Creates a buffer for the VoxelManip at vm_idx and leaves it on top of stack
+	static void create(lua_State *L, int vm_idx, Field field);
+
+	static LuaVoxelManipBuffer *checkobject(lua_State *L, int narg);
+
+	static void Register(lua_State *L);
+};
+
 #endif /* L_VMANIP_H_ */
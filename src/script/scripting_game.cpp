@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server.h"
 #include "log.h"
 #include "settings.h"
+#include "threading/thread.h"
 #include "cpp_api/s_internal.h"
 #include "lua_api/l_areastore.h"
 #include "lua_api/l_base.h"
@@ -102,10 +103,33 @@ void GameScripting::InitializeModApi(lua_State *L, int top)
 	LuaPcgRandom::Register(L);
 	LuaSecureRandom::Register(L);
 	LuaVoxelManip::Register(L);
+	LuaVoxelManipBuffer::Register(L);
 	NodeMetaRef::Register(L);
 	NodeTimerRef::Register(L);
 	ObjectRef::Register(L);
 	LuaSettings::Register(L);
+
+	// Functions available to async jobs, these mustn't access the
+	// environment or files
+	ModApiUtil::InitializeAsync(asyncEngine, false);
+
+	s16 num_async_threads = g_settings->getS16("async_threads");
+	if (num_async_threads <= 0)
+		num_async_threads = MYMIN(Thread::getNumberOfProcessors() - 1, 4);
+	if (num_async_threads < 1)
+		num_async_threads = 1;
+	asyncEngine.initialize(num_async_threads, true);
+}
+
+unsigned int GameScripting::queueAsync(const std::string &serialized_func,
+		const std::string &serialized_params)
+{
+	return asyncEngine.queueAsyncJob(serialized_func, serialized_params);
+}
+
+void GameScripting::pushFinishedAsyncJobs(lua_State *L)
+{
+	asyncEngine.pushFinishedJobs(L);
 }
 
 void log_deprecated(const std::string &message)
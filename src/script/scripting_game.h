@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define SCRIPTING_GAME_H_
 
 #include "cpp_api/s_base.h"
+#include "cpp_api/s_async.h"
 #include "cpp_api/s_entity.h"
 #include "cpp_api/s_env.h"
 #include "cpp_api/s_inventory.h"
@@ -48,8 +49,16 @@ class GameScripting :
 
 	// use ScriptApiBase::loadMod() to load mods
 
+	// Pass async jobs of mods to the async threads
+	unsigned int queueAsync(const std::string &serialized_func,
+			const std::string &serialized_params);
+	// Push the finished async jobs as a list onto the stack
+	void pushFinishedAsyncJobs(lua_State *L);
+
 private:
 	void InitializeModApi(lua_State *L, int top);
+
+	AsyncEngine asyncEngine;
 };
 
 void log_deprecated(const std::string &message);
@@ -33,6 +33,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "version.h"
 #include "filesys.h"
 #include "mapblock.h"
+#include "nodemetadata.h"
+#include "serialization.h"
 #include "serverobject.h"
 #include "genericobject.h"
 #include "settings.h"
@@ -173,6 +175,9 @@ Server::Server(
 	m_thread(NULL),
 	m_time_of_day_send_timer(0),
 	m_uptime(0),
+	m_time_speed("time_speed"),
+	m_time_send_interval("time_send_interval"),
+	m_max_block_sends_total("max_simultaneous_block_sends_server_total"),
 	m_clients(&m_con),
 	m_shutdown_requested(false),
 	m_shutdown_ask_reconnect(false),
@@ -189,6 +194,7 @@ Server::Server(
 	m_objectdata_timer = 0.0;
 	m_emergethread_trigger_timer = 0.0;
 	m_savemap_timer = 0.0;
+	m_profiler_trace_timer = 0.0;
 
 	m_step_dtime = 0.0;
 	m_lag = g_settings->getFloat("dedicated_server_step");
@@ -424,6 +430,11 @@ Server::~Server()
 			i != m_detached_inventories.end(); ++i) {
 		delete i->second;
 	}
+	for (std::map<std::string, Inventory*>::iterator
+			i = m_detached_inventories_sent.begin();
+			i != m_detached_inventories_sent.end(); ++i) {
+		delete i->second;
+	}
 }
 
 void Server::start(Address bind_addr)
@@ -538,7 +549,7 @@ void Server::AsyncRunStep(bool initial_step)
 	/*
 		Update time of day and overall game time
 	*/
-	m_env->setTimeOfDaySpeed(g_settings->getFloat("time_speed"));
+	m_env->setTimeOfDaySpeed(m_time_speed.get());
 
 	/*
 		Send to clients at constant intervals
@@ -546,10 +557,9 @@ void Server::AsyncRunStep(bool initial_step)
 
 	m_time_of_day_send_timer -= dtime;
 	if(m_time_of_day_send_timer < 0.0) {
-		m_time_of_day_send_timer = g_settings->getFloat("time_send_interval");
+		m_time_of_day_send_timer = m_time_send_interval.get();
 		u16 time = m_env->getTimeOfDay();
-		float time_speed = g_settings->getFloat("time_speed");
-		SendTimeOfDay(PEER_ID_INEXISTENT, time, time_speed);
+		SendTimeOfDay(PEER_ID_INEXISTENT, time, m_time_speed.get());
 	}
 
 	{
@@ -927,6 +937,10 @@ void Server::AsyncRunStep(bool initial_step)
 						prof.add("MEET_BLOCK_NODE_METADATA_CHANGED", 1);
 						setBlockNotSent(event->p);
 				break;
+			case MEET_NODE_METADATA_CHANGED:
+				prof.add("MEET_NODE_METADATA_CHANGED", 1);
+				m_changed_nodemeta[getNodeBlockPos(event->p)].insert(event->p);
+				break;
 			case MEET_OTHER:
 				infostream << "Server: MEET_OTHER" << std::endl;
 				prof.add("MEET_OTHER", 1);
@@ -981,6 +995,8 @@ void Server::AsyncRunStep(bool initial_step)
 			prof.print(verbosestream);
 		}
 
+		sendNodeMetadataChanges();
+
 	}
 
 	/*
@@ -1024,6 +1040,35 @@ void Server::AsyncRunStep(bool initial_step)
 			m_env->saveMeta();
 		}
 	}
+
+	// Write the profiler trace when it is done
+	if (m_profiler_trace_timer > 0.0) {
+		m_profiler_trace_timer -= dtime;
+		if (m_profiler_trace_timer <= 0.0) {
+			std::ostringstream os(std::ios_base::binary);
+			u32 count = g_profiler->stopTrace(os);
+			if (fs::safeWriteToFile(m_profiler_trace_path, os.str())) {
+				actionstream << "Wrote profiler trace with " << count
+					<< " scopes to " << m_profiler_trace_path << std::endl;
+			} else {
+				errorstream << "Failed to write profiler trace to "
+					<< m_profiler_trace_path << std::endl;
+			}
+		}
+	}
+}
+
+std::string Server::startProfilerTrace(float seconds)
+{
+	sanity_check(seconds > 0.0);
+	if (m_profiler_trace_timer > 0.0)
+		return "";
+
+	m_profiler_trace_path = m_path_world + DIR_DELIM + "profiler_trace_"
+		+ itos(time(NULL)) + ".json";
+	m_profiler_trace_timer = seconds;
+	g_profiler->startTrace();
+	return m_profiler_trace_path;
 }
 
 void Server::Receive()
@@ -1335,7 +1380,7 @@ void Server::setInventoryModified(const InventoryLocation &loc, bool playerSend)
 		if(block)
 			block->raiseModified(MOD_STATE_WRITE_NEEDED);
 
-		setBlockNotSent(blockpos);
+		m_changed_nodemeta[blockpos].insert(loc.p);
 	}
 		break;
 	case InventoryLocation::DETACHED:
@@ -1625,7 +1670,33 @@ void Server::SendInventory(PlayerSAO* playerSAO)
 {
 	DSTACK(FUNCTION_NAME);
 
-	UpdateCrafting(playerSAO->getPlayer());
+	Inventory *inv = playerSAO->getInventory();
+	RemoteClient *client = getClientNoEx(playerSAO->getPeerID(), CS_Created);
+	Inventory *sent = client ? client->m_sent_inventory : NULL;
+
+	// The preview only depends on the craft grid
+	const InventoryList *craft = inv->getList("craft");
+	const InventoryList *sent_craft = sent ? sent->getList("craft") : NULL;
+	if (!craft || !sent_craft || *craft != *sent_craft)
+		UpdateCrafting(playerSAO->getPlayer());
+
+	/*
+		Send only the changes if the client has the inventory already.
+		The delta is sent even if empty, it makes the client drop its
+		predictions.
+	*/
+	if (sent) {
+		NetworkPacket pkt(TOCLIENT_INVENTORY_DELTA, 0, playerSAO->getPeerID());
+
+		std::ostringstream os(std::ios_base::binary);
+		os << serializeString("");
+		inv->serializeDelta(os, *sent);
+
+		std::string s = os.str();
+		pkt.putRawString(s.c_str(), s.size());
+		Send(&pkt);
+		return;
+	}
 
 	/*
 		Serialize it
@@ -1634,12 +1705,15 @@ void Server::SendInventory(PlayerSAO* playerSAO)
 	NetworkPacket pkt(TOCLIENT_INVENTORY, 0, playerSAO->getPeerID());
 
 	std::ostringstream os;
-	playerSAO->getInventory()->serialize(os);
+	inv->serialize(os);
 
 	std::string s = os.str();
 
 	pkt.putRawString(s.c_str(), s.size());
 	Send(&pkt);
+
+	if (client && client->net_proto_version >= 28)
+		client->m_sent_inventory = new Inventory(*inv);
 }
 
 void Server::SendChatMessage(u16 peer_id, const std::wstring &message)
@@ -2138,26 +2212,111 @@ void Server::setBlockNotSent(v3s16 p)
 	m_clients.unlock();
 }
 
-void Server::SendBlockNoLock(u16 peer_id, MapBlock *block, u8 ver, u16 net_proto_version)
+void Server::sendNodeMetadataChanges()
+{
+	if (m_changed_nodemeta.empty())
+		return;
+
+	/*
+		Serialize the changes of each block once, for all clients.
+		Changes of blocks that are not loaded anymore can't be serialized,
+		the whole block is sent instead.
+	*/
+	Map &map = m_env->getMap();
+	std::map<v3s16, std::string> block_changes;
+	std::map<v3s16, u32> block_counts;
+	for (std::map<v3s16, std::set<v3s16> >::iterator
+			i = m_changed_nodemeta.begin();
+			i != m_changed_nodemeta.end(); ++i) {
+		MapBlock *block = map.getBlockNoCreateNoEx(i->first);
+		if (!block)
+			continue;
+
+		std::ostringstream os(std::ios::binary);
+		for (std::set<v3s16>::iterator
+				p = i->second.begin(); p != i->second.end(); ++p) {
+			NodeMetadata *meta = block->m_node_metadata.get(
+				*p - i->first * MAP_BLOCKSIZE);
+			writeV3S16(os, *p);
+			writeU8(os, meta ? 1 : 0);
+			if (meta)
+				meta->serialize(os);
+		}
+		block_changes[i->first] = os.str();
+		block_counts[i->first] = i->second.size();
+	}
+
+	std::vector<u16> clients = m_clients.getClientIDs();
+	m_clients.lock();
+	for (std::vector<u16>::iterator i = clients.begin();
+			i != clients.end(); ++i) {
+		RemoteClient *client = m_clients.lockedGetClientNoEx(*i);
+		if (!client)
+			continue;
+
+		std::string data;
+		u32 count = 0;
+		for (std::map<v3s16, std::set<v3s16> >::iterator
+				b = m_changed_nodemeta.begin();
+				b != m_changed_nodemeta.end(); ++b) {
+			v3s16 blockpos = b->first;
+			std::map<v3s16, std::string>::iterator changes =
+				block_changes.find(blockpos);
+			if (client->net_proto_version < 28 ||
+					changes == block_changes.end()) {
+				client->SetBlockNotSent(blockpos);
+				continue;
+			}
+
+			// A block on the wire may be older than the change
+			client->ResendBlockIfOnWire(blockpos);
+			// Blocks the client doesn't have are sent with the change later
+			if (!client->isBlockSent(blockpos))
+				continue;
+
+			data += changes->second;
+			count += block_counts[blockpos];
+		}
+		if (count == 0)
+			continue;
+
+		std::ostringstream os(std::ios::binary);
+		writeU32(os, count);
+		os << data;
+		std::ostringstream compressed(std::ios::binary);
+		compressZlib(os.str(), compressed);
+
+		NetworkPacket pkt(TOCLIENT_NODEMETA_CHANGED, 0, *i);
+		pkt.putLongString(compressed.str());
+		Send(&pkt);
+	}
+	m_clients.unlock();
+
+	m_changed_nodemeta.clear();
+}
+
+bool Server::SendBlockNoLock(u16 peer_id, MapBlock *block, u8 ver, u16 net_proto_version)
 {
 	DSTACK(FUNCTION_NAME);
 
 	v3s16 p = block->getPos();
 
 	/*
-		Create a packet with the block in the right format
+		Create a packet with the block in the right format.
+		The serialized data is shared by all clients using the same versions.
 	*/
 
-	std::ostringstream os(std::ios_base::binary);
-	block->serialize(os, ver, false);
-	block->serializeNetworkSpecific(os, net_proto_version);
-	std::string s = os.str();
+	bool cache_hit;
+	const std::string &s = block->getNetworkSerialization(ver,
+			net_proto_version, &cache_hit);
 
 	NetworkPacket pkt(TOCLIENT_BLOCKDATA, 2 + 2 + 2 + 2 + s.size(), peer_id);
 
 	pkt << p;
 	pkt.putRawString(s.c_str(), s.size());
 	Send(&pkt);
+
+	return cache_hit;
 }
 
 void Server::SendBlocks(float dtime)
@@ -2172,6 +2331,7 @@ void Server::SendBlocks(float dtime)
 	std::vector<PrioritySortedBlockTransfer> queue;
 
 	s32 total_sending = 0;
+	u32 cache_hits = 0;
 
 	{
 		ScopeProfiler sp(g_profiler, "Server: selecting blocks for sending");
@@ -2201,8 +2361,7 @@ void Server::SendBlocks(float dtime)
 	for(u32 i=0; i<queue.size(); i++)
 	{
 		//TODO: Calculate limit dynamically
-		if(total_sending >= g_settings->getS32
-				("max_simultaneous_block_sends_server_total"))
+		if(total_sending >= m_max_block_sends_total.get())
 			break;
 
 		PrioritySortedBlockTransfer q = queue[i];
@@ -2222,12 +2381,20 @@ void Server::SendBlocks(float dtime)
 		if(!client)
 			continue;
 
-		SendBlockNoLock(q.peer_id, block, client->serialization_version, client->net_proto_version);
+		if (SendBlockNoLock(q.peer_id, block, client->serialization_version,
+				client->net_proto_version))
+			cache_hits++;
 
 		client->SentBlock(q.pos);
 		total_sending++;
 	}
 	m_clients.unlock();
+
+	if (total_sending > 0) {
+		g_profiler->add("Server: block data cache hits", cache_hits);
+		g_profiler->add("Server: block data cache misses",
+				total_sending - cache_hits);
+	}
 }
 
 void Server::fillMediaCache()
@@ -2487,12 +2654,46 @@ void Server::sendDetachedInventory(const std::string &name, u16 peer_id)
 	NetworkPacket pkt(TOCLIENT_DETACHED_INVENTORY, 0, peer_id);
 	pkt.putRawString(s.c_str(), s.size());
 
-	if (peer_id != PEER_ID_INEXISTENT) {
-		Send(&pkt);
-	}
-	else {
-		m_clients.sendToAll(0, &pkt, true);
+	/*
+		All clients get the changes since the inventory was last sent to
+		them, as a delta if they support it. A single client getting the
+		whole inventory is then in sync with all others.
+	*/
+	Inventory *&sent = m_detached_inventories_sent[name];
+	bool use_delta = sent != NULL;
+	std::ostringstream delta_os(std::ios_base::binary);
+	delta_os << serializeString(name);
+	bool changed = true;
+	if (use_delta)
+		changed = inv->serializeDelta(delta_os, *sent);
+	else
+		sent = new Inventory(*inv);
+
+	if (changed || peer_id == PEER_ID_INEXISTENT) {
+		std::string delta = delta_os.str();
+		NetworkPacket delta_pkt(TOCLIENT_INVENTORY_DELTA, 0);
+		delta_pkt.putRawString(delta.c_str(), delta.size());
+
+		std::vector<u16> clients = m_clients.getClientIDs(CS_Created);
+		m_clients.lock();
+		for (std::vector<u16>::iterator i = clients.begin();
+				i != clients.end(); ++i) {
+			RemoteClient *client = m_clients.lockedGetClientNoEx(*i, CS_Created);
+			if (!client || client->net_proto_version == 0 || *i == peer_id)
+				continue;
+
+			if (use_delta && client->net_proto_version >= 28) {
+				if (changed)
+					m_clients.send(*i, 0, &delta_pkt, true);
+			} else {
+				m_clients.send(*i, 0, &pkt, true);
+			}
+		}
+		m_clients.unlock();
 	}
+
+	if (peer_id != PEER_ID_INEXISTENT)
+		Send(&pkt);
 }
 
 void Server::sendDetachedInventories(u16 peer_id)
@@ -3234,6 +3435,9 @@ Inventory* Server::createDetachedInventory(const std::string &name)
 	if(m_detached_inventories.count(name) > 0){
 		infostream<<"Server clearing detached inventory \""<<name<<"\""<<std::endl;
 		delete m_detached_inventories[name];
+		// Send the new inventory whole
+		delete m_detached_inventories_sent[name];
+		m_detached_inventories_sent.erase(name);
 	} else {
 		infostream<<"Server creating detached inventory \""<<name<<"\""<<std::endl;
 	}
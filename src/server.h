@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "gamedef.h"
 #include "serialization.h" // For SER_FMT_VER_INVALID
 #include "mods.h"
+#include "settings.h"
 #include "inventorymanager.h"
 #include "subgame.h"
 #include "util/numeric.h"
@@ -300,6 +301,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	bool rollbackRevertActions(const std::list<RollbackAction> &actions,
 			std::list<std::string> *log);
 
+	// Records a profiler trace for the given time and writes it into the
+	// world directory. Returns the file name, or "" if a trace is running.
+	// seconds must be positive.
+	std::string startProfilerTrace(float seconds);
+
 	// IGameDef interface
 	// Under envlock
 	virtual IItemDefManager* getItemDefManager();
@@ -434,9 +440,13 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 			std::vector<u16> *far_players=NULL, float far_d_nodes=100,
 			bool remove_metadata=true);
 	void setBlockNotSent(v3s16 p);
+	// Sends the node metadata changes collected in m_changed_nodemeta
+	// Environment must be locked when called
+	void sendNodeMetadataChanges();
 
 	// Environment and Connection must be locked when called
-	void SendBlockNoLock(u16 peer_id, MapBlock *block, u8 ver, u16 net_proto_version);
+	// Returns true if the block's cached network serialization was reused
+	bool SendBlockNoLock(u16 peer_id, MapBlock *block, u8 ver, u16 net_proto_version);
 
 	// Sends blocks to clients (locks env and con on its own)
 	void SendBlocks(float dtime);
@@ -531,6 +541,9 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	float m_emergethread_trigger_timer;
 	float m_savemap_timer;
 	IntervalLimiter m_map_timer_and_unload_interval;
+	// Time left of the running profiler trace
+	float m_profiler_trace_timer;
+	std::string m_profiler_trace_path;
 
 	// Environment
 	ServerEnvironment *m_env;
@@ -591,6 +604,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// Uptime of server in seconds
 	MutexedVariable<double> m_uptime;
 
+	// Settings used in every step
+	SettingHandle<float> m_time_speed;
+	SettingHandle<float> m_time_send_interval;
+	SettingHandle<s32> m_max_block_sends_total;
+
 	/*
 	 Client interface
 	 */
@@ -628,6 +646,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 		This is behind m_env_mutex
 	*/
 	std::queue<MapEditEvent*> m_unsent_map_edit_queue;
+	/*
+		Positions of nodes with changed metadata by block, sent once per step
+		This is behind m_env_mutex
+	*/
+	std::map<v3s16, std::set<v3s16> > m_changed_nodemeta;
 	/*
 		Set to true when the server itself is modifying the map and does
 		all sending of information by itself.
@@ -662,6 +685,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	*/
 	// key = name
 	std::map<std::string, Inventory*> m_detached_inventories;
+	// Detached inventories as last sent to the clients, see sendDetachedInventory
+	std::map<std::string, Inventory*> m_detached_inventories_sent;
 
 	DISABLE_CLASS_COPY(Server);
 };
@@ -770,7 +770,11 @@ bool Settings::set(const std::string &name, const std::string &value)
 
 bool Settings::setDefault(const std::string &name, const std::string &value)
 {
-	return setEntry(name, &value, false, true);
+	if (!setEntry(name, &value, false, true))
+		return false;
+
+	doCallbacks(name);
+	return true;
 }
 
 
@@ -878,16 +882,20 @@ bool Settings::setNoiseParams(const std::string &name,
 
 bool Settings::remove(const std::string &name)
 {
-	MutexAutoLock lock(m_mutex);
+	{
+		MutexAutoLock lock(m_mutex);
+
+		std::map<std::string, SettingsEntry>::iterator it = m_settings.find(name);
+		if (it == m_settings.end())
+			return false;
 
-	std::map<std::string, SettingsEntry>::iterator it = m_settings.find(name);
-	if (it != m_settings.end()) {
 		delete it->second.group;
 		m_settings.erase(it);
-		return true;
-	} else {
-		return false;
 	}
+
+	// The default value applies again
+	doCallbacks(name);
+	return true;
 }
 
 
@@ -1021,3 +1029,56 @@ void Settings::doCallbacks(const std::string name)
 		}
 	}
 }
+
+
+/*****************
+ * SettingHandle *
+ *****************/
+
+template <typename T>
+SettingHandle<T>::SettingHandle(const std::string &name, Settings *settings) :
+	m_name(name),
+	m_settings(settings)
+{
+	// Registered first, so that no change is missed
+	m_settings->registerChangedCallback(m_name, changedCallback, this);
+	try {
+		m_value = read();
+	} catch (SettingNotFoundException &e) {
+		m_settings->deregisterChangedCallback(m_name, changedCallback, this);
+		throw;
+	}
+}
+
+template <typename T>
+SettingHandle<T>::~SettingHandle()
+{
+	m_settings->deregisterChangedCallback(m_name, changedCallback, this);
+}
+
+template <typename T>
+void SettingHandle<T>::changedCallback(const std::string &name, void *data)
+{
+	SettingHandle<T> *handle = (SettingHandle<T> *)data;
+	try {
+		handle->m_value = handle->read();
+	} catch (SettingNotFoundException &e) {
+	}
+}
+
+template <> bool SettingHandle<bool>::read() const
+{ return m_settings->getBool(m_name); }
+template <> u16 SettingHandle<u16>::read() const
+{ return m_settings->getU16(m_name); }
+template <> s16 SettingHandle<s16>::read() const
+{ return m_settings->getS16(m_name); }
+template <> s32 SettingHandle<s32>::read() const
+{ return m_settings->getS32(m_name); }
+template <> float SettingHandle<float>::read() const
+{ return m_settings->getFloat(m_name); }
+
+template class SettingHandle<bool>;
+template class SettingHandle<u16>;
+template class SettingHandle<s16>;
+template class SettingHandle<s32>;
+template class SettingHandle<float>;
@@ -23,6 +23,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes_bloated.h"
 #include "util/string.h"
 #include "threading/mutex.h"
+#include "threading/atomic.h"
+#include "util/basic_macros.h"
 #include <string>
 #include <map>
 #include <list>
@@ -230,5 +232,34 @@ class Settings {
 
 };
 
+/*
+	Typed value of a setting, parsed once and kept up to date through the
+	changed callbacks of the Settings. Reading it doesn't lock anything,
+	so it is meant for settings that are read in every step.
+
+	The setting must exist when the handle is created; if it is removed
+	later, the last value is kept. The Settings must outlive the handle.
+	Instantiated for bool, u16, s16, s32 and float.
+*/
+template <typename T>
+class SettingHandle {
+public:
+	SettingHandle(const std::string &name, Settings *settings = g_settings);
+	~SettingHandle();
+
+	T get() const { return m_value; }
+	const std::string &getName() const { return m_name; }
+
+private:
+	DISABLE_CLASS_COPY(SettingHandle);
+
+	static void changedCallback(const std::string &name, void *data);
+	T read() const;
+
+	std::string m_name;
+	Settings *m_settings;
+	mutable GenericAtomic<T> m_value;
+};
+
 #endif
 
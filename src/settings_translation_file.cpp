@@ -235,6 +235,8 @@ fake_function() {
 	gettext("Maximum proportion of current window to be used for hotbar.\nUseful if there's something to be displayed right or left of hotbar.");
 	gettext("Mesh cache");
 	gettext("Enables caching of facedir rotated meshes.");
+	gettext("Mesh generation threads");
+	gettext("Number of threads making mapblock meshes.\n0 = number of processors minus two, at least one.");
 	gettext("Minimap");
 	gettext("Enables minimap.");
 	gettext("Round minimap");
@@ -380,6 +382,10 @@ fake_function() {
 	gettext("Controls length of day/night cycle.\nExamples: 72 = 20min, 360 = 4min, 1 = 24hour, 0 = day/night/whatever stays unchanged.");
 	gettext("Map save interval");
 	gettext("Interval of saving important changes in the world, stated in seconds.");
+	gettext("Asynchronous map saving");
+	gettext("Compress and write modified mapblocks to the database on a separate thread.\nThe server only copies the block data, which avoids lag spikes when saving.");
+	gettext("Map save queue limit");
+	gettext("Maximum number of mapblocks waiting to be written by the map save thread.\nWhen the queue is full, the server waits for the thread to catch up.");
 	gettext("Physics");
 	gettext("Default acceleration");
 	gettext("Acceleration in air");
@@ -425,6 +431,10 @@ fake_function() {
 	gettext("Max liquids processed per step.");
 	gettext("Liquid queue purge time");
 	gettext("The time (in seconds) that the liquids queue may grow beyond processing\ncapacity until an attempt is made to decrease its size by dumping old queue\nitems.  A value of 0 disables the functionality.");
+	gettext("Liquid threads");
+	gettext("Number of threads that decide liquid updates in parallel, each taking\nwhole mapblocks. The result doesn't depend on the number of threads.\nValue of 0 (default) will use the number of processors minus one, up to 4.");
+	gettext("Async threads");
+	gettext("Number of threads that run the async jobs of mods (core.handle_async).\nValue of 0 (default) will use the number of processors minus one, up to 4.");
 	gettext("Liquid update tick");
 	gettext("Liquid update interval in seconds.");
 	gettext("Mapgen");
@@ -451,6 +461,8 @@ fake_function() {
 	gettext("Maximum number of blocks to be queued that are to be generated.\nSet to blank for an appropriate amount to be chosen automatically.");
 	gettext("Number of emerge threads");
 	gettext("Number of emerge threads to use. Make this field blank, or increase this number\nto use multiple threads. On multiprocessor systems, this will improve mapgen speed greatly\nat the cost of slightly buggy caves.");
+	gettext("Number of emerge load threads");
+	gettext("Number of threads that load existing mapblocks from the database.\nThey run separately from the emerge threads generating new mapblocks, so that\nloading never has to wait for map generation.");
 	gettext("Mapgen biome heat noise parameters");
 	gettext("Noise parameters for biome API temperature, humidity and biome blend.");
 	gettext("Mapgen heat blend noise parameters");
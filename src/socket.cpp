@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/string.h"
 #include "util/numeric.h"
 #include "constants.h"
+#include "config.h"
 #include "debug.h"
 #include "settings.h"
 #include "log.h"
@@ -59,6 +60,22 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 	typedef int socket_t;
 #endif
 
+#if HAVE_SYS_EPOLL_H
+	#include <sys/epoll.h>
+#endif
+
+// Maximum number of datagrams passed to one sendmmsg() or recvmmsg() call
+#define UDP_BATCH_MAX 64
+
+#if HAVE_SENDMMSG
+// Set if the kernel doesn't support sendmmsg(), Send() is used instead
+static bool g_sendmmsg_unsupported = false;
+#endif
+#if HAVE_RECVMMSG
+// Set if the kernel doesn't support recvmmsg(), Receive() is used instead
+static bool g_recvmmsg_unsupported = false;
+#endif
+
 // Set to true to enable verbose debug output
 bool socket_enable_debug_output = false;        // yuck
 
@@ -310,6 +327,39 @@ void Address::print(std::ostream *s) const
 		*s << serializeString() << ":" << m_port;
 }
 
+#if HAVE_SENDMMSG || HAVE_RECVMMSG
+// Returns the length of the socket address written to storage
+static socklen_t address_to_sockaddr(const Address &address,
+	struct sockaddr_storage *storage)
+{
+	memset(storage, 0, sizeof(*storage));
+	if (address.isIPv6()) {
+		struct sockaddr_in6 *a = (struct sockaddr_in6 *)storage;
+		*a = address.getAddress6();
+		a->sin6_family = AF_INET6;
+		a->sin6_port = htons(address.getPort());
+		return sizeof(struct sockaddr_in6);
+	}
+	struct sockaddr_in *a = (struct sockaddr_in *)storage;
+	*a = address.getAddress();
+	a->sin_family = AF_INET;
+	a->sin_port = htons(address.getPort());
+	return sizeof(struct sockaddr_in);
+}
+
+static Address sockaddr_to_address(const struct sockaddr_storage *storage)
+{
+	if (storage->ss_family == AF_INET6) {
+		const struct sockaddr_in6 *a = (const struct sockaddr_in6 *)storage;
+		IPv6AddressBytes bytes;
+		memcpy(bytes.bytes, a->sin6_addr.s6_addr, 16);
+		return Address(&bytes, ntohs(a->sin6_port));
+	}
+	const struct sockaddr_in *a = (const struct sockaddr_in *)storage;
+	return Address(ntohl(a->sin_addr.s_addr), ntohs(a->sin_port));
+}
+#endif
+
 /*
 	UDPSocket
 */
@@ -321,6 +371,8 @@ UDPSocket::UDPSocket(bool ipv6)
 
 bool UDPSocket::init(bool ipv6, bool noExceptions)
 {
+	m_epoll_handle = -1;
+
 	if (g_sockets_initialized == false) {
 		dstream << "Sockets not initialized" << std::endl;
 		return false;
@@ -348,6 +400,21 @@ bool UDPSocket::init(bool ipv6, bool noExceptions)
 
 	setTimeoutMs(0);
 
+#if HAVE_SYS_EPOLL_H
+	// WaitData() falls back to select() if this fails
+	m_epoll_handle = epoll_create(1);
+	if (m_epoll_handle != -1) {
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = m_handle;
+		if (epoll_ctl(m_epoll_handle, EPOLL_CTL_ADD, m_handle, &event) != 0) {
+			close(m_epoll_handle);
+			m_epoll_handle = -1;
+		}
+	}
+#endif
+
 	return true;
 }
 
@@ -363,6 +430,8 @@ UDPSocket::~UDPSocket()
 	closesocket(m_handle);
 #else
 	close(m_handle);
+	if (m_epoll_handle != -1)
+		close(m_epoll_handle);
 #endif
 }
 
@@ -532,6 +601,116 @@ int UDPSocket::Receive(Address & sender, void *data, int size)
 	return received;
 }
 
+int UDPSocket::SendBatch(const UDPDatagram *datagrams, int count)
+{
+	int sent = 0;
+	int i = 0;
+
+#if HAVE_SENDMMSG
+	// Send() does the debug output and the simulated packet loss
+	while (i < count && !g_sendmmsg_unsupported &&
+			!socket_enable_debug_output && !INTERNET_SIMULATOR) {
+		struct sockaddr_storage addresses[UDP_BATCH_MAX];
+		struct iovec iovs[UDP_BATCH_MAX];
+		struct mmsghdr msgs[UDP_BATCH_MAX];
+
+		int batch_start = i;
+		int n = 0;
+		for (; i < count && n < UDP_BATCH_MAX; i++) {
+			const UDPDatagram &datagram = datagrams[i];
+			if (datagram.address.getFamily() != m_addr_family)
+				continue;
+			iovs[n].iov_base = datagram.data;
+			iovs[n].iov_len = datagram.size;
+			memset(&msgs[n], 0, sizeof(msgs[n]));
+			msgs[n].msg_hdr.msg_name = &addresses[n];
+			msgs[n].msg_hdr.msg_namelen =
+				address_to_sockaddr(datagram.address, &addresses[n]);
+			msgs[n].msg_hdr.msg_iov = &iovs[n];
+			msgs[n].msg_hdr.msg_iovlen = 1;
+			n++;
+		}
+
+		int done = 0;
+		while (done < n) {
+			int result = sendmmsg(m_handle, &msgs[done], n - done, 0);
+			if (result > 0) {
+				sent += result;
+				done += result;
+			} else if (result < 0 && errno == ENOSYS) {
+				// Nothing of this batch has been sent, send it one by one
+				g_sendmmsg_unsupported = true;
+				i = batch_start;
+				break;
+			} else if (result < 0 && errno != EINTR) {
+				// Skip the datagram that failed
+				done++;
+			}
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		try {
+			Send(datagrams[i].address, datagrams[i].data, datagrams[i].size);
+			sent++;
+		} catch (SendFailedException &e) {
+		}
+	}
+
+	return sent;
+}
+
+int UDPSocket::ReceiveBatch(UDPDatagram *datagrams, int count)
+{
+	if (count <= 0 || !WaitData(m_timeout_ms))
+		return 0;
+
+#if HAVE_RECVMMSG
+	// Receive() does the debug output
+	if (!g_recvmmsg_unsupported && !socket_enable_debug_output) {
+		struct sockaddr_storage addresses[UDP_BATCH_MAX];
+		struct iovec iovs[UDP_BATCH_MAX];
+		struct mmsghdr msgs[UDP_BATCH_MAX];
+
+		int n = MYMIN(count, UDP_BATCH_MAX);
+		for (int i = 0; i < n; i++) {
+			iovs[i].iov_base = datagrams[i].data;
+			iovs[i].iov_len = datagrams[i].capacity;
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = &addresses[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int received = recvmmsg(m_handle, msgs, n, MSG_DONTWAIT, NULL);
+		if (received >= 0) {
+			for (int i = 0; i < received; i++) {
+				datagrams[i].size = msgs[i].msg_len;
+				datagrams[i].address = sockaddr_to_address(&addresses[i]);
+			}
+			return received;
+		}
+		if (errno != ENOSYS)
+			return 0;
+		g_recvmmsg_unsupported = true;
+	}
+#endif
+
+	// One recvfrom() per datagram, as long as there is data
+	int received = 0;
+	while (received < count && (received == 0 || WaitData(0))) {
+		UDPDatagram &datagram = datagrams[received];
+		datagram.size = Receive(datagram.address, datagram.data,
+			datagram.capacity);
+		if (datagram.size < 0)
+			break;
+		received++;
+	}
+	return received;
+}
+
 int UDPSocket::GetHandle()
 {
 	return m_handle;
@@ -544,6 +723,21 @@ void UDPSocket::setTimeoutMs(int timeout_ms)
 
 bool UDPSocket::WaitData(int timeout_ms)
 {
+#if HAVE_SYS_EPOLL_H
+	if (m_epoll_handle != -1) {
+		struct epoll_event event;
+		int result = epoll_wait(m_epoll_handle, &event, 1, timeout_ms);
+		if (result > 0)
+			return true;
+		// Same as for select() below
+		if (result == 0 || errno == EINTR || errno == EBADF)
+			return false;
+		dstream << (int) m_handle << ": epoll_wait failed: "
+		        << strerror(errno) << std::endl;
+		throw SocketException("epoll_wait failed");
+	}
+#endif
+
 	fd_set readset;
 	int result;
 
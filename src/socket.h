@@ -112,10 +112,25 @@ class Address
 	u16 m_port; // Port is separate from sockaddr structures
 };
 
+// One datagram for UDPSocket::SendBatch() and UDPSocket::ReceiveBatch()
+struct UDPDatagram
+{
+	// Destination when sending, sender when receiving
+	Address address;
+	void *data;
+	// Size of the data buffer, only used when receiving
+	int capacity;
+	// Size of the datagram
+	int size;
+};
+
 class UDPSocket
 {
 public:
-	UDPSocket() { }
+	UDPSocket():
+		m_handle(-1),
+		m_epoll_handle(-1)
+	{ }
 	UDPSocket(bool ipv6);
 	~UDPSocket();
 	void Bind(Address addr);
@@ -127,6 +142,18 @@ class UDPSocket
 	void Send(const Address & destination, const void * data, int size);
 	// Returns -1 if there is no data
 	int Receive(Address & sender, void * data, int size);
+	/*
+		Sends the datagrams, with a single system call where supported.
+		Datagrams that can't be sent are skipped.
+		Returns the number of datagrams sent.
+	*/
+	int SendBatch(const UDPDatagram *datagrams, int count);
+	/*
+		Waits for data like Receive(), then receives up to count datagrams
+		that are already queued, with a single system call where supported.
+		Returns the number of datagrams received, 0 if there is no data.
+	*/
+	int ReceiveBatch(UDPDatagram *datagrams, int count);
 	int GetHandle(); // For debugging purposes only
 	void setTimeoutMs(int timeout_ms);
 	// Returns true if there is data, false if timeout occurred
@@ -135,6 +162,8 @@ class UDPSocket
 	int m_handle;
 	int m_timeout_ms;
 	int m_addr_family;
+	// Used by WaitData() instead of select() if not -1
+	int m_epoll_handle;
 };
 
 #endif
@@ -0,0 +1,197 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "environment.h"
+#include "noise.h"
+
+class TestActiveBlockList : public TestBase {
+public:
+	TestActiveBlockList() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestActiveBlockList"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testScripted();
+	void testRandomWalk();
+};
+
+static TestActiveBlockList g_test_instance;
+
+void TestActiveBlockList::runTests(IGameDef *gamedef)
+{
+	TEST(testScripted);
+	TEST(testRandomWalk);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// What ActiveBlockList had to do before it was kept incrementally
+static void get_expected_blocks(const std::map<u16, v3s16> &players,
+	const std::set<v3s16> &forceloaded, s16 radius, std::set<v3s16> &dst)
+{
+	dst = forceloaded;
+	for (std::map<u16, v3s16>::const_iterator i = players.begin();
+			i != players.end(); ++i) {
+		v3s16 p, p0 = i->second;
+		for (p.X = p0.X - radius; p.X <= p0.X + radius; p.X++)
+		for (p.Y = p0.Y - radius; p.Y <= p0.Y + radius; p.Y++)
+		for (p.Z = p0.Z - radius; p.Z <= p0.Z + radius; p.Z++)
+			dst.insert(p);
+	}
+}
+
+// Updates the list and compares it and the changes with the expected ones
+static void update_and_check(ActiveBlockList &list,
+	const std::map<u16, v3s16> &players, s16 radius)
+{
+	std::set<v3s16> old_list = list.m_list;
+	std::set<v3s16> removed, added, expected;
+	list.update(players, radius, removed, added);
+	get_expected_blocks(players, list.m_forceloaded_list, radius, expected);
+
+	UASSERT(list.m_list == expected);
+	for (std::set<v3s16>::iterator i = added.begin(); i != added.end(); ++i)
+		UASSERT(old_list.count(*i) == 0 && expected.count(*i) == 1);
+	for (std::set<v3s16>::iterator i = removed.begin(); i != removed.end(); ++i)
+		UASSERT(old_list.count(*i) == 1 && expected.count(*i) == 0);
+	UASSERTEQ(size_t, old_list.size() + added.size() - removed.size(),
+		expected.size());
+}
+
+void TestActiveBlockList::testScripted()
+{
+	ActiveBlockList list;
+	std::map<u16, v3s16> players;
+	s16 radius = 2;
+
+	update_and_check(list, players, radius);
+	UASSERT(list.m_list.empty());
+
+	// Join
+	players[1] = v3s16(0, 0, 0);
+	update_and_check(list, players, radius);
+	UASSERTEQ(size_t, list.m_list.size(), 5 * 5 * 5);
+	players[2] = v3s16(3, 0, 0);
+	update_and_check(list, players, radius);
+
+	// Move by one block, into and out of the other player's area
+	players[1] = v3s16(1, 0, 0);
+	update_and_check(list, players, radius);
+	players[1] = v3s16(1, -1, 0);
+	update_and_check(list, players, radius);
+	players[2] = v3s16(2, 0, 0);
+	update_and_check(list, players, radius);
+
+	// Standing still changes nothing
+	std::set<v3s16> removed, added;
+	list.update(players, radius, removed, added);
+	UASSERT(removed.empty() && added.empty());
+
+	// Teleport
+	players[2] = v3s16(100, -20, 50);
+	update_and_check(list, players, radius);
+
+	// Radius change, both ways
+	update_and_check(list, players, 3);
+	update_and_check(list, players, 1);
+	radius = 2;
+	update_and_check(list, players, radius);
+
+	// Forceloaded blocks, inside and outside of a player's area
+	list.m_forceloaded_list.insert(v3s16(1, 0, 0));
+	list.m_forceloaded_list.insert(v3s16(-50, 0, 0));
+	update_and_check(list, players, radius);
+	players[1] = v3s16(40, 0, 0);
+	update_and_check(list, players, radius);
+	UASSERT(list.contains(v3s16(1, 0, 0)));
+	list.m_forceloaded_list.erase(v3s16(1, 0, 0));
+	update_and_check(list, players, radius);
+	UASSERT(!list.contains(v3s16(1, 0, 0)));
+	// Walking into a forceloaded block and unforceloading it there
+	players[1] = v3s16(-50, 0, 1);
+	update_and_check(list, players, radius);
+	list.m_forceloaded_list.clear();
+	update_and_check(list, players, radius);
+	UASSERT(list.contains(v3s16(-50, 0, 0)));
+
+	// A block that failed to activate is added again on the next update
+	v3s16 retry_p(-50, 1, 1);
+	list.retryLater(retry_p);
+	UASSERT(!list.contains(retry_p));
+	removed.clear();
+	added.clear();
+	list.update(players, radius, removed, added);
+	UASSERT(removed.empty());
+	UASSERTEQ(size_t, added.size(), 1);
+	UASSERT(added.count(retry_p) == 1);
+	update_and_check(list, players, radius);
+
+	// Unless it is not wanted anymore by then
+	list.retryLater(retry_p);
+	players[1] = v3s16(0, 0, 0);
+	update_and_check(list, players, radius);
+	UASSERT(!list.contains(retry_p));
+
+	// Leave
+	players.erase(1);
+	update_and_check(list, players, radius);
+	players.erase(2);
+	update_and_check(list, players, radius);
+	UASSERT(list.m_list.empty());
+}
+
+void TestActiveBlockList::testRandomWalk()
+{
+	ActiveBlockList list;
+	std::map<u16, v3s16> players;
+	PcgRandom pr(4321);
+
+	for (u32 step = 0; step != 500; step++) {
+		s16 radius = step < 250 ? 2 : 3;
+		u16 id = pr.range(0, 7);
+		switch (pr.range(0, 9)) {
+		case 0:
+			players.erase(id);
+			break;
+		case 1:
+			players[id] = v3s16(pr.range(-10, 10), pr.range(-3, 3),
+				pr.range(-10, 10));
+			break;
+		case 2:
+			list.m_forceloaded_list.insert(
+				v3s16(pr.range(-10, 10), 0, pr.range(-10, 10)));
+			break;
+		case 3:
+			if (!list.m_forceloaded_list.empty())
+				list.m_forceloaded_list.erase(list.m_forceloaded_list.begin());
+			break;
+		case 4:
+			if (!list.m_list.empty())
+				list.retryLater(*list.m_list.begin());
+			break;
+		default: {
+			v3s16 &p = players[id];
+			p += v3s16(pr.range(-1, 1), pr.range(-1, 1), pr.range(-1, 1));
+		}
+		}
+		update_and_check(list, players, radius);
+	}
+}
@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "settings.h"
 #include "util/serialize.h"
 #include "network/connection.h"
+#include "noise.h"
 
 class TestConnection : public TestBase {
 public:
@@ -38,7 +39,11 @@ class TestConnection : public TestBase {
 	void runTests(IGameDef *gamedef);
 
 	void testHelpers();
+	void testReliablePacketBuffer();
+	void testIncomingSplitBuffer();
 	void testConnectSendReceive();
+	void testSocketBatch();
+	void benchLoopbackPacketRate();
 };
 
 static TestConnection g_test_instance;
@@ -46,7 +51,11 @@ static TestConnection g_test_instance;
 void TestConnection::runTests(IGameDef *gamedef)
 {
 	TEST(testHelpers);
+	TEST(testReliablePacketBuffer);
+	TEST(testIncomingSplitBuffer);
 	TEST(testConnectSendReceive);
+	TEST(testSocketBatch);
+	TEST(benchLoopbackPacketRate);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -124,6 +133,140 @@ void TestConnection::testHelpers()
 	UASSERT(readU8(&p2[3]) == data1[0]);
 }
 
+static con::BufferedPacket make_reliable_packet(u16 seqnum)
+{
+	SharedBuffer<u8> data(1);
+	data[0] = seqnum & 0xff;
+	SharedBuffer<u8> reliable = con::makeReliablePacket(data, seqnum);
+	Address a(127, 0, 0, 1, 10);
+	return con::makePacket(a, reliable, 0x12345678, 123, 0);
+}
+
+static u16 get_seqnum(con::BufferedPacket &p)
+{
+	return readU16(&p.data[BASE_HEADER_SIZE + 1]);
+}
+
+void TestConnection::testReliablePacketBuffer()
+{
+	// Out of order, wrapping around, with a duplicate
+	{
+		con::ReliablePacketBuffer buf;
+		const u16 next_expected = 65528;
+		const u16 order[] = {3, 65530, 0, 65535, 2, 65529, 1, 65531, 0};
+		for (size_t i = 0; i < ARRLEN(order); i++) {
+			con::BufferedPacket p = make_reliable_packet(order[i]);
+			buf.insert(p, next_expected);
+		}
+		UASSERTEQ(u32, buf.size(), 8);
+		UASSERT(buf.containsPacket(65535));
+		UASSERT(!buf.containsPacket(65532));
+
+		u16 first;
+		UASSERT(buf.getFirstSeqnum(first));
+		UASSERTEQ(u16, first, 65529);
+
+		con::BufferedPacket p = buf.popSeqnum(65535);
+		UASSERTEQ(u16, get_seqnum(p), 65535);
+
+		const u16 expected[] = {65529, 65530, 65531, 0, 1, 2, 3};
+		for (size_t i = 0; i < ARRLEN(expected); i++) {
+			p = buf.popFirst();
+			UASSERTEQ(u16, get_seqnum(p), expected[i]);
+		}
+		UASSERT(buf.empty());
+		UASSERT(!buf.getFirstSeqnum(first));
+	}
+
+	// Resend timeouts
+	{
+		con::ReliablePacketBuffer buf;
+		for (u16 s = 10; s < 13; s++) {
+			con::BufferedPacket p = make_reliable_packet(s);
+			buf.insert(p, 0);
+		}
+
+		buf.incrementTimeouts(0.5);
+		UASSERT(buf.getTimedOuts(1.0, 100).empty());
+
+		buf.incrementTimeouts(0.6);
+		std::list<con::BufferedPacket> timed_outs = buf.getTimedOuts(1.0, 2);
+		UASSERTEQ(size_t, timed_outs.size(), 2);
+		UASSERTEQ(u16, get_seqnum(timed_outs.front()), 10);
+		UASSERTEQ(u16, get_seqnum(timed_outs.back()), 11);
+		timed_outs = buf.getTimedOuts(1.0, 100);
+		UASSERTEQ(size_t, timed_outs.size(), 1);
+		UASSERTEQ(u16, get_seqnum(timed_outs.front()), 12);
+
+		// Resent packets time out again one timeout later
+		buf.popSeqnum(11);
+		UASSERT(buf.getTimedOuts(1.0, 100).empty());
+		buf.incrementTimeouts(1.0);
+		timed_outs = buf.getTimedOuts(1.0, 100);
+		UASSERTEQ(size_t, timed_outs.size(), 2);
+		UASSERTEQ(u16, get_seqnum(timed_outs.front()), 10);
+
+		con::BufferedPacket p = buf.popSeqnum(12);
+		UASSERT(p.totaltime > 2.0 && p.totaltime < 2.2);
+	}
+
+	// A large window, acknowledged in random order
+	{
+		con::ReliablePacketBuffer buf;
+		std::vector<u16> seqnums;
+		for (u32 i = 0; i < 20000; i++) {
+			u16 s = 60000 + i;
+			con::BufferedPacket p = make_reliable_packet(s);
+			buf.insert(p, 59000);
+			seqnums.push_back(s);
+		}
+		UASSERTEQ(u32, buf.size(), seqnums.size());
+
+		PcgRandom pr(42);
+		for (size_t i = seqnums.size() - 1; i > 0; i--)
+			std::swap(seqnums[i], seqnums[pr.range(0, i)]);
+		for (size_t i = 0; i < seqnums.size(); i++) {
+			con::BufferedPacket p = buf.popSeqnum(seqnums[i]);
+			UASSERTEQ(u16, get_seqnum(p), seqnums[i]);
+		}
+		UASSERT(buf.empty());
+	}
+}
+
+static con::BufferedPacket make_split_packet(u16 seqnum, u16 chunk_count,
+	u16 chunk_num, const std::string &chunk)
+{
+	SharedBuffer<u8> data(7 + chunk.size());
+	writeU8(&data[0], TYPE_SPLIT);
+	writeU16(&data[1], seqnum);
+	writeU16(&data[3], chunk_count);
+	writeU16(&data[5], chunk_num);
+	memcpy(&data[7], chunk.c_str(), chunk.size());
+	Address a(127, 0, 0, 1, 10);
+	return con::makePacket(a, data, 0x12345678, 123, 0);
+}
+
+void TestConnection::testIncomingSplitBuffer()
+{
+	con::IncomingSplitBuffer buf;
+
+	// Out of order, with a duplicate
+	con::BufferedPacket p = make_split_packet(5, 3, 2, "ef");
+	UASSERT(buf.insert(p, true).getSize() == 0);
+	p = make_split_packet(5, 3, 0, "abc");
+	UASSERT(buf.insert(p, true).getSize() == 0);
+	p = make_split_packet(5, 3, 0, "xyz");
+	UASSERT(buf.insert(p, true).getSize() == 0);
+	p = make_split_packet(5, 3, 1, "d");
+	SharedBuffer<u8> full = buf.insert(p, true);
+	UASSERT(std::string((char *)*full, full.getSize()) == "abcdef");
+
+	// A huge chunk count only costs the chunks that actually arrive
+	p = make_split_packet(6, 65535, 65534, "z");
+	UASSERT(buf.insert(p, true).getSize() == 0);
+	p = make_split_packet(6, 65535, 65535, "z");
+	UASSERT(buf.insert(p, true).getSize() == 0);
+}
 
 void TestConnection::testConnectSendReceive()
 {
@@ -346,3 +489,172 @@ void TestConnection::testConnectSendReceive()
 	UASSERT(hand_server.count == 1);
 	UASSERT(hand_server.last_id == 2);
 }
+
+
+/*
+	Datagrams sent with SendBatch() arrive intact and in order through
+	ReceiveBatch(), and mix with the single datagram calls.
+*/
+void TestConnection::testSocketBatch()
+{
+	const int burst_size = 16;
+	const int max_size = 64;
+
+	Address address(0, 0, 0, 0, 30002);
+	Address bind_addr(0, 0, 0, 0, 30002);
+	// See testConnectSendReceive()
+	std::string bind_str = g_settings->get("bind_address");
+	try {
+		bind_addr.Resolve(bind_str.c_str());
+
+		if (!bind_addr.isIPv6()) {
+			address = bind_addr;
+		}
+	} catch (ResolveError &e) {
+	}
+
+	Address dest_addr(127, 0, 0, 1, 30002);
+	if (address != Address(0, 0, 0, 0, 30002)) {
+		dest_addr = bind_addr;
+	}
+
+	UDPSocket socket(false);
+	socket.Bind(address);
+	socket.setTimeoutMs(1000);
+
+	// Datagram i has size i + 1 and every byte set to i
+	std::vector<u8> senddata(burst_size * max_size);
+	std::vector<u8> rcvdata(burst_size * max_size);
+	UDPDatagram out[burst_size];
+	UDPDatagram in[burst_size];
+	for (int i = 0; i < burst_size; i++) {
+		memset(&senddata[i * max_size], i, max_size);
+		out[i].address = dest_addr;
+		out[i].data = &senddata[i * max_size];
+		out[i].size = i + 1;
+		in[i].data = &rcvdata[i * max_size];
+		in[i].capacity = max_size;
+	}
+
+	UASSERTEQ(int, socket.SendBatch(out, burst_size), burst_size);
+
+	int received = 0;
+	while (received < burst_size) {
+		int count = socket.ReceiveBatch(&in[received],
+			burst_size - received);
+		UASSERT(count > 0);
+		received += count;
+	}
+	for (int i = 0; i < burst_size; i++) {
+		UASSERTEQ(int, in[i].size, i + 1);
+		UASSERT(in[i].address.getPort() == 30002);
+		u8 *data = (u8 *)in[i].data;
+		for (int j = 0; j < in[i].size; j++)
+			UASSERTEQ(int, data[j], i);
+	}
+
+	// Nothing left queued
+	socket.setTimeoutMs(10);
+	UASSERTEQ(int, socket.ReceiveBatch(in, burst_size), 0);
+	socket.setTimeoutMs(1000);
+
+	// Single sends are picked up by a batch receive and the other way round
+	socket.Send(dest_addr, out[2].data, out[2].size);
+	UASSERTEQ(int, socket.ReceiveBatch(in, 1), 1);
+	UASSERTEQ(int, in[0].size, 3);
+
+	UASSERTEQ(int, socket.SendBatch(&out[4], 1), 1);
+	Address sender;
+	u8 buf[max_size];
+	UASSERTEQ(int, socket.Receive(sender, buf, max_size), 5);
+	UASSERTEQ(int, buf[0], 4);
+	UASSERT(sender.getPort() == 30002);
+}
+
+/*
+	Measures how many packets per second go through a socket on the
+	loopback interface, once with a system call per packet and once with
+	SendBatch()/ReceiveBatch(). Only prints the rates, they are too noisy
+	to assert on.
+*/
+void TestConnection::benchLoopbackPacketRate()
+{
+	const u32 num_bursts = 2000;
+	const int burst_size = 32;
+	const int packet_size = 64;
+
+	Address address(0, 0, 0, 0, 30002);
+	Address bind_addr(0, 0, 0, 0, 30002);
+	// See testConnectSendReceive()
+	std::string bind_str = g_settings->get("bind_address");
+	try {
+		bind_addr.Resolve(bind_str.c_str());
+
+		if (!bind_addr.isIPv6()) {
+			address = bind_addr;
+		}
+	} catch (ResolveError &e) {
+	}
+
+	Address dest_addr(127, 0, 0, 1, 30002);
+	if (address != Address(0, 0, 0, 0, 30002)) {
+		dest_addr = bind_addr;
+	}
+
+	UDPSocket socket(false);
+	socket.Bind(address);
+	socket.setTimeoutMs(100);
+
+	std::vector<u8> senddata(burst_size * packet_size);
+	std::vector<u8> rcvdata(burst_size * packet_size);
+	UDPDatagram out[burst_size];
+	UDPDatagram in[burst_size];
+	for (int i = 0; i < burst_size; i++) {
+		memset(&senddata[i * packet_size], i, packet_size);
+		out[i].address = dest_addr;
+		out[i].data = &senddata[i * packet_size];
+		out[i].size = packet_size;
+		in[i].data = &rcvdata[i * packet_size];
+		in[i].capacity = packet_size;
+	}
+
+	for (int batched = 0; batched < 2; batched++) {
+		u32 received = 0;
+		u32 t1 = porting::getTimeMs();
+		for (u32 n = 0; n < num_bursts; n++) {
+			int burst_received = 0;
+			if (batched) {
+				socket.SendBatch(out, burst_size);
+				while (burst_received < burst_size) {
+					int count = socket.ReceiveBatch(&in[burst_received],
+						burst_size - burst_received);
+					if (count == 0)
+						break;
+					burst_received += count;
+				}
+			} else {
+				for (int i = 0; i < burst_size; i++)
+					socket.Send(out[i].address, out[i].data, out[i].size);
+				while (burst_received < burst_size) {
+					UDPDatagram &d = in[burst_received];
+					d.size = socket.Receive(d.address, d.data, d.capacity);
+					if (d.size < 0)
+						break;
+					burst_received++;
+				}
+			}
+			received += burst_received;
+		}
+		u32 t2 = porting::getTimeMs();
+
+		UASSERT(received > 0);
+		UASSERT(in[0].size == packet_size);
+		UASSERT(in[0].address.getPort() == 30002);
+
+		rawstream << "    " << (batched ? "batched: " : "one by one: ")
+			<< received << "/" << num_bursts * burst_size
+			<< " packets in " << (t2 - t1) << "ms, "
+			<< (u64)received * 1000 / MYMAX(t2 - t1, 1) << " packets/s"
+			<< std::endl;
+	}
+}
@@ -0,0 +1,215 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <fstream>
+#include <iterator>
+#include <set>
+#include "database-region.h"
+#include "filesys.h"
+#include "util/serialize.h"
+
+class TestDatabaseRegion : public TestBase {
+public:
+	TestDatabaseRegion() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestDatabaseRegion"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testSaveLoadDelete();
+	void testSectorReuse();
+	void testInvalidEntries();
+};
+
+static TestDatabaseRegion g_test_instance;
+
+void TestDatabaseRegion::runTests(IGameDef *gamedef)
+{
+	TEST(testSaveLoadDelete);
+	TEST(testSectorReuse);
+	TEST(testInvalidEntries);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Block data that differs between blocks and between versions of a block
+static std::string block_data(size_t size, char c)
+{
+	std::string data(size, c);
+	for (size_t i = 0; i < size; i += 97)
+		data[i] = (char)i;
+	return data;
+}
+
+static std::ifstream::pos_type region_file_size(const std::string &dir,
+	const std::string &name)
+{
+	std::string path = dir + DIR_DELIM + "map_regions" + DIR_DELIM + name;
+	std::ifstream is(path.c_str(), std::ios::binary | std::ios::ate);
+	return is.tellg();
+}
+
+// Overwrites the table entry of the block with index i (see database-region.cpp)
+static void write_table_entry(const std::string &path, u32 i, u32 offset,
+	u32 length)
+{
+	u8 entry[8];
+	writeU32(&entry[0], offset);
+	writeU32(&entry[4], length);
+	std::fstream fs(path.c_str(),
+		std::ios::binary | std::ios::in | std::ios::out);
+	fs.seekp(8 + i * 8);
+	fs.write((char *)entry, sizeof(entry));
+}
+
+void TestDatabaseRegion::testSaveLoadDelete()
+{
+	std::string dir = getTestTempDirectory() + DIR_DELIM + "region";
+	v3s16 p1(0, 0, 0), p2(31, 31, 31), p3(-1, -1, -1), p4(32, 0, -33);
+
+	{
+		Database_Region db(dir);
+		UASSERT(db.loadBlock(p1) == "");
+		UASSERT(db.deleteBlock(p1));
+
+		UASSERT(db.saveBlock(p1, block_data(100, 'a')));
+		UASSERT(db.saveBlock(p2, block_data(1000, 'b')));
+		UASSERT(db.saveBlock(p3, block_data(256, 'c')));
+		UASSERT(db.saveBlock(p4, block_data(257, 'd')));
+		UASSERT(db.loadBlock(p1) == block_data(100, 'a'));
+		UASSERT(db.loadBlock(p2) == block_data(1000, 'b'));
+		UASSERT(db.loadBlock(p3) == block_data(256, 'c'));
+		UASSERT(db.loadBlock(p4) == block_data(257, 'd'));
+		UASSERT(db.loadBlock(v3s16(1, 0, 0)) == "");
+
+		UASSERT(db.deleteBlock(p2));
+		UASSERT(db.loadBlock(p2) == "");
+	}
+
+	// Everything is still there after reopening
+	Database_Region db(dir);
+	UASSERT(db.loadBlock(p1) == block_data(100, 'a'));
+	UASSERT(db.loadBlock(p2) == "");
+	UASSERT(db.loadBlock(p3) == block_data(256, 'c'));
+	UASSERT(db.loadBlock(p4) == block_data(257, 'd'));
+
+	std::vector<v3s16> blocks;
+	db.listAllLoadableBlocks(blocks);
+	UASSERTEQ(size_t, blocks.size(), 3);
+	std::set<v3s16> block_set(blocks.begin(), blocks.end());
+	UASSERT(block_set.count(p1) && block_set.count(p3) && block_set.count(p4));
+}
+
+void TestDatabaseRegion::testSectorReuse()
+{
+	std::string dir = getTestTempDirectory() + DIR_DELIM + "region_reuse";
+	v3s16 p1(0, 0, 0), p2(1, 0, 0), p3(2, 0, 0);
+	std::ifstream::pos_type size;
+
+	{
+		Database_Region db(dir);
+		UASSERT(db.saveBlock(p1, block_data(3000, 'a')));
+		UASSERT(db.saveBlock(p2, block_data(500, 'b')));
+
+		// Shrinking and growing again must not make the file grow
+		// further than needed for one extra copy of the block
+		for (u32 i = 0; i < 50; i++) {
+			UASSERT(db.saveBlock(p1, block_data(10, 'c')));
+			UASSERT(db.saveBlock(p1, block_data(3000, 'd')));
+			if (i == 0)
+				size = region_file_size(dir, "r.0.0.0.mtr");
+		}
+		UASSERT(region_file_size(dir, "r.0.0.0.mtr") == size);
+		UASSERT(db.loadBlock(p1) == block_data(3000, 'd'));
+		UASSERT(db.loadBlock(p2) == block_data(500, 'b'));
+
+		// The sectors of a deleted block are reused
+		UASSERT(db.deleteBlock(p1));
+		UASSERT(db.saveBlock(p3, block_data(2000, 'e')));
+		UASSERT(region_file_size(dir, "r.0.0.0.mtr") == size);
+		UASSERT(db.loadBlock(p2) == block_data(500, 'b'));
+		UASSERT(db.loadBlock(p3) == block_data(2000, 'e'));
+	}
+
+	// The free sectors are found again after reopening
+	Database_Region db(dir);
+	for (u32 i = 0; i < 50; i++) {
+		UASSERT(db.saveBlock(p2, block_data(10, 'f')));
+		UASSERT(db.saveBlock(p2, block_data(1500, 'g')));
+	}
+	UASSERT(region_file_size(dir, "r.0.0.0.mtr") == size);
+	UASSERT(db.loadBlock(p1) == "");
+	UASSERT(db.loadBlock(p2) == block_data(1500, 'g'));
+	UASSERT(db.loadBlock(p3) == block_data(2000, 'e'));
+}
+
+void TestDatabaseRegion::testInvalidEntries()
+{
+	std::string dir = getTestTempDirectory() + DIR_DELIM + "region_invalid";
+	std::string path = dir + DIR_DELIM + "map_regions" + DIR_DELIM +
+		"r.0.0.0.mtr";
+	v3s16 p0(0, 0, 0), p1(1, 0, 0), p2(2, 0, 0), p3(3, 0, 0), p4(4, 0, 0);
+	std::ifstream::pos_type size;
+
+	{
+		Database_Region db(dir);
+		UASSERT(db.saveBlock(p0, block_data(100, 'a')));
+		UASSERT(db.saveBlock(p4, block_data(1024, 'b')));
+		size = region_file_size(dir, "r.0.0.0.mtr");
+	}
+
+	// Into the header, far past the end and just past the end
+	write_table_entry(path, 1, 1, 100);
+	write_table_entry(path, 2, 0xFFFFFFF0, 100);
+	write_table_entry(path, 3, (u32)size / 256 - 1, 257);
+
+	{
+		Database_Region db(dir);
+		UASSERT(db.loadBlock(p0) == block_data(100, 'a'));
+		UASSERT(db.loadBlock(p1) == "");
+		UASSERT(db.loadBlock(p2) == "");
+		UASSERT(db.loadBlock(p3) == "");
+		UASSERT(db.loadBlock(p4) == block_data(1024, 'b'));
+
+		std::vector<v3s16> blocks;
+		db.listAllLoadableBlocks(blocks);
+		UASSERTEQ(size_t, blocks.size(), 2);
+
+		// Saving does not use sectors claimed by the invalid entries
+		UASSERT(db.saveBlock(p2, block_data(100, 'c')));
+		UASSERT(db.loadBlock(p2) == block_data(100, 'c'));
+		UASSERT(region_file_size(dir, "r.0.0.0.mtr") - size == 256);
+		UASSERT(db.loadBlock(p0) == block_data(100, 'a'));
+	}
+
+	// A truncated file loses the blocks that were cut off, p4 fills its
+	// last sector
+	{
+		std::ifstream is(path.c_str(), std::ios::binary);
+		std::string data((std::istreambuf_iterator<char>(is)),
+			std::istreambuf_iterator<char>());
+		is.close();
+		std::ofstream os(path.c_str(), std::ios::binary | std::ios::trunc);
+		os.write(data.data(), (std::streamsize)size - 1);
+	}
+	Database_Region db(dir);
+	UASSERT(db.loadBlock(p0) == block_data(100, 'a'));
+	UASSERT(db.loadBlock(p4) == "");
+}
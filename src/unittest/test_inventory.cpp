@@ -32,6 +32,7 @@ class TestInventory : public TestBase {
 	void runTests(IGameDef *gamedef);
 
 	void testSerializeDeserialize(IItemDefManager *idef);
+	void testSerializeDelta(IItemDefManager *idef);
 
 	static const char *serialized_inventory;
 	static const char *serialized_inventory_2;
@@ -42,6 +43,7 @@ static TestInventory g_test_instance;
 void TestInventory::runTests(IGameDef *gamedef)
 {
 	TEST(testSerializeDeserialize, gamedef->getItemDefManager());
+	TEST(testSerializeDelta, gamedef->getItemDefManager());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -66,6 +68,66 @@ void TestInventory::testSerializeDeserialize(IItemDefManager *idef)
 	UASSERTEQ(std::string, inv_os.str(), serialized_inventory_2);
 }
 
+void TestInventory::testSerializeDelta(IItemDefManager *idef)
+{
+	Inventory inv(idef);
+	std::istringstream is(serialized_inventory, std::ios::binary);
+	inv.deSerialize(is);
+	inv.addList("craft", 9)->setWidth(3);
+
+	Inventory sent(inv);
+	Inventory client(inv);
+
+	// Nothing changed
+	std::ostringstream os(std::ios::binary);
+	UASSERT(!inv.serializeDelta(os, sent));
+	UASSERTEQ(size_t, os.str().size(), 2);
+
+	// Changed slots only
+	InventoryList *list = inv.getList("0");
+	list->changeItem(0, ItemStack("default:dirt", 5, 0, "", idef));
+	list->deleteItem(1);
+	// Changes through the reference are found too
+	UASSERTEQ(std::string, list->getItem(9).name, "default:cobble");
+	list->getItem(9).count = 7;
+	os.str("");
+	UASSERT(inv.serializeDelta(os, sent));
+	UASSERT(sent == inv);
+	std::string slots_delta = os.str();
+
+	std::istringstream delta_is(slots_delta, std::ios::binary);
+	client.deSerializeDelta(delta_is);
+	UASSERT(client == inv);
+
+	// New, resized and removed lists
+	inv.addList("bag", 4)->addItem(ItemStack("default:cobble", 3, 0, "", idef));
+	inv.getList("0")->setSize(16);
+	inv.deleteList("craft");
+	os.str("");
+	UASSERT(inv.serializeDelta(os, sent));
+	UASSERT(sent == inv);
+
+	delta_is.str(os.str());
+	delta_is.clear();
+	client.deSerializeDelta(delta_is);
+	UASSERT(client == inv);
+
+	// Item strings longer than 65535 bytes
+	inv.getList("bag")->changeItem(1,
+		ItemStack("default:cobble", 1, 0, std::string(70000, 'm'), idef));
+	os.str("");
+	UASSERT(inv.serializeDelta(os, sent));
+	delta_is.str(os.str());
+	delta_is.clear();
+	client.deSerializeDelta(delta_is);
+	UASSERT(client == inv);
+
+	// Only the changed slots are in the delta
+	std::ostringstream full_os(std::ios::binary);
+	inv.serialize(full_os);
+	UASSERT(slots_delta.size() < full_os.str().size() / 4);
+}
+
 const char *TestInventory::serialized_inventory =
 	"List 0 32\n"
 	"Width 3\n"
@@ -0,0 +1,230 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <map>
+#include "log.h"
+#include "mapblock_hashmap.h"
+#include "noise.h"
+
+class TestMapBlockHashMap : public TestBase {
+public:
+	TestMapBlockHashMap() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlockHashMap"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBasic();
+	void testRandomOperations();
+	void testDenseArea();
+	void benchLookup();
+};
+
+static TestMapBlockHashMap g_test_instance;
+
+void TestMapBlockHashMap::runTests(IGameDef *gamedef)
+{
+	TEST(testBasic);
+	TEST(testRandomOperations);
+	TEST(testDenseArea);
+	TEST(benchLookup);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The map never dereferences the blocks, so any non-NULL pointer will do
+static MapBlock *fake_block(u32 i)
+{
+	return (MapBlock *)(size_t)((i + 1) * 8);
+}
+
+void TestMapBlockHashMap::testBasic()
+{
+	MapBlockHashMap blocks;
+
+	UASSERT(blocks.get(v3s16(0, 0, 0)) == NULL);
+	UASSERT(!blocks.remove(v3s16(0, 0, 0)));
+
+	blocks.set(v3s16(0, 0, 0), fake_block(0));
+	blocks.set(v3s16(-1, 2, -3), fake_block(1));
+	blocks.set(v3s16(-2048, 2047, -2048), fake_block(2));
+	UASSERTEQ(u32, blocks.size(), 3);
+	UASSERT(blocks.get(v3s16(0, 0, 0)) == fake_block(0));
+	UASSERT(blocks.get(v3s16(-1, 2, -3)) == fake_block(1));
+	UASSERT(blocks.get(v3s16(-2048, 2047, -2048)) == fake_block(2));
+	UASSERT(blocks.get(v3s16(1, 2, -3)) == NULL);
+
+	// Replacing keeps the size
+	blocks.set(v3s16(-1, 2, -3), fake_block(3));
+	UASSERTEQ(u32, blocks.size(), 3);
+	UASSERT(blocks.get(v3s16(-1, 2, -3)) == fake_block(3));
+
+	UASSERT(blocks.remove(v3s16(-1, 2, -3)));
+	UASSERT(!blocks.remove(v3s16(-1, 2, -3)));
+	UASSERT(blocks.get(v3s16(-1, 2, -3)) == NULL);
+	UASSERTEQ(u32, blocks.size(), 2);
+
+	std::vector<MapBlock *> all;
+	blocks.getBlocks(all);
+	UASSERTEQ(size_t, all.size(), 2);
+
+	blocks.clear();
+	UASSERTEQ(u32, blocks.size(), 0);
+	UASSERT(blocks.get(v3s16(0, 0, 0)) == NULL);
+}
+
+void TestMapBlockHashMap::testRandomOperations()
+{
+	MapBlockHashMap blocks;
+	std::map<v3s16, MapBlock *> expected;
+	PcgRandom pr(1234);
+
+	// A small area, so that the same positions are hit over and over
+	for (u32 i = 0; i != 100000; i++) {
+		v3s16 p(pr.range(-20, 20), pr.range(-8, 8), pr.range(-20, 20));
+		switch (pr.range(0, 2)) {
+		case 0:
+			blocks.set(p, fake_block(i));
+			expected[p] = fake_block(i);
+			break;
+		case 1:
+			UASSERTEQ(bool, blocks.remove(p), expected.erase(p) == 1);
+			break;
+		default: {
+			std::map<v3s16, MapBlock *>::iterator it = expected.find(p);
+			UASSERT(blocks.get(p) ==
+				(it == expected.end() ? NULL : it->second));
+		}
+		}
+		UASSERTEQ(u32, blocks.size(), expected.size());
+	}
+
+	std::vector<MapBlock *> all;
+	blocks.getBlocks(all);
+	UASSERTEQ(size_t, all.size(), expected.size());
+}
+
+/*
+	Loaded blocks form dense boxes, which is the worst case for linear
+	probing with a weak hash. Grows and shrinks through several resizes.
+*/
+void TestMapBlockHashMap::testDenseArea()
+{
+	const s16 range = 12;
+
+	MapBlockHashMap blocks;
+	u32 i = 0;
+	for (s16 z = -range; z <= range; z++)
+	for (s16 y = -range / 4; y <= range / 4; y++)
+	for (s16 x = -range; x <= range; x++)
+		blocks.set(v3s16(x, y, z), fake_block(i++));
+	UASSERTEQ(u32, blocks.size(), i);
+
+	// Drop every other block, the rest must still be found
+	i = 0;
+	for (s16 z = -range; z <= range; z++)
+	for (s16 y = -range / 4; y <= range / 4; y++)
+	for (s16 x = -range; x <= range; x++) {
+		if (i % 2 == 0)
+			UASSERT(blocks.remove(v3s16(x, y, z)));
+		i++;
+	}
+	UASSERTEQ(u32, blocks.size(), i / 2);
+
+	i = 0;
+	for (s16 z = -range; z <= range; z++)
+	for (s16 y = -range / 4; y <= range / 4; y++)
+	for (s16 x = -range; x <= range; x++) {
+		UASSERT(blocks.get(v3s16(x, y, z)) ==
+			(i % 2 == 0 ? NULL : fake_block(i)));
+		i++;
+	}
+	UASSERT(blocks.get(v3s16(range + 1, 0, 0)) == NULL);
+
+	std::vector<MapBlock *> all;
+	blocks.getBlocks(all);
+	UASSERTEQ(size_t, all.size(), blocks.size());
+
+	// Removing everything shrinks back down without losing entries
+	i = 0;
+	for (s16 z = -range; z <= range; z++)
+	for (s16 y = -range / 4; y <= range / 4; y++)
+	for (s16 x = -range; x <= range; x++) {
+		UASSERTEQ(bool, blocks.remove(v3s16(x, y, z)), i % 2 == 1);
+		i++;
+	}
+	UASSERTEQ(u32, blocks.size(), 0);
+	UASSERT(blocks.get(v3s16(0, 0, 0)) == NULL);
+}
+
+/*
+	Compares lookups against the sector/block std::map pair that Map used
+	before. Only prints the timings, they are too noisy to assert on.
+*/
+void TestMapBlockHashMap::benchLookup()
+{
+	const s16 range = 24;
+	const u32 num_lookups = 4000000;
+
+	MapBlockHashMap blocks;
+	std::map<v2s16, std::map<s16, MapBlock *> > sectors;
+	u32 i = 0;
+	for (s16 z = -range; z <= range; z++)
+	for (s16 y = -range / 4; y <= range / 4; y++)
+	for (s16 x = -range; x <= range; x++) {
+		blocks.set(v3s16(x, y, z), fake_block(i));
+		sectors[v2s16(x, z)][y] = fake_block(i);
+		i++;
+	}
+
+	std::vector<v3s16> positions;
+	PcgRandom pr(5678);
+	for (u32 n = 0; n != 4096; n++) {
+		positions.push_back(v3s16(pr.range(-range, range),
+			pr.range(-range / 2, range / 2), pr.range(-range, range)));
+	}
+
+	u32 found_map = 0;
+	u32 t1 = porting::getTime(PRECISION_MILLI);
+	for (u32 n = 0; n != num_lookups; n++) {
+		const v3s16 &p = positions[n & 4095];
+		std::map<v2s16, std::map<s16, MapBlock *> >::iterator si =
+			sectors.find(v2s16(p.X, p.Z));
+		if (si == sectors.end())
+			continue;
+		std::map<s16, MapBlock *>::iterator bi = si->second.find(p.Y);
+		if (bi != si->second.end())
+			found_map++;
+	}
+	u32 t2 = porting::getTime(PRECISION_MILLI);
+
+	u32 found_hash = 0;
+	for (u32 n = 0; n != num_lookups; n++) {
+		if (blocks.get(positions[n & 4095]))
+			found_hash++;
+	}
+	u32 t3 = porting::getTime(PRECISION_MILLI);
+
+	UASSERTEQ(u32, found_hash, found_map);
+
+	rawstream << "    " << num_lookups << " lookups in " << blocks.size()
+		<< " blocks: sector maps " << (t2 - t1) << "ms, hash map "
+		<< (t3 - t2) << "ms" << std::endl;
+}
@@ -0,0 +1,110 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <sstream>
+#include "nodetimer.h"
+
+class TestNodeTimer : public TestBase {
+public:
+	TestNodeTimer() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestNodeTimer"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testStep();
+	void testSerializeDeserialize();
+};
+
+static TestNodeTimer g_test_instance;
+
+void TestNodeTimer::runTests(IGameDef *gamedef)
+{
+	TEST(testStep);
+	TEST(testSerializeDeserialize);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestNodeTimer::testStep()
+{
+	NodeTimerList timers;
+	std::vector<std::pair<v3s16, NodeTimer> > elapsed;
+
+	timers.set(v3s16(1, 2, 3), NodeTimer(1.0, 0.0));
+	timers.set(v3s16(4, 5, 6), NodeTimer(3.0, 1.0));
+	timers.set(v3s16(7, 8, 9), NodeTimer(5.0, 0.0));
+
+	timers.step(0.5, elapsed);
+	UASSERT(elapsed.empty());
+	UASSERT(timers.get(v3s16(4, 5, 6)).elapsed == 1.5);
+
+	// Overshoot is kept in the elapsed time
+	timers.step(1.0, elapsed);
+	UASSERTEQ(size_t, elapsed.size(), 1);
+	UASSERT(elapsed[0].first == v3s16(1, 2, 3));
+	UASSERT(elapsed[0].second.timeout == 1.0);
+	UASSERT(elapsed[0].second.elapsed == 1.5);
+	UASSERT(timers.get(v3s16(1, 2, 3)).timeout == 0);
+
+	// Replacing a timer moves it
+	timers.set(v3s16(7, 8, 9), NodeTimer(1.0, 0.0));
+	timers.remove(v3s16(4, 5, 6));
+	elapsed.clear();
+	timers.step(1.0, elapsed);
+	UASSERTEQ(size_t, elapsed.size(), 1);
+	UASSERT(elapsed[0].first == v3s16(7, 8, 9));
+
+	// No timers left
+	elapsed.clear();
+	timers.step(100.0, elapsed);
+	UASSERT(elapsed.empty());
+}
+
+void TestNodeTimer::testSerializeDeserialize()
+{
+	NodeTimerList timers;
+	timers.set(v3s16(15, 0, 0), NodeTimer(2.0, 0.5));
+	timers.set(v3s16(0, 0, 1), NodeTimer(1.0, 0.0));
+	std::vector<std::pair<v3s16, NodeTimer> > elapsed;
+	timers.step(0.25, elapsed);
+
+	// Sorted by position, with the elapsed time
+	std::ostringstream os(std::ios::binary);
+	timers.serialize(os, 25);
+	UASSERTEQ(std::string, os.str(), std::string(
+		"\x0a\x00\x02"
+		"\x01\x00\x00\x00\x03\xe8\x00\x00\x00\xfa"
+		"\x00\x0f\x00\x00\x07\xd0\x00\x00\x02\xee", 23));
+
+	NodeTimerList timers2;
+	std::istringstream is(os.str(), std::ios::binary);
+	timers2.deSerialize(is, 25);
+	UASSERT(timers2.get(v3s16(15, 0, 0)).elapsed == 0.75);
+	UASSERT(timers2.get(v3s16(0, 0, 1)).timeout == 1.0);
+
+	// The elapsed time is kept
+	elapsed.clear();
+	timers2.step(0.5, elapsed);
+	UASSERT(elapsed.empty());
+	timers2.step(0.25, elapsed);
+	UASSERTEQ(size_t, elapsed.size(), 1);
+	UASSERT(elapsed[0].first == v3s16(0, 0, 1));
+}
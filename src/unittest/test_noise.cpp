@@ -20,7 +20,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include "exceptions.h"
+#include "log.h"
 #include "noise.h"
+#include "util/basic_macros.h"
+
+#include <vector>
 
 class TestNoise : public TestBase {
 public:
@@ -34,6 +38,9 @@ class TestNoise : public TestBase {
 	void testNoise3dPoint();
 	void testNoise3dBulk();
 	void testNoiseInvalidParams();
+	void testNoiseSimdLevels();
+	void testNoiseSimdKnownValues();
+	void benchNoiseMaps();
 
 	static const float expected_2d_results[10 * 10];
 	static const float expected_3d_results[10 * 10 * 10];
@@ -48,6 +55,9 @@ void TestNoise::runTests(IGameDef *gamedef)
 	TEST(testNoise3dPoint);
 	TEST(testNoise3dBulk);
 	TEST(testNoiseInvalidParams);
+	TEST(testNoiseSimdLevels);
+	TEST(testNoiseSimdKnownValues);
+	TEST(benchNoiseMaps);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -120,6 +130,110 @@ void TestNoise::testNoiseInvalidParams()
 	UASSERT(exception_thrown);
 }
 
+/*
+	Every kernel must give exactly the maps of the scalar ones, so that a
+	world generates the same on every CPU.
+*/
+void TestNoise::testNoiseSimdLevels()
+{
+	NoiseSimdLevel supported = getSupportedNoiseSimdLevel();
+	const u32 flags[] = {
+		NOISE_FLAG_DEFAULTS,
+		NOISE_FLAG_EASED | NOISE_FLAG_ABSVALUE,
+		0,
+	};
+
+	for (u32 f = 0; f != ARRLEN(flags); f++) {
+		// Odd sizes, so that the kernels also have to handle remainders
+		NoiseParams np(0.5, 2, v3f(23, 11, 41), 42, 4, 0.6, 2.0, flags[f]);
+		Noise noise_2d(&np, 1337, 37, 13);
+		Noise noise_3d(&np, 1337, 19, 7, 11);
+		float pmap[37 * 13];
+		for (u32 i = 0; i != ARRLEN(pmap); i++)
+			pmap[i] = 0.4 + 0.001 * i;
+
+		setNoiseSimdLevel(NOISE_SIMD_NONE);
+		std::vector<float> expected_2d(noise_2d.perlinMap2D(-100.5, 17, pmap),
+			noise_2d.result + 37 * 13);
+		std::vector<float> expected_3d(noise_3d.perlinMap3D(9, -3.25, 1000),
+			noise_3d.result + 19 * 7 * 11);
+
+		for (int level = NOISE_SIMD_NONE + 1; level <= supported; level++) {
+			setNoiseSimdLevel((NoiseSimdLevel)level);
+			UASSERTEQ(int, getNoiseSimdLevel(), level);
+
+			float *actual = noise_2d.perlinMap2D(-100.5, 17, pmap);
+			for (u32 i = 0; i != expected_2d.size(); i++)
+				UASSERT(actual[i] == expected_2d[i]);
+
+			actual = noise_3d.perlinMap3D(9, -3.25, 1000);
+			for (u32 i = 0; i != expected_3d.size(); i++)
+				UASSERT(actual[i] == expected_3d[i]);
+		}
+	}
+
+	setNoiseSimdLevel(supported);
+}
+
+/*
+	The bulk tests above only cover the level picked for this CPU; check
+	every supported level against the known values as well.
+*/
+void TestNoise::testNoiseSimdKnownValues()
+{
+	NoiseSimdLevel supported = getSupportedNoiseSimdLevel();
+	NoiseParams np_normal(20, 40, v3f(50, 50, 50), 9, 5, 0.6, 2.0);
+	Noise noise_normal_2d(&np_normal, 1337, 10, 10);
+	Noise noise_normal_3d(&np_normal, 1337, 10, 10, 10);
+
+	for (int level = NOISE_SIMD_NONE; level <= supported; level++) {
+		setNoiseSimdLevel((NoiseSimdLevel)level);
+
+		float *noisevals = noise_normal_2d.perlinMap2D(0, 0, NULL);
+		for (u32 i = 0; i != 10 * 10; i++)
+			UASSERT(fabs(noisevals[i] - expected_2d_results[i]) <= 0.00001);
+
+		noisevals = noise_normal_3d.perlinMap3D(0, 0, 0, NULL);
+		for (u32 i = 0; i != 10 * 10 * 10; i++)
+			UASSERT(fabs(noisevals[i] - expected_3d_results[i]) <= 0.00001);
+	}
+
+	setNoiseSimdLevel(supported);
+}
+
+/*
+	Times a mapchunk sized 3D map and a 2D map for each supported level.
+	Only prints the timings, they are too noisy to assert on.
+*/
+void TestNoise::benchNoiseMaps()
+{
+	const u32 runs = 20;
+	const char *level_names[] = { "scalar", "SSE2", "AVX2" };
+	NoiseSimdLevel supported = getSupportedNoiseSimdLevel();
+	NoiseParams np_3d(0, 12, v3f(61, 61, 61), 52534, 3, 0.5, 2.0);
+	NoiseParams np_2d(0, 1, v3f(600, 600, 600), 5934, 5, 0.6, 2.0);
+	Noise noise_3d(&np_3d, 1337, 80, 82, 80);
+	Noise noise_2d(&np_2d, 1337, 80, 80);
+
+	for (int level = NOISE_SIMD_NONE; level <= supported; level++) {
+		setNoiseSimdLevel((NoiseSimdLevel)level);
+
+		u32 t1 = porting::getTime(PRECISION_MICRO);
+		for (u32 i = 0; i != runs; i++)
+			noise_3d.perlinMap3D(i * 80, -32, 160);
+		u32 t2 = porting::getTime(PRECISION_MICRO);
+		for (u32 i = 0; i != runs * 10; i++)
+			noise_2d.perlinMap2D(i * 80, 160);
+		u32 t3 = porting::getTime(PRECISION_MICRO);
+
+		rawstream << "    " << level_names[level] << ": 3D map "
+			<< (t2 - t1) / runs << "us, 2D map "
+			<< (t3 - t2) / (runs * 10) << "us" << std::endl;
+	}
+
+	setNoiseSimdLevel(supported);
+}
+
 const float TestNoise::expected_2d_results[10 * 10] = {
 	19.11726, 18.49626, 16.48476, 15.02135, 14.75713, 16.26008, 17.54822,
 	18.06860, 18.57016, 18.48407, 18.49649, 17.89160, 15.94162, 14.54901,
@@ -0,0 +1,189 @@
+/*
+Minetest
+Copyright (C) 2016 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <algorithm>
+#include "database-files.h"
+#include "database-sqlite3.h"
+#include "filesys.h"
+#include "util/string.h"
+
+class TestPlayerDatabase : public TestBase {
+public:
+	TestPlayerDatabase() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestPlayerDatabase"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testFiles();
+	void testFilesAlternates();
+	void testFilesAlternateGap();
+	void testSQLite3();
+};
+
+static TestPlayerDatabase g_test_instance;
+
+void TestPlayerDatabase::runTests(IGameDef *gamedef)
+{
+	TEST(testFiles);
+	TEST(testFilesAlternates);
+	TEST(testFilesAlternateGap);
+	TEST(testSQLite3);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static std::string player_data(const std::string &name, int hp)
+{
+	return "name = " + name + "\nhp = " + itos(hp) + "\nPlayerArgsEnd\n";
+}
+
+static void check_player_database(PlayerDatabase *db)
+{
+	UASSERT(db->loadPlayer("foo") == "");
+
+	db->beginSave();
+	UASSERT(db->savePlayer("foo", player_data("foo", 20)));
+	UASSERT(db->savePlayer("bar", player_data("bar", 10)));
+	db->endSave();
+	UASSERT(db->loadPlayer("foo") == player_data("foo", 20));
+	UASSERT(db->loadPlayer("bar") == player_data("bar", 10));
+
+	// Replacing
+	UASSERT(db->savePlayer("foo", player_data("foo", 5)));
+	UASSERT(db->loadPlayer("foo") == player_data("foo", 5));
+
+	std::vector<std::string> names;
+	db->listPlayers(names);
+	std::sort(names.begin(), names.end());
+	UASSERTEQ(size_t, names.size(), 2);
+	UASSERT(names[0] == "bar" && names[1] == "foo");
+
+	UASSERT(db->removePlayer("foo"));
+	UASSERT(db->loadPlayer("foo") == "");
+	UASSERT(db->loadPlayer("bar") == player_data("bar", 10));
+}
+
+void TestPlayerDatabase::testFiles()
+{
+	std::string dir = getTestTempDirectory() + DIR_DELIM + "files";
+	PlayerDatabase_Files db(dir);
+	check_player_database(&db);
+}
+
+void TestPlayerDatabase::testFilesAlternates()
+{
+	std::string dir = getTestTempDirectory() + DIR_DELIM + "alternates";
+	std::string players = dir + DIR_DELIM + "players" + DIR_DELIM;
+
+	{
+		PlayerDatabase_Files db(dir);
+		// What "Foo" gets on a case-insensitive file system
+		UASSERT(fs::safeWriteToFile(players + "foo", player_data("Foo", 1)));
+		UASSERT(db.savePlayer("foo", player_data("foo", 2)));
+		UASSERT(db.savePlayer("foo", player_data("foo", 3)));
+		UASSERT(fs::PathExists(players + "foo0"));
+		UASSERT(!fs::PathExists(players + "foo1"));
+		UASSERT(db.loadPlayer("foo") == player_data("foo", 3));
+	}
+
+	{
+		PlayerDatabase_Files db(dir);
+		UASSERT(db.loadPlayer("foo") == player_data("foo", 3));
+
+		std::vector<std::string> names;
+		db.listPlayers(names);
+		std::sort(names.begin(), names.end());
+		UASSERTEQ(size_t, names.size(), 2);
+		UASSERT(names[0] == "Foo" && names[1] == "foo");
+	}
+
+	// Removing a player only deletes its own file
+	UASSERT(fs::Rename(players + "foo", players + "foo1"));
+	UASSERT(fs::Rename(players + "foo0", players + "foo"));
+	UASSERT(fs::Rename(players + "foo1", players + "foo0"));
+	{
+		PlayerDatabase_Files db(dir);
+		UASSERT(db.removePlayer("foo"));
+		UASSERT(!fs::PathExists(players + "foo"));
+		UASSERT(fs::PathExists(players + "foo0"));
+		UASSERT(db.loadPlayer("foo") == "");
+
+		std::vector<std::string> names;
+		db.listPlayers(names);
+		UASSERTEQ(size_t, names.size(), 1);
+		UASSERT(names[0] == "Foo");
+	}
+}
+
+void TestPlayerDatabase::testFilesAlternateGap()
+{
+	std::string dir = getTestTempDirectory() + DIR_DELIM + "alternate_gap";
+	std::string players = dir + DIR_DELIM + "players" + DIR_DELIM;
+
+	PlayerDatabase_Files db(dir);
+	// "foo0" is missing, the player is stored after it
+	UASSERT(fs::safeWriteToFile(players + "foo", player_data("Foo", 1)));
+	UASSERT(fs::safeWriteToFile(players + "foo1", player_data("foo", 2)));
+	UASSERT(db.loadPlayer("foo") == player_data("foo", 2));
+
+	// Saving keeps the existing file instead of filling the gap
+	UASSERT(db.savePlayer("foo", player_data("foo", 3)));
+	UASSERT(!fs::PathExists(players + "foo0"));
+	UASSERT(db.loadPlayer("foo") == player_data("foo", 3));
+
+	// A player without a file goes into the first gap
+	UASSERT(fs::safeWriteToFile(players + "foo1", player_data("FOO", 4)));
+	PlayerDatabase_Files db2(dir);
+	UASSERT(db2.savePlayer("foo", player_data("foo", 5)));
+	UASSERT(db2.loadPlayer("foo") == player_data("foo", 5));
+
+	PlayerDatabase_Files db3(dir);
+	UASSERT(db3.loadPlayer("foo") == player_data("foo", 5));
+	UASSERT(fs::PathExists(players + "foo0"));
+
+	// Removing leaves a gap, the later alternates are still found
+	UASSERT(db3.removePlayer("foo"));
+	UASSERT(!fs::PathExists(players + "foo0"));
+	UASSERT(db3.loadPlayer("foo") == "");
+	UASSERT(db3.savePlayer("foo", player_data("foo", 6)));
+
+	PlayerDatabase_Files db4(dir);
+	UASSERT(db4.loadPlayer("foo") == player_data("foo", 6));
+	std::vector<std::string> names;
+	db4.listPlayers(names);
+	std::sort(names.begin(), names.end());
+	UASSERTEQ(size_t, names.size(), 3);
+	UASSERT(names[0] == "FOO" && names[1] == "Foo" && names[2] == "foo");
+	UASSERT(db4.loadPlayer("FOO") == player_data("FOO", 4));
+}
+
+void TestPlayerDatabase::testSQLite3()
+{
+	std::string dir = getTestTempDirectory() + DIR_DELIM + "sqlite3";
+	{
+		PlayerDatabase_SQLite3 db(dir);
+		check_player_database(&db);
+	}
+
+	// Reopening keeps the players
+	PlayerDatabase_SQLite3 db(dir);
+	UASSERT(db.loadPlayer("bar") == player_data("bar", 10));
+}
@@ -19,7 +19,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "test.h"
 
+#include <sstream>
 #include "profiler.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
 
 class TestProfiler : public TestBase {
 public:
@@ -29,6 +32,8 @@ class TestProfiler : public TestBase {
 	void runTests(IGameDef *gamedef);
 
 	void testProfilerAverage();
+	void testProfilerThreads();
+	void testProfilerTrace();
 };
 
 static TestProfiler g_test_instance;
@@ -36,6 +41,8 @@ static TestProfiler g_test_instance;
 void TestProfiler::runTests(IGameDef *gamedef)
 {
 	TEST(testProfilerAverage);
+	TEST(testProfilerThreads);
+	TEST(testProfilerTrace);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -70,3 +77,81 @@ void TestProfiler::testProfilerAverage()
 
 	UASSERT(p.getValue("Test2") == 123.57f);
 }
+
+class ProfilerTestThread : public Thread {
+public:
+	ProfilerTestThread(Profiler *profiler, Semaphore &trigger) :
+		Thread("ProfilerTest"),
+		m_profiler(profiler),
+		m_trigger(trigger)
+	{}
+
+	void *run()
+	{
+		m_trigger.wait();
+		for (u32 i = 0; i < 1000; i++) {
+			m_profiler->add("Add", 1.f);
+			m_profiler->avg("Avg", (i % 2) ? 1.f : 3.f);
+		}
+		return NULL;
+	}
+
+private:
+	Profiler *m_profiler;
+	Semaphore &m_trigger;
+};
+
+void TestProfiler::testProfilerThreads()
+{
+	Profiler p;
+	p.add("Add", 1.f);
+	p.avg("Avg", 2.f);
+
+	Semaphore trigger;
+	ProfilerTestThread t1(&p, trigger), t2(&p, trigger), t3(&p, trigger);
+	t1.start();
+	t2.start();
+	t3.start();
+	trigger.post(3);
+	t1.wait();
+	t2.wait();
+	t3.wait();
+
+	// The values of all threads are summed up
+	UASSERT(p.getValue("Add") == 3001.f);
+	UASSERT(p.getValue("Avg") == 2.f);
+
+	p.clear();
+	UASSERT(p.getValue("Add") == 0.f);
+}
+
+void TestProfiler::testProfilerTrace()
+{
+	Profiler p;
+
+	{
+		ScopeProfiler outside(&p, "Outside");
+		sleep_ms(2);
+		p.startTrace();
+	}
+	{
+		ScopeProfiler outer(&p, "Outer");
+		ScopeProfiler inner(&p, "Inner \"quoted\"", SPT_AVG);
+	}
+
+	std::ostringstream os;
+	UASSERTEQ(u32, p.stopTrace(os), 2);
+	std::string json = os.str();
+	UASSERT(json.find("Outside") == std::string::npos);
+	UASSERT(json.find("\"name\":\"Outer\"") != std::string::npos);
+	UASSERT(json.find("\"name\":\"Inner \\\"quoted\\\"\"") != std::string::npos);
+	UASSERT(json.find("\"depth\":0") != std::string::npos);
+	UASSERT(json.find("\"depth\":1") != std::string::npos);
+
+	// Nothing is recorded after the trace
+	{
+		ScopeProfiler after(&p, "After");
+	}
+	std::ostringstream os2;
+	UASSERTEQ(u32, p.stopTrace(os2), 0);
+}
@@ -30,6 +30,7 @@ class TestSettings : public TestBase {
 	void runTests(IGameDef *gamedef);
 
 	void testAllSettings();
+	void testSettingHandle();
 
 	static const char *config_text_before;
 	static const char *config_text_after;
@@ -40,6 +41,7 @@ static TestSettings g_test_instance;
 void TestSettings::runTests(IGameDef *gamedef)
 {
 	TEST(testAllSettings);
+	TEST(testSettingHandle);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -202,3 +204,50 @@ void TestSettings::testAllSettings()
 		UASSERT(!"Setting not found!");
 	}
 }
+
+void TestSettings::testSettingHandle()
+{
+	Settings s;
+	s.setDefault("int", "5");
+	s.set("float", "1.5");
+	s.set("bool", "true");
+
+	SettingHandle<s32> h_int("int", &s);
+	SettingHandle<float> h_float("float", &s);
+	SettingHandle<bool> h_bool("bool", &s);
+	UASSERTEQ(s32, h_int.get(), 5);
+	UASSERT(h_float.get() == 1.5f);
+	UASSERT(h_bool.get() == true);
+
+	// Changes are picked up
+	s.setS32("int", -7);
+	s.setFloat("float", 0.25f);
+	s.setBool("bool", false);
+	UASSERTEQ(s32, h_int.get(), -7);
+	UASSERT(h_float.get() == 0.25f);
+	UASSERT(h_bool.get() == false);
+
+	// Removing the value brings back the default
+	s.remove("int");
+	UASSERTEQ(s32, h_int.get(), 5);
+	s.setDefault("int", "6");
+	UASSERTEQ(s32, h_int.get(), 6);
+
+	// Without any value, the last one is kept
+	s.remove("float");
+	UASSERT(h_float.get() == 0.25f);
+
+	// Missing settings can't have handles
+	try {
+		SettingHandle<u16> h_missing("missing", &s);
+		UASSERT(!"SettingHandle of a missing setting was created");
+	} catch (SettingNotFoundException &e) {
+	}
+
+	// Handles that are gone are not called anymore
+	{
+		SettingHandle<s16> h_temp("int", &s);
+	}
+	s.setS32("int", 8);
+	UASSERTEQ(s32, h_int.get(), 8);
+}
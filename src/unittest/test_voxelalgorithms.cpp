@@ -20,6 +20,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include "gamedef.h"
+#include "log.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapsector.h"
+#include "noise.h"
+#include "nodedef.h"
+#include "porting.h"
+#include "util/directiontables.h"
 #include "voxelalgorithms.h"
 
 class TestVoxelAlgorithms : public TestBase {
@@ -31,6 +39,11 @@ class TestVoxelAlgorithms : public TestBase {
 
 	void testPropogateSunlight(INodeDefManager *ndef);
 	void testClearLightAndCollectSources(INodeDefManager *ndef);
+	void testSpreadLightInArea(INodeDefManager *ndef);
+	void testLightSpreader(INodeDefManager *ndef);
+	void testRelightBlockGroups(IGameDef *gamedef);
+	void testLightSpreaderSingleSource(INodeDefManager *ndef);
+	void benchLighting(INodeDefManager *ndef);
 };
 
 static TestVoxelAlgorithms g_test_instance;
@@ -41,6 +54,11 @@ void TestVoxelAlgorithms::runTests(IGameDef *gamedef)
 
 	TEST(testPropogateSunlight, ndef);
 	TEST(testClearLightAndCollectSources, ndef);
+	TEST(testSpreadLightInArea, ndef);
+	TEST(testLightSpreader, ndef);
+	TEST(testRelightBlockGroups, gamedef);
+	TEST(testLightSpreaderSingleSource, ndef);
+	TEST(benchLighting, ndef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -202,3 +220,432 @@ void TestVoxelAlgorithms::testClearLightAndCollectSources(INodeDefManager *ndef)
 		UASSERT(unlight_from.size() == 1);
 	}
 }
+
+/*
+	Random caves with torches and lava in them, sunlit from above the same
+	way as Mapgen::propagateSunlight does it
+*/
+static void make_light_test_area(VoxelManipulator &v, const VoxelArea &a,
+		u32 seed, INodeDefManager *ndef)
+{
+	PcgRandom pr(seed);
+	v.addArea(a);
+	for (s32 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+	for (s32 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++)
+	for (s32 x = a.MinEdge.X; x <= a.MaxEdge.X; x++) {
+		u32 i = v.m_area.index(x, y, z);
+		s32 r = pr.range(0, 999);
+		content_t c = CONTENT_AIR;
+		if (r < 300)
+			c = t_CONTENT_STONE;
+		else if (r < 304)
+			c = t_CONTENT_TORCH;
+		else if (r < 306)
+			c = t_CONTENT_LAVA;
+		v.m_data[i] = MapNode(c);
+		v.m_flags[i] &= ~VOXELFLAG_NO_DATA;
+	}
+
+	for (s32 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+	for (s32 x = a.MinEdge.X; x <= a.MaxEdge.X; x++)
+	for (s32 y = a.MaxEdge.Y; y >= a.MinEdge.Y; y--) {
+		MapNode &n = v.m_data[v.m_area.index(x, y, z)];
+		if (!ndef->get(n).sunlight_propagates)
+			break;
+		n.param1 = LIGHT_SUN;
+	}
+}
+
+static bool light_equals(VoxelManipulator &v1, VoxelManipulator &v2,
+		const VoxelArea &a)
+{
+	for (s32 i = 0; i != a.getVolume(); i++) {
+		if (v1.m_data[i].param1 != v2.m_data[i].param1)
+			return false;
+	}
+	return true;
+}
+
+/*
+	The recursive Mapgen::lightSpread and Mapgen::spreadLight that
+	voxalgo::spreadLightInArea has to give the same light as
+*/
+static void ref_mapgen_light_spread(VoxelManipulator &v, const VoxelArea &a,
+		v3s16 p, u8 light, INodeDefManager *ndef)
+{
+	if (light <= 1 || !a.contains(p))
+		return;
+
+	MapNode &n = v.m_data[v.m_area.index(p)];
+
+	u8 light_day = light & 0x0F;
+	if (light_day > 0)
+		light_day -= 0x01;
+
+	u8 light_night = light & 0xF0;
+	if (light_night > 0)
+		light_night -= 0x10;
+
+	if ((light_day  <= (n.param1 & 0x0F) &&
+		light_night <= (n.param1 & 0xF0)) ||
+		!ndef->get(n).light_propagates)
+		return;
+
+	light = MYMAX(light_day, n.param1 & 0x0F) |
+			MYMAX(light_night, n.param1 & 0xF0);
+
+	n.param1 = light;
+
+	ref_mapgen_light_spread(v, a, p + v3s16(0, 0, 1), light, ndef);
+	ref_mapgen_light_spread(v, a, p + v3s16(0, 1, 0), light, ndef);
+	ref_mapgen_light_spread(v, a, p + v3s16(1, 0, 0), light, ndef);
+	ref_mapgen_light_spread(v, a, p - v3s16(0, 0, 1), light, ndef);
+	ref_mapgen_light_spread(v, a, p - v3s16(0, 1, 0), light, ndef);
+	ref_mapgen_light_spread(v, a, p - v3s16(1, 0, 0), light, ndef);
+}
+
+static void ref_mapgen_spread_light(VoxelManipulator &v, const VoxelArea &a,
+		INodeDefManager *ndef)
+{
+	for (s32 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+	for (s32 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++)
+	for (s32 x = a.MinEdge.X; x <= a.MaxEdge.X; x++) {
+		MapNode &n = v.m_data[v.m_area.index(x, y, z)];
+		if (n.getContent() == CONTENT_IGNORE)
+			continue;
+
+		const ContentFeatures &cf = ndef->get(n);
+		if (!cf.light_propagates)
+			continue;
+
+		u8 light_produced = cf.light_source;
+		if (light_produced)
+			n.param1 = light_produced | (light_produced << 4);
+
+		u8 light = n.param1;
+		if (light) {
+			for (u8 d = 0; d != 6; d++) {
+				ref_mapgen_light_spread(v, a, v3s16(x, y, z) + g_6dirs[d],
+					light, ndef);
+			}
+		}
+	}
+}
+
+/*
+	The set based Map::unspreadLight and Map::spreadLight that
+	voxalgo::LightSpreader has to give the same light as
+*/
+static void ref_unspread_light(VoxelManipulator &v, enum LightBank bank,
+		std::map<v3s16, u8> from_nodes, std::set<v3s16> &light_sources,
+		INodeDefManager *ndef)
+{
+	while (!from_nodes.empty()) {
+		std::map<v3s16, u8> unlighted_nodes;
+		for (std::map<v3s16, u8>::iterator j = from_nodes.begin();
+				j != from_nodes.end(); ++j) {
+			for (u8 d = 0; d != 6; d++) {
+				v3s16 n2pos = j->first + g_6dirs[d];
+				if (!v.m_area.contains(n2pos))
+					continue;
+				MapNode &n2 = v.m_data[v.m_area.index(n2pos)];
+				u8 light2 = n2.getLight(bank, ndef);
+				if (light2 < j->second) {
+					if (ndef->get(n2).light_propagates && light2 != 0) {
+						n2.setLight(bank, 0, ndef);
+						unlighted_nodes[n2pos] = light2;
+					}
+				} else {
+					light_sources.insert(n2pos);
+				}
+			}
+		}
+		from_nodes.swap(unlighted_nodes);
+	}
+}
+
+static void ref_spread_light(VoxelManipulator &v, enum LightBank bank,
+		std::set<v3s16> from_nodes, INodeDefManager *ndef)
+{
+	while (!from_nodes.empty()) {
+		std::set<v3s16> lighted_nodes;
+		for (std::set<v3s16>::iterator j = from_nodes.begin();
+				j != from_nodes.end(); ++j) {
+			u8 oldlight = v.m_data[v.m_area.index(*j)].getLight(bank, ndef);
+			u8 newlight = diminish_light(oldlight);
+			for (u8 d = 0; d != 6; d++) {
+				v3s16 n2pos = *j + g_6dirs[d];
+				if (!v.m_area.contains(n2pos))
+					continue;
+				MapNode &n2 = v.m_data[v.m_area.index(n2pos)];
+				u8 light2 = n2.getLight(bank, ndef);
+				if (light2 > undiminish_light(oldlight))
+					lighted_nodes.insert(n2pos);
+				if (light2 < newlight && ndef->get(n2).light_propagates) {
+					n2.setLight(bank, newlight, ndef);
+					lighted_nodes.insert(n2pos);
+				}
+			}
+		}
+		from_nodes.swap(lighted_nodes);
+	}
+}
+
+// Lights a whole area from scratch the way Map::updateLighting does
+static void ref_light_area(VoxelManipulator &v, const VoxelArea &a,
+		INodeDefManager *ndef)
+{
+	for (u8 bank = 0; bank != 2; bank++) {
+		std::set<v3s16> light_sources;
+		for (s32 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+		for (s32 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++)
+		for (s32 x = a.MinEdge.X; x <= a.MaxEdge.X; x++) {
+			v3s16 p(x, y, z);
+			if (v.getNodeRefUnsafe(p).getLight((LightBank)bank, ndef) != 0)
+				light_sources.insert(p);
+		}
+		ref_spread_light(v, (LightBank)bank, light_sources, ndef);
+	}
+}
+
+void TestVoxelAlgorithms::testSpreadLightInArea(INodeDefManager *ndef)
+{
+	VoxelArea a(v3s16(-20, -20, -20), v3s16(19, 19, 19));
+	// Light must not be spread out of the given area
+	VoxelArea inner(v3s16(-15, -20, -17), v3s16(12, 16, 19));
+
+	for (u32 seed = 0; seed != 10; seed++) {
+		VoxelManipulator expected, actual;
+		make_light_test_area(expected, a, seed, ndef);
+		make_light_test_area(actual, a, seed, ndef);
+
+		const VoxelArea &spread_a = (seed % 2) ? inner : a;
+		ref_mapgen_spread_light(expected, spread_a, ndef);
+		voxalgo::spreadLightInArea(actual, spread_a, ndef);
+
+		UASSERT(light_equals(expected, actual, a));
+		for (s32 i = 0; i != a.getVolume(); i++)
+			UASSERT(actual.m_flags[i] == expected.m_flags[i]);
+	}
+}
+
+void TestVoxelAlgorithms::testLightSpreader(INodeDefManager *ndef)
+{
+	VoxelArea a(v3s16(-20, -20, -20), v3s16(19, 19, 19));
+
+	for (u32 seed = 0; seed != 10; seed++) {
+		VoxelManipulator expected, actual;
+		make_light_test_area(expected, a, seed, ndef);
+		make_light_test_area(actual, a, seed, ndef);
+		ref_light_area(expected, a, ndef);
+		ref_light_area(actual, a, ndef);
+		UASSERT(light_equals(expected, actual, a));
+
+		// Dig out and fill in some nodes, then relight around them
+		PcgRandom pr(seed);
+		v3s16 changed_min(pr.range(-20, 4), pr.range(-20, 4), pr.range(-20, 4));
+		VoxelArea changed(changed_min, changed_min + v3s16(15, 15, 15));
+		for (u32 i = 0; i != 300; i++) {
+			v3s16 p(pr.range(changed.MinEdge.X, changed.MaxEdge.X),
+				pr.range(changed.MinEdge.Y, changed.MaxEdge.Y),
+				pr.range(changed.MinEdge.Z, changed.MaxEdge.Z));
+			content_t c = pr.range(0, 3) ? CONTENT_AIR : t_CONTENT_STONE;
+			expected.getNodeRefUnsafe(p).setContent(c);
+			actual.getNodeRefUnsafe(p).setContent(c);
+		}
+
+		for (u8 b = 0; b != 2; b++) {
+			LightBank bank = (LightBank)b;
+
+			std::set<v3s16> light_sources;
+			std::map<v3s16, u8> unlight_from;
+			voxalgo::clearLightAndCollectSources(expected, changed, bank, ndef,
+				light_sources, unlight_from);
+			ref_unspread_light(expected, bank, unlight_from, light_sources,
+				ndef);
+			ref_spread_light(expected, bank, light_sources, ndef);
+
+			light_sources.clear();
+			unlight_from.clear();
+			voxalgo::clearLightAndCollectSources(actual, changed, bank, ndef,
+				light_sources, unlight_from);
+			voxalgo::LightSpreader spreader(actual, ndef);
+			for (std::map<v3s16, u8>::iterator it = unlight_from.begin();
+					it != unlight_from.end(); ++it)
+				spreader.addUnlightFrom(bank, it->first, it->second);
+			for (std::set<v3s16>::iterator it = light_sources.begin();
+					it != light_sources.end(); ++it)
+				spreader.addLightSource(bank, *it);
+			spreader.unspreadLight(bank);
+			spreader.spreadLight(bank);
+		}
+
+		UASSERT(light_equals(expected, actual, a));
+		for (s32 i = 0; i != a.getVolume(); i++)
+			UASSERT(actual.m_flags[i] == expected.m_flags[i]);
+	}
+}
+
+// A Map that holds blank blocks, without any database or generator
+class LightTestMap : public Map {
+public:
+	LightTestMap(IGameDef *gamedef) : Map(dstream, gamedef) {}
+
+	MapBlock *createBlock(v3s16 p, MapNode n)
+	{
+		v2s16 p2d(p.X, p.Z);
+		MapSector *sector = getSectorNoGenerateNoEx(p2d);
+		if (sector == NULL) {
+			sector = new ServerMapSector(this, p2d, m_gamedef);
+			m_sectors[p2d] = sector;
+		}
+		MapBlock *block = sector->createBlankBlock(p.Y);
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+			block->setNodeNoCheck(x, y, z, n);
+		block->resetModified();
+		return block;
+	}
+};
+
+void TestVoxelAlgorithms::testRelightBlockGroups(IGameDef *gamedef)
+{
+	INodeDefManager *ndef = gamedef->getNodeDefManager();
+	LightTestMap map(gamedef);
+
+	for (s16 z = -1; z <= 1; z++)
+	for (s16 y = -1; y <= 1; y++)
+	for (s16 x = -1; x <= 1; x++)
+		map.createBlock(v3s16(x, y, z), MapNode(CONTENT_AIR));
+
+	// A torch at the +X face of the middle block lights into its neighbour
+	v3s16 torch_p(MAP_BLOCKSIZE - 1, 8, 8);
+	MapNode torch(t_CONTENT_TORCH);
+	u8 torch_light = ndef->get(torch).light_source;
+	torch.setLight(LIGHTBANK_NIGHT, torch_light, ndef);
+	map.getBlockNoCreate(v3s16(0, 0, 0))->setNodeNoCheck(torch_p, torch);
+
+	std::vector<v3s16> blocks;
+	blocks.push_back(v3s16(0, 0, 0));
+	std::map<v3s16, u8> unlight_from;
+	std::set<v3s16> light_sources;
+	light_sources.insert(torch_p);
+	std::map<v3s16, MapBlock *> modified_blocks;
+	map.relightBlockGroups(LIGHTBANK_NIGHT, blocks, unlight_from,
+		light_sources, modified_blocks);
+
+	UASSERTEQ(int, map.getNodeNoEx(torch_p + v3s16(1, 0, 0))
+		.getLight(LIGHTBANK_NIGHT, ndef), torch_light - 1);
+
+	// The neighbour is not one of the given blocks, but must be saved too
+	MapBlock *border = map.getBlockNoCreate(v3s16(1, 0, 0));
+	UASSERT(modified_blocks.count(v3s16(1, 0, 0)) == 1);
+	UASSERT(border->getModified() == MOD_STATE_WRITE_NEEDED);
+	UASSERT(border->getModifiedReason() & MOD_REASON_RELIGHT);
+
+	// Too far away to get any light
+	UASSERT(modified_blocks.count(v3s16(-1, 0, 0)) == 0);
+	UASSERT(map.getBlockNoCreate(v3s16(-1, 0, 0))->getModified() ==
+		MOD_STATE_CLEAN);
+}
+
+/*
+	In open air the light of a single source falls off by one per node of
+	manhattan distance, and goes away completely with the source.
+*/
+void TestVoxelAlgorithms::testLightSpreaderSingleSource(INodeDefManager *ndef)
+{
+	VoxelArea a(v3s16(-16, -16, -16), v3s16(15, 15, 15));
+	VoxelManipulator v;
+	v.addArea(a);
+	for (s32 i = 0; i != a.getVolume(); i++) {
+		v.m_data[i] = MapNode(CONTENT_AIR);
+		v.m_flags[i] &= ~VOXELFLAG_NO_DATA;
+	}
+
+	MapNode &torch = v.getNodeRefUnsafe(v3s16(0, 0, 0));
+	torch.setContent(t_CONTENT_TORCH);
+	u8 torch_light = ndef->get(torch).light_source;
+	torch.setLight(LIGHTBANK_NIGHT, torch_light, ndef);
+
+	{
+		voxalgo::LightSpreader spreader(v, ndef);
+		spreader.addLightSource(LIGHTBANK_NIGHT, v3s16(0, 0, 0));
+		spreader.spreadLight(LIGHTBANK_NIGHT);
+	}
+
+	for (s32 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+	for (s32 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++)
+	for (s32 x = a.MinEdge.X; x <= a.MaxEdge.X; x++) {
+		s32 expected = MYMAX(torch_light - (abs(x) + abs(y) + abs(z)), 0);
+		MapNode &n = v.getNodeRefUnsafe(v3s16(x, y, z));
+		UASSERTEQ(int, n.getLight(LIGHTBANK_NIGHT, ndef), expected);
+		// Nothing leaks into the day bank
+		UASSERTEQ(int, n.param1 & 0x0f, 0);
+	}
+
+	torch.setContent(CONTENT_AIR);
+	torch.setLight(LIGHTBANK_NIGHT, 0, ndef);
+
+	{
+		voxalgo::LightSpreader spreader(v, ndef);
+		spreader.addUnlightFrom(LIGHTBANK_NIGHT, v3s16(0, 0, 0), torch_light);
+		spreader.unspreadLight(LIGHTBANK_NIGHT);
+		spreader.spreadLight(LIGHTBANK_NIGHT);
+	}
+
+	for (s32 i = 0; i != a.getVolume(); i++)
+		UASSERTEQ(int, v.m_data[i].param1, 0);
+}
+
+/*
+	Lights a mapchunk sized area with the old and the new code.
+	Only prints the timings, they are too noisy to assert on.
+*/
+void TestVoxelAlgorithms::benchLighting(INodeDefManager *ndef)
+{
+	VoxelArea a(v3s16(-40, -40, -40), v3s16(39, 39, 39));
+
+	VoxelManipulator v1, v2;
+	make_light_test_area(v1, a, 1234, ndef);
+	make_light_test_area(v2, a, 1234, ndef);
+
+	u32 t1 = porting::getTime(PRECISION_MILLI);
+	ref_mapgen_spread_light(v1, a, ndef);
+	u32 t2 = porting::getTime(PRECISION_MILLI);
+	voxalgo::spreadLightInArea(v2, a, ndef);
+	u32 t3 = porting::getTime(PRECISION_MILLI);
+	UASSERT(light_equals(v1, v2, a));
+
+	rawstream << "    mapgen light, " << a.getVolume() << " nodes: recursive "
+		<< (t2 - t1) << "ms, queued " << (t3 - t2) << "ms" << std::endl;
+
+	VoxelManipulator v3, v4;
+	make_light_test_area(v3, a, 1234, ndef);
+	make_light_test_area(v4, a, 1234, ndef);
+
+	std::set<v3s16> light_sources;
+	for (s32 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+	for (s32 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++)
+	for (s32 x = a.MinEdge.X; x <= a.MaxEdge.X; x++) {
+		v3s16 p(x, y, z);
+		if (v3.getNodeRefUnsafe(p).getLight(LIGHTBANK_DAY, ndef) != 0)
+			light_sources.insert(p);
+	}
+
+	t1 = porting::getTime(PRECISION_MILLI);
+	ref_spread_light(v3, LIGHTBANK_DAY, light_sources, ndef);
+	t2 = porting::getTime(PRECISION_MILLI);
+	voxalgo::LightSpreader spreader(v4, ndef);
+	for (std::set<v3s16>::iterator it = light_sources.begin();
+			it != light_sources.end(); ++it)
+		spreader.addLightSource(LIGHTBANK_DAY, *it);
+	spreader.spreadLight(LIGHTBANK_DAY);
+	t3 = porting::getTime(PRECISION_MILLI);
+	UASSERT(light_equals(v3, v4, a));
+
+	rawstream << "    map light, " << light_sources.size() << " sources: "
+		<< "set based " << (t2 - t1) << "ms, queued " << (t3 - t2) << "ms"
+		<< std::endl;
+}
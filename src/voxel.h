@@ -542,18 +542,6 @@ class VoxelManipulator /*: public NodeContainer*/
 
 	void clearFlag(u8 flag);
 
-	// TODO: Move to voxelalgorithms.h
-
-	void unspreadLight(enum LightBank bank, v3s16 p, u8 oldlight,
-			std::set<v3s16> & light_sources, INodeDefManager *nodemgr);
-	void unspreadLight(enum LightBank bank,
-			std::map<v3s16, u8> & from_nodes,
-			std::set<v3s16> & light_sources, INodeDefManager *nodemgr);
-
-	void spreadLight(enum LightBank bank, v3s16 p, INodeDefManager *nodemgr);
-	void spreadLight(enum LightBank bank,
-			std::set<v3s16> & from_nodes, INodeDefManager *nodemgr);
-
 	/*
 		Virtual functions
 	*/
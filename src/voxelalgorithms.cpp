@@ -20,9 +20,27 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "voxelalgorithms.h"
 #include "nodedef.h"
 
+// Set while a node is queued for spreading, one per bank
+#define VOXELFLAG_LIGHT_QUEUED_DAY   VOXELFLAG_CHECKED3
+#define VOXELFLAG_LIGHT_QUEUED_NIGHT VOXELFLAG_CHECKED4
+
 namespace voxalgo
 {
 
+static const v3s16 light_dirs[6] = {
+	v3s16(0,0,1), // back
+	v3s16(0,1,0), // top
+	v3s16(1,0,0), // right
+	v3s16(0,0,-1), // front
+	v3s16(0,-1,0), // bottom
+	v3s16(-1,0,0), // left
+};
+
+static const u8 light_queued_flags[2] = {
+	VOXELFLAG_LIGHT_QUEUED_DAY,
+	VOXELFLAG_LIGHT_QUEUED_NIGHT,
+};
+
 void setLight(VoxelManipulator &v, VoxelArea a, u8 light,
 		INodeDefManager *ndef)
 {
@@ -153,5 +171,216 @@ SunlightPropagateResult propagateSunlight(VoxelManipulator &v, VoxelArea a,
 	return SunlightPropagateResult(bottom_sunlight_valid);
 }
 
+/*
+	Each lit node is spread from completely before the next one is looked
+	at, as the recursive version did; a light source only gets its light
+	when it is reached, so earlier nodes can already have spread over it.
+	Doing the same keeps the generated light exactly as it was.
+*/
+void spreadLightInArea(VoxelManipulator &v, const VoxelArea &a,
+		INodeDefManager *ndef)
+{
+	const VoxelArea &area = v.m_area;
+	std::vector<v3s16> queue;
+
+	for (s32 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+	for (s32 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++) {
+		u32 vi = area.index(a.MinEdge.X, y, z);
+		for (s32 x = a.MinEdge.X; x <= a.MaxEdge.X; x++, vi++) {
+			MapNode &n = v.m_data[vi];
+			if (n.getContent() == CONTENT_IGNORE)
+				continue;
+
+			const ContentFeatures &cf = ndef->get(n);
+			if (!cf.light_propagates)
+				continue;
+
+			u8 light_produced = cf.light_source;
+			if (light_produced)
+				n.param1 = light_produced | (light_produced << 4);
+			if (n.param1 == 0)
+				continue;
+
+			queue.push_back(v3s16(x, y, z));
+			v.m_flags[vi] |= VOXELFLAG_LIGHT_QUEUED_DAY;
+
+			for (size_t head = 0; head != queue.size(); head++) {
+				v3s16 p = queue[head];
+				u32 i = area.index(p);
+				v.m_flags[i] &= ~VOXELFLAG_LIGHT_QUEUED_DAY;
+
+				// Decay light in each of the banks separately
+				u8 light = v.m_data[i].param1;
+				u8 light_day = light & 0x0F;
+				if (light_day > 0)
+					light_day -= 0x01;
+				u8 light_night = light & 0xF0;
+				if (light_night > 0)
+					light_night -= 0x10;
+				if (light_day == 0 && light_night == 0)
+					continue;
+
+				for (u8 d = 0; d != 6; d++) {
+					v3s16 p2 = p + light_dirs[d];
+					if (!a.contains(p2))
+						continue;
+					u32 i2 = area.index(p2);
+					MapNode &n2 = v.m_data[i2];
+
+					// Go on while either bank still gets brighter
+					if ((light_day  <= (n2.param1 & 0x0F) &&
+							light_night <= (n2.param1 & 0xF0)) ||
+							!ndef->get(n2).light_propagates)
+						continue;
+
+					n2.param1 = MYMAX(light_day, n2.param1 & 0x0F) |
+						MYMAX(light_night, n2.param1 & 0xF0);
+
+					if (!(v.m_flags[i2] & VOXELFLAG_LIGHT_QUEUED_DAY)) {
+						v.m_flags[i2] |= VOXELFLAG_LIGHT_QUEUED_DAY;
+						queue.push_back(p2);
+					}
+				}
+			}
+			queue.clear();
+		}
+	}
+}
+
+
+LightSpreader::LightSpreader(VoxelManipulator &v, INodeDefManager *ndef):
+	m_vmanip(v),
+	m_ndef(ndef)
+{
+	m_top_level[LIGHTBANK_DAY] = 0;
+	m_top_level[LIGHTBANK_NIGHT] = 0;
+}
+
+LightSpreader::~LightSpreader()
+{
+	// Don't leave flags of sources that were never spread from behind
+	for (u8 bank = 0; bank != 2; bank++)
+	for (u8 level = 0; level <= LIGHT_SUN; level++) {
+		std::vector<v3s16> &bucket = m_sources[bank][level];
+		for (size_t j = 0; j != bucket.size(); j++) {
+			m_vmanip.m_flags[m_vmanip.m_area.index(bucket[j])] &=
+				~light_queued_flags[bank];
+		}
+	}
+}
+
+void LightSpreader::addUnlightFrom(enum LightBank bank, v3s16 p, u8 oldlight)
+{
+	const VoxelArea &area = m_vmanip.m_area;
+	if (area.contains(p) &&
+			!(m_vmanip.m_flags[area.index(p)] & VOXELFLAG_NO_DATA))
+		m_unlight[bank].push_back(UnlightNode(p, oldlight));
+}
+
+void LightSpreader::addLightSource(enum LightBank bank, v3s16 p)
+{
+	const VoxelArea &area = m_vmanip.m_area;
+	if (!area.contains(p))
+		return;
+	u32 i = area.index(p);
+	if (!(m_vmanip.m_flags[i] & VOXELFLAG_NO_DATA))
+		queueSource(bank, p, i, m_vmanip.m_data[i].getLight(bank, m_ndef));
+}
+
+void LightSpreader::queueSource(enum LightBank bank, v3s16 p, u32 i, u8 light)
+{
+	u8 &flags = m_vmanip.m_flags[i];
+	if (flags & light_queued_flags[bank])
+		return;
+	flags |= light_queued_flags[bank];
+
+	m_sources[bank][light].push_back(p);
+	if (light > m_top_level[bank])
+		m_top_level[bank] = light;
+}
+
+void LightSpreader::unspreadLight(enum LightBank bank)
+{
+	const VoxelArea &area = m_vmanip.m_area;
+	std::vector<UnlightNode> &queue = m_unlight[bank];
+
+	for (size_t head = 0; head != queue.size(); head++) {
+		// Copied, pushing to the queue can move it
+		UnlightNode from = queue[head];
+
+		for (u8 d = 0; d != 6; d++) {
+			v3s16 p2 = from.p + light_dirs[d];
+			if (!area.contains(p2))
+				continue;
+			u32 i2 = area.index(p2);
+			if (m_vmanip.m_flags[i2] & VOXELFLAG_NO_DATA)
+				continue;
+			MapNode &n2 = m_vmanip.m_data[i2];
+
+			/*
+				A dimmer neighbor got its light from here, unless it
+				has none or doesn't let light through.
+				A brighter one will light this area up again.
+			*/
+			u8 light2 = n2.getLight(bank, m_ndef);
+			if (light2 < from.light) {
+				if (light2 != 0 && m_ndef->get(n2).light_propagates) {
+					n2.setLight(bank, 0, m_ndef);
+					m_changed.push_back(p2);
+					queue.push_back(UnlightNode(p2, light2));
+				}
+			} else {
+				queueSource(bank, p2, i2, light2);
+			}
+		}
+	}
+
+	queue.clear();
+}
+
+void LightSpreader::spreadLight(enum LightBank bank)
+{
+	const VoxelArea &area = m_vmanip.m_area;
+	u8 &top = m_top_level[bank];
+
+	for (;;) {
+		while (top > 0 && m_sources[bank][top].empty())
+			top--;
+		std::vector<v3s16> &bucket = m_sources[bank][top];
+		if (bucket.empty())
+			break;
+
+		v3s16 p = bucket.back();
+		bucket.pop_back();
+		u32 i = area.index(p);
+		m_vmanip.m_flags[i] &= ~light_queued_flags[bank];
+
+		// The light may have grown since the node was queued
+		u8 oldlight = m_vmanip.m_data[i].getLight(bank, m_ndef);
+		u8 newlight = diminish_light(oldlight);
+
+		for (u8 d = 0; d != 6; d++) {
+			v3s16 p2 = p + light_dirs[d];
+			if (!area.contains(p2))
+				continue;
+			u32 i2 = area.index(p2);
+			if (m_vmanip.m_flags[i2] & VOXELFLAG_NO_DATA)
+				continue;
+			MapNode &n2 = m_vmanip.m_data[i2];
+
+			// A brighter neighbor will light this node up on its turn
+			u8 light2 = n2.getLight(bank, m_ndef);
+			if (light2 > undiminish_light(oldlight))
+				queueSource(bank, p2, i2, light2);
+
+			if (light2 < newlight && m_ndef->get(n2).light_propagates) {
+				n2.setLight(bank, newlight, m_ndef);
+				m_changed.push_back(p2);
+				queueSource(bank, p2, i2, newlight);
+			}
+		}
+	}
+}
+
 } // namespace voxalgo
 
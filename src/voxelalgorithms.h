@@ -24,12 +24,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapnode.h"
 #include <set>
 #include <map>
+#include <vector>
 
 namespace voxalgo
 {
 
-// TODO: Move unspreadLight and spreadLight from VoxelManipulator to here
-
 void setLight(VoxelManipulator &v, VoxelArea a, u8 light,
 		INodeDefManager *ndef);
 
@@ -52,6 +51,68 @@ SunlightPropagateResult propagateSunlight(VoxelManipulator &v, VoxelArea a,
 		std::set<v3s16> & light_sources,
 		INodeDefManager *ndef);
 
+/*
+	Light spreading of the mapgens: spreads both banks of every lit node of
+	the area over the area, in index order. Light sources get their light
+	first, and every node takes one level off, also off sunlight.
+*/
+void spreadLightInArea(VoxelManipulator &v, const VoxelArea &a,
+		INodeDefManager *ndef);
+
+/*
+	Light spreading of Map::updateLighting over a whole VoxelManipulator.
+
+	Nodes are queued by position in one bucket per light level, brightest
+	first, so that most of them are visited once. A flag per bank in m_flags
+	keeps a node from being queued twice.
+*/
+class LightSpreader
+{
+public:
+	LightSpreader(VoxelManipulator &v, INodeDefManager *ndef);
+	~LightSpreader();
+
+	// p had oldlight before its light was cleared
+	void addUnlightFrom(enum LightBank bank, v3s16 p, u8 oldlight);
+	void addLightSource(enum LightBank bank, v3s16 p);
+
+	/*
+		Clears the light of every node that got it from the unlight nodes.
+		The nodes that are at least as bright are queued as light sources.
+	*/
+	void unspreadLight(enum LightBank bank);
+	/*
+		Spreads from the light sources until nothing changes. Neighbours
+		that are brighter than a visited node are spread from, too.
+	*/
+	void spreadLight(enum LightBank bank);
+
+	// Positions of the nodes whose light was changed, may repeat
+	const std::vector<v3s16> &getChangedNodes() const
+	{ return m_changed; }
+
+private:
+	struct UnlightNode
+	{
+		v3s16 p;
+		u8 light;
+
+		UnlightNode(v3s16 p_, u8 light_): p(p_), light(light_) {}
+	};
+
+	void queueSource(enum LightBank bank, v3s16 p, u32 i, u8 light);
+
+	VoxelManipulator &m_vmanip;
+	INodeDefManager *m_ndef;
+
+	std::vector<UnlightNode> m_unlight[2];
+	std::vector<v3s16> m_sources[2][LIGHT_SUN + 1];
+	// No bucket above this one has anything in it
+	u8 m_top_level[2];
+
+	std::vector<v3s16> m_changed;
+};
+
 } // namespace voxalgo
 
 #endif